@@ -0,0 +1,55 @@
+/*
+  HM1X Bluetooth Framed Echo
+  By: Niel Cansino
+  Date: October 19, 2026
+  License: This code is public domain but you buy me a beer 
+  if you use this and we meet someday (Beerware license).
+
+  Splits the transparent link into CRC-checked frames and
+  echoes every frame back with its type incremented. Noise
+  or dropped bytes cost only the frames they touch.
+
+  On the host, extras/hm1x_host/framing.py encodes and
+  decodes the same frames.
+
+  Hardware Connections:
+  HM-1X module --------------------- Arduino Uno
+       GND ----------------------------- GND
+       VCC ----------------------------- 5V
+       TX ------------------------------ 10
+       RX ------------------------------ 11
+*/
+
+#include <SoftwareSerial.h>
+// Use Library Manager or download here: https://github.com/sparkfun/SparkFun_HM1X_Bluetooth_Arduino_Library
+#include <SparkFun_HM1X_Bluetooth_Arduino_Library.h>
+#include <HM1X_Framer.h>
+
+SoftwareSerial btSerial(10, 11); // RX, TX
+
+HM1X_BT bt(HM1X_BT::HM19);
+
+// Room for one whole frame with a 64 byte payload
+uint8_t frameStorage[HM1X_FRAME_OVERHEAD + 64];
+HM1X_Framer framer(bt, frameStorage, sizeof(frameStorage));
+
+void setup() {
+  Serial.begin(9600); // Serial debug port @ 9600 bps
+
+  if (bt.begin(btSerial, 9600) == false) {
+    Serial.println(F("Failed to connect to the HM-1X."));
+    while (1) ;
+  }
+  Serial.println("Ready to Bluetooth!");
+}
+
+void loop() {
+  if (framer.poll()) {
+    Serial.print("Frame type ");
+    Serial.print(framer.frameType());
+    Serial.print(", ");
+    Serial.print(framer.frameLength());
+    Serial.println(" bytes");
+    framer.writeFrame(framer.frameType() + 1, framer.frameData(), framer.frameLength());
+  }
+}
@@ -0,0 +1,65 @@
+/*
+  HM1X Bluetooth Stream Passthrough
+  By: Niel Cansino
+  Date: October 19, 2026
+  License: This code is public domain but you buy me a beer 
+  if you use this and we meet someday (Beerware license).
+
+  Initializes and connects to the HM1X module through any
+  Stream -- here AltSoftSerial, which unlike SoftwareSerial
+  keeps interrupts enabled while transmitting and can receive
+  while it sends. Executes a serial pass-through once connected.
+
+  The baud callback lets the library re-open the port at
+  another baud rate, e.g. to recover a module left at an
+  unknown baud.
+
+  Hardware Connections (AltSoftSerial uses fixed pins on the Uno):
+  HM-1X module --------------------- Arduino Uno
+       GND ----------------------------- GND
+       VCC ----------------------------- 5V
+       TX ------------------------------ 8
+       RX ------------------------------ 9
+*/
+
+// Download here: https://github.com/PaulStoffregen/AltSoftSerial
+#include <AltSoftSerial.h>
+// Use Library Manager or download here: https://github.com/sparkfun/SparkFun_HM1X_Bluetooth_Arduino_Library
+#include <SparkFun_HM1X_Bluetooth_Arduino_Library.h>
+
+AltSoftSerial btSerial;
+
+HM1X_BT bt(HM1X_BT::HM19);
+
+// Called by the library whenever it needs the port at a new baud
+void setBtBaud(unsigned long baud) {
+  btSerial.end();
+  btSerial.begin(baud);
+}
+
+void setup() {
+  Serial.begin(9600); // Serial debug port @ 9600 bps
+
+  // Open the port first, then hand it to bt.begin along
+  // with its baud and the baud callback.
+  // Returns true on success
+  btSerial.begin(9600);
+  if (bt.begin(btSerial, 9600, setBtBaud) == false) {
+    Serial.println(F("Failed to connect to the HM-1X."));
+    while (1) ;
+  }
+  Serial.println("Ready to Bluetooth!");
+}
+
+void loop() {
+  // If data is available from bt module, 
+  // print it to serial port
+  if (bt.available()) {
+    Serial.write((char) bt.read());
+  }
+  // If data is available from serial port,
+  // print it to bt module.
+  if (Serial.available()) {
+    bt.write((char) Serial.read());
+  }
+}
@@ -0,0 +1,60 @@
+/*
+  HM1X Bluetooth CBOR Telemetry
+  By: Niel Cansino
+  Date: October 19, 2026
+  License: This code is public domain but you buy me a beer 
+  if you use this and we meet someday (Beerware license).
+
+  Sends a reading every second as a compact CBOR map
+  instead of printed text -- no String, no heap, and
+  about half the bytes on air.
+
+  With coalescing on, each map is gathered into as few
+  BLE packets as possible and sent on flush().
+
+  On the host, extras/hm1x_host/cbor.py decodes the maps.
+
+  Hardware Connections:
+  HM-1X module --------------------- Arduino Uno
+       GND ----------------------------- GND
+       VCC ----------------------------- 5V
+       TX ------------------------------ 10
+       RX ------------------------------ 11
+*/
+
+#include <SoftwareSerial.h>
+// Use Library Manager or download here: https://github.com/sparkfun/SparkFun_HM1X_Bluetooth_Arduino_Library
+#include <SparkFun_HM1X_Bluetooth_Arduino_Library.h>
+#include <HM1X_Cbor.h>
+
+SoftwareSerial btSerial(10, 11); // RX, TX
+
+HM1X_BT bt(HM1X_BT::HM19);
+HM1X_CborWriter cbor(bt);
+
+uint32_t sample = 0;
+
+void setup() {
+  Serial.begin(9600); // Serial debug port @ 9600 bps
+
+  if (bt.begin(btSerial, 9600) == false) {
+    Serial.println(F("Failed to connect to the HM-1X."));
+    while (1) ;
+  }
+  bt.setCoalescing(5);
+  Serial.println("Ready to Bluetooth!");
+}
+
+void loop() {
+  // {"n": sample, "a0": analog reading, "t": millis}
+  cbor.beginMap(3);
+  cbor.writeString(F("n"));
+  cbor.writeUInt(sample++);
+  cbor.writeString(F("a0"));
+  cbor.writeUInt(analogRead(A0));
+  cbor.writeString(F("t"));
+  cbor.writeUInt(millis());
+  bt.flush();
+
+  delay(1000);
+}
@@ -0,0 +1 @@
+"""Host-side (hub) counterparts of the HM1X library's link layers."""
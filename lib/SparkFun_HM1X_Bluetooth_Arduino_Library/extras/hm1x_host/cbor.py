@@ -0,0 +1,148 @@
+"""CBOR (RFC 8949) decoder for telemetry from src/HM1X_Cbor.
+
+Handles everything HM1X_CborWriter produces (and the rest of the core
+data model): integers, byte and text strings, arrays, maps, tags,
+simple values and half/single/double floats, in definite or indefinite
+length form.
+"""
+
+import struct
+
+
+class Tagged:
+    def __init__(self, tag, value):
+        self.tag = tag
+        self.value = value
+
+    def __eq__(self, other):
+        return isinstance(other, Tagged) and (self.tag, self.value) == (other.tag, other.value)
+
+    def __repr__(self):
+        return "Tagged(%d, %r)" % (self.tag, self.value)
+
+
+class Incomplete(Exception):
+    """The buffer ends part way through an item."""
+
+
+_BREAK = object()
+
+
+def _half(bits):
+    sign = -1.0 if bits & 0x8000 else 1.0
+    exp = (bits >> 10) & 0x1F
+    frac = bits & 0x3FF
+    if exp == 0:
+        return sign * frac * 2.0 ** -24
+    if exp == 31:
+        return sign * float("inf") if frac == 0 else float("nan")
+    return sign * (1 + frac / 1024.0) * 2.0 ** (exp - 15)
+
+
+class _Reader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise Incomplete()
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        if info == 31:
+            return None
+        if info > 27:
+            raise ValueError("reserved additional info %d" % info)
+        return int.from_bytes(self.take(1 << (info - 24)), "big")
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1F
+        if major == 7:
+            if info == 25:
+                return _half(int.from_bytes(self.take(2), "big"))
+            if info == 26:
+                return struct.unpack(">f", self.take(4))[0]
+            if info == 27:
+                return struct.unpack(">d", self.take(8))[0]
+            if info == 31:
+                return _BREAK
+            value = info if info < 24 else self.take(1)[0]
+            return {20: False, 21: True, 22: None, 23: None}.get(value, value)
+        arg = self.argument(info)
+        if major == 0:
+            return arg
+        if major == 1:
+            return -1 - arg
+        if major in (2, 3):
+            if arg is None:
+                parts = []
+                while True:
+                    part = self.item()
+                    if part is _BREAK:
+                        break
+                    parts.append(part)
+                joined = b"".join(parts) if major == 2 else "".join(parts)
+                return joined
+            raw = self.take(arg)
+            return bytes(raw) if major == 2 else bytes(raw).decode("utf-8")
+        if major == 4:
+            items = []
+            while arg is None or len(items) < arg:
+                value = self.item()
+                if value is _BREAK:
+                    break
+                items.append(value)
+            return items
+        if major == 5:
+            result = {}
+            while arg is None or len(result) < arg:
+                key = self.item()
+                if key is _BREAK:
+                    break
+                result[key] = self.item()
+            return result
+        return Tagged(arg, self.item())
+
+
+def loads(data):
+    """Decode exactly one item from data."""
+    value, used = decode(data)
+    if used != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - used))
+    return value
+
+
+def decode(data, pos=0):
+    """Decode one item starting at pos. Returns (value, next_pos); raises
+    Incomplete if data ends part way through it."""
+    reader = _Reader(bytes(data), pos)
+    value = reader.item()
+    if value is _BREAK:
+        raise ValueError("unexpected break")
+    return value, reader.pos
+
+
+class StreamDecoder:
+    """Feed bytes as they arrive; returns each complete top-level item."""
+
+    def __init__(self):
+        self._buffer = bytearray()
+
+    def feed(self, data):
+        self._buffer.extend(data)
+        items = []
+        pos = 0
+        while pos < len(self._buffer):
+            try:
+                value, pos = decode(self._buffer, pos)
+            except Incomplete:
+                break
+            items.append(value)
+        del self._buffer[:pos]
+        return items
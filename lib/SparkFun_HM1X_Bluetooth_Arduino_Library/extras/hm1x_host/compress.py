@@ -0,0 +1,96 @@
+"""Streaming codec matching src/HM1X_Compress.
+
+Byte-aligned LZ77 tokens over a 256 byte window:
+
+    0x00-0x7F  literal run: (token + 1) bytes follow as-is
+    0x80-0xFF  match: copy (token - 0x80 + 3) bytes starting
+               (next byte + 1) bytes back in the output
+"""
+
+WINDOW = 256
+MIN_MATCH = 3
+MAX_MATCH = 0x7F + MIN_MATCH
+MAX_LITERALS = 128
+
+
+class Compressor:
+    """compress() returns the tokens for data, all of them decodable: each
+    call is a flush point. History carries over between calls."""
+
+    def __init__(self, max_match=MAX_MATCH):
+        self.max_match = min(max_match, MAX_MATCH)
+        self.history = bytearray()
+
+    def reset(self):
+        self.history = bytearray()
+
+    def compress(self, data):
+        out = bytearray()
+        literals = bytearray()
+        buf = self.history + bytes(data)
+        pos = len(self.history)
+
+        def send_literals():
+            for i in range(0, len(literals), MAX_LITERALS):
+                run = literals[i:i + MAX_LITERALS]
+                out.append(len(run) - 1)
+                out.extend(run)
+            del literals[:]
+
+        while pos < len(buf):
+            limit = min(self.max_match, len(buf) - pos)
+            best, best_distance = 0, 0
+            for distance in range(1, min(pos, WINDOW) + 1):
+                length = 0
+                while length < limit and buf[pos - distance + length] == buf[pos + length]:
+                    length += 1
+                if length > best:
+                    best, best_distance = length, distance
+                    if best == limit:
+                        break
+            if best >= MIN_MATCH:
+                send_literals()
+                out.append(0x80 + best - MIN_MATCH)
+                out.append(best_distance - 1)
+                pos += best
+            else:
+                literals.append(buf[pos])
+                pos += 1
+        send_literals()
+        self.history = buf[-WINDOW:]
+        return bytes(out)
+
+
+class Decompressor:
+    """Incremental decoder: feed() compressed bytes as they arrive, get back
+    the decoded bytes available so far."""
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.window = bytearray()
+        self.literals_left = 0
+        self.match_len = 0
+
+    def feed(self, data):
+        out = bytearray()
+        for c in bytes(data):
+            if self.literals_left:
+                out.append(c)
+                self.window.append(c)
+                self.literals_left -= 1
+            elif self.match_len:
+                start = len(self.window) - c - 1
+                for i in range(self.match_len):
+                    b = self.window[start + i]
+                    out.append(b)
+                    self.window.append(b)
+                self.match_len = 0
+            elif c < 0x80:
+                self.literals_left = c + 1
+            else:
+                self.match_len = c - 0x80 + MIN_MATCH
+            if len(self.window) > 2 * WINDOW:
+                del self.window[:-WINDOW]
+        return bytes(out)
@@ -0,0 +1,80 @@
+"""Frame codec matching src/HM1X_Framer.
+
+    0xA5 | type | length | ~length | payload | CRC-16/CCITT-FALSE (LSB first)
+
+The CRC covers everything after the sync byte. On a bad sync byte, a
+length check failure or a CRC mismatch the decoder drops one byte and
+resynchronises on the next 0xA5.
+"""
+
+SYNC = 0xA5
+HEADER_LEN = 4
+CRC_LEN = 2
+OVERHEAD = HEADER_LEN + CRC_LEN
+MAX_PAYLOAD = 255
+
+# First frame type reserved for library layers
+TYPE_RESERVED = 0xF0
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def encode_frame(frame_type, payload=b""):
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError("payload longer than %d bytes" % MAX_PAYLOAD)
+    body = bytes((frame_type, len(payload), len(payload) ^ 0xFF)) + bytes(payload)
+    crc = crc16(body)
+    return bytes((SYNC,)) + body + bytes((crc & 0xFF, crc >> 8))
+
+
+class FrameDecoder:
+    """Incremental decoder. feed() bytes as they arrive from the link; it
+    returns the complete frames as (type, payload) tuples. Scanning works
+    on the buffer in place; only delivered payloads are copied out.
+    """
+
+    def __init__(self, max_payload=MAX_PAYLOAD):
+        self.max_frame = OVERHEAD + max_payload
+        self.dropped_bytes = 0
+        self.crc_errors = 0
+        self._buffer = bytearray()
+
+    def feed(self, data):
+        buf = self._buffer
+        buf.extend(data)
+        frames = []
+        start = 0
+        while start < len(buf):
+            if buf[start] != SYNC:
+                sync = buf.find(SYNC, start)
+                skip = (sync if sync >= 0 else len(buf)) - start
+                self.dropped_bytes += skip
+                start += skip
+                continue
+            if len(buf) - start < HEADER_LEN:
+                break
+            frame_len = OVERHEAD + buf[start + 2]
+            if buf[start + 3] != buf[start + 2] ^ 0xFF or frame_len > self.max_frame:
+                self.dropped_bytes += 1
+                start += 1
+                continue
+            if len(buf) - start < frame_len:
+                break
+            end = start + frame_len
+            crc = buf[end - 2] | (buf[end - 1] << 8)
+            if crc16(buf[start + 1:end - CRC_LEN]) != crc:
+                self.crc_errors += 1
+                self.dropped_bytes += 1
+                start += 1
+                continue
+            frames.append((buf[start + 1], bytes(buf[start + HEADER_LEN:end - CRC_LEN])))
+            start = end
+        del buf[:start]
+        return frames
@@ -0,0 +1,91 @@
+"""Channel multiplexer matching src/HM1X_Mux.
+
+Messages travel one per frame (type 0xF2: channel | payload). Outgoing
+messages are scheduled highest priority first, with deficit round robin
+between channels of equal priority.
+"""
+
+from collections import deque
+
+from .framing import FrameDecoder, encode_frame
+
+TYPE_MUX = 0xF2
+QUANTUM = 20
+
+
+class _Channel:
+    def __init__(self, priority, weight, on_receive):
+        self.priority = priority
+        self.weight = max(1, weight)
+        self.on_receive = on_receive
+        self.queue = deque()
+        self.deficit = 0
+        self.turn = False
+
+
+class Mux:
+    """send(bytes) puts raw bytes on the wire; feed() takes bytes from it.
+    Call service() to send queued messages, at most `budget` bytes a call.
+    Frames of other types go to on_frame(type, payload) if given.
+    """
+
+    def __init__(self, send, on_frame=None):
+        self.send = send
+        self.on_frame = on_frame
+        self.decoder = FrameDecoder()
+        self.channels = {}
+        self._order = []
+        self._next = 0
+
+    def begin_channel(self, channel, priority=0, weight=1, on_receive=None):
+        self.channels[channel] = _Channel(priority, weight, on_receive)
+        self._order = sorted(self.channels)
+
+    def write(self, channel, payload):
+        if len(payload) > 254:
+            raise ValueError("payload longer than 254 bytes")
+        self.channels[channel].queue.append(bytes(payload))
+
+    def queued(self, channel):
+        return sum(len(m) for m in self.channels[channel].queue)
+
+    def feed(self, data):
+        for frame_type, payload in self.decoder.feed(data):
+            if frame_type == TYPE_MUX and payload:
+                ch = self.channels.get(payload[0])
+                if ch is not None and ch.on_receive is not None:
+                    ch.on_receive(payload[0], payload[1:])
+            elif self.on_frame is not None:
+                self.on_frame(frame_type, payload)
+
+    def service(self, budget=64):
+        while budget > 0:
+            index = self._next_channel()
+            if index is None:
+                return
+            number = self._order[index]
+            ch = self.channels[number]
+            if not ch.turn:
+                ch.deficit += ch.weight * QUANTUM
+                ch.turn = True
+            size = len(ch.queue[0]) + 1
+            if size > ch.deficit:
+                ch.turn = False
+                self._next = (index + 1) % len(self._order)
+                continue
+            self.send(encode_frame(TYPE_MUX, bytes((number,)) + ch.queue.popleft()))
+            ch.deficit -= size
+            budget -= size
+            if not ch.queue:
+                ch.deficit = 0
+                ch.turn = False
+                self._next = (index + 1) % len(self._order)
+
+    def _next_channel(self):
+        best = None
+        for i in range(len(self._order)):
+            index = (self._next + i) % len(self._order)
+            ch = self.channels[self._order[index]]
+            if ch.queue and (best is None or ch.priority > self.channels[self._order[best]].priority):
+                best = index
+        return best
@@ -0,0 +1,87 @@
+"""Latency probe and clock sync matching src/HM1X_Probe.
+
+Probe (0xF5): seq | t1.  Reply (0xF6): seq | t1 | t2 | t3.
+Times are little-endian 32-bit microsecond counters, compared modulo
+2**32. Answering the device's probes with this clock is what lets the
+device map its micros() onto hub time.
+"""
+
+import struct
+import time
+
+from .framing import FrameDecoder, encode_frame
+
+TYPE_PROBE = 0xF5
+TYPE_REPLY = 0xF6
+SAMPLES = 8
+
+
+def micros32():
+    return (time.monotonic_ns() // 1000) & 0xFFFFFFFF
+
+
+def _signed(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+class Probe:
+    """Answers probes from the device and can probe it in turn. send(bytes)
+    puts raw bytes on the wire; pass received bytes to feed(). Frames of
+    other types go to on_frame(type, payload) if given.
+    """
+
+    def __init__(self, send, clock=micros32, on_frame=None):
+        self.send = send
+        self.clock = clock
+        self.on_frame = on_frame
+        self.decoder = FrameDecoder()
+        self.seq = 0
+        self.waiting = None
+        self.last_rtt = None
+        self.srtt = None
+        self.rttvar = None
+        self.min_rtt = None
+        self.offset = 0      # device clock - hub clock, in microseconds
+        self.samples = 0
+        self.lost = 0        # replies dropped for a turnaround longer than the round trip
+        self.recent = []
+
+    def probe(self):
+        self.seq = (self.seq + 1) & 0xFF
+        self.waiting = self.seq
+        self.send(encode_frame(TYPE_PROBE, struct.pack("<BI", self.seq, self.clock())))
+
+    def feed(self, data):
+        for frame_type, payload in self.decoder.feed(data):
+            received = self.clock()
+            if frame_type == TYPE_PROBE and len(payload) == 5:
+                self.send(encode_frame(TYPE_REPLY, payload + struct.pack("<II", received, self.clock())))
+            elif frame_type == TYPE_REPLY and len(payload) == 13:
+                self._sample(payload, received)
+            elif self.on_frame is not None:
+                self.on_frame(frame_type, payload)
+
+    def to_device_time(self, hub_micros):
+        return (hub_micros + self.offset) & 0xFFFFFFFF
+
+    def _sample(self, payload, t4):
+        seq, t1, t2, t3 = struct.unpack("<BIII", payload)
+        if seq != self.waiting:
+            return
+        self.waiting = None
+        if (t3 - t2) & 0xFFFFFFFF > (t4 - t1) & 0xFFFFFFFF:
+            self.lost += 1  # would be a negative RTT, as the device drops it
+            return
+        rtt = ((t4 - t1) - (t3 - t2)) & 0xFFFFFFFF
+        offset = _signed((t2 - t1) - rtt // 2)  # as the device computes it
+        if self.samples == 0:
+            self.srtt, self.rttvar = rtt, rtt / 2
+        else:
+            self.rttvar = 0.75 * self.rttvar + 0.25 * abs(rtt - self.srtt)
+            self.srtt = 0.875 * self.srtt + 0.125 * rtt
+        self.last_rtt = rtt
+        self.min_rtt = rtt if self.min_rtt is None else min(self.min_rtt, rtt)
+        self.samples += 1
+        self.recent = (self.recent + [(rtt, offset)])[-SAMPLES:]
+        self.offset = min(self.recent)[1]
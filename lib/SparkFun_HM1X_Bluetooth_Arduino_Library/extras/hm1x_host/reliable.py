@@ -0,0 +1,159 @@
+"""Reliable delivery matching src/HM1X_Reliable (Go-Back-N ARQ).
+
+Data frames (type 0xF0) carry an 8-bit sequence number before the
+payload; ACK frames (type 0xF1) carry the next sequence number the
+receiver expects. Frames are accepted only in order, so each payload
+is delivered exactly once.
+
+An end that restarts mid-stream calls resync(), which sends a SYNC
+frame (type 0xF7) with its tx base and rx next sequence numbers and
+holds data until a SYNC_ACK (type 0xF8, same layout) comes back. The
+end receiving a SYNC re-bases on it: it expects the peer's stream from
+the peer's tx base, and renumbers its unacknowledged frames from the
+peer's rx next and sends them again.
+"""
+
+import time
+from collections import deque
+
+from .framing import FrameDecoder, encode_frame
+
+TYPE_DATA = 0xF0
+TYPE_ACK = 0xF1
+TYPE_SYNC = 0xF7
+TYPE_SYNC_ACK = 0xF8
+
+MAX_WINDOW = 127
+DEFAULT_TIMEOUT = 0.5
+
+
+class ReliableLink:
+    """One end of a reliable link.
+
+    send(bytes) puts raw bytes on the wire. Pass bytes read from the wire
+    to feed(), which returns the payloads delivered in order. Call poll()
+    regularly so timed-out frames are resent. Frames of other types are
+    passed to on_frame(type, payload) if given.
+    """
+
+    def __init__(self, send, window=8, max_payload=64, timeout=DEFAULT_TIMEOUT,
+                 clock=time.monotonic, on_frame=None):
+        self.send = send
+        self.window = max(1, min(window, MAX_WINDOW))
+        self.max_payload = min(max_payload, 254)
+        self.timeout = timeout
+        self.clock = clock
+        self.on_frame = on_frame
+        self.decoder = FrameDecoder()
+        self.retransmits = 0
+        self.reset()
+
+    def reset(self):
+        self.tx_base = 0
+        self.tx_sent = 0
+        self.tx_queue = deque()   # payloads for [tx_base, tx_base + len)
+        self.tx_timer = 0.0
+        self.rx_next = 0
+        self.paused = False
+        self.syncing = False
+
+    def resync(self):
+        """Forget all state and have the peer start again with us."""
+        self.reset()
+        self.syncing = True
+        if not self.paused:
+            self._send_sync(TYPE_SYNC)
+
+    @property
+    def pending(self):
+        return len(self.tx_queue)
+
+    def can_write(self):
+        return self.pending < self.window
+
+    def write(self, payload):
+        """Queue payload for delivery. Returns False if the window is full."""
+        if len(payload) > self.max_payload:
+            raise ValueError("payload longer than %d bytes" % self.max_payload)
+        if not self.can_write():
+            return False
+        self.tx_queue.append(bytes(payload))
+        self._send_pending()
+        return True
+
+    def pause(self):
+        """Link went down: hold everything, resend it all on resume()."""
+        self.paused = True
+        self.tx_sent = self.tx_base
+
+    def resume(self):
+        self.paused = False
+        self._send_pending()
+
+    def feed(self, data):
+        delivered = []
+        for frame_type, payload in self.decoder.feed(data):
+            if frame_type == TYPE_SYNC and len(payload) == 2:
+                self._rebase(payload[0], payload[1])
+                if not self.paused:
+                    self._send_sync(TYPE_SYNC_ACK)
+            elif frame_type == TYPE_SYNC_ACK and len(payload) == 2:
+                if self.syncing:
+                    self.syncing = False
+                    self._rebase(payload[0], payload[1])
+            elif frame_type == TYPE_ACK and len(payload) == 1:
+                if not self.syncing:
+                    self._handle_ack(payload[0])
+            elif frame_type == TYPE_DATA and len(payload) >= 1:
+                if self.syncing:
+                    continue  # numbered from before the peer knew we restarted
+                if payload[0] == self.rx_next:
+                    self.rx_next = (self.rx_next + 1) & 0xFF
+                    delivered.append(payload[1:])
+                if not self.paused:
+                    self.send(encode_frame(TYPE_ACK, bytes((self.rx_next,))))
+            elif self.on_frame is not None:
+                self.on_frame(frame_type, payload)
+        self.poll()
+        return delivered
+
+    def poll(self):
+        if self.syncing:
+            if not self.paused and self.clock() - self.tx_timer >= self.timeout:
+                self.retransmits += 1
+                self._send_sync(TYPE_SYNC)
+            return
+        if (not self.paused and self.tx_sent != self.tx_base
+                and self.clock() - self.tx_timer >= self.timeout):
+            self.retransmits += 1
+            self.tx_sent = self.tx_base
+        self._send_pending()
+
+    def _send_pending(self):
+        if self.paused or self.syncing:
+            return
+        tx_next = (self.tx_base + len(self.tx_queue)) & 0xFF
+        while self.tx_sent != tx_next:
+            offset = (self.tx_sent - self.tx_base) & 0xFF
+            if self.tx_sent == self.tx_base:
+                self.tx_timer = self.clock()
+            self.send(encode_frame(TYPE_DATA, bytes((self.tx_sent,)) + self.tx_queue[offset]))
+            self.tx_sent = (self.tx_sent + 1) & 0xFF
+
+    def _handle_ack(self, next_seq):
+        acked = (next_seq - self.tx_base) & 0xFF
+        if acked == 0 or acked > ((self.tx_sent - self.tx_base) & 0xFF):
+            return
+        for _ in range(acked):
+            self.tx_queue.popleft()
+        self.tx_base = next_seq
+        self.tx_timer = self.clock()
+
+    def _send_sync(self, frame_type):
+        self.send(encode_frame(frame_type, bytes((self.tx_base, self.rx_next))))
+        self.tx_timer = self.clock()
+
+    def _rebase(self, peer_tx_base, peer_rx_next):
+        self.tx_base = peer_rx_next
+        self.tx_sent = self.tx_base
+        self.rx_next = peer_tx_base
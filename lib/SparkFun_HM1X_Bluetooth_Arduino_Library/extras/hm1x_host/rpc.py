@@ -0,0 +1,90 @@
+"""RPC client matching src/HM1X_Rpc.
+
+Requests (frame type 0xF3: id | method | args) go out as fast as the
+caller makes them; responses (0xF4: id | status | result) are matched
+back to their call by id, in whatever order they arrive.
+"""
+
+import time
+
+from .framing import FrameDecoder, encode_frame
+
+TYPE_REQUEST = 0xF3
+TYPE_RESPONSE = 0xF4
+
+OK = 0
+NO_METHOD = 1
+BAD_ARGS = 2
+FAILED = 3
+TIMEOUT = -1   # Host-side only: no response in time
+
+
+class Call:
+    def __init__(self, call_id, method, deadline, callback):
+        self.id = call_id
+        self.method = method
+        self.deadline = deadline
+        self.callback = callback
+        self.status = None
+        self.result = None
+
+    @property
+    def done(self):
+        return self.status is not None
+
+    def _finish(self, status, result):
+        self.status = status
+        self.result = result
+        if self.callback is not None:
+            self.callback(self)
+
+
+class RpcClient:
+    """send(bytes) puts raw bytes on the wire; feed() takes bytes from it.
+    Up to max_in_flight calls may be outstanding; poll() times out calls
+    with no answer. Frames of other types go to on_frame(type, payload).
+    """
+
+    def __init__(self, send, max_in_flight=32, timeout=2.0, clock=time.monotonic, on_frame=None):
+        self.send = send
+        self.max_in_flight = min(max_in_flight, 256)
+        self.timeout = timeout
+        self.clock = clock
+        self.on_frame = on_frame
+        self.decoder = FrameDecoder()
+        self.pending = {}
+        self._next_id = 0
+
+    def can_call(self):
+        return len(self.pending) < self.max_in_flight
+
+    def call(self, method, args=b"", callback=None):
+        """Send a request now. Returns its Call; callback(call) runs when
+        the response (or a timeout) arrives."""
+        if not self.can_call():
+            raise RuntimeError("too many calls in flight")
+        if len(args) > 253:
+            raise ValueError("args longer than 253 bytes")
+        while self._next_id in self.pending:
+            self._next_id = (self._next_id + 1) & 0xFF
+        call = Call(self._next_id, method, self.clock() + self.timeout, callback)
+        self.pending[call.id] = call
+        self._next_id = (self._next_id + 1) & 0xFF
+        self.send(encode_frame(TYPE_REQUEST, bytes((call.id, method)) + bytes(args)))
+        return call
+
+    def feed(self, data):
+        for frame_type, payload in self.decoder.feed(data):
+            if frame_type == TYPE_RESPONSE and len(payload) >= 2:
+                call = self.pending.pop(payload[0], None)
+                if call is not None:
+                    call._finish(payload[1], payload[2:])
+            elif self.on_frame is not None:
+                self.on_frame(frame_type, payload)
+        self.poll()
+
+    def poll(self):
+        now = self.clock()
+        for call in [c for c in self.pending.values() if now >= c.deadline]:
+            del self.pending[call.id]
+            call._finish(TIMEOUT, b"")
@@ -0,0 +1,5 @@
+"""Host-side tests. The byte vectors in them come from the device code and
+are checked from the device side by the project's test/ directory.
+
+Run from the extras directory: python3 -m unittest discover hm1x_host
+"""
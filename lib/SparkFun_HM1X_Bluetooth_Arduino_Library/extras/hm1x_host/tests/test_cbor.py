@@ -0,0 +1,65 @@
+import unittest
+
+from hm1x_host.cbor import Incomplete, StreamDecoder, Tagged, decode, loads
+
+# HM1X_CborWriter's output, see test/test_cbor
+DEVICE_MESSAGE = bytes.fromhex(
+    "a6"
+    "6174" "fa41ac0000"
+    "616e" "1a000186a0"
+    "636e6567" "3901f3"
+    "626f6b" "f5"
+    "63617272" "9f" "00" "17" "1818" "1a00010000" "f6" "43010203" "ff"
+    "627473" "c1" "1a6553f100")
+DEVICE_VALUE = {
+    "t": 21.5,
+    "n": 100000,
+    "neg": -500,
+    "ok": True,
+    "arr": [0, 23, 24, 65536, None, b"\x01\x02\x03"],
+    "ts": Tagged(1, 1700000000),
+}
+
+# RFC 8949 Appendix A, including the forms the device writes
+RFC_EXAMPLES = [
+    ("00", 0), ("17", 23), ("1818", 24), ("1903e8", 1000), ("1a000f4240", 1000000),
+    ("1b000000e8d4a51000", 1000000000000), ("20", -1), ("3863", -100), ("3903e7", -1000),
+    ("f90000", 0.0), ("f93c00", 1.0), ("f97bff", 65504.0), ("fa47c35000", 100000.0),
+    ("fac0800000", -4.0), ("fb3ff199999999999a", 1.1), ("f4", False), ("f5", True),
+    ("f6", None), ("60", ""), ("6449455446", "IETF"), ("4401020304", b"\x01\x02\x03\x04"),
+    ("83010203", [1, 2, 3]), ("a201020304", {1: 2, 3: 4}),
+    ("9f018202039f0405ffff", [1, [2, 3], [4, 5]]),
+    ("bf61610161629f0203ffff", {"a": 1, "b": [2, 3]}),
+    ("5f42010243030405ff", b"\x01\x02\x03\x04\x05"),
+    ("7f657374726561646d696e67ff", "streaming"),
+    ("c11a514b67b0", Tagged(1, 1363896240)),
+]
+
+
+class CborTest(unittest.TestCase):
+    def test_decode_device_message(self):
+        self.assertEqual(loads(DEVICE_MESSAGE), DEVICE_VALUE)
+
+    def test_rfc_examples(self):
+        for encoded, value in RFC_EXAMPLES:
+            self.assertEqual(loads(bytes.fromhex(encoded)), value, encoded)
+
+    def test_stream_byte_at_a_time(self):
+        decoder = StreamDecoder()
+        items = []
+        for byte in DEVICE_MESSAGE + DEVICE_MESSAGE:
+            items += decoder.feed(bytes((byte,)))
+        self.assertEqual(items, [DEVICE_VALUE, DEVICE_VALUE])
+
+    def test_incomplete(self):
+        for end in range(len(DEVICE_MESSAGE)):
+            with self.assertRaises(Incomplete):
+                decode(DEVICE_MESSAGE[:end])
+
+    def test_trailing_bytes(self):
+        with self.assertRaises(ValueError):
+            loads(DEVICE_MESSAGE + b"\x00")
+
+
+if __name__ == "__main__":
+    unittest.main()
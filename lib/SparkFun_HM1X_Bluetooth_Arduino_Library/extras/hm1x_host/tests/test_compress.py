@@ -0,0 +1,65 @@
+import random
+import unittest
+
+from hm1x_host.compress import Compressor, Decompressor
+
+# HM1X_Compressor's output for two messages, see test/test_compress
+TEXT_1 = b"T=21.5,H=40;T=21.5,H=41;T=21.5,H=40;" + b"a" * 44 + b"\n"
+DEVICE_STREAM_1 = bytes.fromhex("0b543d32312e352c483d34303b870b0031880b02303b619d008800000a")
+TEXT_2 = b"T=21.5,H=40;\n"
+DEVICE_STREAM_2 = bytes.fromhex("8938000a")
+# Literal runs and matches longer than the device coder emits; the device
+# test decodes the same stream
+LONG_INPUT = bytes(i * 7 & 0xFF for i in range(140)) + b"\x55" * 140
+LONG_STREAM = (b"\x7f" + LONG_INPUT[:128] + b"\x0c" + LONG_INPUT[128:141]
+               + bytes((0xFF, 0x00, 0x86, 0x00)))
+
+# Device look-ahead, HM1X_LZ_LOOKAHEAD
+DEVICE_MAX_MATCH = 32
+
+
+class CompressTest(unittest.TestCase):
+    def test_decode_device_stream(self):
+        decompressor = Decompressor()
+        self.assertEqual(decompressor.feed(DEVICE_STREAM_1), TEXT_1)
+        self.assertEqual(decompressor.feed(DEVICE_STREAM_2), TEXT_2)
+
+    def test_decode_byte_at_a_time(self):
+        decompressor = Decompressor()
+        out = b"".join(decompressor.feed(bytes((c,))) for c in DEVICE_STREAM_1 + DEVICE_STREAM_2)
+        self.assertEqual(out, TEXT_1 + TEXT_2)
+
+    def test_encode_matches_device(self):
+        compressor = Compressor(max_match=DEVICE_MAX_MATCH)
+        self.assertEqual(compressor.compress(TEXT_1), DEVICE_STREAM_1)
+        self.assertEqual(compressor.compress(TEXT_2), DEVICE_STREAM_2)
+
+    def test_long_tokens(self):
+        self.assertEqual(Compressor().compress(LONG_INPUT), LONG_STREAM)
+        self.assertEqual(Decompressor().feed(LONG_STREAM), LONG_INPUT)
+
+    def test_round_trip(self):
+        rng = random.Random(35)
+        compressor = Compressor()
+        decompressor = Decompressor()
+        raw = wire = 0
+        for i in range(300):
+            line = ("T=%d.%d,H=%d,state=%s\n" % (20 + i % 5, i % 10, 40 + i % 7,
+                                                  "run" if i % 3 else "idle")).encode()
+            if i % 50 == 0:
+                line += bytes(rng.randrange(256) for _ in range(rng.randrange(300)))
+            packed = compressor.compress(line)
+            self.assertEqual(decompressor.feed(packed), line)
+            raw += len(line)
+            wire += len(packed)
+        self.assertLess(wire, raw)
+
+    def test_reset(self):
+        compressor = Compressor()
+        compressor.compress(TEXT_2)
+        compressor.reset()
+        self.assertEqual(Decompressor().feed(compressor.compress(TEXT_2)), TEXT_2)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,64 @@
+import random
+import unittest
+
+from hm1x_host.framing import SYNC, FrameDecoder, crc16, encode_frame
+
+# HM1X_Framer::writeFrame() output, see test/test_framing
+SYNC_PAYLOAD = bytes((0xA5, 0xA5, 0x00, 0xFF, 0x5A))
+DEVICE_SYNC_FRAME = bytes.fromhex("a52105faa5a500ff5adcc4")
+DEVICE_EMPTY_FRAME = bytes.fromhex("a53000ffc917")
+DEVICE_HELLO_FRAME = bytes.fromhex("a50705fa68656c6c6f5d5b")
+
+
+class FramingTest(unittest.TestCase):
+    def test_crc_check_value(self):
+        self.assertEqual(crc16(b"123456789"), 0x29B1)
+
+    def test_encode_matches_device(self):
+        self.assertEqual(encode_frame(0x21, SYNC_PAYLOAD), DEVICE_SYNC_FRAME)
+        self.assertEqual(encode_frame(0x30), DEVICE_EMPTY_FRAME)
+        self.assertEqual(encode_frame(0x07, b"hello"), DEVICE_HELLO_FRAME)
+
+    def test_decode_device_frames(self):
+        decoder = FrameDecoder()
+        frames = decoder.feed(DEVICE_SYNC_FRAME + DEVICE_EMPTY_FRAME)
+        self.assertEqual(frames, [(0x21, SYNC_PAYLOAD), (0x30, b"")])
+        self.assertEqual(decoder.dropped_bytes, 0)
+
+    def test_decode_byte_at_a_time(self):
+        decoder = FrameDecoder()
+        frames = []
+        for byte in DEVICE_SYNC_FRAME + DEVICE_HELLO_FRAME:
+            frames += decoder.feed(bytes((byte,)))
+        self.assertEqual(frames, [(0x21, SYNC_PAYLOAD), (0x07, b"hello")])
+
+    def test_resync(self):
+        garbage = bytes((0x00, 0xA5, 0xA5, 0x01)) + b"zz"
+        corrupt = bytearray(DEVICE_HELLO_FRAME)
+        corrupt[6] ^= 0x01
+        decoder = FrameDecoder()
+        frames = decoder.feed(garbage + corrupt + DEVICE_HELLO_FRAME + DEVICE_SYNC_FRAME)
+        self.assertEqual(frames, [(0x07, b"hello"), (0x21, SYNC_PAYLOAD)])
+        self.assertEqual(decoder.crc_errors, 1)
+        self.assertEqual(decoder.dropped_bytes, len(garbage) + len(corrupt))
+
+    def test_oversize_frame_skipped(self):
+        decoder = FrameDecoder(max_payload=16)
+        frames = decoder.feed(encode_frame(1, bytes(17)) + DEVICE_HELLO_FRAME)
+        self.assertEqual(frames, [(0x07, b"hello")])
+
+    def test_round_trip(self):
+        rng = random.Random(32)
+        decoder = FrameDecoder()
+        for length in range(256):
+            payload = bytes(SYNC if i & 1 else rng.randrange(256) for i in range(length))
+            self.assertEqual(decoder.feed(encode_frame(length, payload)), [(length, payload)])
+        self.assertEqual(decoder.dropped_bytes, 0)
+
+    def test_payload_too_long(self):
+        with self.assertRaises(ValueError):
+            encode_frame(0, bytes(256))
+
+
+if __name__ == "__main__":
+    unittest.main()
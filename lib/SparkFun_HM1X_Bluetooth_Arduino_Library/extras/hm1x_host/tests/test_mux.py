@@ -0,0 +1,63 @@
+import unittest
+
+from hm1x_host.framing import encode_frame
+from hm1x_host.mux import Mux
+
+# HM1X_Mux's frames, see test/test_mux
+DEVICE_TEMP = bytes.fromhex("a5f205fa0174656d70a3cc")   # channel 1 "temp"
+DEVICE_EMPTY = bytes.fromhex("a5f201fe0259d1")          # channel 2, empty
+# Order HM1X_Mux sends 6 messages of 18 bytes on channels 1 (weight 3)
+# and 2 (weight 1) with one urgent message on channel 0
+DEVICE_SCHEDULE = "0111211122222"
+
+
+class MuxTest(unittest.TestCase):
+    def setUp(self):
+        self.sent = []
+        self.received = []
+        self.other = []
+        self.mux = Mux(self.sent.append, on_frame=lambda t, p: self.other.append((t, p)))
+        on_receive = lambda channel, payload: self.received.append((channel, payload))
+        self.mux.begin_channel(0, priority=2, on_receive=on_receive)
+        self.mux.begin_channel(1, weight=3, on_receive=on_receive)
+        self.mux.begin_channel(2, on_receive=on_receive)
+
+    def test_send_matches_device(self):
+        self.mux.write(1, b"temp")
+        self.mux.write(2, b"")
+        self.mux.service()
+        self.assertEqual(self.sent, [DEVICE_TEMP, DEVICE_EMPTY])
+
+    def test_receive_from_device(self):
+        self.mux.feed(DEVICE_TEMP + DEVICE_EMPTY + encode_frame(0x10, b"x"))
+        self.assertEqual(self.received, [(1, b"temp"), (2, b"")])
+        self.assertEqual(self.other, [(0x10, b"x")])
+
+    def test_schedule_matches_device(self):
+        for i in range(6):
+            self.mux.write(1, bytes((i,)) * 18)
+            self.mux.write(2, bytes((i,)) * 18)
+        self.mux.write(0, bytes(5))
+        while any(self.mux.queued(c) for c in range(3)):
+            self.mux.service()
+        self.assertEqual("".join(str(frame[4]) for frame in self.sent), DEVICE_SCHEDULE)
+
+    def test_round_trip(self):
+        peer_received = []
+        peer = Mux(None)
+        for channel in range(3):
+            peer.begin_channel(channel, on_receive=lambda c, p: peer_received.append((c, p)))
+        messages = [(n % 3, bytes((n,)) * (n % 40)) for n in range(60)]
+        for channel, payload in messages:
+            self.mux.write(channel, payload)
+        while any(self.mux.queued(c) for c in range(3)):
+            self.mux.service()
+        peer.feed(b"".join(self.sent))
+        self.assertEqual(sorted(peer_received), sorted(messages))
+        for channel in range(3):
+            self.assertEqual([p for c, p in peer_received if c == channel],
+                             [p for c, p in messages if c == channel])
+
+
+if __name__ == "__main__":
+    unittest.main()
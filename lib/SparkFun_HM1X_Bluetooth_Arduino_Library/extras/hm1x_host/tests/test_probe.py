@@ -0,0 +1,84 @@
+import struct
+import unittest
+
+from hm1x_host.framing import encode_frame
+from hm1x_host.probe import Probe
+
+# A probe laid out as HM1X_Probe sends it (seq 1, t1 0x00010000), see
+# test/test_probe, and this end's reply to it at 0x00020000/0x00020010
+DEVICE_PROBE = bytes.fromhex("a5f505fa010000010074c3")
+HOST_REPLY = bytes.fromhex("a5f60df2010000010000000200100002006554")
+# The probe the device test answers: seq 7, t1 0x12345678
+HOST_PROBE = bytes.fromhex("a5f505fa07785634123aed")
+
+
+class Clock:
+    """Microsecond counter; each reading advances it by step."""
+
+    def __init__(self, now, step=0):
+        self.now = now
+        self.step = step
+
+    def __call__(self):
+        now = self.now
+        self.now += self.step
+        return now
+
+
+class ProbeTest(unittest.TestCase):
+    def test_answer_device_probe(self):
+        sent = []
+        probe = Probe(sent.append, clock=Clock(0x20000, step=0x10))
+        probe.feed(DEVICE_PROBE)
+        self.assertEqual(sent, [HOST_REPLY])
+
+    def test_probe_matches_device_test(self):
+        sent = []
+        probe = Probe(sent.append, clock=Clock(0x12345678))
+        probe.seq = 6
+        probe.probe()
+        self.assertEqual(sent, [HOST_PROBE])
+
+    def test_other_frames_passed_on(self):
+        other = []
+        probe = Probe(None, on_frame=lambda t, p: other.append((t, p)))
+        probe.feed(HOST_REPLY)   # Not waiting for it: dropped
+        probe.feed(encode_frame(0x10, b"x"))
+        self.assertEqual(other, [(0x10, b"x")])
+        self.assertEqual(probe.samples, 0)
+
+    def test_round_trip_offset(self):
+        # 300 us each way, the remote clock 1 s ahead; the local clock
+        # wraps around part way through
+        now = [0xFFFFFFFF - 500]
+        wire = []
+        local_end = Probe(wire.append, clock=lambda: now[0] & 0xFFFFFFFF)
+        remote_end = Probe(wire.append, clock=lambda: (now[0] + 1000000) & 0xFFFFFFFF)
+        for _ in range(3):
+            local_end.probe()
+            now[0] += 300
+            remote_end.feed(wire.pop())
+            now[0] += 300
+            local_end.feed(wire.pop())
+        self.assertEqual(local_end.samples, 3)
+        self.assertEqual(local_end.last_rtt, 600)
+        self.assertEqual(local_end.offset, 1000000)
+        self.assertEqual(local_end.to_device_time(0xFFFFFFFF), 1000000 - 1)
+
+    def test_negative_rtt_dropped(self):
+        # The reply claims 10 s between receiving and answering, but came
+        # back 600 us after the probe went out
+        sent = []
+        probe = Probe(sent.append, clock=Clock(1000))
+        probe.probe()
+        probe.clock.now = 1600
+        reply = encode_frame(0xF6, sent[0][4:9] + struct.pack("<II", 5000, 10005000))
+        probe.feed(reply)
+        self.assertEqual(probe.samples, 0)
+        self.assertEqual(probe.lost, 1)
+        self.assertIsNone(probe.last_rtt)
+        self.assertIsNone(probe.waiting)
+
+
+if __name__ == "__main__":
+    unittest.main()
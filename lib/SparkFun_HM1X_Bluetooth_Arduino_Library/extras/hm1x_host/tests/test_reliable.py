@@ -0,0 +1,181 @@
+import random
+import unittest
+
+from hm1x_host.reliable import ReliableLink
+
+# HM1X_Reliable's frames, see test/test_reliable
+DEVICE_DATA_0 = bytes.fromhex("a5f003fc006162fed5")   # seq 0 "ab"
+DEVICE_DATA_1 = bytes.fromhex("a5f002fd0163c50d")     # seq 1 "c"
+DEVICE_ACK_1 = bytes.fromhex("a5f101fe01e67a")
+DEVICE_ACK_2 = bytes.fromhex("a5f101fe02854a")
+HOST_DATA_0 = bytes.fromhex("a5f003fc0068690dde")     # seq 0 "hi"
+SYNC_0 = bytes.fromhex("a5f702fd0000e505")            # tx base 0, rx next 0
+SYNC_ACK_0 = bytes.fromhex("a5f802fd00001c60")
+DEVICE_DATA_0_C = bytes.fromhex("a5f002fd0063f43e")   # "c" renumbered to seq 0
+
+
+class Clock:
+    def __init__(self):
+        self.now = 0.0
+
+    def __call__(self):
+        return self.now
+
+
+class ReliableTest(unittest.TestCase):
+    def setUp(self):
+        self.sent = []
+        self.clock = Clock()
+        self.link = ReliableLink(self.sent.append, window=4, max_payload=8,
+                                 timeout=0.1, clock=self.clock)
+
+    def test_send_matches_device(self):
+        self.assertTrue(self.link.write(b"ab"))
+        self.assertEqual(self.sent, [DEVICE_DATA_0])
+        self.assertEqual(self.link.feed(DEVICE_ACK_1), [])
+        self.assertEqual(self.link.pending, 0)
+
+    def test_receive_from_device(self):
+        self.assertEqual(self.link.feed(DEVICE_DATA_0), [b"ab"])
+        self.assertEqual(self.sent, [DEVICE_ACK_1])
+        # A resent copy is acknowledged again but not delivered twice
+        self.assertEqual(self.link.feed(DEVICE_DATA_0), [])
+        self.assertEqual(self.sent, [DEVICE_ACK_1, DEVICE_ACK_1])
+        self.assertEqual(self.link.feed(DEVICE_DATA_1), [b"c"])
+        self.assertEqual(self.sent[-1], DEVICE_ACK_2)
+
+    def test_host_frames_match_device_test(self):
+        self.link.write(b"hi")
+        self.assertEqual(self.sent, [HOST_DATA_0])
+
+    def test_retransmit(self):
+        self.link.write(b"ab")
+        self.link.poll()
+        self.assertEqual(len(self.sent), 1)
+        self.clock.now += 0.2
+        self.link.poll()
+        self.assertEqual(self.sent, [DEVICE_DATA_0, DEVICE_DATA_0])
+        self.assertEqual(self.link.retransmits, 1)
+
+    def test_window_full(self):
+        for i in range(4):
+            self.assertTrue(self.link.write(bytes((i,))))
+        self.assertFalse(self.link.write(b"x"))
+        with self.assertRaises(ValueError):
+            self.link.write(bytes(9))
+
+    def test_pause_resends_on_resume(self):
+        self.link.write(b"ab")
+        self.link.pause()
+        self.link.write(b"c")
+        self.assertEqual(self.sent, [DEVICE_DATA_0])
+        self.link.resume()
+        self.assertEqual(self.sent, [DEVICE_DATA_0, DEVICE_DATA_0, DEVICE_DATA_1])
+
+    def test_sync_frames_match_device(self):
+        self.link.resync()
+        self.assertEqual(self.sent, [SYNC_0])
+        self.assertTrue(self.link.syncing)
+        # Data waits for the SYNC_ACK; frames from before it are dropped
+        self.link.write(b"c")
+        self.assertEqual(self.link.feed(HOST_DATA_0), [])
+        self.assertEqual(self.sent, [SYNC_0])
+        self.clock.now += 0.2
+        self.link.poll()
+        self.assertEqual(self.sent, [SYNC_0, SYNC_0])
+        self.link.feed(SYNC_ACK_0)
+        self.assertFalse(self.link.syncing)
+        self.assertEqual(self.sent[-1], DEVICE_DATA_0_C)
+
+    def test_rebase_on_peer_sync(self):
+        self.link.write(b"ab")
+        self.link.write(b"c")
+        self.link.feed(DEVICE_ACK_1)
+        del self.sent[:]
+        # The peer restarted with "c" (seq 1) unacknowledged
+        self.assertEqual(self.link.feed(SYNC_0), [])
+        self.assertEqual(self.sent, [SYNC_ACK_0, DEVICE_DATA_0_C])
+        self.assertEqual(self.link.feed(HOST_DATA_0), [b"hi"])
+
+    def test_restart_mid_stream(self):
+        clock = Clock()
+        to_a, to_b = [], []
+
+        def end(wire):
+            return ReliableLink(wire.append, window=4, max_payload=8, timeout=0.05, clock=clock)
+
+        a, b = end(to_b), end(to_a)
+        messages = [bytes((n,)) for n in range(40)]
+        replies = [b"r" + bytes((n,)) for n in range(10)]
+        after_restart = [b"s" + bytes((n,)) for n in range(10)]
+        at_a, at_b, at_old_b = [], [], []
+        sent, replied = 0, 0
+        for step in range(2000):
+            if step == 30:
+                # b restarts, losing its state and whatever was on its wire
+                b = end(to_a)
+                del to_b[:]
+                at_old_b, at_b = at_b, []
+                replies, replied = after_restart, 0
+                b.resync()
+            if sent < len(messages) and a.write(messages[sent]):
+                sent += 1
+            if replied < len(replies) and b.write(replies[replied]):
+                replied += 1
+            while to_b:
+                at_b += b.feed(to_b.pop(0))
+            while to_a:
+                at_a += a.feed(to_a.pop(0))
+            clock.now += 0.01
+            a.poll()
+            b.poll()
+            if sent == len(messages) and a.pending == 0 and b.pending == 0 and step > 30:
+                break
+        self.assertFalse(b.syncing)
+        # The new b picks up a's stream no later than where the old b was,
+        # and gets the rest in order
+        resumed = len(messages) - len(at_b)
+        self.assertLessEqual(resumed, len(at_old_b))
+        self.assertEqual(at_b, messages[resumed:])
+        # a gets what the old b sent, then everything the new b sends
+        self.assertEqual(at_a[len(at_a) - len(after_restart):], after_restart)
+
+    def test_round_trip_over_lossy_link(self):
+        rng = random.Random(33)
+        clock = Clock()
+        wire = {"a": [], "b": []}
+
+        def lossy(queue):
+            def send(frame):
+                frame = bytearray(frame)
+                roll = rng.random()
+                if roll < 0.05:
+                    return
+                if roll < 0.08:
+                    frame[rng.randrange(len(frame))] ^= 0x10
+                queue.append(bytes(frame))
+            return send
+
+        a = ReliableLink(lossy(wire["b"]), window=5, max_payload=30, timeout=0.05, clock=clock)
+        b = ReliableLink(lossy(wire["a"]), window=5, max_payload=30, timeout=0.05, clock=clock)
+        messages = [bytes([n & 0xFF]) * (1 + n % 30) for n in range(600)]
+        sent = 0
+        received = []
+        for _ in range(100000):
+            if sent < len(messages) and a.write(messages[sent]):
+                sent += 1
+            while wire["b"]:
+                received += b.feed(wire["b"].pop(0))
+            while wire["a"]:
+                a.feed(wire["a"].pop(0))
+            clock.now += 0.01
+            a.poll()
+            b.poll()
+            if len(received) == len(messages):
+                break
+        self.assertEqual(received, messages)
+        self.assertGreater(a.retransmits, 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
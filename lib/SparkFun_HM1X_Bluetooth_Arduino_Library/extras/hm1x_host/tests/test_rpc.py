@@ -0,0 +1,75 @@
+import unittest
+
+from hm1x_host import rpc
+from hm1x_host.rpc import RpcClient
+
+# Requests for add(2, 3), slow(), method 9 and add(7); see test/test_rpc,
+# where the device answers them
+REQUEST_ADD = bytes.fromhex("a5f304fb00010203edb2")
+REQUEST_SLOW = bytes.fromhex("a5f302fd0102909f")
+REQUEST_UNKNOWN = bytes.fromhex("a5f302fd0209a87b")
+REQUEST_BAD_ARGS = bytes.fromhex("a5f303fc0301076775")
+# HM1X_Rpc's answers
+DEVICE_ADD = bytes.fromhex("a5f403fc00000505f7")
+DEVICE_UNKNOWN = bytes.fromhex("a5f402fd0201749d")
+DEVICE_BAD_ARGS = bytes.fromhex("a5f402fd0302269e")
+DEVICE_SLOW = bytes.fromhex("a5f403fc01002ab815")
+
+
+class Clock:
+    def __init__(self):
+        self.now = 0.0
+
+    def __call__(self):
+        return self.now
+
+
+class RpcTest(unittest.TestCase):
+    def setUp(self):
+        self.sent = []
+        self.clock = Clock()
+        self.client = RpcClient(self.sent.append, max_in_flight=4, timeout=1.0, clock=self.clock)
+
+    def start_calls(self):
+        return [self.client.call(1, b"\x02\x03"), self.client.call(2),
+                self.client.call(9), self.client.call(1, b"\x07")]
+
+    def test_requests_match_device_test(self):
+        self.start_calls()
+        self.assertEqual(self.sent, [REQUEST_ADD, REQUEST_SLOW, REQUEST_UNKNOWN, REQUEST_BAD_ARGS])
+
+    def test_device_answers_out_of_order(self):
+        add, slow, unknown, bad_args = self.start_calls()
+        self.assertFalse(self.client.can_call())
+        self.client.feed(DEVICE_ADD + DEVICE_UNKNOWN + DEVICE_BAD_ARGS)
+        self.assertEqual((add.status, add.result), (rpc.OK, b"\x05"))
+        self.assertEqual(unknown.status, rpc.NO_METHOD)
+        self.assertEqual(bad_args.status, rpc.BAD_ARGS)
+        self.assertFalse(slow.done)
+        self.client.feed(DEVICE_SLOW)
+        self.assertEqual((slow.status, slow.result), (rpc.OK, b"\x2a"))
+        self.assertEqual(self.client.pending, {})
+
+    def test_callback_and_stray_answer(self):
+        finished = []
+        self.client.call(1, b"\x02\x03", callback=finished.append)
+        self.client.feed(DEVICE_SLOW)   # No call with id 1: ignored
+        self.client.feed(DEVICE_ADD)
+        self.assertEqual([call.result for call in finished], [b"\x05"])
+
+    def test_timeout(self):
+        call = self.client.call(2)
+        self.clock.now += 1.5
+        self.client.poll()
+        self.assertEqual(call.status, rpc.TIMEOUT)
+        self.client.feed(DEVICE_ADD)   # Too late
+        self.assertEqual(call.status, rpc.TIMEOUT)
+
+    def test_ids_skip_calls_in_flight(self):
+        first = self.client.call(1)
+        for _ in range(255):
+            self.client.pending.pop(self.client.call(1).id)
+        self.assertEqual(self.client.call(1).id, (first.id + 1) & 0xFF)
+
+if __name__ == "__main__":
+    unittest.main()
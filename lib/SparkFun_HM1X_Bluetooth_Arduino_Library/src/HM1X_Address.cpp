@@ -0,0 +1,76 @@
+/*
+  Bluetooth device address as a 6 byte value. See HM1X_Address.h.
+*/
+
+#include "HM1X_Address.h"
+
+static const char hm1xHexDigits[] = "0123456789ABCDEF";
+
+int8_t HM1X_address_t::hexDigit(char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    return -1;
+}
+
+boolean HM1X_address_t::parse(const char * text)
+{
+    for (uint8_t i = 0; i < HM1X_ADDRESS_BYTES * 2; i++)
+    {
+        int8_t digit = hexDigit(text[i]);
+        if (digit < 0)
+        {
+            clear();
+            return false;
+        }
+        if ((i & 1) == 0)
+        {
+            bytes[i / 2] = digit << 4;
+        }
+        else
+        {
+            bytes[i / 2] |= digit;
+        }
+    }
+    return true;
+}
+
+void HM1X_address_t::toString(char * text) const
+{
+    for (uint8_t i = 0; i < HM1X_ADDRESS_BYTES; i++)
+    {
+        *text++ = hm1xHexDigits[bytes[i] >> 4];
+        *text++ = hm1xHexDigits[bytes[i] & 0x0F];
+    }
+    *text = '\0';
+}
+
+size_t HM1X_address_t::printTo(Print & p) const
+{
+    char text[HM1X_ADDRESS_BYTES * 2 + 1];
+
+    toString(text);
+    return p.print(text);
+}
+
+boolean HM1X_address_t::isNull(void) const
+{
+    for (uint8_t i = 0; i < HM1X_ADDRESS_BYTES; i++)
+    {
+        if (bytes[i] != 0) return false;
+    }
+    return true;
+}
+
+// The low bytes (device specific) vary most, so they're mixed in last
+uint16_t HM1X_address_t::hash(void) const
+{
+    uint16_t h = 0;
+
+    for (uint8_t i = 0; i < HM1X_ADDRESS_BYTES; i++)
+    {
+        h = (h << 5) - h + bytes[i];
+    }
+    return h;
+}
@@ -0,0 +1,50 @@
+/*
+  Bluetooth device address as a 6 byte value.
+
+  The module reports addresses as 12 hex digits ("OK+CONB:001122334455").
+  HM1X_address_t holds them parsed, most significant byte first, so
+  comparing two peers is a 6 byte compare rather than a String one, and
+  each stored address costs 6 bytes instead of a String's heap copy.
+  Text is only produced when asked for, with toString() or printTo().
+
+    HM1X_address_t peer;
+    if (bt.lastBleAddress(peer) == HM1X_SUCCESS && peer == known) ...
+
+  The all-zero address means "none" (isNull()).
+*/
+
+#pragma once
+
+#if (ARDUINO >= 100)
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define HM1X_ADDRESS_BYTES 6
+
+struct HM1X_address_t {
+    uint8_t bytes[HM1X_ADDRESS_BYTES];
+
+    // Parse 12 hex digits (either case). On failure the address is cleared
+    // and false returned.
+    boolean parse(const char * text);
+    // Write the 12 digit upper case form plus terminator into text
+    void toString(char * text) const;
+    size_t printTo(Print & p) const;
+
+    void clear(void) { memset(bytes, 0, sizeof(bytes));};
+    boolean isNull(void) const;
+    // Cheap 16 bit hash for tables keyed on address
+    uint16_t hash(void) const;
+
+    // Value of a hex digit (either case), or -1 if c isn't one. Shared by
+    // everything in the library that parses the module's hex replies.
+    static int8_t hexDigit(char c);
+
+    bool operator==(const HM1X_address_t & other) const
+    {
+        return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+    };
+    bool operator!=(const HM1X_address_t & other) const { return !(*this == other);};
+};
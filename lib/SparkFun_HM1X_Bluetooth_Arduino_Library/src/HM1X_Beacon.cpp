@@ -0,0 +1,239 @@
+/*
+  iBeacon observer: AT+DISI? records parsed and summarised on the MCU.
+  See HM1X_Beacon.h.
+*/
+
+#include "HM1X_Beacon.h"
+#include "HM1X_Cbor.h"
+
+// What the module prints during AT+DISI?: 'h' is a hex digit, 'd' a
+// decimal digit or sign. Bit n of _alive is set while template n still
+// matches the line.
+#define HM1X_DISI_START  0
+#define HM1X_DISI_END    1
+#define HM1X_DISI_RECORD 2
+#define HM1X_DISI_TEMPLATES 3
+
+static const char hm1xDisiStart[] PROGMEM = "OK+DISIS";
+static const char hm1xDisiEnd[] PROGMEM = "OK+DISCE";
+static const char hm1xDisiRecord[] PROGMEM =
+    "OK+DISC:hhhhhhhh:hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh:hhhhhhhhhh:hhhhhhhhhhhh:dddd";
+static PGM_P const hm1xDisiTemplates[HM1X_DISI_TEMPLATES] = {
+    hm1xDisiStart, hm1xDisiEnd, hm1xDisiRecord
+};
+
+// Where fields sit in _raw, the record's hex digits as bytes
+#define HM1X_DISI_FACTORY 0
+#define HM1X_DISI_UUID    4
+#define HM1X_DISI_MAJOR   20
+#define HM1X_DISI_MINOR   22
+#define HM1X_DISI_POWER   24
+#define HM1X_DISI_MAC     25
+
+HM1X_BeaconObserver::HM1X_BeaconObserver(HM1X_BT & link, HM1X_beacon_stats_t * storage, uint8_t size)
+{
+    _link = &link;
+    _out = &link;
+    _stats = storage;
+    _size = size;
+    _used = 0;
+    _dropped = 0;
+    _window = HM1X_BEACON_WINDOW;
+    _running = false;
+    _uuidFilter = NULL;
+    _callback = NULL;
+    _pos = 0;
+}
+
+HM1X_error_t HM1X_BeaconObserver::begin(void)
+{
+    _used = 0;
+    _dropped = 0;
+    _pos = 0;
+    _windowStart = millis();
+    _running = true;
+    return _link->startIBeaconDiscovery();
+}
+
+void HM1X_BeaconObserver::poll(void)
+{
+    while (_link->available() > 0)
+    {
+        parse(_link->read());
+    }
+    if (_running && (millis() - _windowStart >= _window) && canSend())
+    {
+        summarise();
+        _windowStart = millis();
+    }
+}
+
+void HM1X_BeaconObserver::parse(char c)
+{
+    if (_pos == 0)
+    {
+        if (c != 'O') return; // Line ends, or something unrecognised
+        _alive = (1 << HM1X_DISI_TEMPLATES) - 1;
+        _nibbles = 0;
+        _rssi = 0;
+    }
+
+    for (uint8_t t = 0; t < HM1X_DISI_TEMPLATES; t++)
+    {
+        if ((_alive & (1 << t)) == 0) continue;
+
+        char p = pgm_read_byte(hm1xDisiTemplates[t] + _pos);
+        boolean match;
+        if (p == 'h')
+        {
+            match = (HM1X_address_t::hexDigit(c) >= 0);
+        }
+        else if (p == 'd')
+        {
+            match = (((c >= '0') && (c <= '9')) || (c == '-'));
+        }
+        else
+        {
+            match = (c == p);
+        }
+        if (!match) _alive &= ~(1 << t);
+    }
+
+    if (_alive == 0)
+    {
+        // Not a line we know: start again, from this character if it could begin one
+        _pos = 0;
+        if (c == 'O') parse(c);
+        return;
+    }
+
+    if (_alive & (1 << HM1X_DISI_RECORD))
+    {
+        int8_t digit = HM1X_address_t::hexDigit(c);
+        char p = pgm_read_byte(hm1xDisiRecord + _pos);
+        if (p == 'h')
+        {
+            if ((_nibbles & 1) == 0)
+            {
+                _raw[_nibbles / 2] = digit << 4;
+            }
+            else
+            {
+                _raw[_nibbles / 2] |= digit;
+            }
+            _nibbles++;
+        }
+        else if ((p == 'd') && (c != '-'))
+        {
+            _rssi = _rssi * 10 - (c - '0'); // RSSI is always negative
+        }
+    }
+    _pos++;
+
+    for (uint8_t t = 0; t < HM1X_DISI_TEMPLATES; t++)
+    {
+        if ((_alive & (1 << t)) && (pgm_read_byte(hm1xDisiTemplates[t] + _pos) == '\0'))
+        {
+            _pos = 0;
+            if (t == HM1X_DISI_RECORD)
+            {
+                record();
+            }
+            else if ((t == HM1X_DISI_END) && _running)
+            {
+                _link->startIBeaconDiscovery();
+            }
+            return;
+        }
+    }
+}
+
+void HM1X_BeaconObserver::record(void)
+{
+    HM1X_ibeacon_t beacon;
+    HM1X_beacon_stats_t * s = NULL;
+
+    // Devices that aren't beacons report a zero factory ID
+    if ((_raw[HM1X_DISI_FACTORY] | _raw[HM1X_DISI_FACTORY + 1] |
+         _raw[HM1X_DISI_FACTORY + 2] | _raw[HM1X_DISI_FACTORY + 3]) == 0)
+    {
+        return;
+    }
+    if ((_uuidFilter != NULL) &&
+        (memcmp(&_raw[HM1X_DISI_UUID], _uuidFilter, HM1X_IBEACON_UUID_LEN) != 0))
+    {
+        return;
+    }
+
+    memcpy(beacon.uuid, &_raw[HM1X_DISI_UUID], HM1X_IBEACON_UUID_LEN);
+    beacon.major = ((uint16_t) _raw[HM1X_DISI_MAJOR] << 8) | _raw[HM1X_DISI_MAJOR + 1];
+    beacon.minor = ((uint16_t) _raw[HM1X_DISI_MINOR] << 8) | _raw[HM1X_DISI_MINOR + 1];
+    beacon.txPower = (int8_t) _raw[HM1X_DISI_POWER];
+    beacon.rssi = _rssi;
+    memcpy(beacon.address.bytes, &_raw[HM1X_DISI_MAC], HM1X_ADDRESS_BYTES);
+
+    if (_callback != NULL)
+    {
+        _callback(beacon);
+    }
+
+    for (uint8_t i = 0; i < _used; i++)
+    {
+        if ((_stats[i].major == beacon.major) && (_stats[i].minor == beacon.minor))
+        {
+            s = &_stats[i];
+            break;
+        }
+    }
+    if (s == NULL)
+    {
+        if (_used == _size)
+        {
+            _dropped++;
+            return;
+        }
+        s = &_stats[_used++];
+        s->major = beacon.major;
+        s->minor = beacon.minor;
+        s->count = 0;
+        s->minRssi = beacon.rssi;
+        s->maxRssi = beacon.rssi;
+        s->rssiSum = 0;
+    }
+    if (s->count < 0xFFFF) s->count++;
+    if (beacon.rssi < s->minRssi) s->minRssi = beacon.rssi;
+    if (beacon.rssi > s->maxRssi) s->maxRssi = beacon.rssi;
+    s->rssiSum += beacon.rssi;
+}
+
+// Anything but the link can always take a summary. The link can only
+// while a connection is known to be up, which needs polling to track.
+boolean HM1X_BeaconObserver::canSend(void)
+{
+    return (_out != _link) || (_link->polling() && _link->connected());
+}
+
+// One CBOR item for the window, then start the next one empty
+void HM1X_BeaconObserver::summarise(void)
+{
+    HM1X_CborWriter cbor(*_out);
+
+    if (_used == 0) return;
+
+    cbor.beginArray(2);
+    cbor.writeUInt(millis() - _windowStart);
+    cbor.beginArray(_used);
+    for (uint8_t i = 0; i < _used; i++)
+    {
+        HM1X_beacon_stats_t * s = &_stats[i];
+        cbor.beginArray(6);
+        cbor.writeUInt(s->major);
+        cbor.writeUInt(s->minor);
+        cbor.writeUInt(s->count);
+        cbor.writeInt(s->minRssi);
+        cbor.writeInt(s->maxRssi);
+        cbor.writeInt(s->rssiSum / (int32_t) s->count);
+    }
+    _out->flush();
+    _used = 0;
+}
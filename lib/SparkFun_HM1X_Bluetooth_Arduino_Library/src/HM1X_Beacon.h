@@ -0,0 +1,107 @@
+/*
+  iBeacon observer: AT+DISI? records parsed and summarised on the MCU.
+
+  In central mode an HM-10 style module reports every advertisement
+  it hears during AT+DISI? as one fixed-width record:
+
+    OK+DISC:4C000215:<UUID, 32 hex>:<major 4><minor 4><power 2>:<MAC, 12 hex>:-052
+
+  HM1X_BeaconObserver reads these from the link a character at a time
+  into a 31 byte scratch record -- no String, no heap -- and restarts
+  the scan each time the module ends one (OK+DISCE).
+
+  Rather than pass every sighting upstream, sightings are counted per
+  beacon (major/minor) over a window and, at the end of each, written
+  out as one CBOR item (see HM1X_Cbor.h):
+
+    [window ms, [[major, minor, count, min RSSI, max RSSI, mean RSSI], ...]]
+
+  setUuidFilter() keeps only one deployment's beacons; non-iBeacon
+  devices (factory ID 00000000) are always skipped. onBeacon() also
+  hands each decoded record to a callback as it arrives.
+*/
+
+#pragma once
+
+#include "SparkFun_HM1X_Bluetooth_Arduino_Library.h"
+
+#define HM1X_IBEACON_UUID_LEN 16
+// Length of the summary window, unless setWindow() says otherwise
+#define HM1X_BEACON_WINDOW 5000
+
+// One decoded OK+DISC record
+typedef struct {
+    uint8_t uuid[HM1X_IBEACON_UUID_LEN];
+    uint16_t major;
+    uint16_t minor;
+    int8_t txPower;    // Measured power at 1 m, dBm
+    int8_t rssi;       // As received, dBm
+    HM1X_address_t address;
+} HM1X_ibeacon_t;
+
+// Sightings of one beacon in the current window
+typedef struct {
+    uint16_t major;
+    uint16_t minor;
+    uint16_t count;
+    int8_t minRssi;
+    int8_t maxRssi;
+    int32_t rssiSum;
+} HM1X_beacon_stats_t;
+
+typedef void (*HM1X_beacon_callback_t)(const HM1X_ibeacon_t & beacon);
+
+class HM1X_BeaconObserver
+{
+public:
+    // Summaries are written to the link unless setOutput() names another Print
+    HM1X_BeaconObserver(HM1X_BT & link, HM1X_beacon_stats_t * storage, uint8_t size);
+
+    // Start scanning (AT+DISI?), and keep restarting until stop()
+    HM1X_error_t begin(void);
+    void stop(void) { _running = false; };
+
+    // Call often: reads records, sends a summary when the window is up.
+    // Summaries to the link wait, and the window stays open, until the
+    // module reports a connection, so the link must be polled
+    // (HM1X_BT::setupPoll()): bytes written without one would be taken
+    // as AT commands.
+    void poll(void);
+
+    void setWindow(uint16_t windowMs) { _window = windowMs; };
+    void setOutput(Print & out) { _out = &out; };
+    // Only count beacons with this UUID (NULL to count all)
+    void setUuidFilter(const uint8_t * uuid) { _uuidFilter = uuid; };
+    void onBeacon(HM1X_beacon_callback_t callback) { _callback = callback; };
+
+    // Records that didn't fit in the table, counted since begin()
+    uint16_t dropped(void) { return _dropped; };
+    // Beacons in the current window
+    uint8_t beacons(void) { return _used; };
+
+private:
+    HM1X_BT * _link;
+    Print * _out;
+    HM1X_beacon_stats_t * _stats;
+    uint8_t _size;
+    uint8_t _used;
+    uint16_t _dropped;
+    uint16_t _window;
+    unsigned long _windowStart;
+    boolean _running;
+    const uint8_t * _uuidFilter;
+    HM1X_beacon_callback_t _callback;
+
+    // Parser: position in the line, templates still matching, hex digits
+    // of the record so far, and its RSSI
+    uint8_t _pos;
+    uint8_t _alive;
+    uint8_t _nibbles;
+    uint8_t _raw[31];
+    int8_t _rssi;
+
+    void parse(char c);
+    void record(void);
+    void summarise(void);
+    boolean canSend(void);
+};
@@ -0,0 +1,161 @@
+/*
+  CBOR (RFC 8949) encoder for telemetry over the HM1X link. See
+  HM1X_Cbor.h.
+*/
+
+#include "HM1X_Cbor.h"
+
+// Major types, pre-shifted into the top three bits
+#define CBOR_UINT   0x00
+#define CBOR_NINT   0x20
+#define CBOR_BYTES  0x40
+#define CBOR_TEXT   0x60
+#define CBOR_ARRAY  0x80
+#define CBOR_MAP    0xA0
+#define CBOR_TAG    0xC0
+#define CBOR_SIMPLE 0xE0
+
+#define CBOR_FALSE      0xF4
+#define CBOR_TRUE       0xF5
+#define CBOR_NULL       0xF6
+#define CBOR_FLOAT32    0xFA
+#define CBOR_BREAK      0xFF
+#define CBOR_INDEFINITE 0x1F
+
+HM1X_CborWriter::HM1X_CborWriter(Print & out)
+{
+    _out = &out;
+    _written = 0;
+}
+
+void HM1X_CborWriter::writeUInt(uint32_t value)
+{
+    writeHead(CBOR_UINT, value);
+}
+
+void HM1X_CborWriter::writeInt(int32_t value)
+{
+    if (value < 0)
+    {
+        writeHead(CBOR_NINT, (uint32_t) (-1 - value));
+    }
+    else
+    {
+        writeHead(CBOR_UINT, (uint32_t) value);
+    }
+}
+
+void HM1X_CborWriter::writeFloat(float value)
+{
+    uint8_t head[5];
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    head[0] = CBOR_FLOAT32;
+    head[1] = bits >> 24;
+    head[2] = bits >> 16;
+    head[3] = bits >> 8;
+    head[4] = bits;
+    _written += _out->write(head, sizeof(head));
+}
+
+void HM1X_CborWriter::writeBool(boolean value)
+{
+    _written += _out->write((uint8_t) (value ? CBOR_TRUE : CBOR_FALSE));
+}
+
+void HM1X_CborWriter::writeNull(void)
+{
+    _written += _out->write((uint8_t) CBOR_NULL);
+}
+
+void HM1X_CborWriter::writeString(const char * str)
+{
+    writeString(str, strlen(str));
+}
+
+void HM1X_CborWriter::writeString(const char * str, size_t length)
+{
+    writeHead(CBOR_TEXT, length);
+    _written += _out->write((const uint8_t *) str, length);
+}
+
+void HM1X_CborWriter::writeString(const __FlashStringHelper * str)
+{
+    PGM_P p = reinterpret_cast<PGM_P>(str);
+    size_t length = strlen_P(p);
+
+    writeHead(CBOR_TEXT, length);
+    for (size_t i = 0; i < length; i++)
+    {
+        _written += _out->write((uint8_t) pgm_read_byte(p + i));
+    }
+}
+
+void HM1X_CborWriter::writeBytes(const uint8_t * data, size_t length)
+{
+    writeHead(CBOR_BYTES, length);
+    _written += _out->write(data, length);
+}
+
+void HM1X_CborWriter::beginArray(uint32_t count)
+{
+    writeHead(CBOR_ARRAY, count);
+}
+
+void HM1X_CborWriter::beginMap(uint32_t count)
+{
+    writeHead(CBOR_MAP, count);
+}
+
+void HM1X_CborWriter::end(void)
+{
+    _written += _out->write((uint8_t) CBOR_BREAK);
+}
+
+void HM1X_CborWriter::writeTag(uint32_t tag)
+{
+    writeHead(CBOR_TAG, tag);
+}
+
+// Initial byte plus the shortest argument that holds value.
+// HM1X_CBOR_INDEFINITE is only meaningful for containers.
+void HM1X_CborWriter::writeHead(uint8_t major, uint32_t value)
+{
+    uint8_t head[5];
+    uint8_t len;
+
+    if ((value == HM1X_CBOR_INDEFINITE) && ((major == CBOR_ARRAY) || (major == CBOR_MAP)))
+    {
+        head[0] = major | CBOR_INDEFINITE;
+        len = 1;
+    }
+    else if (value < 24)
+    {
+        head[0] = major | value;
+        len = 1;
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] = major | 24;
+        head[1] = value;
+        len = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] = major | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        len = 3;
+    }
+    else
+    {
+        head[0] = major | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        len = 5;
+    }
+    _written += _out->write(head, len);
+}
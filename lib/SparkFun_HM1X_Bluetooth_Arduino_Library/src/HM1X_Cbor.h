@@ -0,0 +1,64 @@
+/*
+  CBOR (RFC 8949) encoder for telemetry over the HM1X link.
+
+  HM1X_CborWriter serialises values straight into a Print -- normally the
+  HM1X_BT itself, so with setCoalescing() the bytes land directly in the
+  library's outgoing buffer. There is no intermediate buffer and no heap:
+  each item's header is at most 5 bytes on the stack, and strings are
+  written from where they already are (including F() strings in flash).
+
+  Integers use the shortest CBOR form, so small values cost one byte.
+  Floats are sent as single precision (what AVR's float and double are).
+
+    HM1X_CborWriter cbor(bt);
+    cbor.beginMap(2);
+    cbor.writeString(F("t")); cbor.writeFloat(21.5);
+    cbor.writeString(F("n")); cbor.writeUInt(count);
+
+  Containers of unknown size: beginMap()/beginArray() with no count,
+  then end(). extras/hm1x_host/cbor.py decodes on the host.
+*/
+
+#pragma once
+
+#if (ARDUINO >= 100)
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define HM1X_CBOR_INDEFINITE 0xFFFFFFFF
+
+class HM1X_CborWriter
+{
+public:
+    HM1X_CborWriter(Print & out);
+
+    void writeUInt(uint32_t value);
+    void writeInt(int32_t value);
+    void writeFloat(float value);
+    void writeBool(boolean value);
+    void writeNull(void);
+
+    void writeString(const char * str);
+    void writeString(const char * str, size_t length);
+    void writeString(const __FlashStringHelper * str);
+    void writeBytes(const uint8_t * data, size_t length);
+
+    // count items (map: key/value pairs), or none for an indefinite
+    // length container closed by end()
+    void beginArray(uint32_t count = HM1X_CBOR_INDEFINITE);
+    void beginMap(uint32_t count = HM1X_CBOR_INDEFINITE);
+    void end(void);
+
+    void writeTag(uint32_t tag);
+
+    // Bytes written so far (what the Print accepted)
+    size_t written(void) { return _written; };
+
+private:
+    Print * _out;
+    size_t _written;
+
+    void writeHead(uint8_t major, uint32_t value);
+};
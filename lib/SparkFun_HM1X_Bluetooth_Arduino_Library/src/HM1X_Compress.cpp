@@ -0,0 +1,193 @@
+/*
+  Streaming compression for the HM1X transparent link. See
+  HM1X_Compress.h for the stream format.
+*/
+
+#include "HM1X_Compress.h"
+
+HM1X_Compressor::HM1X_Compressor(Print & link)
+{
+    _link = &link;
+    reset();
+}
+
+void HM1X_Compressor::reset(void)
+{
+    _windowPos = 0;
+    _history = 0;
+    _lookaheadLen = 0;
+    _literalLen = 0;
+}
+
+size_t HM1X_Compressor::write(uint8_t c)
+{
+    _lookahead[_lookaheadLen++] = c;
+    if (_lookaheadLen == HM1X_LZ_LOOKAHEAD)
+    {
+        step();
+    }
+    return 1;
+}
+
+void HM1X_Compressor::flush(void)
+{
+    while (_lookaheadLen > 0)
+    {
+        step();
+    }
+    sendLiterals();
+    _link->flush();
+}
+
+// Encode from the front of the look-ahead: the longest match in the window
+// if it's worth it, otherwise one literal. Greedy, brute force search --
+// a 256 byte window keeps that cheap next to the link's speed.
+void HM1X_Compressor::step(void)
+{
+    uint8_t best = 0;
+    uint16_t bestDistance = 0;
+
+    for (uint16_t d = 1; d <= _history; d++)
+    {
+        if (at(d, 0) != _lookahead[0]) continue;
+
+        uint8_t len = 1;
+        while ((len < _lookaheadLen) && (at(d, len) == _lookahead[len]))
+        {
+            len++;
+        }
+        if (len > best)
+        {
+            best = len;
+            bestDistance = d;
+            if (best == _lookaheadLen) break;
+        }
+    }
+
+    if (best >= HM1X_LZ_MIN_MATCH)
+    {
+        sendLiterals();
+        _link->write((uint8_t) (0x80 + best - HM1X_LZ_MIN_MATCH));
+        _link->write((uint8_t) (bestDistance - 1));
+    }
+    else
+    {
+        best = 1;
+        _literals[_literalLen++] = _lookahead[0];
+        if (_literalLen == HM1X_LZ_LITERAL_BUFFER)
+        {
+            sendLiterals();
+        }
+    }
+
+    for (uint8_t i = 0; i < best; i++)
+    {
+        remember(_lookahead[i]);
+    }
+    _lookaheadLen -= best;
+    memmove(_lookahead, &_lookahead[best], _lookaheadLen);
+}
+
+// Byte i of a match starting `distance` back. Matches may run on into the
+// look-ahead itself, as the decoder copies one byte at a time.
+uint8_t HM1X_Compressor::at(uint16_t distance, uint8_t i)
+{
+    if (i < distance)
+    {
+        return _window[(uint8_t) (_windowPos - distance + i)];
+    }
+    return _lookahead[i - distance];
+}
+
+void HM1X_Compressor::remember(uint8_t c)
+{
+    _window[_windowPos++] = c;
+    if (_history < HM1X_LZ_WINDOW) _history++;
+}
+
+void HM1X_Compressor::sendLiterals(void)
+{
+    if (_literalLen == 0) return;
+
+    _link->write((uint8_t) (_literalLen - 1));
+    _link->write(_literals, _literalLen);
+    _literalLen = 0;
+}
+
+HM1X_Decompressor::HM1X_Decompressor(HM1X_BT & link)
+{
+    _link = &link;
+    reset();
+}
+
+void HM1X_Decompressor::reset(void)
+{
+    _windowPos = 0;
+    _literalsLeft = 0;
+    _matchLeft = 0;
+    _matchLen = 0;
+    _matchFrom = 0;
+    _ready = false;
+}
+
+int HM1X_Decompressor::available(void)
+{
+    if (!_ready)
+    {
+        _ready = decode();
+    }
+    return _ready ? 1 : 0;
+}
+
+int HM1X_Decompressor::read(void)
+{
+    if (!available())
+    {
+        return -1;
+    }
+    _ready = false;
+    return _next;
+}
+
+// Decode the next output byte into _next, reading from the link as needed.
+// Returns false if the link ran dry first; decoding resumes on the next call.
+boolean HM1X_Decompressor::decode(void)
+{
+    while (true)
+    {
+        if (_matchLeft > 0)
+        {
+            _next = _window[_matchFrom++];
+            _window[_windowPos++] = _next;
+            _matchLeft--;
+            return true;
+        }
+        if (_link->available() <= 0)
+        {
+            return false;
+        }
+
+        uint8_t c = (uint8_t) _link->read();
+        if (_literalsLeft > 0)
+        {
+            _next = c;
+            _window[_windowPos++] = c;
+            _literalsLeft--;
+            return true;
+        }
+        if (_matchLen > 0)
+        {
+            _matchFrom = _windowPos - c - 1;
+            _matchLeft = _matchLen;
+            _matchLen = 0;
+        }
+        else if (c < 0x80)
+        {
+            _literalsLeft = c + 1;
+        }
+        else
+        {
+            _matchLen = c - 0x80 + HM1X_LZ_MIN_MATCH;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+  Streaming compression for the HM1X transparent link.
+
+  An LZ77-family coder with a 256 byte window, small enough for the
+  Uno's 2 KB of SRAM. The stream is a sequence of byte-aligned tokens:
+
+    0x00-0x7F  literal run: (token + 1) bytes follow as-is
+    0x80-0xFF  match: copy (token - 0x80 + 3) bytes starting
+               (next byte + 1) bytes back in the output
+
+  HM1X_Compressor is a Print: print()/write() into it and it writes the
+  compressed stream to the link. Data is held back until a match can be
+  judged, so call flush() at message boundaries -- everything written so
+  far is then sent and decodable. HM1X_Decompressor reads the stream back
+  from the link.
+
+  Both ends share history from the start of the stream, so the link under
+  them must not drop bytes (use HM1X_Reliable, or reset() both ends after
+  a reconnect). extras/hm1x_host/compress.py is the host-side codec.
+*/
+
+#pragma once
+
+#include "SparkFun_HM1X_Bluetooth_Arduino_Library.h"
+
+#define HM1X_LZ_WINDOW 256
+#define HM1X_LZ_MIN_MATCH 3
+#define HM1X_LZ_MAX_LITERALS 128
+// Longest match the compressor looks for; also its look-ahead buffer size
+#ifndef HM1X_LZ_LOOKAHEAD
+#define HM1X_LZ_LOOKAHEAD 32
+#endif
+// Literals the compressor holds before sending a run
+#ifndef HM1X_LZ_LITERAL_BUFFER
+#define HM1X_LZ_LITERAL_BUFFER 32
+#endif
+
+class HM1X_Compressor : public Print
+{
+public:
+    HM1X_Compressor(Print & link);
+
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    // Send everything written so far, then flush the link
+    virtual void flush(void);
+
+    // Start a new stream with empty history
+    void reset(void);
+
+private:
+    Print * _link;
+    uint8_t _window[HM1X_LZ_WINDOW];
+    uint8_t _windowPos;  // Next write position in _window
+    uint16_t _history;   // Bytes in _window, up to HM1X_LZ_WINDOW
+    uint8_t _lookahead[HM1X_LZ_LOOKAHEAD];
+    uint8_t _lookaheadLen;
+    uint8_t _literals[HM1X_LZ_LITERAL_BUFFER];
+    uint8_t _literalLen;
+
+    void step(void);
+    uint8_t at(uint16_t distance, uint8_t i);
+    void remember(uint8_t c);
+    void sendLiterals(void);
+};
+
+class HM1X_Decompressor
+{
+public:
+    HM1X_Decompressor(HM1X_BT & link);
+
+    // Decoded bytes ready (0 or 1: decoding is byte at a time)
+    int available(void);
+    // Next decoded byte, or -1 if none is ready
+    int read(void);
+
+    void reset(void);
+
+private:
+    HM1X_BT * _link;
+    uint8_t _window[HM1X_LZ_WINDOW];
+    uint8_t _windowPos;
+    uint8_t _literalsLeft;
+    uint8_t _matchLeft;
+    uint8_t _matchLen;   // Match token waiting for its offset byte
+    uint8_t _matchFrom;  // Window position the match copies from
+    boolean _ready;
+    uint8_t _next;
+
+    boolean decode(void);
+};
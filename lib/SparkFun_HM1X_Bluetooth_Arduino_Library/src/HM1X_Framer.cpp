@@ -0,0 +1,133 @@
+/*
+  Framing layer for the HM1X transparent link. See HM1X_Framer.h for
+  the frame format.
+*/
+
+#include "HM1X_Framer.h"
+
+HM1X_Framer::HM1X_Framer(HM1X_BT & link, uint8_t * storage, uint16_t size)
+{
+    _link = &link;
+    _buffer = storage;
+    _size = size;
+    _fill = 0;
+    _release = 0;
+    _droppedBytes = 0;
+    _crcErrors = 0;
+}
+
+boolean HM1X_Framer::poll(void)
+{
+    if (_release > 0)
+    {
+        discard(_release);
+        _release = 0;
+    }
+
+    while ((_fill < _size) && (_link->available() > 0))
+    {
+        _buffer[_fill++] = _link->read();
+    }
+
+    while (_fill > 0)
+    {
+        // Skip to the next sync byte in one go
+        if (_buffer[0] != HM1X_FRAME_SYNC)
+        {
+            const uint8_t * sync = (const uint8_t *) memchr(_buffer, HM1X_FRAME_SYNC, _fill);
+            uint16_t skip = (sync != NULL) ? (sync - _buffer) : _fill;
+            _droppedBytes += skip;
+            discard(skip);
+            continue;
+        }
+
+        if (_fill < HM1X_FRAME_HEADER_LEN)
+        {
+            return false; // Wait for the header
+        }
+
+        uint16_t frameLen = HM1X_FRAME_OVERHEAD + _buffer[2];
+        if (((uint8_t) ~_buffer[3] != _buffer[2]) || (frameLen > _size))
+        {
+            // Not a real frame (or one we can never hold): resync past this sync byte
+            _droppedBytes++;
+            discard(1);
+            continue;
+        }
+        if (_fill < frameLen)
+        {
+            return false; // Wait for the rest
+        }
+
+        uint16_t crc = _buffer[frameLen - 2] | ((uint16_t) _buffer[frameLen - 1] << 8);
+        if (crc16(&_buffer[1], frameLen - HM1X_FRAME_CRC_LEN - 1) != crc)
+        {
+            _crcErrors++;
+            _droppedBytes++;
+            discard(1);
+            continue;
+        }
+
+        _release = frameLen;
+        return true;
+    }
+    return false;
+}
+
+size_t HM1X_Framer::writeFrame(uint8_t type, const uint8_t * data, uint8_t length)
+{
+    return writeFrame(type, NULL, 0, data, length);
+}
+
+size_t HM1X_Framer::writeFrame(uint8_t type, const uint8_t * prefix, uint8_t prefixLength,
+                               const uint8_t * data, uint8_t length)
+{
+    uint8_t total = prefixLength + length;
+    uint8_t header[HM1X_FRAME_HEADER_LEN] = {HM1X_FRAME_SYNC, type, total, (uint8_t) ~total};
+    uint8_t trailer[HM1X_FRAME_CRC_LEN];
+    uint16_t crc;
+    size_t written = 0;
+
+    if (prefixLength + length > HM1X_FRAME_MAX_PAYLOAD)
+    {
+        return 0;
+    }
+
+    crc = crc16(&header[1], HM1X_FRAME_HEADER_LEN - 1);
+    crc = crc16(prefix, prefixLength, crc);
+    crc = crc16(data, length, crc);
+    trailer[0] = crc & 0xFF;
+    trailer[1] = crc >> 8;
+
+    if (_link->write(header, sizeof(header)) != sizeof(header)) return 0;
+    if (prefixLength > 0) written += _link->write(prefix, prefixLength);
+    if (length > 0) written += _link->write(data, length);
+    if (_link->write(trailer, sizeof(trailer)) != sizeof(trailer)) return 0;
+    return written;
+}
+
+// CRC-16/CCITT-FALSE, bitwise to keep it out of RAM and flash
+uint16_t HM1X_Framer::crc16(const uint8_t * data, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        crc ^= (uint16_t) (*data++) << 8;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Drop count bytes from the front of the buffer
+void HM1X_Framer::discard(uint16_t count)
+{
+    if (count >= _fill)
+    {
+        _fill = 0;
+        return;
+    }
+    memmove(_buffer, &_buffer[count], _fill - count);
+    _fill -= count;
+}
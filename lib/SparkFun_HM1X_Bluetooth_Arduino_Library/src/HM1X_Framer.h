@@ -0,0 +1,94 @@
+/*
+  Framing layer for the HM1X transparent link.
+
+  HM1X_BT::read()/write() carry an unframed byte stream. HM1X_Framer
+  splits it into frames:
+
+    0xA5 | type | length | ~length | payload | CRC-16 (LSB first)
+
+  The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over
+  everything after the sync byte. The inverted length lets a stray 0xA5
+  be rejected at once instead of stalling the decoder while it waits for
+  a bogus length. A bad sync byte, a length check failure or a CRC
+  mismatch drops one byte and the decoder resynchronises on the next
+  0xA5, so garbage on the link costs only the frames it touched.
+
+  Received bytes are decoded in place in caller-provided storage and
+  each frame is handed out by pointer, valid until the next poll().
+  Frame types 0xF0-0xFF are reserved for layers built on the framer.
+
+  The storage is a second buffer rather than a view into HM1X_BT's own
+  receive buffer because that one can't hold a frame: it is at most
+  HM1X_RX_BUFFER_SIZE (255) bytes where a frame can be 261, it is a
+  ring that a frame may wrap around, it is only used while HM1X_BT is
+  polling, and bytes reach it only after notice filtering has ruled
+  out an OK+CONN or similar. Each byte is copied once, as it leaves
+  HM1X_BT; resynchronising moves the rest down with one memmove.
+
+  extras/hm1x_host/framing.py is the matching host-side codec.
+*/
+
+#pragma once
+
+#include "SparkFun_HM1X_Bluetooth_Arduino_Library.h"
+
+#define HM1X_FRAME_SYNC 0xA5
+#define HM1X_FRAME_HEADER_LEN 4 // sync, type, length, ~length
+#define HM1X_FRAME_CRC_LEN 2
+#define HM1X_FRAME_OVERHEAD (HM1X_FRAME_HEADER_LEN + HM1X_FRAME_CRC_LEN)
+#define HM1X_FRAME_MAX_PAYLOAD 255
+
+// First frame type reserved for library layers
+#define HM1X_FRAME_TYPE_RESERVED 0xF0
+#define HM1X_FRAME_TYPE_ARQ_DATA 0xF0 // HM1X_Reliable: seq | payload
+#define HM1X_FRAME_TYPE_ARQ_ACK  0xF1 // HM1X_Reliable: next expected seq
+#define HM1X_FRAME_TYPE_MUX      0xF2 // HM1X_Mux: channel | payload
+#define HM1X_FRAME_TYPE_RPC_REQUEST  0xF3 // HM1X_Rpc: id | method | args
+#define HM1X_FRAME_TYPE_RPC_RESPONSE 0xF4 // HM1X_Rpc: id | status | result
+#define HM1X_FRAME_TYPE_PROBE       0xF5 // HM1X_Probe: seq | t1
+#define HM1X_FRAME_TYPE_PROBE_REPLY 0xF6 // HM1X_Probe: seq | t1 | t2 | t3
+#define HM1X_FRAME_TYPE_ARQ_SYNC     0xF7 // HM1X_Reliable: sender's tx base | rx next
+#define HM1X_FRAME_TYPE_ARQ_SYNC_ACK 0xF8 // HM1X_Reliable: same, answering a SYNC
+
+class HM1X_Framer
+{
+public:
+    // storage holds received bytes while a frame is assembled; it must be
+    // at least HM1X_FRAME_OVERHEAD plus the largest payload expected.
+    HM1X_Framer(HM1X_BT & link, uint8_t * storage, uint16_t size);
+
+    // Pull whatever the link has and look for a frame. Returns true when
+    // one is ready in frameType()/frameData()/frameLength(). The previous
+    // frame's data is released on the next call.
+    boolean poll(void);
+
+    uint8_t frameType(void) { return _buffer[1]; };
+    const uint8_t * frameData(void) { return &_buffer[HM1X_FRAME_HEADER_LEN]; };
+    uint8_t frameLength(void) { return _buffer[2]; };
+
+    // Send one frame. Returns the number of payload bytes written.
+    size_t writeFrame(uint8_t type, const uint8_t * data, uint8_t length);
+    // Same, with the payload in two pieces (e.g. a layer's header and its data)
+    size_t writeFrame(uint8_t type, const uint8_t * prefix, uint8_t prefixLength,
+                      const uint8_t * data, uint8_t length);
+
+    // Bytes skipped while resynchronising, and frames dropped on a bad CRC
+    uint16_t droppedBytes(void) { return _droppedBytes; };
+    uint16_t crcErrors(void) { return _crcErrors; };
+
+    HM1X_BT * link(void) { return _link; };
+
+    static uint16_t crc16(const uint8_t * data, size_t length, uint16_t crc = 0xFFFF);
+
+private:
+    HM1X_BT * _link;
+    uint8_t * _buffer;
+    uint16_t _size;
+    uint16_t _fill;    // Bytes held in _buffer
+    uint16_t _release; // Length of the frame handed out last, freed on the next poll()
+
+    uint16_t _droppedBytes;
+    uint16_t _crcErrors;
+
+    void discard(uint16_t count);
+};
@@ -0,0 +1,186 @@
+/*
+  Logical channels over one HM1X link. See HM1X_Mux.h.
+
+  Each channel queue keeps messages contiguous as
+  length | channel | payload, with length counting the channel byte.
+  A message that won't fit before the end of storage starts again at
+  the front; a zero length byte marks the unused tail.
+*/
+
+#include "HM1X_Mux.h"
+
+HM1X_Mux::HM1X_Mux(HM1X_Framer & framer)
+{
+    _framer = &framer;
+    _next = 0;
+    memset(_channels, 0, sizeof(_channels));
+}
+
+boolean HM1X_Mux::beginChannel(uint8_t channel, uint8_t * storage, uint16_t size,
+                               uint8_t priority, uint8_t weight, HM1X_mux_callback_t onReceive)
+{
+    if (channel >= HM1X_MUX_MAX_CHANNELS)
+    {
+        return false;
+    }
+    channel_t * ch = &_channels[channel];
+    memset(ch, 0, sizeof(channel_t));
+    ch->storage = storage;
+    ch->size = size;
+    ch->priority = priority;
+    ch->weight = (weight > 0) ? weight : 1;
+    ch->onReceive = onReceive;
+    return true;
+}
+
+size_t HM1X_Mux::write(uint8_t channel, const uint8_t * data, uint8_t length)
+{
+    channel_t * ch;
+    uint16_t need = length + 2;
+
+    if ((channel >= HM1X_MUX_MAX_CHANNELS) || (length > HM1X_FRAME_MAX_PAYLOAD - 1))
+    {
+        return 0;
+    }
+    ch = &_channels[channel];
+    if (ch->storage == NULL)
+    {
+        return 0;
+    }
+
+    if (ch->used == 0)
+    {
+        ch->head = 0;
+        ch->tail = 0;
+    }
+    if ((ch->tail > ch->head) || (ch->used == 0))
+    {
+        if (need > ch->size - ch->tail)
+        {
+            // Doesn't fit before the end: wrap if the front has room
+            if (need > ch->head) return 0;
+            if (ch->tail < ch->size) ch->storage[ch->tail] = 0;
+            ch->used += ch->size - ch->tail;
+            ch->tail = 0;
+        }
+    }
+    else if (need > ch->head - ch->tail)
+    {
+        return 0;
+    }
+
+    ch->storage[ch->tail] = length + 1;
+    ch->storage[ch->tail + 1] = channel;
+    if (length > 0) memcpy(&ch->storage[ch->tail + 2], data, length);
+    ch->tail += need;
+    ch->used += need;
+    return length;
+}
+
+uint16_t HM1X_Mux::queued(uint8_t channel)
+{
+    return (channel < HM1X_MUX_MAX_CHANNELS) ? _channels[channel].used : 0;
+}
+
+void HM1X_Mux::service(void)
+{
+    while (_framer->poll())
+    {
+        handleFrame(_framer->frameType(), _framer->frameData(), _framer->frameLength());
+    }
+    transmit();
+}
+
+boolean HM1X_Mux::handleFrame(uint8_t type, const uint8_t * data, uint8_t length)
+{
+    if ((type != HM1X_FRAME_TYPE_MUX) || (length < 1))
+    {
+        return false;
+    }
+    if ((data[0] < HM1X_MUX_MAX_CHANNELS) && (_channels[data[0]].onReceive != NULL))
+    {
+        _channels[data[0]].onReceive(data[0], &data[1], length - 1);
+    }
+    return true;
+}
+
+void HM1X_Mux::transmit(void)
+{
+    uint16_t budget = HM1X_MUX_SERVICE_BUDGET;
+
+    while (budget > 0)
+    {
+        int8_t c = nextChannel();
+        if (c < 0) return; // Nothing queued
+
+        channel_t * ch = &_channels[c];
+        const uint8_t * msg = head(ch);
+        if (!ch->turn)
+        {
+            ch->deficit += (uint16_t) ch->weight * HM1X_MUX_QUANTUM;
+            ch->turn = true;
+        }
+        if (msg[0] > ch->deficit)
+        {
+            // Out of credit this round, next channel's turn
+            ch->turn = false;
+            _next = (c + 1) % HM1X_MUX_MAX_CHANNELS;
+            continue;
+        }
+        if (_framer->link()->availableForWrite() <= 0)
+        {
+            return; // Module is full, pick up here next time
+        }
+
+        _framer->writeFrame(HM1X_FRAME_TYPE_MUX, &msg[1], msg[0]);
+        ch->deficit -= msg[0];
+        budget = (msg[0] < budget) ? (budget - msg[0]) : 0;
+        pop(ch);
+        if (ch->used == 0)
+        {
+            // Idle channels don't bank credit
+            ch->deficit = 0;
+            ch->turn = false;
+            _next = (c + 1) % HM1X_MUX_MAX_CHANNELS;
+        }
+    }
+}
+
+// Start of the oldest queued message, skipping a wrap marker
+const uint8_t * HM1X_Mux::head(channel_t * ch)
+{
+    if ((ch->head >= ch->size) || (ch->storage[ch->head] == 0))
+    {
+        ch->used -= ch->size - ch->head;
+        ch->head = 0;
+    }
+    return &ch->storage[ch->head];
+}
+
+void HM1X_Mux::pop(channel_t * ch)
+{
+    uint16_t len = ch->storage[ch->head] + 1;
+    ch->head += len;
+    ch->used -= len;
+    if ((ch->used > 0) && ((ch->head >= ch->size) || (ch->storage[ch->head] == 0)))
+    {
+        head(ch);
+    }
+}
+
+// Round robin from _next among the highest priority channels with data
+int8_t HM1X_Mux::nextChannel(void)
+{
+    int8_t best = -1;
+
+    for (uint8_t i = 0; i < HM1X_MUX_MAX_CHANNELS; i++)
+    {
+        uint8_t c = (_next + i) % HM1X_MUX_MAX_CHANNELS;
+        if (_channels[c].used == 0) continue;
+        if ((best < 0) || (_channels[c].priority > _channels[best].priority))
+        {
+            best = c;
+        }
+    }
+    return best;
+}
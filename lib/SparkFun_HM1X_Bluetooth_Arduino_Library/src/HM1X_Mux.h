@@ -0,0 +1,80 @@
+/*
+  Logical channels over one HM1X link.
+
+  HM1X_Mux carries numbered channels over HM1X_Framer, one message per
+  frame (type 0xF2: channel | payload), and hands each received message
+  to its channel's callback.
+
+  Outgoing messages wait in a per-channel queue. service() sends them
+  highest priority first; channels that share a priority are served by
+  deficit round robin, each getting weight * HM1X_MUX_QUANTUM bytes per
+  round. A bulk channel can then only hold a more urgent one up for the
+  frame already on the air, and equal channels split the link by weight.
+
+  extras/hm1x_host/mux.py is the host-side end.
+*/
+
+#pragma once
+
+#include "HM1X_Framer.h"
+
+#ifndef HM1X_MUX_MAX_CHANNELS
+#define HM1X_MUX_MAX_CHANNELS 4
+#endif
+
+// Bytes of credit per unit of weight, per round
+#define HM1X_MUX_QUANTUM 20
+// Bytes service() sends per call at most, so callers get control back
+#define HM1X_MUX_SERVICE_BUDGET 64
+
+typedef void (*HM1X_mux_callback_t)(uint8_t channel, const uint8_t * data, uint8_t length);
+
+class HM1X_Mux
+{
+public:
+    HM1X_Mux(HM1X_Framer & framer);
+
+    // Open channel (0 to HM1X_MUX_MAX_CHANNELS - 1). storage queues outgoing
+    // messages (2 bytes of overhead each). Higher priority is served first.
+    boolean beginChannel(uint8_t channel, uint8_t * storage, uint16_t size,
+                         uint8_t priority = 0, uint8_t weight = 1,
+                         HM1X_mux_callback_t onReceive = NULL);
+
+    // Queue one message. Returns length, or 0 if the channel's queue is full.
+    size_t write(uint8_t channel, const uint8_t * data, uint8_t length);
+
+    // Bytes queued on a channel, waiting to be sent
+    uint16_t queued(uint8_t channel);
+
+    // Call often: delivers received messages and sends queued ones.
+    // Frames of other types are dropped.
+    void service(void);
+
+    // For sketches that read the framer themselves: offer a frame, returns
+    // true if it was a mux message (and has been delivered)
+    boolean handleFrame(uint8_t type, const uint8_t * data, uint8_t length);
+    // ...and call this often instead of service(): sends queued messages
+    void transmit(void);
+
+private:
+    typedef struct {
+        uint8_t * storage;
+        uint16_t size;
+        uint16_t head;
+        uint16_t tail;
+        uint16_t used;
+        uint8_t priority;
+        uint8_t weight;
+        uint16_t deficit;
+        boolean turn;      // Quantum for the current round already added
+        HM1X_mux_callback_t onReceive;
+    } channel_t;
+
+    HM1X_Framer * _framer;
+    channel_t _channels[HM1X_MUX_MAX_CHANNELS];
+    uint8_t _next; // Round-robin position
+
+    const uint8_t * head(channel_t * ch);
+    void pop(channel_t * ch);
+    int8_t nextChannel(void);
+};
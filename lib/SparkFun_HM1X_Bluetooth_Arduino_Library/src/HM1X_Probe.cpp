@@ -0,0 +1,164 @@
+/*
+  Round-trip latency probe and clock synchronisation over the HM1X link.
+  See HM1X_Probe.h.
+*/
+
+#include "HM1X_Probe.h"
+
+#define PROBE_LEN 5  // seq, t1
+#define REPLY_LEN 13 // seq, t1, t2, t3
+
+static void putTime(uint8_t * dest, uint32_t t)
+{
+    dest[0] = t;
+    dest[1] = t >> 8;
+    dest[2] = t >> 16;
+    dest[3] = t >> 24;
+}
+
+static uint32_t getTime(const uint8_t * src)
+{
+    return (uint32_t) src[0] | ((uint32_t) src[1] << 8) |
+           ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+HM1X_Probe::HM1X_Probe(HM1X_Framer & framer)
+{
+    _framer = &framer;
+    _interval = 0;
+    _lastProbe = 0;
+    _waiting = false;
+    _seq = 0;
+    _lastRtt = 0;
+    _srtt = 0;
+    _rttVar = 0;
+    _minRtt = 0xFFFFFFFF;
+    _offset = 0;
+    _samples = 0;
+    _lost = 0;
+    _recentPos = 0;
+    for (uint8_t i = 0; i < HM1X_PROBE_SAMPLES; i++)
+    {
+        _recentRtt[i] = 0xFFFFFFFF;
+        _recentOffset[i] = 0;
+    }
+}
+
+boolean HM1X_Probe::probe(void)
+{
+    uint8_t frame[PROBE_LEN];
+
+    if (_waiting)
+    {
+        return false;
+    }
+    _seq++;
+    frame[0] = _seq;
+    putTime(&frame[1], micros());
+    _framer->writeFrame(HM1X_FRAME_TYPE_PROBE, frame, sizeof(frame));
+    _waiting = true;
+    _lastProbe = millis();
+    return true;
+}
+
+void HM1X_Probe::poll(void)
+{
+    while (_framer->poll())
+    {
+        handleFrame(_framer->frameType(), _framer->frameData(), _framer->frameLength());
+    }
+
+    if (_waiting && (millis() - _lastProbe >= HM1X_PROBE_TIMEOUT))
+    {
+        _waiting = false;
+        _lost++;
+    }
+
+    // Background probes only go out when the link has room for them now
+    if ((_interval > 0) && !_waiting && (millis() - _lastProbe >= _interval) &&
+        (_framer->link()->availableForWrite() >= PROBE_LEN + HM1X_FRAME_OVERHEAD))
+    {
+        probe();
+    }
+}
+
+boolean HM1X_Probe::handleFrame(uint8_t type, const uint8_t * data, uint8_t length)
+{
+    uint32_t received = micros();
+
+    if ((type == HM1X_FRAME_TYPE_PROBE) && (length == PROBE_LEN))
+    {
+        reply(data, received);
+        return true;
+    }
+    if ((type == HM1X_FRAME_TYPE_PROBE_REPLY) && (length == REPLY_LEN))
+    {
+        sample(data, received);
+        return true;
+    }
+    return false;
+}
+
+void HM1X_Probe::reply(const uint8_t * data, uint32_t received)
+{
+    uint8_t frame[REPLY_LEN];
+
+    memcpy(frame, data, PROBE_LEN); // seq, t1 echoed back
+    putTime(&frame[5], received);
+    putTime(&frame[9], micros());
+    _framer->writeFrame(HM1X_FRAME_TYPE_PROBE_REPLY, frame, sizeof(frame));
+}
+
+void HM1X_Probe::sample(const uint8_t * data, uint32_t t4)
+{
+    uint32_t t1 = getTime(&data[1]);
+    uint32_t t2 = getTime(&data[5]);
+    uint32_t t3 = getTime(&data[9]);
+    uint32_t rtt;
+    int32_t offset;
+
+    if (!_waiting || (data[0] != _seq))
+    {
+        return; // Late reply to a probe already counted as lost
+    }
+    _waiting = false;
+
+    // A peer that held the probe longer than the whole round trip took
+    // (clocks at different rates, or a bad timestamp) gives no usable RTT
+    if (t3 - t2 > t4 - t1)
+    {
+        _lost++;
+        return;
+    }
+    rtt = (t4 - t1) - (t3 - t2);
+    // ((t2 - t1) + (t3 - t4)) / 2, kept unsigned until the end so the sum
+    // can't overflow
+    offset = (int32_t) ((t2 - t1) - rtt / 2);
+
+    // RFC 6298 smoothing: srtt gains 1/8 of the error, rttvar 1/4
+    if (_samples == 0)
+    {
+        _srtt = rtt;
+        _rttVar = rtt / 2;
+    }
+    else
+    {
+        uint32_t err = (rtt > _srtt) ? (rtt - _srtt) : (_srtt - rtt);
+        _rttVar = _rttVar - (_rttVar >> 2) + (err >> 2);
+        _srtt = _srtt - (_srtt >> 3) + (rtt >> 3);
+    }
+    _lastRtt = rtt;
+    if (rtt < _minRtt) _minRtt = rtt;
+    if (_samples < 0xFFFF) _samples++;
+
+    _recentRtt[_recentPos] = rtt;
+    _recentOffset[_recentPos] = offset;
+    _recentPos = (_recentPos + 1) % HM1X_PROBE_SAMPLES;
+
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < HM1X_PROBE_SAMPLES; i++)
+    {
+        if (_recentRtt[i] < _recentRtt[best]) best = i;
+    }
+    _offset = _recentOffset[best];
+}
@@ -0,0 +1,84 @@
+/*
+  Round-trip latency probe and clock synchronisation over the HM1X link.
+
+  A probe (frame type 0xF5: seq | t1) is answered with a reply (0xF6:
+  seq | t1 | t2 | t3), where t1 is the sender's transmit time, t2 and t3
+  the responder's receive and transmit times. With t4 the time the
+  reply arrives, as in NTP:
+
+    rtt    = (t4 - t1) - (t3 - t2)
+    offset = ((t2 - t1) + (t3 - t4)) / 2      (remote clock - local clock)
+
+  Times are 32-bit microsecond counters (micros() here), compared modulo
+  2^32. The offset reported is the one from the lowest-RTT sample of the
+  last HM1X_PROBE_SAMPLES, which has the least queueing error in it.
+  RTT is smoothed and its jitter tracked as in TCP (RFC 6298).
+  A reply whose turnaround (t3 - t2) exceeds the round trip (t4 - t1)
+  would give a negative RTT; it is dropped and counted as lost.
+
+  Either end can probe; both answer. setInterval() probes in the
+  background, but only while the link has room for the probe in the
+  current connection interval, so user traffic isn't delayed by it.
+  extras/hm1x_host/probe.py is the host-side end.
+*/
+
+#pragma once
+
+#include "HM1X_Framer.h"
+
+#define HM1X_PROBE_SAMPLES 8
+#define HM1X_PROBE_TIMEOUT 2000 // ms before an unanswered probe counts as lost
+
+class HM1X_Probe
+{
+public:
+    HM1X_Probe(HM1X_Framer & framer);
+
+    // Probe every intervalMs from poll() (0 = only when probe() is called)
+    void setInterval(uint16_t intervalMs) { _interval = intervalMs; };
+
+    // Send a probe now. False if one is already waiting for its reply.
+    boolean probe(void);
+
+    // Call often: answers probes, takes replies, sends periodic probes
+    void poll(void);
+
+    // For sketches that read the framer themselves: true if the frame was
+    // a probe or reply (and has been handled)
+    boolean handleFrame(uint8_t type, const uint8_t * data, uint8_t length);
+
+    // Statistics, in microseconds
+    uint32_t lastRtt(void) { return _lastRtt; };
+    uint32_t smoothedRtt(void) { return _srtt; };
+    uint32_t jitter(void) { return _rttVar; };
+    uint32_t minRtt(void) { return _minRtt; };
+    int32_t offset(void) { return _offset; };
+    uint16_t samples(void) { return _samples; };
+    uint16_t lost(void) { return _lost; };
+
+    // A local micros() timestamp on the remote clock
+    uint32_t toRemoteTime(uint32_t localMicros) { return localMicros + _offset; };
+
+private:
+    HM1X_Framer * _framer;
+    uint16_t _interval;
+    unsigned long _lastProbe; // millis() the last probe went out
+    boolean _waiting;
+    uint8_t _seq;
+
+    uint32_t _lastRtt;
+    uint32_t _srtt;
+    uint32_t _rttVar;
+    uint32_t _minRtt;
+    int32_t _offset;
+    uint16_t _samples;
+    uint16_t _lost;
+
+    // Recent samples the offset is picked from
+    uint32_t _recentRtt[HM1X_PROBE_SAMPLES];
+    int32_t _recentOffset[HM1X_PROBE_SAMPLES];
+    uint8_t _recentPos;
+
+    void reply(const uint8_t * data, uint32_t received);
+    void sample(const uint8_t * data, uint32_t received);
+};
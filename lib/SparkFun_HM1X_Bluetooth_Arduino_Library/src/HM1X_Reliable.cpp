@@ -0,0 +1,237 @@
+/*
+  Reliable delivery over the HM1X transparent link. See HM1X_Reliable.h.
+*/
+
+#include "HM1X_Reliable.h"
+
+HM1X_Reliable::HM1X_Reliable(HM1X_Framer & framer, uint8_t * txStorage, uint8_t window, uint8_t maxPayload)
+{
+    _framer = &framer;
+    _txStorage = txStorage;
+    _window = (window > HM1X_ARQ_MAX_WINDOW) ? HM1X_ARQ_MAX_WINDOW : window;
+    if (_window == 0) _window = 1;
+    _maxPayload = (maxPayload > HM1X_FRAME_MAX_PAYLOAD - 1) ? (HM1X_FRAME_MAX_PAYLOAD - 1) : maxPayload;
+    _timeout = HM1X_ARQ_DEFAULT_TIMEOUT;
+    reset();
+}
+
+void HM1X_Reliable::reset(void)
+{
+    _txBase = 0;
+    _txSent = 0;
+    _txNext = 0;
+    _txBaseSlot = 0;
+    _txTimer = 0;
+    _rxNext = 0;
+    _rxData = NULL;
+    _rxLength = 0;
+    _retransmits = 0;
+    _paused = false;
+    _syncing = false;
+}
+
+void HM1X_Reliable::resync(void)
+{
+    reset();
+    _syncing = true;
+    updatePaused();
+    if (!_paused)
+    {
+        sendSync(HM1X_FRAME_TYPE_ARQ_SYNC);
+    }
+}
+
+boolean HM1X_Reliable::poll(void)
+{
+    _rxData = NULL;
+    _rxLength = 0;
+    updatePaused();
+    while (_framer->poll())
+    {
+        handleFrame(_framer->frameType(), _framer->frameData(), _framer->frameLength());
+        if (_rxData != NULL)
+        {
+            return true; // Frame stays valid until the next _framer->poll()
+        }
+    }
+    transmit();
+    return false;
+}
+
+boolean HM1X_Reliable::handleFrame(uint8_t type, const uint8_t * data, uint8_t length)
+{
+    _rxData = NULL;
+    _rxLength = 0;
+
+    if ((type == HM1X_FRAME_TYPE_ARQ_SYNC) && (length == 2))
+    {
+        rebase(data[0], data[1]);
+        if (!_paused) sendSync(HM1X_FRAME_TYPE_ARQ_SYNC_ACK);
+        sendPending();
+        return true;
+    }
+    if ((type == HM1X_FRAME_TYPE_ARQ_SYNC_ACK) && (length == 2))
+    {
+        if (_syncing)
+        {
+            _syncing = false;
+            rebase(data[0], data[1]);
+            sendPending();
+        }
+        return true;
+    }
+    if ((type == HM1X_FRAME_TYPE_ARQ_ACK) && (length == 1))
+    {
+        if (!_syncing) handleAck(data[0]);
+        return true;
+    }
+    if ((type == HM1X_FRAME_TYPE_ARQ_DATA) && (length >= 1))
+    {
+        if (_syncing)
+        {
+            return true; // Numbered from before the peer knew we restarted
+        }
+        boolean inOrder = (data[0] == _rxNext);
+        if (inOrder)
+        {
+            _rxNext++;
+            _rxData = &data[1];
+            _rxLength = length - 1;
+        }
+        // ACK duplicates and out-of-order frames too, so a lost ACK
+        // doesn't leave the sender retransmitting forever
+        if (!_paused) sendAck();
+        return true;
+    }
+    return false;
+}
+
+void HM1X_Reliable::transmit(void)
+{
+    updatePaused();
+    if (!_paused && _syncing)
+    {
+        if (millis() - _txTimer >= _timeout)
+        {
+            _retransmits++;
+            sendSync(HM1X_FRAME_TYPE_ARQ_SYNC);
+        }
+        return;
+    }
+    if (!_paused && (_txSent != _txBase) && (millis() - _txTimer >= _timeout))
+    {
+        // Go back: everything unacknowledged goes out again
+        _retransmits++;
+        _txSent = _txBase;
+    }
+    sendPending();
+}
+
+// Hold everything while the module is disconnected, resend it all after
+void HM1X_Reliable::updatePaused(void)
+{
+    if (linkDown())
+    {
+        _paused = true;
+        _txSent = _txBase;
+    }
+    else
+    {
+        _paused = false;
+    }
+}
+
+size_t HM1X_Reliable::write(const uint8_t * data, uint8_t length)
+{
+    uint8_t * s;
+
+    if ((length > _maxPayload) || !canWrite())
+    {
+        return 0;
+    }
+
+    // Slots hold the frame as sent: length, then seq and payload
+    s = slot(_txNext);
+    s[0] = length + 1;
+    s[1] = _txNext;
+    memcpy(&s[2], data, length);
+    _txNext++;
+
+    sendPending();
+    return length;
+}
+
+uint8_t * HM1X_Reliable::slot(uint8_t seq)
+{
+    uint8_t index = (_txBaseSlot + (uint8_t) (seq - _txBase)) % _window;
+    return &_txStorage[index * (_maxPayload + 2)];
+}
+
+// Send frames queued but not yet on the air, restarting the timer when the
+// oldest one goes out
+void HM1X_Reliable::sendPending(void)
+{
+    if (_paused || _syncing) return;
+
+    while (_txSent != _txNext)
+    {
+        uint8_t * s = slot(_txSent);
+        if (_txSent == _txBase)
+        {
+            _txTimer = millis();
+        }
+        _framer->writeFrame(HM1X_FRAME_TYPE_ARQ_DATA, &s[1], s[0]);
+        _txSent++;
+    }
+}
+
+void HM1X_Reliable::sendAck(void)
+{
+    _framer->writeFrame(HM1X_FRAME_TYPE_ARQ_ACK, &_rxNext, 1);
+}
+
+// Cumulative ACK: the peer has everything before `next`
+void HM1X_Reliable::handleAck(uint8_t next)
+{
+    uint8_t acked = next - _txBase;
+
+    if ((acked == 0) || (acked > (uint8_t) (_txSent - _txBase)))
+    {
+        return; // Duplicate, or for frames we haven't sent
+    }
+    _txBase = next;
+    _txBaseSlot = (_txBaseSlot + acked) % _window;
+    _txTimer = millis(); // Oldest in-flight frame gets a fresh timeout
+}
+
+// Our sequence numbers, so the peer can pick up from them
+void HM1X_Reliable::sendSync(uint8_t type)
+{
+    uint8_t sync[2] = {_txBase, _rxNext};
+
+    _framer->writeFrame(type, sync, sizeof(sync));
+    _txTimer = millis();
+}
+
+// The peer's stream starts again at peerTxBase, and it expects ours from
+// peerRxNext: renumber everything not yet acknowledged from there and send
+// it all again
+void HM1X_Reliable::rebase(uint8_t peerTxBase, uint8_t peerRxNext)
+{
+    uint8_t count = _txNext - _txBase;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        slot(_txBase + i)[1] = peerRxNext + i;
+    }
+    _txBase = peerRxNext;
+    _txSent = _txBase;
+    _txNext = _txBase + count;
+    _rxNext = peerTxBase;
+}
+
+boolean HM1X_Reliable::linkDown(void)
+{
+    HM1X_BT * link = _framer->link();
+    return link->polling() && !link->connected();
+}
@@ -0,0 +1,112 @@
+/*
+  Reliable delivery over the HM1X transparent link.
+
+  HM1X_Reliable runs a sliding-window (Go-Back-N) ARQ on top of
+  HM1X_Framer. Each data frame carries an 8-bit sequence number; the
+  receiver accepts frames only in order and acknowledges cumulatively
+  with the next sequence number it expects. Up to `window` frames may
+  be in flight, so the link stays full rather than waiting on every
+  ACK. If the oldest frame isn't acknowledged within the retransmit
+  timeout, everything outstanding is sent again.
+
+  When the module reports a disconnect (HM1X_BT::poll(), after
+  setupPoll()) sending pauses -- bytes written in that state would be
+  taken as AT commands -- and everything outstanding is resent once
+  the link is back. Data is delivered exactly once and in order.
+
+  An end that restarts mid-stream calls resync(): it sends a SYNC frame
+  carrying its sequence numbers (both 0 after a restart) and holds its
+  data until the peer answers with SYNC_ACK. The peer re-bases on a
+  SYNC -- it expects the restarted end's stream from the sequence number
+  given, and renumbers and resends whatever it had not had acknowledged
+  from the number the restarted end now expects -- so neither side waits
+  forever on a sequence number the other has forgotten. Data frames
+  that arrive before the SYNC_ACK are dropped unacknowledged, and the
+  SYNC is resent on the retransmit timeout until it is answered.
+
+  extras/hm1x_host/reliable.py is the host-side end of the link.
+*/
+
+#pragma once
+
+#include "HM1X_Framer.h"
+
+// Largest window: sequence numbers must stay unambiguous modulo 256
+#define HM1X_ARQ_MAX_WINDOW 127
+#define HM1X_ARQ_DEFAULT_TIMEOUT 500
+
+// Bytes of storage needed to hold `window` frames of `maxPayload` bytes
+#define HM1X_ARQ_STORAGE_SIZE(window, maxPayload) ((window) * ((maxPayload) + 2))
+
+class HM1X_Reliable
+{
+public:
+    // txStorage holds unacknowledged frames until their ACK arrives, and
+    // must be HM1X_ARQ_STORAGE_SIZE(window, maxPayload) bytes.
+    HM1X_Reliable(HM1X_Framer & framer, uint8_t * txStorage, uint8_t window, uint8_t maxPayload);
+
+    // Call often: receives frames, sends ACKs and retransmits. Returns true
+    // when the next in-order payload is ready in data()/length(), valid
+    // until the next poll(). Frames of other types are dropped.
+    boolean poll(void);
+
+    // For sketches that read the framer themselves: offer a frame, returns
+    // true if it was an ARQ frame (and has been handled). An in-order
+    // payload is then in data()/length(); data() is NULL otherwise.
+    boolean handleFrame(uint8_t type, const uint8_t * data, uint8_t length);
+    // ...and call this often instead of poll(): retransmits and sends
+    void transmit(void);
+
+    const uint8_t * data(void) { return _rxData; };
+    uint8_t length(void) { return _rxLength; };
+
+    // Queue length bytes (at most maxPayload) for delivery. Returns length,
+    // or 0 if the window is full -- poll() and try again.
+    size_t write(const uint8_t * data, uint8_t length);
+    boolean canWrite(void) { return pending() < _window; };
+
+    // Frames written but not yet acknowledged
+    uint8_t pending(void) { return (uint8_t) (_txNext - _txBase); };
+
+    void setRetransmitTimeout(uint16_t ms) { _timeout = ms; };
+    uint16_t retransmits(void) { return _retransmits; };
+
+    // Forget all state, on this end only
+    void reset(void);
+    // Forget all state and bring the peer along, e.g. on restarting
+    // while the peer kept running. Writes are held until the peer answers.
+    void resync(void);
+    boolean syncing(void) { return _syncing; };
+
+private:
+    HM1X_Framer * _framer;
+    uint8_t * _txStorage;
+    uint8_t _window;
+    uint8_t _maxPayload;
+
+    // Sequence numbers: [_txBase, _txSent) are in flight,
+    // [_txSent, _txNext) are queued and not sent yet
+    uint8_t _txBase;
+    uint8_t _txSent;
+    uint8_t _txNext;
+    uint8_t _txBaseSlot;    // Storage slot holding _txBase
+    unsigned long _txTimer; // When the oldest in-flight frame was (re)sent
+
+    uint8_t _rxNext;
+    const uint8_t * _rxData;
+    uint8_t _rxLength;
+
+    uint16_t _timeout;
+    uint16_t _retransmits;
+    boolean _paused;
+    boolean _syncing;
+
+    uint8_t * slot(uint8_t seq);
+    void sendPending(void);
+    void sendAck(void);
+    void handleAck(uint8_t next);
+    void sendSync(uint8_t type);
+    void rebase(uint8_t peerTxBase, uint8_t peerRxNext);
+    boolean linkDown(void);
+    void updatePaused(void);
+};
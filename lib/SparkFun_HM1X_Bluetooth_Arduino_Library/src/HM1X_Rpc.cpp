@@ -0,0 +1,76 @@
+/*
+  Binary RPC over the HM1X link. See HM1X_Rpc.h.
+*/
+
+#include "HM1X_Rpc.h"
+
+HM1X_Rpc::HM1X_Rpc(HM1X_Framer & framer)
+{
+    _framer = &framer;
+    for (uint8_t i = 0; i < HM1X_RPC_MAX_HANDLERS; i++)
+    {
+        _handlers[i] = NULL;
+    }
+}
+
+boolean HM1X_Rpc::on(uint8_t method, HM1X_rpc_handler_t handler)
+{
+    int8_t free = -1;
+
+    for (uint8_t i = 0; i < HM1X_RPC_MAX_HANDLERS; i++)
+    {
+        if ((_handlers[i] != NULL) && (_methods[i] == method))
+        {
+            _handlers[i] = handler; // Replace, or remove with NULL
+            return true;
+        }
+        if ((_handlers[i] == NULL) && (free < 0))
+        {
+            free = i;
+        }
+    }
+    if (handler == NULL)
+    {
+        return true;
+    }
+    if (free < 0)
+    {
+        return false; // Table full
+    }
+    _methods[free] = method;
+    _handlers[free] = handler;
+    return true;
+}
+
+size_t HM1X_Rpc::respond(uint8_t id, HM1X_rpc_status_t status, const uint8_t * result, uint8_t length)
+{
+    uint8_t head[2] = {id, (uint8_t) status};
+
+    return _framer->writeFrame(HM1X_FRAME_TYPE_RPC_RESPONSE, head, sizeof(head), result, length);
+}
+
+void HM1X_Rpc::poll(void)
+{
+    while (_framer->poll())
+    {
+        handleFrame(_framer->frameType(), _framer->frameData(), _framer->frameLength());
+    }
+}
+
+boolean HM1X_Rpc::handleFrame(uint8_t type, const uint8_t * data, uint8_t length)
+{
+    if ((type != HM1X_FRAME_TYPE_RPC_REQUEST) || (length < 2))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < HM1X_RPC_MAX_HANDLERS; i++)
+    {
+        if ((_handlers[i] != NULL) && (_methods[i] == data[1]))
+        {
+            _handlers[i](*this, data[0], &data[2], length - 2);
+            return true;
+        }
+    }
+    respond(data[0], HM1X_RPC_NO_METHOD);
+    return true;
+}
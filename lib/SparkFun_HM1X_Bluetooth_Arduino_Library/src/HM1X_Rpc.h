@@ -0,0 +1,61 @@
+/*
+  Binary RPC over the HM1X link.
+
+  The host sends requests (frame type 0xF3: id | method | args) and the
+  device answers each with a response (0xF4: id | status | result).
+  Requests carry an 8-bit id chosen by the caller, so the host can keep
+  many calls in flight and match the answers as they come back, in any
+  order -- throughput is then set by bandwidth, not round trips.
+
+  On the device, register a handler per method number with on(). A
+  handler answers with respond(), either before it returns or later
+  (e.g. once a measurement completes); requests for methods with no
+  handler get HM1X_RPC_NO_METHOD.
+
+  extras/hm1x_host/rpc.py is the host-side client.
+*/
+
+#pragma once
+
+#include "HM1X_Framer.h"
+
+#ifndef HM1X_RPC_MAX_HANDLERS
+#define HM1X_RPC_MAX_HANDLERS 8
+#endif
+
+typedef enum {
+    HM1X_RPC_OK = 0,
+    HM1X_RPC_NO_METHOD,
+    HM1X_RPC_BAD_ARGS,
+    HM1X_RPC_FAILED
+} HM1X_rpc_status_t;
+
+class HM1X_Rpc;
+
+// args is valid only until the handler returns
+typedef void (*HM1X_rpc_handler_t)(HM1X_Rpc & rpc, uint8_t id, const uint8_t * args, uint8_t length);
+
+class HM1X_Rpc
+{
+public:
+    HM1X_Rpc(HM1X_Framer & framer);
+
+    // Register (or with NULL, remove) the handler for a method
+    boolean on(uint8_t method, HM1X_rpc_handler_t handler);
+
+    // Answer request id
+    size_t respond(uint8_t id, HM1X_rpc_status_t status,
+                   const uint8_t * result = NULL, uint8_t length = 0);
+
+    // Call often: reads frames and runs handlers
+    void poll(void);
+
+    // For sketches that read the framer themselves: offer a frame, returns
+    // true if it was an RPC request (and has been handled)
+    boolean handleFrame(uint8_t type, const uint8_t * data, uint8_t length);
+
+private:
+    HM1X_Framer * _framer;
+    uint8_t _methods[HM1X_RPC_MAX_HANDLERS];
+    HM1X_rpc_handler_t _handlers[HM1X_RPC_MAX_HANDLERS];
+};
@@ -0,0 +1,132 @@
+/*
+  Peers seen by BLE discovery, one entry per address. See
+  HM1X_ScanCache.h.
+*/
+
+#include "HM1X_ScanCache.h"
+
+HM1X_ScanCache::HM1X_ScanCache(HM1X_scan_entry_t * storage, uint8_t capacity)
+{
+    _entries = storage;
+    _capacity = capacity;
+    _evictions = 0;
+    clear();
+}
+
+void HM1X_ScanCache::clear(void)
+{
+    memset(_entries, 0, (size_t) _capacity * sizeof(HM1X_scan_entry_t));
+    _count = 0;
+}
+
+uint8_t HM1X_ScanCache::probeLength(void)
+{
+    return (_capacity < HM1X_SCAN_MAX_PROBE) ? _capacity : HM1X_SCAN_MAX_PROBE;
+}
+
+// Probing doesn't stop at an empty slot: expire() leaves holes, and the
+// whole (short) probe range is checked instead of tracking them.
+HM1X_scan_entry_t * HM1X_ScanCache::find(const HM1X_address_t & address)
+{
+    uint8_t slot;
+
+    if (_capacity == 0) return NULL;
+
+    slot = address.hash() % _capacity;
+    for (uint8_t i = probeLength(); i > 0; i--)
+    {
+        HM1X_scan_entry_t * e = &_entries[slot];
+        if ((e->sightings > 0) && (e->address == address))
+        {
+            return e;
+        }
+        slot = (slot + 1 < _capacity) ? slot + 1 : 0;
+    }
+    return NULL;
+}
+
+HM1X_scan_entry_t * HM1X_ScanCache::sighting(const HM1X_address_t & address, int8_t rssi)
+{
+    HM1X_scan_entry_t * e = find(address);
+    unsigned long now = millis();
+
+    if (e == NULL)
+    {
+        if (_capacity == 0) return NULL;
+
+        // An empty slot in the probe range, else the stalest peer there
+        uint8_t slot = address.hash() % _capacity;
+        for (uint8_t i = probeLength(); i > 0; i--)
+        {
+            HM1X_scan_entry_t * candidate = &_entries[slot];
+            if (candidate->sightings == 0)
+            {
+                e = candidate;
+                break;
+            }
+            if ((e == NULL) || (now - candidate->lastSeen > now - e->lastSeen))
+            {
+                e = candidate;
+            }
+            slot = (slot + 1 < _capacity) ? slot + 1 : 0;
+        }
+        if (e->sightings > 0)
+        {
+            _evictions++;
+        }
+        else
+        {
+            _count++;
+        }
+        e->address = address;
+        e->rssiAvg = 0;
+        e->sightings = 0;
+    }
+
+    e->lastSeen = now;
+    if (e->sightings < 0xFFFF) e->sightings++;
+    addRssi(e, rssi);
+    return e;
+}
+
+void HM1X_ScanCache::addRssi(HM1X_scan_entry_t * entry, int8_t rssi)
+{
+    int16_t sample = (int16_t) rssi * 16;
+
+    if ((entry == NULL) || (rssi == 0)) return;
+
+    if (entry->rssiAvg == 0)
+    {
+        entry->rssiAvg = sample;
+    }
+    else
+    {
+        entry->rssiAvg += (sample - entry->rssiAvg) / (1 << HM1X_SCAN_RSSI_SHIFT);
+    }
+}
+
+uint8_t HM1X_ScanCache::expire(unsigned long maxAge)
+{
+    unsigned long now = millis();
+    uint8_t dropped = 0;
+
+    for (uint8_t i = 0; i < _capacity; i++)
+    {
+        if ((_entries[i].sightings > 0) && (now - _entries[i].lastSeen > maxAge))
+        {
+            _entries[i].sightings = 0;
+            dropped++;
+        }
+    }
+    _count -= dropped;
+    return dropped;
+}
+
+HM1X_scan_entry_t * HM1X_ScanCache::entry(uint8_t slot)
+{
+    if ((slot >= _capacity) || (_entries[slot].sightings == 0))
+    {
+        return NULL;
+    }
+    return &_entries[slot];
+}
@@ -0,0 +1,76 @@
+/*
+  Peers seen by BLE discovery, one entry per address.
+
+  A scan reports the same devices over and over. HM1X_ScanCache keeps
+  one entry per address in caller-provided storage: when it was last
+  seen, how many times, and its RSSI smoothed with an exponentially
+  weighted moving average (each sample moves it 1/2^HM1X_SCAN_RSSI_SHIFT
+  of the way).
+
+  It is an open addressing hash table keyed on HM1X_address_t::hash().
+  Probing is capped at HM1X_SCAN_MAX_PROBE slots, so a lookup or update
+  costs the same however full the table is. A new peer takes an empty
+  slot in its probe range, or else evicts the least recently seen peer
+  there.
+
+    HM1X_scan_entry_t peers[32];
+    HM1X_ScanCache cache(peers, 32);
+    bt.setScanCache(&cache);
+    bt.startDiscovery(NULL, 0, onScanDone);
+*/
+
+#pragma once
+
+#include "HM1X_Address.h"
+
+// Slots looked at for each address
+#ifndef HM1X_SCAN_MAX_PROBE
+#define HM1X_SCAN_MAX_PROBE 8
+#endif
+// RSSI smoothing: each sample moves the average 1/2^shift of the way
+#ifndef HM1X_SCAN_RSSI_SHIFT
+#define HM1X_SCAN_RSSI_SHIFT 2
+#endif
+
+struct HM1X_scan_entry_t {
+    HM1X_address_t address;
+    unsigned long lastSeen;  // millis() of the latest sighting
+    int16_t rssiAvg;         // Smoothed RSSI in 1/16 dBm, 0 before the first sample
+    uint16_t sightings;      // 0 marks an empty slot
+
+    int8_t rssi(void) const { return rssiAvg / 16;};
+};
+
+class HM1X_ScanCache
+{
+public:
+    HM1X_ScanCache(HM1X_scan_entry_t * storage, uint8_t capacity);
+
+    // Count a sighting of address, adding it if new. rssi in dBm, or 0 if
+    // not reported. Returns the peer's entry.
+    HM1X_scan_entry_t * sighting(const HM1X_address_t & address, int8_t rssi = 0);
+    // Fold an RSSI sample into a peer's average
+    void addRssi(HM1X_scan_entry_t * entry, int8_t rssi);
+
+    // The peer's entry, or NULL if it isn't cached
+    HM1X_scan_entry_t * find(const HM1X_address_t & address);
+
+    // Drop peers not seen for maxAge ms. Returns how many went.
+    uint8_t expire(unsigned long maxAge);
+    void clear(void);
+
+    // Entries are iterated by slot: entry() is NULL for an empty one
+    uint8_t capacity(void) { return _capacity;};
+    HM1X_scan_entry_t * entry(uint8_t slot);
+    uint8_t count(void) { return _count;};
+    // Peers pushed out by newer ones
+    uint16_t evictions(void) { return _evictions;};
+
+private:
+    HM1X_scan_entry_t * _entries;
+    uint8_t _capacity;
+    uint8_t _count;
+    uint16_t _evictions;
+
+    uint8_t probeLength(void);
+};
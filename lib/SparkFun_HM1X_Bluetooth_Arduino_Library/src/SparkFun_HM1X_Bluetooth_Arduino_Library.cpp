@@ -30,84 +30,65 @@
 */
 
 #include <SparkFun_HM1X_Bluetooth_Arduino_Library.h>
+#include "HM1X_ScanCache.h"
+#ifdef ARDUINO_ARCH_AVR
+#include <avr/sleep.h>
+#endif
+#ifdef HM1X_EEPROM_ENABLED
+#include <EEPROM.h>
+#endif
 
 #define CHECK_HM1X_CONNECTION_ON_BEGIN
 
 const int HM1X_DEFAULT_TIMEOUT = 1000;
 const int HM1X_RESPONSE_TIMEOUT = 100;
-const int HM1X_POLL_DELAY = 10;
+// Longest we wait for the module to re-assert CTS before giving up on a write
+const int HM1X_FLOW_CONTROL_TIMEOUT = 1000;
+// Longest a module takes to come back after AT+RESET
+const int HM1X_RESET_TIMEOUT = 5000;
+// Silence after which a discovery is taken as finished, if OK+DISCE was lost
+const unsigned long HM1X_DISCOVERY_TIMEOUT = 15000;
+// Longest a connect attempt may take before it counts as failed
+const int HM1X_RECONNECT_TIMEOUT = 3000;
+// Wait before the first retry; it doubles after each one, up to the maximum
+const uint16_t HM1X_RECONNECT_BACKOFF_MIN = 100;
+const uint16_t HM1X_RECONNECT_BACKOFF_MAX = 2000;
+// The module tells commands apart by the pause after each, so a
+// fire-and-forget set goes out this long after the one before it, unless
+// that one's reply has come already
+const int HM1X_COMMAND_GAP = 20;
+// Longest a blocking command waits for earlier fire-and-forget replies. Each
+// times out on its own after HM1X_DEFAULT_TIMEOUT, so this only trips if
+// callbacks keep queueing more, or the receive buffer is full.
+const int HM1X_REPLY_WAIT_TIMEOUT = 2000;
+// Once a reply has started, this much silence on the line ends it.
+// Only used for replies whose length isn't known up front (names, version).
+const int HM1X_RESPONSE_GAP = 10;
+// A sleeping module wakes on a string longer than 80 characters
+const uint8_t HM1X_WAKE_LENGTH = 81;
+const char HM1X_WAKE_CHAR = 'W';
+const int HM1X_WAKE_TIMEOUT = 1000;
+// Transmit pacing, once turned on: a 20 byte BLE payload (23 byte ATT MTU),
+// up to 4 packets per connection interval (HM1X_TX_INTERVAL)
+const uint8_t HM1X_TX_PACKET_SIZE = 20;
+const uint8_t HM1X_TX_PACKETS_PER_INTERVAL = 4;
+// ATT header bytes taken out of each MTU
+const uint8_t HM1X_ATT_HEADER_LEN = 3;
 
 const char HM1X_COMMAND_AT[] = "AT";
-const char HM1X_COMMAND_RESET[] = "RESET";
-const char HM1X_COMMAND_FACTORY_DEFAULTS[] = "RENEW";
-const char HM1X_COMMAND_VERSION[] = "VERR";
-const char HM1X_COMMAND_INIT_NOTIFY[] = "INIT";
-const char HM1X_COMMAND_NOTIFY_INIT[] = "NOTI";
-const char HM1X_COMMAND_NOTIFY_MODE[] = "NOTP";
-const char HM1X_COMMAND_EDR_NAME[] = "NAME";
-const char HM1X_COMMAND_BLE_NAME[] = "NAMB";
-const char HM1X_COMMAND_EDR_ADR[] = "ADDE";
-const char HM1X_COMMAND_BLE_ADR[] = "ADDB";
-const char HM1X_COMMAND_BLE_ADR_SINGLE[] = "ADDR";
-const char HM1X_COMMAND_LAST_EDR[] = "RADE";
-const char HM1X_COMMAND_LAST_BLE[] = "RADB";
-const char HM1X_COMMAND_LAST_SINGLE[] = "RADD";
-const char HM1X_COMMAND_CLEAR_BOND_EDR[] = "BONDE";
-const char HM1X_COMMAND_CLEAR_BOND_BLE[] = "BONDB";
-const char HM1X_COMMAND_CLEAR_ADR_EDR[] = "CLEAE";
-const char HM1X_COMMAND_CLEAR_ADR_BLE[] = "CLEAB";
-const char HM1X_COMMAND_CLEAR_ADR_SINGLE[] = "CLEAR";
-const char HM1X_COMMAND_EDR_MODE[] = "ROLE";
-const char HM1X_COMMAND_BLE_MODE[] = "ROLB";
-const char HM1X_COMMAND_HIGH_SPEED_SPP[] = "HIGH";
-const char HM1X_COMMAND_DUAL_WORK_MODE[] = "DUAL";
-const char HM1X_COMMAND_MODULE_WORK_MODE[] = "MODE";
-const char HM1X_COMMAND_A_TO_B_MODE[] = "ATOB";
-const char HM1X_COMMAND_AUTHENTICATION_MODE[] = "AUTH";
-const char HM1X_COMMAND_EDR_PIN_CODE[] = "PINE";
-const char HM1X_COMMAND_BLE_PIN_CODE[] = "PINB";
-const char HM1X_COMMAND_PIN_CODE_SINGLE[] = "PASS";
-const char HM1X_COMMAND_COD[] = "COFD";
-const char HM1X_COMMAND_UPDATE_CON_PARAM[] = "COUP";
-const char HM1X_COMMAND_IBEACON_SWITCH[] = "IBEA";
-const char HM1X_COMMAND_IBEACON_UUID[] = "IBE";
-const char HM1X_COMMAND_IBEACON_MAJOR[] = "MAJO";
-const char HM1X_COMMAND_IBEACON_MINOR[] = "MINO";
-const char HM1X_COMMAND_IBEACON_POWER[] = "MEAS";
-const char HM1X_COMMAND_MTU_SIZE[] = "MTUS";
-const char HM1X_COMMAND_ADVERT_TYPE[] = "SCAN";
-const char HM1X_COMMAND_SAFE_MODE[] = "SAFE";
-const char HM1X_COMMAND_BLE_MAC[] = "ONEM";
-const char HM1X_COMMAND_SYSTEM_KEY[] = "PIO0";
-const char HM1X_COMMAND_SYSTEM_LED[] = "PIO1";
-const char HM1X_COMMAND_PIO_STATUS[] = "PIO";
-const char HM1X_COMMAND_BLE_WORK_METHOD[] = "RESP";
-const char HM1X_COMMAND_EDR_WORK_TYPE[] = "IMME";
-const char HM1X_COMMAND_BLE_WORK_TYPE[] = "IMMB";
-const char HM1X_COMMAND_START_EDR_WORK[] = "STARE";
-const char HM1X_COMMAND_START_BLE_WORK[] = "STARB";
-const char HM1X_COMMAND_STOP_EDR_WORK[] = "STOPE";
-const char HM1X_COMMAND_STOP_BLE_WORK[] = "STOPB";
-const char HM1X_COMMAND_BAUD[] = "BAUD";
-const char HM1X_COMMAND_FLOW_CONTROL[] ="FIOW";
-const char HM1X_COMMAND_STOP_BITS[] = "STOP";
-const char HM1X_COMMAND_PARITY_BIT[] = "PARI";
+const char HM1X_COMMAND_PREFIX[] = "AT+";
 
 const char HM1X_RESPONSE_OK[] = "OK";
-const char HM1X_RESPONSE_GET[] = "+Get:";
-const char HM1X_RESPONSE_SET[] = "+Set:";
-
-const char HM1X_OK_CONN_EDR[] = "OK+CONE:";
-const char HM1X_OK_CONN_BLE[] = "OK+CONB:";
-const char HM1X_OK_DISCON_EDR[] = "OK+LSTE";
-const char HM1X_OK_DISCON_BLE[] = "OK+LSTB";
-
+const char HM1X_RESPONSE_ER[] = "ER";
 const char HM1X_RESPONSE_PLUS[] = "+";
 const char HM1X_QUERY_STRING[] = "?";
 
-const char HM1X_DISCONNECT_RESPONSE_LEN = 20;
-const uint8_t HM1X_CONNECT_LENGTH = 20;
-const uint8_t HM1X_DISCONNECT_LENGTH = 21;
+const char HM1X_NOTICE_PREFIX[] = "OK+";
+
+// Longest command or reply the engine handles: "OK+Set:" plus a 28 character name
+const uint8_t HM1X_MAX_COMMAND_LEN = 40;
+// Marks a reply whose value length isn't known in advance
+const uint8_t HM1X_LENGTH_UNKNOWN = 0xFF;
 
 #ifdef HM1X_I2C_ENABLED
 typedef enum {
@@ -121,7 +102,8 @@ typedef enum {
 
 static const long btBauds[HM1X_BT::NUM_HM1X_BAUDS] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400};
 
-// These are arrays that maps the required baudChar for each desired baud rate declared in the enum HM1X_baud_t
+// These arrays map each model's baudChar (the array index, as sent in AT+BAUD<baudChar>)
+// to the baud rate it selects, declared in the enum HM1X_baud_t
 static const uint8_t btBauds_HM10_11[HM1X_BT::NUM_HM1X_BAUDS] =        {3, 4, 5, 6, 7, 2, 1, 0, 8};
 static const uint8_t btBauds_HM16_17_18_19[HM1X_BT::NUM_HM1X_BAUDS] =  {0, 1, 2, 3, 4, 5, 6, 7, 8};
 static const uint8_t btBauds_HM12_13[HM1X_BT::NUM_HM1X_BAUDS] =        {0, 2, 3, 4, 5, 6, 7, 8, 0};
@@ -130,23 +112,251 @@ static const uint8_t btBauds_validRange_HM10_11[2] =        {0, 8};
 static const uint8_t btBauds_validRange_HM16_17_18_19[2] =  {0, 8};
 static const uint8_t btBauds_validRange_HM12_13[2] =        {1, 7};
 
+////////////////////////
+// AT command table   //
+////////////////////////
+
+// How a command's argument/value is written on the wire
+typedef enum {
+    HM1X_FORMAT_NONE,   // Action only, e.g. AT+RESET -> OK+RESET
+    HM1X_FORMAT_HEX,    // Exactly `width` upper-case hex digits, e.g. AT+MAJO00FF
+    HM1X_FORMAT_TEXT,   // Free text of up to `width` characters, e.g. AT+NAMBMyBLE
+    HM1X_FORMAT_DIGITS  // Decimal digits, up to `width` of them, e.g. AT+PASS123456
+} hm1x_format_t;
+
+#define HM1X_MODEL_BIT(m) (1 << HM1X_BT::m)
+#define HM1X_MODELS_ALL   ((1 << HM1X_BT::NUM_HM_MODELS) - 1)
+#define HM1X_MODELS_DUAL  (HM1X_MODEL_BIT(HM12) | HM1X_MODEL_BIT(HM13))
+#define HM1X_MODELS_HM10_11 (HM1X_MODEL_BIT(HM10) | HM1X_MODEL_BIT(HM11))
+
+// One row per AT command. Getters and setters below are thin wrappers around
+// the generic engine (commandGet/commandSet/commandExecute), which builds the
+// command, sends it and parses the reply from this description alone.
+// Rows MUST stay in the same order as HM1X_BT::HM1X_command_t.
+typedef struct hm1x_command_desc {
+    char mnemonic[6];       // Sent as AT+<mnemonic>
+    char singleMnemonic[6]; // Sent instead on single-mode (BLE only) modules, "" if the same
+    uint8_t format;         // hm1x_format_t
+    uint8_t width;          // Hex digits, or maximum text length
+    uint16_t models;        // Bitmask of supported HM1X_model_t
+    uint32_t minValue;      // Valid range of numeric arguments
+    uint32_t maxValue;
+} hm1x_command_desc_t;
+
+static const hm1x_command_desc_t hm1xCommands[] PROGMEM = {
+    // mnemonic  single   format              width  models             min  max
+    { "RESET",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_RESET
+    { "RENEW",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_FACTORY_DEFAULTS
+    { "VERR",    "",      HM1X_FORMAT_TEXT,   20,    HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_VERSION
+    { "NOTI",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_NOTIFY_INIT
+    { "NOTP",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_NOTIFY_MODE
+    { "NAME",    "",      HM1X_FORMAT_TEXT,   28,    HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_EDR_NAME
+    { "NAMB",    "NAME",  HM1X_FORMAT_TEXT,   28,    HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_BLE_NAME
+    { "ADDE",    "",      HM1X_FORMAT_HEX,    12,    HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_EDR_ADR
+    { "ADDB",    "ADDR",  HM1X_FORMAT_HEX,    12,    HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_BLE_ADR
+    { "RADE",    "",      HM1X_FORMAT_HEX,    12,    HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_LAST_EDR
+    { "RADB",    "RADD",  HM1X_FORMAT_HEX,    12,    HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_LAST_BLE
+    { "BONDE",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_CLEAR_BOND_EDR
+    { "BONDB",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_CLEAR_BOND_BLE
+    { "CLEAE",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_CLEAR_ADR_EDR
+    { "CLEAB",   "CLEAR", HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_CLEAR_ADR_BLE
+    { "ROLE",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_DUAL,  0,   1 },          // HM1X_CMD_EDR_MODE
+    { "ROLB",    "ROLE",  HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_BLE_MODE
+    { "HIGH",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_HIGH_SPEED_SPP
+    { "DUAL",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_DUAL,  0,   1 },          // HM1X_CMD_DUAL_WORK_MODE
+    { "MODE",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_MODULE_WORK_MODE
+    { "ATOB",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_A_TO_B_MODE
+    { "AUTH",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_AUTHENTICATION_MODE
+    { "PINE",    "",      HM1X_FORMAT_DIGITS, 6,     HM1X_MODELS_DUAL,  0,   0 },          // HM1X_CMD_EDR_PIN_CODE
+    { "PINB",    "PASS",  HM1X_FORMAT_DIGITS, 6,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_BLE_PIN_CODE
+    { "COFD",    "",      HM1X_FORMAT_HEX,    6,     HM1X_MODELS_ALL,   0,   0xFFFFFE },   // HM1X_CMD_COD
+    { "COUP",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_UPDATE_CON_PARAM
+    { "IBEA",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_IBEACON_SWITCH
+    { "IBE",     "",      HM1X_FORMAT_HEX,    8,     HM1X_MODELS_ALL,   0,   0xFFFFFFFF }, // HM1X_CMD_IBEACON_UUID (indexed 0-3)
+    { "MAJO",    "",      HM1X_FORMAT_HEX,    4,     HM1X_MODELS_ALL,   0,   0xFFFE },     // HM1X_CMD_IBEACON_MAJOR
+    { "MINO",    "",      HM1X_FORMAT_HEX,    4,     HM1X_MODELS_ALL,   0,   0xFFFE },     // HM1X_CMD_IBEACON_MINOR
+    { "MEAS",    "",      HM1X_FORMAT_HEX,    2,     HM1X_MODELS_ALL,   0,   0xFF },       // HM1X_CMD_IBEACON_POWER
+    { "MTUS",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_MTU_SIZE
+    { "SCAN",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_ADVERT_TYPE
+    { "SAFE",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_SAFE_MODE
+    { "ONEM",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_BLE_MAC
+    { "PIO0",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_SYSTEM_KEY
+    { "PIO1",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_SYSTEM_LED
+    { "PIO",     "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_PIO_STATUS (indexed by pin)
+    { "BAUD",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   8 },          // HM1X_CMD_BAUD
+    { "FIOW",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   1 },          // HM1X_CMD_FLOW_CONTROL
+    { "DISC",    "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_DISCOVER
+    { "DISI",    "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_DISCOVER_IBEACON
+    { "CON",     "",      HM1X_FORMAT_HEX,    12,    HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_CONNECT_ADDRESS
+    { "CONNL",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_ALL,   0,   0 },          // HM1X_CMD_CONNECT_LAST
+    { "ADVI",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_ALL,   0,   15 },         // HM1X_CMD_ADVERT_INTERVAL
+    { "COMI",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_HM10_11, 0, 9 },          // HM1X_CMD_CONN_INTERVAL_MIN
+    { "COMA",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_HM10_11, 0, 9 },          // HM1X_CMD_CONN_INTERVAL_MAX
+    { "COLA",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_HM10_11, 0, 4 },          // HM1X_CMD_SLAVE_LATENCY
+    { "COSU",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_HM10_11, 0, 6 },          // HM1X_CMD_SUPERVISION_TIMEOUT
+    { "SLEEP",   "",      HM1X_FORMAT_NONE,   0,     HM1X_MODELS_HM10_11, 0, 0 },          // HM1X_CMD_SLEEP
+    { "PWRM",    "",      HM1X_FORMAT_HEX,    1,     HM1X_MODELS_HM10_11, 0, 1 },          // HM1X_CMD_AUTO_SLEEP
+    { "PIO?",    "",      HM1X_FORMAT_HEX,    3,     HM1X_MODELS_HM10_11, 0, 0x3FF },      // HM1X_CMD_PIO_ALL (bit 0 is PIO2)
+};
+
+// One setting applied by applyProfile() on the models in `models`. The steps
+// live in applyProfile(), and the profile's baud (hm1xProfileBauds) is always
+// applied last.
+typedef struct {
+    uint8_t profile;   // HM1X_BT::HM1X_profile_t (HM1X_conn_preset_t for applyConnectionPreset())
+    uint16_t models;   // Models this step applies to
+    uint8_t command;   // HM1X_BT::HM1X_command_t
+    uint8_t value;
+} hm1x_profile_step_t;
+
+// UART baud for each profile. Models that can't run it get the next lower one they support.
+static const uint8_t hm1xProfileBauds[HM1X_BT::NUM_HM1X_PROFILES] = {
+    HM1X_BT::HM1X_BAUD_230400, // PROFILE_MAX_THROUGHPUT
+    HM1X_BT::HM1X_BAUD_115200, // PROFILE_LOW_LATENCY
+    HM1X_BT::HM1X_BAUD_9600    // PROFILE_LOW_POWER
+};
+
+// Model named in an AT+VERR reply. Versions that name none are told
+// apart by probing (detectModel).
+typedef struct {
+    char text[6];
+    uint8_t model;     // HM1X_BT::HM1X_model_t
+} hm1x_version_model_t;
+
+static const hm1x_version_model_t hm1xVersionModels[] PROGMEM = {
+    { "HM-10", HM1X_BT::HM10 },
+    { "HM-11", HM1X_BT::HM11 },
+    { "HM-12", HM1X_BT::HM12 },
+    { "HM-13", HM1X_BT::HM13 },
+    { "HM-14", HM1X_BT::HM14 },
+    { "HM-15", HM1X_BT::HM15 },
+    { "HM-16", HM1X_BT::HM16 },
+    { "HM-17", HM1X_BT::HM17 },
+    { "HM-18", HM1X_BT::HM18 },
+    { "HM-19", HM1X_BT::HM19 },
+};
+
+#ifdef HM1X_EEPROM_ENABLED
+// What the library keeps at its EEPROM address (setEepromAddress()).
+// Change the magic number along with the layout.
+#define HM1X_EEPROM_MAGIC 0xA2
+typedef struct {
+    uint8_t magic;              // HM1X_EEPROM_MAGIC once written
+    uint8_t model;              // HM1X_BT::HM1X_model_t found by detectModel(), NUM_HM_MODELS if none
+    uint32_t configVersion;     // Boot snapshot (saveBootSnapshot), valid if baud isn't 0
+    uint32_t baud;
+    HM1X_address_t bleAddress;
+} hm1x_eeprom_t;
+
+// The record saved at address, or an empty one if there's none
+static void readEeprom(uint16_t address, hm1x_eeprom_t & saved)
+{
+    EEPROM.get(address, saved);
+    if (saved.magic != HM1X_EEPROM_MAGIC)
+    {
+        memset(&saved, 0, sizeof(saved));
+        saved.magic = HM1X_EEPROM_MAGIC;
+        saved.model = HM1X_BT::NUM_HM_MODELS;
+    }
+}
+#endif
+
+// Write `digits` upper-case hex digits of value to dest and null-terminate
+static char * appendHex(char * dest, uint32_t value, uint8_t digits)
+{
+    while (digits > 0)
+    {
+        digits--;
+        uint8_t nibble = (value >> (digits * 4)) & 0x0F;
+        *dest++ = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+    }
+    *dest = '\0';
+    return dest;
+}
+
+// Checks text against a command's format, e.g. 8 hex digits for a UUID part
+static boolean validText(const char * text, const hm1x_command_desc_t & desc)
+{
+    size_t len = strlen(text);
+
+    if ((len == 0) || (len > desc.width)) return false;
+    if ((desc.format == HM1X_FORMAT_HEX) && (len != desc.width)) return false;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((desc.format == HM1X_FORMAT_HEX) && (HM1X_address_t::hexDigit(text[i]) < 0)) return false;
+        if ((desc.format == HM1X_FORMAT_DIGITS) && ((text[i] < '0') || (text[i] > '9'))) return false;
+    }
+    return true;
+}
+
 // Class Constructor
 HM1X_BT::HM1X_BT(HM1X_model_t btModel)
 {
-    _btModel = btModel;
+    // Auto: drive it as an HM-10 until begin() knows better
+    _modelUnknown = (btModel == HM_AUTO);
+    _btModel = _modelUnknown ? HM10 : btModel;
+    _eepromAddress = HM1X_EEPROM_ADDRESS;
     
     _connectedBle = false;
     _connectedEdr = false;
-    _edrAddress = "";
-    _bleAddress = "";
-    _response = "";
+    _edrPeer.clear();
+    _blePeer.clear();
+    _rxHead = 0;
+    _rxCount = 0;
+    _noticeLen = 0;
+    _noticesSeen = 0;
+    _eventHead = 0;
+    _eventCount = 0;
+    _eventsDropped = 0;
+    _eventCallback = NULL;
+    _discovering = false;
+    _discTokenLen = 0;
+    _discResults = NULL;
+    _discCount = 0;
+    _scanCache = NULL;
+    _reconnectLeft = 0;
+    _reconnectInFlight = false;
+    _autoReconnect = 0;
+    _setHead = 0;
+    _setCount = 0;
+    _setSent = 0;
+    _setMismatches = 0;
+    _setTimeouts = 0;
+    _setCallback = NULL;
+    _waitingForReplies = false;
+    _pioStates = 0;
+    _pioKnown = false;
+    _pioRequested = false;
+    _pioSent = false;
+    _pioTime = 0;
+    _pioMask = 0;
+    _pioInterval = 0;
+    _pioCallback = NULL;
+    memset(&_reconnectStats, 0, sizeof(_reconnectStats));
+    _moduleAsleep = false;
+    _autoSleep = false;
+    _powerSince = 0;
+    memset(&_powerStats, 0, sizeof(_powerStats));
 
     _polling = false;
 
+    _rtsPin = HM1X_NO_PIN;
+    _ctsPin = HM1X_NO_PIN;
+    _rtsThreshold = (HM1X_RX_BUFFER_SIZE * 3) / 4;
+
+    _txPacketSize = HM1X_TX_PACKET_SIZE;
+    setTxPacing(HM1X_TX_INTERVAL, HM1X_TX_PACKETS_PER_INTERVAL);
+    _txCoalesceDelay = 0;
+    _txPending = 0;
+
     // set model-specific variables
     // _isEdrSupported, _btBauds_ptr, and _validBaudBounds_ptr
     setModelSpecificVariables();
 
+    _serial = NULL;
+    _baudCallback = NULL;
+    _baud = 0;
 #ifdef HM1X_SOFTWARE_SERIAL_ENABLED
     _softSerial = NULL;
 #endif
@@ -163,30 +373,11 @@ HM1X_BT::HM1X_BT(HM1X_model_t btModel)
 boolean HM1X_BT::begin(SoftwareSerial & softSerial, unsigned long baud)
 {
     _softSerial = &softSerial;
+    _serial = &softSerial;
     _softSerial->begin(baud);
-    
-#ifdef CHECK_HM1X_CONNECTION_ON_BEGIN
-    if( init() == HM1X_SUCCESS ) 
-    {
-        return true;
-    }
+    _baud = baud;
 
-    // If init() fails the first time, try forcing the baud rate to the requested baud and try again.
-    if (forceBaud(baud) == HM1X_SUCCESS)
-    {
-        reset();
-        _softSerial->begin(baud);
-        delay(5000); // Delay long enough for module to reset
-        if( init() == HM1X_SUCCESS ) 
-        {
-            return true;
-        }
-    }
-
-    return false;
-#else
-    return true;
-#endif
+    return beginSerial(baud);
 }
 #endif
 
@@ -194,23 +385,47 @@ boolean HM1X_BT::begin(SoftwareSerial & softSerial, unsigned long baud)
 boolean HM1X_BT::begin(HardwareSerial &serialPort, unsigned long baud)
 {
     _serialPort = &serialPort;
+    _serial = &serialPort;
     _serialPort->begin(baud);
+    _baud = baud;
+
+    return beginSerial(baud);
+}
+#endif
+
+// Any Stream: AltSoftSerial, NeoSWSerial, USB CDC, a host-side pty...
+// The stream must already be open at baud. setBaudCallback lets the library
+// re-open it at another baud (forceBaud, setTransportBaud); without it the
+// library can only talk at the baud it was given.
+boolean HM1X_BT::begin(Stream & serial, unsigned long baud, HM1X_baud_callback_t setBaudCallback)
+{
+    _serial = &serial;
+    _baudCallback = setBaudCallback;
+    _baud = baud;
+
+    return beginSerial(baud);
+}
+
+// Shared by the serial begin()s once the port is open at baud
+boolean HM1X_BT::beginSerial(unsigned long baud)
+{
+    if (_modelUnknown) loadModel();
 
 #ifdef CHECK_HM1X_CONNECTION_ON_BEGIN
     if( init() == HM1X_SUCCESS ) 
     {
-        return true;
+        return (resolveModel() == HM1X_SUCCESS);
     }
 
     // If init() fails the first time, try forcing the baud rate to the requested baud and try again.
     if (forceBaud(baud) == HM1X_SUCCESS)
     {
         reset();
-        _serialPort->begin(baud);
+        setTransportBaud(baud);
         delay(5000); // Delay long enough for module to reset
         if( init() == HM1X_SUCCESS ) 
         {
-            return true;
+            return (resolveModel() == HM1X_SUCCESS);
         }
     }
 
@@ -219,7 +434,15 @@ boolean HM1X_BT::begin(HardwareSerial &serialPort, unsigned long baud)
     return true;
 #endif
 }
-#endif
+
+// HM_AUTO: the model a previous boot saved to EEPROM, else ask the module.
+// Needs init() to have succeeded; a no-op once the model is known.
+HM1X_error_t HM1X_BT::resolveModel(void)
+{
+    if (_modelUnknown) loadModel();
+    if (!_modelUnknown) return HM1X_SUCCESS;
+    return detectModel();
+}
 
 #ifdef HM1X_I2C_ENABLED
 boolean HM1X_BT::begin(TwoWire & wirePort, uint8_t wireAddress)
@@ -228,12 +451,13 @@ boolean HM1X_BT::begin(TwoWire & wirePort, uint8_t wireAddress)
     _wireAddress = wireAddress;
 
     _wirePort->begin();
+    _baud = 9600; // The bridge's UART default, for detectModel()'s BAUD? check
 
 #ifdef CHECK_HM1X_CONNECTION_ON_BEGIN
     //writeI2cBaud(HM1X_BAUD_9600);
     if( init() == HM1X_SUCCESS ) 
     {
-        return true;
+        return (resolveModel() == HM1X_SUCCESS);
     }
 
     // If we fail to initialize, try forcing the baud rate to 9600
@@ -269,80 +493,351 @@ boolean HM1X_BT::setupPoll(void)
     return false;
 }
 
+// Unsolicited notices poll() picks out of the data stream: "OK+", a
+// keyword, then ":" and the peer address where the module sends one.
+// OK+CONx and OK+LOST are HM-10 style; the rest are HM-12/13 style.
+// OK+Set: and OK+PIO?: are replies to commands sent without waiting, only
+// looked for while one is due.
+typedef enum {
+    HM1X_NOTICE_NO_ADDRESS,
+    HM1X_NOTICE_OPTIONAL_ADDRESS,
+    HM1X_NOTICE_ADDRESS,   // Only with 4 character keywords: it must fit _notice
+    HM1X_NOTICE_SET_VALUE, // ":" and the pending set's value
+    HM1X_NOTICE_PIO_VALUE  // ":" and every PIO's state
+} hm1x_notice_tail_t;
+
+typedef struct {
+    char keyword[6];
+    uint8_t type;      // HM1X_event_type_t
+    uint8_t link;      // HM1X_link_t
+    uint8_t tail;      // hm1x_notice_tail_t
+} hm1x_notice_t;
+
+static const hm1x_notice_t hm1xNotices[] PROGMEM = {
+    {"INIT",  HM1X_EVENT_INIT,           HM1X_LINK_NONE, HM1X_NOTICE_NO_ADDRESS},
+    {"CONE",  HM1X_EVENT_CONNECT,        HM1X_LINK_EDR,  HM1X_NOTICE_ADDRESS},
+    {"CONB",  HM1X_EVENT_CONNECT,        HM1X_LINK_BLE,  HM1X_NOTICE_ADDRESS},
+    {"LSTE",  HM1X_EVENT_DISCONNECT,     HM1X_LINK_EDR,  HM1X_NOTICE_OPTIONAL_ADDRESS},
+    {"LSTB",  HM1X_EVENT_DISCONNECT,     HM1X_LINK_BLE,  HM1X_NOTICE_OPTIONAL_ADDRESS},
+    {"CONN",  HM1X_EVENT_CONNECT,        HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"LOST",  HM1X_EVENT_DISCONNECT,     HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"CONNA", HM1X_EVENT_CONNECTING,     HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"CONNL", HM1X_EVENT_CONNECTING,     HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"CONNE", HM1X_EVENT_CONNECT_FAILED, HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"CONNF", HM1X_EVENT_CONNECT_FAILED, HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"CONNN", HM1X_EVENT_CONNECT_FAILED, HM1X_LINK_BLE,  HM1X_NOTICE_NO_ADDRESS},
+    {"WAKE",  HM1X_EVENT_WAKE,           HM1X_LINK_NONE, HM1X_NOTICE_NO_ADDRESS},
+    {"Set",   0,                         HM1X_LINK_NONE, HM1X_NOTICE_SET_VALUE},
+    {"PIO?",  0,                         HM1X_LINK_NONE, HM1X_NOTICE_PIO_VALUE},
+};
+const uint8_t HM1X_NUM_NOTICES = sizeof(hm1xNotices) / sizeof(hm1xNotices[0]);
+
+typedef enum {
+    NOTICE_NONE,     // Not a notice
+    NOTICE_PARTIAL,  // Could still become one
+    NOTICE_SHORT,    // A notice, unless more follows (an address, or a longer keyword)
+    NOTICE_COMPLETE
+} hm1x_notice_state_t;
+
+// Length of "OK+<keyword>" for a notice
+static uint8_t noticeKeywordEnd(uint8_t notice)
+{
+    return strlen(HM1X_NOTICE_PREFIX) + strlen_P(hm1xNotices[notice].keyword);
+}
+
+// How far buf gets towards notice n on its own. setWidth, pioWidth: value
+// digits of the OK+Set: or OK+PIO?: expected, 0 if none is.
+static hm1x_notice_state_t noticeMatch(const char * buf, uint8_t len, uint8_t n,
+                                       uint8_t setWidth, uint8_t pioWidth)
+{
+    uint8_t prefixLen = strlen(HM1X_NOTICE_PREFIX);
+    uint8_t end = noticeKeywordEnd(n);
+    uint8_t tail = pgm_read_byte(&hm1xNotices[n].tail);
+    uint8_t compare = ((len < end) ? len : end) - prefixLen;
+    uint8_t valueLen = HM1X_ADDRESS_LEN;
+
+    if (tail == HM1X_NOTICE_SET_VALUE) valueLen = setWidth;
+    if (tail == HM1X_NOTICE_PIO_VALUE) valueLen = pioWidth;
+    if (valueLen == 0) return NOTICE_NONE;
+    if (strncmp_P(&buf[prefixLen], hm1xNotices[n].keyword, compare) != 0) return NOTICE_NONE;
+
+    if (len < end) return NOTICE_PARTIAL;
+    if (len == end)
+    {
+        if (tail == HM1X_NOTICE_NO_ADDRESS) return NOTICE_COMPLETE;
+        return (tail == HM1X_NOTICE_OPTIONAL_ADDRESS) ? NOTICE_SHORT : NOTICE_PARTIAL;
+    }
+    if ((tail == HM1X_NOTICE_NO_ADDRESS) || (buf[end] != ':')) return NOTICE_NONE;
+    for (uint8_t i = end + 1; i < len; i++)
+    {
+        if (HM1X_address_t::hexDigit(buf[i]) < 0) return NOTICE_NONE;
+    }
+    return (len == end + 1 + valueLen) ? NOTICE_COMPLETE : NOTICE_PARTIAL;
+}
+
+// How far buf gets towards any notice; *notice is set to the one it is.
+// A finished notice that's also the start of a longer one (OK+CONN,
+// OK+CONNA) is SHORT until the next byte or a pause settles it.
+static hm1x_notice_state_t noticeState(const char * buf, uint8_t len, uint8_t * notice,
+                                       uint8_t setWidth, uint8_t pioWidth)
+{
+    uint8_t prefixLen = strlen(HM1X_NOTICE_PREFIX);
+    boolean partial = false;
+    boolean done = false;
+    boolean complete = false;
+
+    for (uint8_t i = 0; (i < prefixLen) && (i < len); i++)
+    {
+        if (buf[i] != HM1X_NOTICE_PREFIX[i]) return NOTICE_NONE;
+    }
+    if (len <= prefixLen) return NOTICE_PARTIAL;
+
+    for (uint8_t n = 0; n < HM1X_NUM_NOTICES; n++)
+    {
+        hm1x_notice_state_t state = noticeMatch(buf, len, n, setWidth, pioWidth);
+        if (state == NOTICE_PARTIAL)
+        {
+            partial = true;
+        }
+        else if (state != NOTICE_NONE)
+        {
+            *notice = n;
+            done = true;
+            complete = (state == NOTICE_COMPLETE);
+        }
+    }
+    if (done)
+    {
+        return (complete && !partial) ? NOTICE_COMPLETE : NOTICE_SHORT;
+    }
+    return partial ? NOTICE_PARTIAL : NOTICE_NONE;
+}
+
+// Notices can arrive back to back, split across calls, or between data
+// bytes, so the stream is parsed a byte at a time and never waited on.
 boolean HM1X_BT::poll(void)
 {
-    String response = "";
-    boolean handled = false;
+    uint8_t seen = _noticesSeen;
 
-    // Receive serial stream, delay for a bit between charaters
-    if (hwAvailable())
+    flushIfDue();
+
+    // Never take more than the receive buffer can hold, counting held notice
+    // and scan bytes that may turn out to be data: the rest stays in the
+    // serial buffer, where flow control (if enabled) holds the module off.
+    while ((_rxCount + _noticeLen + _discTokenLen < HM1X_RX_BUFFER_SIZE) &&
+           (hwAvailable() > 0))
+    {
+        char c = readChar();
+        if (_discovering)
+        {
+            parseDiscovery(c);
+        }
+        else
+        {
+            parseByte(c);
+        }
+    }
+    if (_discovering)
     {
-        while (hwAvailable())
+        if (millis() - _noticeTime >= HM1X_RESPONSE_GAP)
+        {
+            _discInName = false;
+        }
+        if (millis() - _noticeTime >= HM1X_DISCOVERY_TIMEOUT)
         {
-            response += readChar();
-            delay(HM1X_POLL_DELAY);
+            finishDiscovery();
         }
     }
+    // A notice without an address ends when the module goes quiet
+    if ((_noticeLen > 0) && (millis() - _noticeTime >= HM1X_RESPONSE_GAP))
+    {
+        resolveNotice(true);
+    }
+    pollReconnect();
+    pollPendingSets();
+    pollPios();
+    updateRts();
+    return (_noticesSeen != seen);
+}
 
-    if (response.length() == 0)
+boolean HM1X_BT::getEvent(HM1X_event_t & event)
+{
+    if (_eventCount == 0)
     {
         return false;
     }
+    event = _events[_eventHead];
+    _eventHead = (_eventHead + 1) % HM1X_EVENT_QUEUE_DEPTH;
+    _eventCount--;
+    return true;
+}
+
+void HM1X_BT::parseByte(char c)
+{
+    if ((_noticeLen == 0) && (c != HM1X_NOTICE_PREFIX[0]))
+    {
+        storeByte(c);
+        return;
+    }
+    _notice[_noticeLen++] = c;
+    _noticeTime = millis();
+    resolveNotice(false);
+}
+
+// Act on the bytes held in _notice. timedOut: nothing more is coming, so
+// anything short of a notice is data.
+void HM1X_BT::resolveNotice(boolean timedOut)
+{
+    uint8_t notice;
 
-    if (response.length() >= 7)
+    while (_noticeLen > 0)
     {
-        if (response.substring(0, 7) == "OK+INIT") 
+        hm1x_notice_state_t state = noticeState(_notice, _noticeLen, &notice,
+                                                pendingSetWidth(), pendingPioWidth());
+
+        if ((state == NOTICE_COMPLETE) || (timedOut && (state == NOTICE_SHORT)))
+        {
+            handleNotice(notice, _noticeLen);
+            _noticeLen = 0;
+            return;
+        }
+        if ((state != NOTICE_NONE) && !timedOut)
         {
-            // TODO: Module restarted -- need to do anything?
-            handled = true;
+            return; // Wait for more
         }
-        else if (response.substring(0, strlen(HM1X_OK_CONN_EDR)) == String(HM1X_OK_CONN_EDR))
+
+        // A notice without an address, followed by something else
+        if ((_noticeLen > 1) &&
+            (noticeState(_notice, _noticeLen - 1, &notice,
+                         pendingSetWidth(), pendingPioWidth()) == NOTICE_SHORT))
+        {
+            handleNotice(notice, _noticeLen - 1);
+            _notice[0] = _notice[_noticeLen - 1];
+            _noticeLen = 1;
+            if (_notice[0] != HM1X_NOTICE_PREFIX[0])
+            {
+                storeByte(_notice[0]);
+                _noticeLen = 0;
+            }
+            continue;
+        }
+
+        // Not a notice: pass the bytes on as data up to the next 'O', which
+        // may start one
+        uint8_t skip = 1;
+        while ((skip < _noticeLen) && (_notice[skip] != HM1X_NOTICE_PREFIX[0]))
         {
-            _edrAddress = response.substring(8,20);
-            _connectedEdr = true;
-            handled = true;
+            skip++;
         }
-        else if (response.substring(0, strlen(HM1X_OK_CONN_BLE)) == String(HM1X_OK_CONN_BLE))
+        for (uint8_t i = 0; i < skip; i++)
         {
-            _bleAddress = response.substring(8,20);
-            _connectedBle = true;
-            handled = true;
+            storeByte(_notice[i]);
         }
-        else if (response.substring(0, strlen(HM1X_OK_DISCON_EDR)) == String(HM1X_OK_DISCON_EDR))
+        _noticeLen -= skip;
+        memmove(_notice, &_notice[skip], _noticeLen);
+    }
+}
+
+void HM1X_BT::handleNotice(uint8_t notice, uint8_t len)
+{
+    HM1X_event_t event;
+
+    if (pgm_read_byte(&hm1xNotices[notice].tail) == HM1X_NOTICE_SET_VALUE)
+    {
+        setConfirmed(&_notice[noticeKeywordEnd(notice) + 1], len - noticeKeywordEnd(notice) - 1);
+        return;
+    }
+    if (pgm_read_byte(&hm1xNotices[notice].tail) == HM1X_NOTICE_PIO_VALUE)
+    {
+        piosRead(&_notice[noticeKeywordEnd(notice) + 1]);
+        return;
+    }
+
+    event.type = (HM1X_event_type_t) pgm_read_byte(&hm1xNotices[notice].type);
+    event.link = (HM1X_link_t) pgm_read_byte(&hm1xNotices[notice].link);
+    event.timestamp = _noticeTime;
+    if (len > noticeKeywordEnd(notice))
+    {
+        event.address.parse(&_notice[noticeKeywordEnd(notice) + 1]);
+    }
+    else
+    {
+        event.address.clear();
+    }
+
+    if (event.type == HM1X_EVENT_INIT)
+    {
+        // A restarted module has dropped any connection
+        _connectedEdr = false;
+        _connectedBle = false;
+    }
+    else if ((event.type == HM1X_EVENT_CONNECT) || (event.type == HM1X_EVENT_DISCONNECT))
+    {
+        if (event.link == HM1X_LINK_EDR)
         {
-            _edrAddress = response.substring(8, 20);
-            _connectedEdr = false;
-            handled = true;
+            _connectedEdr = (event.type == HM1X_EVENT_CONNECT);
+            if (!event.address.isNull()) _edrPeer = event.address;
         }
-        else if (response.substring(0, strlen(HM1X_OK_DISCON_BLE)) == String(HM1X_OK_DISCON_BLE))
+        else
         {
-            _bleAddress = response.substring(8, 20);
-            _connectedBle = false;
-            handled = true;
+            _connectedBle = (event.type == HM1X_EVENT_CONNECT);
+            if (!event.address.isNull()) _blePeer = event.address;
         }
     }
-    if (handled == false)
+    // Any notice means the module is up, except that one sleeping by itself
+    // goes back to sleep when it restarts or its link drops
+    setModuleAsleep(_autoSleep &&
+                    ((event.type == HM1X_EVENT_INIT) || (event.type == HM1X_EVENT_DISCONNECT)));
+    _noticesSeen++;
+    // Reconnect bookkeeping comes before the event is handed out, except
+    // that a reconnect started by a dropped link follows the drop's event
+    if (event.type != HM1X_EVENT_DISCONNECT) reconnectEvent(event);
+    raiseEvent(event);
+    if (event.type == HM1X_EVENT_DISCONNECT) reconnectEvent(event);
+}
+
+// Hand an event to the callback, or queue it for getEvent()
+void HM1X_BT::raiseEvent(const HM1X_event_t & event)
+{
+    if (_eventCallback != NULL)
+    {
+        _eventCallback(event);
+        return;
+    }
+    if (_eventCount == HM1X_EVENT_QUEUE_DEPTH)
+    {
+        // Full: the oldest event goes
+        _eventHead = (_eventHead + 1) % HM1X_EVENT_QUEUE_DEPTH;
+        _eventCount--;
+        _eventsDropped++;
+    }
+    _events[(_eventHead + _eventCount) % HM1X_EVENT_QUEUE_DEPTH] = event;
+    _eventCount++;
+}
+
+void HM1X_BT::storeByte(char c)
+{
+    if (_rxCount < HM1X_RX_BUFFER_SIZE)
     {
-        // Store response into local buffer
-        _response += response;
+        _rxBuffer[(_rxHead + _rxCount) % HM1X_RX_BUFFER_SIZE] = c;
+        _rxCount++;
     }
-    return handled;
 }
 
 int HM1X_BT::available(void)
 {
     // If we've polled, then return either _response.length()
     //       or otherwise bytes available in I2C/Serial buffer.
+    flushIfDue();
+    updateRts();
     if ( _polling )
     {
-        return _response.length();
+        return _rxCount;
     }
     else
     {
         return hwAvailable();
     }
-
-    //return hwAvailable();
 }
 
 char HM1X_BT::read(void)
@@ -351,8 +846,14 @@ char HM1X_BT::read(void)
     //       or otherwise bytes available in I2C/Serial buffer.
     if ( _polling )
     {
-        char retVal = _response.charAt(0);
-        _response = _response.substring(1);
+        char retVal = 0;
+        if (_rxCount > 0)
+        {
+            retVal = _rxBuffer[_rxHead];
+            _rxHead = (_rxHead + 1) % HM1X_RX_BUFFER_SIZE;
+            _rxCount--;
+        }
+        updateRts();
         return retVal;
     }
     else
@@ -364,287 +865,338 @@ char HM1X_BT::read(void)
 
 size_t HM1X_BT::write(uint8_t c)
 {
-    if (0)
-    {
-
-    }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
-    {
-        return _softSerial->write(c);
-    }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
-    {
-        return _serialPort->write(c);
-    }
-#endif
-#ifdef HM1X_I2C_ENABLED
-    else if (_wirePort != NULL)
-    {
-        _wirePort->beginTransmission(_wireAddress);
-        _wirePort->write(I2C_CMD_WRITE);
-        _wirePort->write(c);
-        _wirePort->endTransmission(true);
-        return (size_t) 1;
-    }
-    return (size_t) 0;
-#endif
+    return write(&c, 1);
 }
 
 size_t HM1X_BT::write(const char *str)
 {
-    size_t len = strlen(str);
+    return write((const uint8_t *) str, strlen(str));
+}
 
-    if (0)
-    {
+size_t HM1X_BT::write(const char * buffer, size_t size)
+{
+    return write((const uint8_t *) buffer, size);
+}
 
-    }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
-    {
-        return _softSerial->print(str);
-    }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
+// With coalescing on, small writes collect in _txBuffer until a packet's
+// worth is waiting or the oldest byte has waited _txCoalesceDelay.
+// Writes of a whole packet or more skip the buffer.
+size_t HM1X_BT::write(const uint8_t * buffer, size_t size)
+{
+    size_t taken = 0;
+    uint8_t limit = (_txPacketSize < HM1X_TX_BUFFER_SIZE) ? _txPacketSize : HM1X_TX_BUFFER_SIZE;
+
+    if (_txCoalesceDelay == 0)
     {
-        return _serialPort->print(str);
+        return sendPaced(buffer, size);
     }
-#endif
-#ifdef HM1X_I2C_ENABLED
-    else if (_wirePort != NULL)
+
+    while (taken < size)
     {
-        _wirePort->beginTransmission(_wireAddress);
-        _wirePort->write(I2C_CMD_WRITE);
-        for (int i = 0; i < len; i++)
+        if ((_txPending == 0) && (size - taken >= limit))
+        {
+            size_t whole = (size - taken) - ((size - taken) % limit);
+            size_t sent = sendPaced(buffer + taken, whole);
+            taken += sent;
+            if (sent < whole) return taken;
+            continue;
+        }
+        if (_txPending == 0)
         {
-            _wirePort->write(str[i]);
+            _txPendingTime = millis();
+        }
+        _txBuffer[_txPending++] = buffer[taken++];
+        if (_txPending >= limit)
+        {
+            flush();
         }
-        _wirePort->endTransmission(true);
-        return len;
     }
-#endif
-    return (size_t) 0;
+    flushIfDue();
+    return taken;
 }
 
-size_t HM1X_BT::write(const char * buffer, size_t size)
+// Send anything held back by write coalescing
+void HM1X_BT::flush(void)
 {
-    if (0)
+    if (_txPending > 0)
     {
+        sendPaced((const uint8_t *) _txBuffer, _txPending);
+        _txPending = 0;
+    }
+}
 
+// Collect small writes into packets, holding them at most delayMs.
+// Pending bytes go out from write(), poll(), available() or flush(),
+// so call one of those regularly. delayMs = 0 turns coalescing off.
+void HM1X_BT::setCoalescing(uint16_t delayMs)
+{
+    if (delayMs == 0)
+    {
+        flush();
     }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
+    _txCoalesceDelay = delayMs;
+}
+
+void HM1X_BT::flushIfDue(void)
+{
+    if ((_txPending > 0) && (millis() - _txPendingTime >= _txCoalesceDelay))
     {
-        return _softSerial->print(buffer);
+        flush();
     }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
+}
+
+// Paced writes go out one packet at a time, each waiting until the module's
+// air buffer has room for it (at most one connection interval).
+size_t HM1X_BT::sendPaced(const uint8_t * buffer, size_t size)
+{
+    size_t written = 0;
+
+    if (_txInterval == 0)
     {
-        return _serialPort->print(buffer);
+        return hwWrite(buffer, size);
     }
-#endif
-#ifdef HM1X_I2C_ENABLED
-    else if (_wirePort != NULL)
+
+    while (written < size)
     {
-        _wirePort->beginTransmission(_wireAddress);
-        _wirePort->write(I2C_CMD_WRITE);
-        for (int i = 0; i < size; i++)
+        size_t chunk = size - written;
+        if (chunk > _txPacketSize) chunk = _txPacketSize;
+
+        refillTxCredits();
+        while (_txCredits < chunk)
         {
-            _wirePort->write(buffer[i]);
+            refillTxCredits();
         }
-        _wirePort->endTransmission(true);
-        return size;
+
+        size_t sent = hwWrite(buffer + written, chunk);
+        _txCredits -= sent;
+        written += sent;
+        if (sent < chunk) break; // CTS timed out
     }
-#endif
-    return (size_t) 0;
+    return written;
 }
 
-HM1X_error_t HM1X_BT::testOrDisconnect(void)
+// Bytes write() will take without blocking
+int HM1X_BT::availableForWrite(void)
 {
-    char * response;
-    HM1X_error_t err;
-
-    response = (char *) calloc(HM1X_DISCONNECT_RESPONSE_LEN + 2, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-
-    sendCommandWithTimeout("", &response, HM1X_DEFAULT_TIMEOUT);
-
-    if (strcmp(response, HM1X_RESPONSE_OK) == 0)
-    {
-        err = HM1X_SUCCESS;
-    }
-    else if (strlen(response) == HM1X_DISCONNECT_RESPONSE_LEN)
+    if ((_ctsPin != HM1X_NO_PIN) && (digitalRead(_ctsPin) == HIGH))
     {
-        // "AT" disconnected us from a BLE source, return success
-        // TODO: Could check here to make sure response is "OK+LSTE:001122334455"
-        err = HM1X_SUCCESS;
+        return 0; // Module has asked us to stop
     }
-    else
+    if (_txInterval == 0)
     {
-        err = HM1X_SUCCESS; //HM1X_UNEXPECTED_RESPONSE;
+        return _txPacketSize; // Unpaced: only the UART holds us up
     }
-
-    free(response);
-
-    return err;
+    refillTxCredits();
+    return _txCredits;
 }
 
-// AT+RENEW -- Restore factory defaults
-HM1X_error_t HM1X_BT::factoryDefaults(void)
+// Model the module's air buffer as one connection interval's worth of
+// packets, drained at each connection event
+void HM1X_BT::setTxPacing(uint16_t intervalMs, uint8_t packetsPerInterval)
 {
-    String expectedResponse;
-    char * command;
-    char * response;
-    HM1X_error_t err;
-
-    // Generate command: "AT+RENEW"
-    command = (char *) calloc(strlen(HM1X_COMMAND_FACTORY_DEFAULTS) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s", HM1X_COMMAND_FACTORY_DEFAULTS);
-
-    // Generate expected response: "OK+RENEW"
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS) 
-                      + strlen(HM1X_COMMAND_FACTORY_DEFAULTS) + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(response, "%s%s%s", HM1X_RESPONSE_OK, HM1X_RESPONSE_PLUS, HM1X_COMMAND_FACTORY_DEFAULTS);
+    _txInterval = intervalMs;
+    _txPacketsPerInterval = (packetsPerInterval > 0) ? packetsPerInterval : 1;
+    _txCredits = (uint16_t) _txPacketSize * _txPacketsPerInterval;
+    _txRefillTime = millis();
+}
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
+// Payload bytes per BLE packet. setMtuSize() keeps this in step with the module.
+void HM1X_BT::setTxPacketSize(uint8_t bytes)
+{
+    _txPacketSize = (bytes > 0) ? bytes : 1;
+    setTxPacing(_txInterval, _txPacketsPerInterval);
+}
 
-    free(response);
-    free(command);
+HM1X_error_t HM1X_BT::testOrDisconnect(void)
+{
+    char response[HM1X_MAX_COMMAND_LEN];
 
-    return err;
+    // "AT" replies "OK", or "OK+LSTE:001122334455" if it disconnected us
+    // from a peer. Any reply at all means the module is there.
+    return transact(HM1X_COMMAND_AT, response, sizeof(response),
+                    HM1X_LENGTH_UNKNOWN, false, HM1X_DEFAULT_TIMEOUT);
 }
 
-// AT+RESET -- Restart module
-HM1X_error_t HM1X_BT::reset(void)
+// AT+RENEW -- Restore factory defaults
+HM1X_error_t HM1X_BT::factoryDefaults(void)
 {
-    String expectedResponse;
-    char * command;
-    char * response;
-    HM1X_error_t err;
-
-    // Generate command: "AT+RESET"
-    command = (char *) calloc(strlen(HM1X_COMMAND_RESET) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s", HM1X_COMMAND_RESET);
-
-    // Generate expected response: "OK+RESET"
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_COMMAND_RESET) + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(response, "%s%s%s", HM1X_RESPONSE_OK, HM1X_RESPONSE_PLUS, HM1X_COMMAND_RESET);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-
-    free(response);
-    free(command);
+    return commandExecute(HM1X_CMD_FACTORY_DEFAULTS);
+}
 
-    return err;
+// AT+RESET -- Restart module
+HM1X_error_t HM1X_BT::reset(void)
+{
+    return commandExecute(HM1X_CMD_RESET);
 }
 
 // AT+VERR -- Software version
 HM1X_error_t HM1X_BT::version(char * version)
 {
-    String expectedResponse;
-    char * command;
-    char * response;
-    int retNum;
+    return commandGetText(HM1X_CMD_VERSION, version);
+}
+
+HM1X_error_t HM1X_BT::detectModel(void)
+{
+    char text[HM1X_VERSION_LEN + 1];
+    hm1x_version_model_t entry;
+    HM1X_address_t address;
+    uint32_t baudChar;
+    boolean hm10Baud;
+    boolean hm19Baud;
+    boolean named;
+    HM1X_error_t err;
+    int8_t found = -1;
 
-    // Generate command: "AT+VERR?"
-    command = (char *) calloc(strlen(HM1X_COMMAND_VERSION) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, HM1X_COMMAND_VERSION);
-    strcat(command, HM1X_QUERY_STRING);
+    err = version(text);
+    if (err != HM1X_SUCCESS) return err;
 
-    // Generate expected response: "OK+RESET"
-    response = (char *) calloc(12 + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+    for (uint8_t i = 0; (i < sizeof(hm1xVersionModels) / sizeof(hm1xVersionModels[0])) && (found < 0); i++)
+    {
+        memcpy_P(&entry, &hm1xVersionModels[i], sizeof(entry));
+        if (strstr(text, entry.text) != NULL) found = entry.model;
+    }
+    named = (found >= 0);
 
-    sendCommandWithTimeout(command, &response, HM1X_DEFAULT_TIMEOUT);
-    strcpy(version, response + strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET));
+    if (found < 0)
+    {
+        // Only the dual-mode modules have an EDR address
+        setModel(HM13);
+        if (commandGetAddress(HM1X_CMD_EDR_ADR, address) == HM1X_SUCCESS) found = HM13;
+    }
+    if (found < 0)
+    {
+        // Single-mode: the families number their bauds differently, so the
+        // character for the baud we're talking at tells them apart
+        setModel(HM10);
+        err = commandGet(HM1X_CMD_BAUD, &baudChar);
+        if (err != HM1X_SUCCESS) return err;
+        if (baudChar >= NUM_HM1X_BAUDS) return HM1X_UNEXPECTED_RESPONSE;
 
-    free(response);
-    free(command);
+        // Neither table fits, or both do ('8' is 230400 in each)
+        hm10Baud = ((unsigned long) btBauds[btBauds_HM10_11[baudChar]] == _baud);
+        hm19Baud = ((unsigned long) btBauds[btBauds_HM16_17_18_19[baudChar]] == _baud);
+        if (hm10Baud == hm19Baud) return HM1X_UNEXPECTED_RESPONSE;
+        found = hm10Baud ? HM10 : HM19;
+    }
 
+    setModel((HM1X_model_t) found);
+    if (_modelUnknown)
+    {
+        // Probing only finds the family, so only a model the version
+        // names is remembered for later boots
+        _modelUnknown = false;
+        if (named) saveModel();
+    }
     return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::notifyInfo(boolean enabled)
+void HM1X_BT::forgetModel(void)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
+
+    readEeprom(_eepromAddress, saved);
+    saved.model = NUM_HM_MODELS;
+    EEPROM.put(_eepromAddress, saved);
+#endif
+}
 
-    if (enabled) param = '1';
-    else param = '0';
+boolean HM1X_BT::bootSnapshotValid(uint32_t configVersion, const char * bleName)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
+    HM1X_address_t address;
+    char name[HM1X_MAX_NAME_LEN + 1];
 
-    // Build command: e.g. AT+NOTI1
-    command = (char *) calloc(strlen(HM1X_COMMAND_NOTIFY_INIT) + 2, sizeof(char));
-    if (command == NULL)
+    readEeprom(_eepromAddress, saved);
+    if ((saved.baud == 0) || (saved.baud != _baud) || (saved.configVersion != configVersion))
     {
-        return HM1X_OUT_OF_MEMORY;
+        return false;
     }
-    sprintf(command, "%s%c", HM1X_COMMAND_NOTIFY_INIT, param);
-
-    // Build expected response: e.g. OK+Set:1
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    if ((bleAddress(address) != HM1X_SUCCESS) || (address != saved.bleAddress))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return false;
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
+    // The module itself may have been reset or renamed since
+    if (bleName == NULL) return true;
+    return ((getBleName(name) == HM1X_SUCCESS) && (strcmp(name, bleName) == 0));
+#else
+    return false;
+#endif
+}
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+HM1X_error_t HM1X_BT::saveBootSnapshot(uint32_t configVersion)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
+    HM1X_address_t address;
+    HM1X_error_t err;
 
-    return err;
+    err = bleAddress(address);
+    if (err != HM1X_SUCCESS) return err;
+
+    readEeprom(_eepromAddress, saved);
+    saved.configVersion = configVersion;
+    saved.baud = _baud;
+    saved.bleAddress = address;
+    EEPROM.put(_eepromAddress, saved);
+    return HM1X_SUCCESS;
+#else
+    return HM1X_ERROR_ER;
+#endif
 }
 
+void HM1X_BT::clearBootSnapshot(void)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
 
-// AT+NOTI -- Set notify information 
-HM1X_error_t HM1X_BT::notifyMode(boolean enabled)
+    readEeprom(_eepromAddress, saved);
+    saved.baud = 0;
+    EEPROM.put(_eepromAddress, saved);
+#endif
+}
+
+unsigned long HM1X_BT::bootBaud(unsigned long defaultBaud)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
-    
-    if (enabled) param = '1';
-    else param = '0';
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
 
-    // Build command: e.g. AT+NOTP1
-    command = (char *) calloc(strlen(HM1X_COMMAND_NOTIFY_MODE) + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(command, "%s%c", HM1X_COMMAND_NOTIFY_MODE, param);
+    readEeprom(_eepromAddress, saved);
+    if (saved.baud != 0) return saved.baud;
+#endif
+    return defaultBaud;
+}
+
+uint16_t HM1X_BT::eepromSize(void)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    return sizeof(hm1x_eeprom_t);
+#else
+    return 0;
+#endif
+}
 
-    // Build expected response: e.g. OK+Set:1)
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+uint32_t HM1X_BT::configHash(const char * text, uint32_t hash)
+{
+    while (*text != '\0')
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        hash = (hash ^ (uint8_t) *text++) * 16777619UL;
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+    return hash;
+}
 
-    return err;
+// AT+NOTI -- Set notify information
+HM1X_error_t HM1X_BT::notifyInfo(boolean enabled)
+{
+    return commandSet(HM1X_CMD_NOTIFY_INIT, enabled ? 1 : 0);
 }
 
+// AT+NOTP -- Set notify mode (with or without address)
+HM1X_error_t HM1X_BT::notifyMode(boolean enabled)
+{
+    return commandSet(HM1X_CMD_NOTIFY_MODE, enabled ? 1 : 0);
+}
 
 // AT+NOTI, AT+NOTP -- Notify information
 HM1X_error_t HM1X_BT::notify(boolean enabled, boolean withAddress)
@@ -660,272 +1212,69 @@ HM1X_error_t HM1X_BT::notify(boolean enabled, boolean withAddress)
 // does not support HM-15/16/17/18/19
 String HM1X_BT::getEdrName(void)
 {
-    char * name;
-    String retName = "";
+    char name[HM1X_MAX_NAME_LEN + 1];
 
-    name = (char *)malloc(32* sizeof(char));
-    if (name != NULL)
+    if (getEdrName(name) == HM1X_SUCCESS)
     {
-        if (getEdrName(name) == HM1X_SUCCESS)
-        {
-            retName = String(name);
-        }
+        return String(name);
     }
-    return retName;
+    return "";
 }
 
-// Set EDR name and copy it to the character array name
+// Get EDR name and copy it to the character array name
 // does not support HM-15/16/17/18/19
 HM1X_error_t HM1X_BT::getEdrName(char * name)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    int retNameLen;
-
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
-    {
-        // return error
-        return HM1X_ERROR_ER;
-    }
-
-    // Create command string: AT+NAME?
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_NAME) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, HM1X_COMMAND_EDR_NAME);
-    strcat(command, HM1X_QUERY_STRING);
-
-    // Allocate enough memory for a response (up to 28 bytes + "OK+Get:")
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET) + 28 + 2, sizeof(char));
-    if (response == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-
-    retNameLen = sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
-    if (retNameLen == 0)
-    {
-        return HM1X_ERROR_TIMEOUT;
-    }
-    strcpy(name, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+    return commandGetText(HM1X_CMD_EDR_NAME, name);
 }
 
 // Set the EDR device name with the input string parameter
 // does not support HM-15/16/17/18/19
 HM1X_error_t HM1X_BT::setEdrName(String name)
 {
-    char * edrChar;
-
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
-    {
-        // return error
-        return HM1X_ERROR_ER;
-    }
-
-    edrChar = (char *) calloc(name.length() + 1, sizeof(char));
-    name.toCharArray(edrChar, name.length() + 1);
-    return setEdrName(edrChar);
+    return setEdrName(name.c_str());
 }
 
-// Set EDR name and copy it to the character array name
+// AT+NAME -- Set EDR name
 HM1X_error_t HM1X_BT::setEdrName(const char * name)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    int nameLen;
-
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
-    {
-        // return error
-        return HM1X_ERROR_ER;
-    }
-
-    nameLen = strlen(name);
-
-    if (nameLen > 28) // Name can't exceed 28 characters
-    {
-        return HM1X_UNEXPECTED_RESPONSE;
-    }
-
-    // Build command: e.g. AT+NAMEMY_EDR_DEVICE
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_NAME) + nameLen + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, HM1X_COMMAND_EDR_NAME);
-    strcat(command, name);
-
-    // Build expected response: e.g. OK+Set:MY_EDR_DEVICE
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + nameLen + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_SET);
-    strcat(response, name);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return commandSetText(HM1X_CMD_EDR_NAME, name);
 }
 
 String HM1X_BT::getBleName(void)
 {
-    char * name;
-    String retName = "";
-    name = (char *)malloc(32* sizeof(char));
-    if (name != NULL)
+    char name[HM1X_MAX_NAME_LEN + 1];
+
+    if (getBleName(name) == HM1X_SUCCESS)
     {
-        if (getBleName(name) == HM1X_SUCCESS)
-        {
-            retName = String(name);
-        }
+        return String(name);
     }
-    return retName;
+    return "";
 }
 
+// AT+NAMB -- BLE name
+// AT+NAME for non-dual devices
 HM1X_error_t HM1X_BT::getBleName(char * name)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    int retNameLen;
-    char *command_no_ble;
-
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_NAME), sizeof(char));
-    if (command_no_ble == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_EDR_NAME);
-    }else{
-        // use HM1X_COMMAND_BLE_NAME as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_NAME);
-    }
-
-    // Create command string: AT+NAMB?
-    command = (char *) calloc(strlen(command_no_ble) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, command_no_ble);
-    strcat(command, HM1X_QUERY_STRING);
-
-    // Allocate enough memory for a response (up to 28 bytes + "OK+Get:")
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET) + 28 + 2, sizeof(char));
-    if (response == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-
-    retNameLen = sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
-    if (retNameLen == 0)
-    {
-        return HM1X_ERROR_TIMEOUT;
-    }
-    strcpy(name, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-
-    free(response);
-    free(command);
-    free(command_no_ble);
-    
-    return HM1X_SUCCESS;
+    return commandGetText(HM1X_CMD_BLE_NAME, name);
 }
 
 HM1X_error_t HM1X_BT::setBleName(String name)
 {
-    char * bleName;
-    bleName = (char *) calloc(name.length() + 1, sizeof(char));
-    name.toCharArray(bleName, name.length() + 1);
-    return setBleName(bleName);
+    return setBleName(name.c_str());
 }
 
 HM1X_error_t HM1X_BT::setBleName(const char * name)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    int nameLen;
-    char *command_no_ble;
-
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_NAME), sizeof(char));
-    if (command_no_ble == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_EDR_NAME);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_NAME);
-    }
-
-    nameLen = strlen(name);
-
-    if (nameLen > 28) // Name can't exceed 28 characters
-    {
-        return HM1X_UNEXPECTED_RESPONSE;
-    }
-
-    // Build command: e.g. AT+NAMBMY_BLE_DEVICE
-    command = (char *) calloc(strlen(command_no_ble) + nameLen + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, command_no_ble);
-    strcat(command, name);
-
-    // Build expected response: e.g. OK+Set:MY_BLE_DEVICE
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + nameLen + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_SET);
-    strcat(response, name);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-    free(command_no_ble);
-
-    return err;
+    return commandSetText(HM1X_CMD_BLE_NAME, name);
 }
 
 // checks EDR address
 // does not support HM-15/16/17/18/19
 String HM1X_BT::edrAddress(void)
 {
-    char * address;
-    address = (char *) calloc(22, sizeof(char));
+    char address[HM1X_ADDRESS_LEN + 1];
+
     if (edrAddress(address) == HM1X_SUCCESS)
     {
         return String(address);
@@ -937,38 +1286,18 @@ String HM1X_BT::edrAddress(void)
 // does not support HM-15/16/17/18/19
 HM1X_error_t HM1X_BT::edrAddress(char * retAddress)
 {
-    char * command;
-    char * response;
-
-    if ( (_btModel >= HM15) && (_btModel <= HM19))
-    {
-        // HM-15 to HM-19 does not support EDR
-        // return error
-        return HM1X_ERROR_ER;
-    }
-
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_ADR) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, HM1X_COMMAND_EDR_ADR);
-    strcat(command, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(20 + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
-
-    strcpy(retAddress, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+    return commandGetText(HM1X_CMD_EDR_ADR, retAddress);
+}
 
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+HM1X_error_t HM1X_BT::edrAddress(HM1X_address_t & address)
+{
+    return commandGetAddress(HM1X_CMD_EDR_ADR, address);
 }
 
 String HM1X_BT::bleAddress(void)
 {
-    char * address;
-    address = (char *) calloc(22, sizeof(char));
+    char address[HM1X_ADDRESS_LEN + 1];
+
     if (bleAddress(address) == HM1X_SUCCESS)
     {
         return String(address);
@@ -980,476 +1309,487 @@ String HM1X_BT::bleAddress(void)
 // AT+ADDR for non-dual devices
 HM1X_error_t HM1X_BT::bleAddress(char * retAddress)
 {
-    char * command;
-    char * response;
-    char *command_no_ble;
-
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_ADR_SINGLE), sizeof(char));
-    if (command_no_ble == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_ADR_SINGLE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_NAME);
-    }
+    return commandGetText(HM1X_CMD_BLE_ADR, retAddress);
+}
 
-    command = (char *) calloc(strlen(command_no_ble) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, command_no_ble);
-    strcat(command, HM1X_QUERY_STRING);
+HM1X_error_t HM1X_BT::bleAddress(HM1X_address_t & address)
+{
+    return commandGetAddress(HM1X_CMD_BLE_ADR, address);
+}
 
-    response = (char *) calloc(20 + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+// AT+RADE, AT+RADB -- Last connected EDR/BLE address
+// does not support HM-15/16/17/18/19
+HM1X_error_t HM1X_BT::lastEdrAddress(char * address)
+{
+    return commandGetText(HM1X_CMD_LAST_EDR, address);
+}
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+// AT+RADD for non-dual devices
+HM1X_error_t HM1X_BT::lastBleAddress(char * address)
+{
+    return commandGetText(HM1X_CMD_LAST_BLE, address);
+}
 
-    strcpy(retAddress, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    
-    free(response);
-    free(command);
-    free(command_no_ble);
+HM1X_error_t HM1X_BT::lastEdrAddress(HM1X_address_t & address)
+{
+    return commandGetAddress(HM1X_CMD_LAST_EDR, address);
+}
 
-    return HM1X_SUCCESS;
+HM1X_error_t HM1X_BT::lastBleAddress(HM1X_address_t & address)
+{
+    return commandGetAddress(HM1X_CMD_LAST_BLE, address);
 }
 
-// AT+RADE, AT+RADB -- Last connected EDR/BLE address
+// AT+BONDE, AT+BONDB --- Clear EDR/BLE bond info
 // does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::lastEdrAddress(char * address)
+HM1X_error_t HM1X_BT::clearEdrBond(void)
 {
-    char * command;
-    char * response;
+    return commandExecute(HM1X_CMD_CLEAR_BOND_EDR);
+}
 
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
-    {
-        // return error
-        return HM1X_ERROR_ER;
-    }
+HM1X_error_t HM1X_BT::clearBleBond(void)
+{
+    return commandExecute(HM1X_CMD_CLEAR_BOND_BLE);
+}
 
-    command = (char *) calloc(strlen(HM1X_COMMAND_LAST_EDR) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, HM1X_COMMAND_LAST_EDR);
-    strcat(command, HM1X_QUERY_STRING);
+// AT+CLEAE, AT+CLEAB -- Clear last connected EDR/BLE address
+// does not support HM-15/16/17/18/19
+HM1X_error_t HM1X_BT::clearEdrConnected(void)
+{
+    return commandExecute(HM1X_CMD_CLEAR_ADR_EDR);
+}
 
-    response = (char *) calloc(20 + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+// AT+CLEAR for non-dual devices
+HM1X_error_t HM1X_BT::clearBleConnected(void)
+{
+    return commandExecute(HM1X_CMD_CLEAR_ADR_BLE);
+}
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+// AT+ROLE, AT+ROLB -- EDR/BLE mode
+// does not support HM-15/16/17/18/19
+HM1X_error_t HM1X_BT::getEdrMode(HM1X_edr_mode_t * mode)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
-    strcpy(address, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+    *mode = EDR_MODE_INVALID;
+    err = commandGet(HM1X_CMD_EDR_MODE, &value);
+    if (err != HM1X_SUCCESS) return err;
+    if (value >= EDR_MODE_INVALID) return HM1X_UNEXPECTED_RESPONSE;
 
-    free(response);
-    free(command);
-    
+    *mode = (HM1X_edr_mode_t) value;
     return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::lastBleAddress(char * address)
+// sets the EDR mode
+// does not support HM-15/16/17/18/19
+HM1X_error_t HM1X_BT::setEdrMode(HM1X_edr_mode_t mode)
 {
-    char * command;
-    char * response;
-    char *command_no_ble;
-
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_LAST_BLE), sizeof(char));
-    if (command_no_ble == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_LAST_SINGLE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_LAST_BLE);
-    }
+    return commandSet(HM1X_CMD_EDR_MODE, mode);
+}
 
-    command = (char *) calloc(strlen(command_no_ble) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, command_no_ble);
-    strcat(command, HM1X_QUERY_STRING);
+// AT+ROLE for non-dual devices
+HM1X_error_t HM1X_BT::getBleMode(HM1X_ble_mode_t * mode)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
-    response = (char *) calloc(20 + 1, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+    *mode = BLE_MODE_INVALID;
+    err = commandGet(HM1X_CMD_BLE_MODE, &value);
+    if (err != HM1X_SUCCESS) return err;
+    if (value >= BLE_MODE_INVALID) return HM1X_UNEXPECTED_RESPONSE;
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    *mode = (HM1X_ble_mode_t) value;
+    return HM1X_SUCCESS;
+}
 
-    strcpy(address, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+HM1X_error_t HM1X_BT::setBleMode(HM1X_ble_mode_t mode)
+{
+    return commandSet(HM1X_CMD_BLE_MODE, mode);
+}
 
-    free(response);
-    free(command);
-    free(command_no_ble);
-    
-    return HM1X_SUCCESS;
+// What the module prints during AT+DISC?, matched a character at a time
+// in the _notice buffer: 'h' is a hex digit, 'd' a decimal digit or sign,
+// '?' any character. OK+NAME: is followed by the name up to the line end.
+typedef enum {
+    HM1X_DISC_START,
+    HM1X_DISC_END,
+    HM1X_DISC_DEVICE,
+    HM1X_DISC_RSSI,
+    HM1X_DISC_NAME,
+    HM1X_NUM_DISC_TOKENS
+} hm1x_disc_token_t;
+
+static const char hm1xDiscoveryTokens[HM1X_NUM_DISC_TOKENS][HM1X_NOTICE_LEN + 1] PROGMEM = {
+    "OK+DISCS",             // HM1X_DISC_START
+    "OK+DISCE",             // HM1X_DISC_END
+    "OK+DIS?:hhhhhhhhhhhh", // HM1X_DISC_DEVICE
+    "OK+RSSI:dddd",         // HM1X_DISC_RSSI
+    "OK+NAME:"              // HM1X_DISC_NAME
+};
+const uint8_t HM1X_DISC_VALUE_START = 8; // strlen("OK+DIS0:")
+const uint8_t HM1X_DISC_NONE = 0xFF;      // _discCurrent: no entry
+
+static boolean discoveryCharMatches(char pattern, char c)
+{
+    switch (pattern)
+    {
+    case 'h':
+        return (HM1X_address_t::hexDigit(c) >= 0);
+    case 'd':
+        return (((c >= '0') && (c <= '9')) || (c == '-'));
+    case '?':
+        return true;
+    default:
+        return (c == pattern);
+    }
 }
 
-// AT+BONDE, AT+BONDB --- Clear EDR/BLE bond info
-// does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::clearEdrBond(void)
+HM1X_error_t HM1X_BT::startDiscovery(HM1X_discovery_result_t * results, uint8_t size,
+                                     HM1X_discovery_callback_t onDone)
 {
     HM1X_error_t err;
-    char * command;
-    char * response;
 
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
+    if (_discovering)
     {
-        // return error
-        return HM1X_ERROR_ER;
+        return HM1X_ERROR_TRY_LATER;
     }
-
-    // Build command: e.g. AT+BONDE
-    command = (char *) calloc(strlen(HM1X_COMMAND_CLEAR_BOND_EDR) + 1, sizeof(char));
-    if (command == NULL)
+    if ((results == NULL) && (size > 0))
     {
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_ERROR_ER; // Nowhere to put the results
     }
-    strcat(command, HM1X_COMMAND_CLEAR_BOND_EDR);
-
-    // Build expected response: e.g. OK+BONDE
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS)
-                    + strlen(HM1X_COMMAND_CLEAR_BOND_EDR) + 1, sizeof(char));
-    if (response == NULL)
+    if ((_setCount > 0) || _pioSent)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_ERROR_TRY_LATER; // The scan parser would eat their replies
     }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_PLUS);
-    strcat(response, HM1X_COMMAND_CLEAR_BOND_EDR);
+    resolveNotice(true); // Bytes held back so far are data
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+    err = commandSend(HM1X_CMD_DISCOVER, HM1X_QUERY_STRING);
+    if (err != HM1X_SUCCESS) return err;
 
-    return err;
+    _discovering = true;
+    _discResults = results;
+    _discSize = size;
+    _discCount = 0;
+    _discCurrent = HM1X_DISC_NONE;
+    _scanEntry = NULL;
+    _discInName = false;
+    _discCallback = onDone;
+    _discTokenLen = 0;
+    _noticeTime = millis();
+    return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::clearBleBond(void)
+// The module can't be stopped mid-scan, so poll() keeps consuming its
+// output until the scan ends; the results and callback are just dropped.
+void HM1X_BT::stopDiscovery(void)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-
-    // Build command: e.g. AT+BONDB
-    command = (char *) calloc(strlen(HM1X_COMMAND_CLEAR_BOND_BLE) + 2, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, HM1X_COMMAND_CLEAR_BOND_BLE);
+    _discSize = 0;
+    _discCount = 0;
+    _discCurrent = HM1X_DISC_NONE;
+    _discCallback = NULL;
+}
 
-    // Build expected response: e.g. OK+BONDB
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS)
-                    + strlen(HM1X_COMMAND_CLEAR_BOND_BLE) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_PLUS);
-    strcat(response, HM1X_COMMAND_CLEAR_BOND_BLE);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+HM1X_error_t HM1X_BT::startIBeaconDiscovery(void)
+{
+    return commandSend(HM1X_CMD_DISCOVER_IBEACON, HM1X_QUERY_STRING);
+}
 
-    return err;
+HM1X_error_t HM1X_BT::reconnect(const HM1X_address_t & address, uint8_t attempts)
+{
+    _reconnectAddress = address;
+    _reconnectToLast = false;
+    return startReconnect(attempts);
 }
 
-// AT+CLEAE, AT+CLEAB -- Clear last connected EDR/BLE address
-// does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::clearEdrConnected(void)
+HM1X_error_t HM1X_BT::reconnectLast(uint8_t attempts)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
+    _reconnectToLast = true;
+    return startReconnect(attempts);
+}
 
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
+HM1X_error_t HM1X_BT::startReconnect(uint8_t attempts)
+{
+    if (attempts == 0)
     {
-        // return error
         return HM1X_ERROR_ER;
     }
-
-    // Build command: e.g. AT+CLEAE
-    command = (char *) calloc(strlen(HM1X_COMMAND_CLEAR_ADR_EDR) + 1, sizeof(char));
-    if (command == NULL)
-    {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(command, HM1X_COMMAND_CLEAR_ADR_EDR);
-
-    // Build expected response: e.g. OK+CLEAE
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS)
-                    + strlen(HM1X_COMMAND_CLEAR_ADR_EDR) + 1, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_PLUS);
-    strcat(response, HM1X_COMMAND_CLEAR_ADR_EDR);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    _reconnectLeft = attempts;
+    _reconnectBackoff = HM1X_RECONNECT_BACKOFF_MIN;
+    _reconnectStart = millis();
+    return reconnectAttempt();
 }
 
-HM1X_error_t HM1X_BT::clearBleConnected(void)
+// An attempt that can't be sent fails like one the module turned down,
+// with an event in place of the module's OK+CONNF, and the back-off
+// retries it
+HM1X_error_t HM1X_BT::reconnectAttempt(void)
 {
+    char address[HM1X_ADDRESS_LEN + 1];
+    HM1X_event_t event;
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char *command_no_ble;
 
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_CLEAR_ADR_BLE), sizeof(char));
-    if (command_no_ble == NULL)
+    if (_reconnectToLast)
     {
-        return HM1X_OUT_OF_MEMORY;
+        err = commandSend(HM1X_CMD_CONNECT_LAST, "");
     }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_CLEAR_ADR_SINGLE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_CLEAR_ADR_BLE);
-    }
-
-    // Build command: e.g. AT+CLEAB
-    command = (char *) calloc(strlen(command_no_ble) + 1, sizeof(char));
-    if (command == NULL)
+    else
     {
-        return HM1X_OUT_OF_MEMORY;
+        _reconnectAddress.toString(address);
+        err = commandSend(HM1X_CMD_CONNECT_ADDRESS, address);
     }
-    strcat(command, command_no_ble);
-
-    // Build expected response: e.g. OK+CLEAB
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS)
-                    + strlen(command_no_ble) + 1, sizeof(char));
-    if (response == NULL)
+    if (err != HM1X_SUCCESS)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_PLUS);
-    strcat(response, command_no_ble);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-    free(command_no_ble);
-
-    return err;
+        reconnectFailed();
+        event.type = HM1X_EVENT_CONNECT_FAILED;
+        event.link = HM1X_LINK_BLE;
+        event.address = _reconnectAddress;
+        if (_reconnectToLast) event.address.clear();
+        event.timestamp = millis();
+        raiseEvent(event);
+        return err;
+    }
+    _reconnectStats.attempts++;
+    _reconnectInFlight = true;
+    _reconnectTime = millis();
+    return HM1X_SUCCESS;
 }
 
-// AT+ROLE, AT+ROLB -- EDR/BLE mode
-// does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::getEdrMode(HM1X_edr_mode_t * mode)
+void HM1X_BT::reconnectFailed(void)
 {
-    char * command;
-    char * response;
-
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
+    _reconnectInFlight = false;
+    _reconnectTime = millis();
+    _reconnectLeft--;
+    if (_reconnectLeft == 0)
     {
-        // return error
-        return HM1X_ERROR_ER;
+        _reconnectStats.failures++;
     }
+}
 
-    // Set command string: "AT+ROLE?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_MODE) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, HM1X_COMMAND_EDR_MODE);
-    strcat(command, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 2, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
-
-    strcpy(response, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+// Times out attempts and starts retries once their back-off is up
+void HM1X_BT::pollReconnect(void)
+{
+    if (_reconnectLeft == 0) return;
 
-    if (strcmp(response, "0") == 0)
+    if (_reconnectInFlight)
     {
-        *mode = EDR_SLAVE;
-    }
-    else if (strcmp(response, "1") == 0)
-    {
-        *mode = EDR_MASTER;
+        if (millis() - _reconnectTime >= (unsigned long) HM1X_RECONNECT_TIMEOUT)
+        {
+            reconnectFailed();
+        }
     }
-    else 
+    else if (millis() - _reconnectTime >= _reconnectBackoff)
     {
-        *mode = EDR_MODE_INVALID;
-        return HM1X_UNEXPECTED_RESPONSE;
+        // A send error is counted as a failed attempt by reconnectAttempt()
+        // itself, so the next one comes after a longer back-off
+        reconnectAttempt();
+        _reconnectBackoff = (_reconnectBackoff < HM1X_RECONNECT_BACKOFF_MAX / 2) ?
+                            _reconnectBackoff * 2 : HM1X_RECONNECT_BACKOFF_MAX;
     }
-
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
 }
 
-// sets the EDR mode
-// does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::setEdrMode(HM1X_edr_mode_t mode)
+void HM1X_BT::reconnectEvent(const HM1X_event_t & event)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char modeParam;
+    if (event.link != HM1X_LINK_BLE) return;
 
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
+    if ((event.type == HM1X_EVENT_CONNECT) && (_reconnectLeft > 0))
     {
-        // return error
-        return HM1X_ERROR_ER;
+        unsigned long elapsed = millis() - _reconnectStart;
+        uint16_t time = (elapsed < 0xFFFF) ? elapsed : 0xFFFF;
+
+        _reconnectLeft = 0;
+        _reconnectInFlight = false;
+        _reconnectStats.lastTime = time;
+        if ((_reconnectStats.successes == 0) || (time < _reconnectStats.minTime))
+        {
+            _reconnectStats.minTime = time;
+        }
+        if (time > _reconnectStats.maxTime)
+        {
+            _reconnectStats.maxTime = time;
+        }
+        _reconnectStats.totalTime += time;
+        _reconnectStats.successes++;
     }
-    
-    if (mode == EDR_MODE_INVALID)
+    else if ((event.type == HM1X_EVENT_CONNECT_FAILED) && _reconnectInFlight)
     {
-        return HM1X_UNEXPECTED_RESPONSE;
+        reconnectFailed();
     }
-
-    // Build command: e.g. AT+ROLE0
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_MODE) + 2, sizeof(char));
-    modeParam = (mode == EDR_SLAVE) ? '0' : '1';
-    sprintf(command, "%s%c", HM1X_COMMAND_EDR_MODE, modeParam);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    else if ((event.type == HM1X_EVENT_DISCONNECT) && (_autoReconnect > 0) && (_reconnectLeft == 0))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        if (!event.address.isNull())
+        {
+            reconnect(event.address, _autoReconnect);
+        }
+        else if (!_blePeer.isNull())
+        {
+            reconnect(_blePeer, _autoReconnect);
+        }
+        else
+        {
+            reconnectLast(_autoReconnect);
+        }
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, modeParam);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
 }
 
-HM1X_error_t HM1X_BT::getBleMode(HM1X_ble_mode_t * mode)
+// Scan output is picked out a line at a time; anything that can't be
+// part of a scan line (a notice, or data from a link) goes on to
+// parseByte() in the order it arrived.
+void HM1X_BT::parseDiscovery(char c)
 {
-    char * command;
-    char * response;
-    char *command_no_ble;
+    boolean partial = false;
 
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_MODE), sizeof(char));
-    if (command_no_ble == NULL)
+    _noticeTime = millis();
+    if (_discInName)
     {
-        return HM1X_OUT_OF_MEMORY;
+        if ((c == '\r') || (c == '\n'))
+        {
+            _discInName = false;
+        }
+        else if (_discCurrent != HM1X_DISC_NONE)
+        {
+            char * name = _discResults[_discCurrent].name;
+            uint8_t len = strlen(name);
+            if (len < HM1X_DISCOVERY_NAME_LEN)
+            {
+                name[len] = c;
+                name[len + 1] = '\0';
+            }
+        }
+        return;
     }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_EDR_MODE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_MODE);
+    if (_discTokenLen == 0)
+    {
+        if ((c == '\r') || (c == '\n'))
+        {
+            return; // The end of a scan line
+        }
+        if (c != HM1X_NOTICE_PREFIX[0])
+        {
+            parseByte(c);
+            return;
+        }
     }
+    _discToken[_discTokenLen++] = c;
 
-    // Set command string: "AT+ROLE?""
-    command = (char *) calloc(strlen(command_no_ble) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    strcpy(command, command_no_ble);
-    strcat(command, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 2, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    for (uint8_t t = 0; t < HM1X_NUM_DISC_TOKENS; t++)
+    {
+        PGM_P token = hm1xDiscoveryTokens[t];
+        uint8_t i = 0;
 
-    strcpy(response, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+        while ((i < _discTokenLen) && (pgm_read_byte(token + i) != '\0') &&
+               discoveryCharMatches(pgm_read_byte(token + i), _discToken[i]))
+        {
+            i++;
+        }
+        if (i < _discTokenLen) continue;
 
-    if (strcmp(response, "0") == 0)
-    {
-        *mode = BLE_PERIPHERAL;
-    }
-    else if (strcmp(response, "1") == 0)
-    {
-        *mode = BLE_CENTRAL;
+        if (pgm_read_byte(token + i) == '\0')
+        {
+            handleDiscoveryToken(t);
+            _discTokenLen = 0;
+            return;
+        }
+        partial = true;
     }
-    else 
+    if (!partial)
     {
-        *mode = BLE_MODE_INVALID;
-        return HM1X_UNEXPECTED_RESPONSE;
+        // Not scan output: pass it on, keeping this character if it could
+        // begin a scan line
+        if ((c == HM1X_NOTICE_PREFIX[0]) && (_discTokenLen > 1))
+        {
+            releaseDiscoveryBytes(_discTokenLen - 1);
+        }
+        else
+        {
+            releaseDiscoveryBytes(_discTokenLen);
+        }
     }
-
-    free(response);
-    free(command);
-    free(command_no_ble);
-    
-    return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::setBleMode(HM1X_ble_mode_t mode)
+// Hand the first count held bytes to the notice and data parser
+void HM1X_BT::releaseDiscoveryBytes(uint8_t count)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char modeParam;
-    char *command_no_ble;
-    
-    if (mode == EDR_MODE_INVALID)
+    for (uint8_t i = 0; i < count; i++)
     {
-        return HM1X_UNEXPECTED_RESPONSE;
+        parseByte(_discToken[i]);
     }
+    _discTokenLen -= count;
+    memmove(_discToken, &_discToken[count], _discTokenLen);
+}
 
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_MODE), sizeof(char));
-    if (command_no_ble == NULL)
+void HM1X_BT::handleDiscoveryToken(uint8_t token)
+{
+    HM1X_address_t address;
+    int8_t rssi;
+
+    switch (token)
     {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for Edr (main)
-        strcpy(command_no_ble, HM1X_COMMAND_EDR_MODE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_MODE);
+    case HM1X_DISC_END:
+        _discTokenLen = 0; // The token itself, not held data
+        finishDiscovery();
+        break;
+    case HM1X_DISC_DEVICE:
+        address.parse(&_discToken[HM1X_DISC_VALUE_START]);
+        if (_scanCache != NULL)
+        {
+            _scanEntry = _scanCache->sighting(address);
+        }
+        for (_discCurrent = 0; _discCurrent < _discCount; _discCurrent++)
+        {
+            if (_discResults[_discCurrent].address == address) break;
+        }
+        if (_discCurrent == _discCount)
+        {
+            if (_discCount == _discSize)
+            {
+                _discCurrent = HM1X_DISC_NONE; // Table full
+                break;
+            }
+            _discResults[_discCurrent].address = address;
+            _discResults[_discCurrent].rssi = 0;
+            _discResults[_discCurrent].name[0] = '\0';
+            _discCount++;
+        }
+        _discResults[_discCurrent].index = _discToken[HM1X_DISC_VALUE_START - 2];
+        break;
+    case HM1X_DISC_RSSI:
+        _discToken[_discTokenLen] = '\0';
+        rssi = atoi(&_discToken[HM1X_DISC_VALUE_START]);
+        if (_discCurrent != HM1X_DISC_NONE)
+        {
+            _discResults[_discCurrent].rssi = rssi;
+        }
+        if (_scanCache != NULL)
+        {
+            _scanCache->addRssi(_scanEntry, rssi);
+        }
+        break;
+    case HM1X_DISC_NAME:
+        if (_discCurrent != HM1X_DISC_NONE)
+        {
+            _discResults[_discCurrent].name[0] = '\0';
+        }
+        _discInName = true;
+        break;
+    default:
+        break;
     }
+}
 
-    // Build command: e.g. AT+ROLB0
-    command = (char *) calloc(strlen(command_no_ble) + 2, sizeof(char));
-    modeParam = (mode == EDR_SLAVE) ? '0' : '1';
-    sprintf(command, "%s%c", command_no_ble, modeParam);
+void HM1X_BT::finishDiscovery(void)
+{
+    HM1X_discovery_result_t * results = _discResults;
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    // Cleared first so the callback can start another scan. A scan that
+    // timed out may have left bytes held that were data after all.
+    _discovering = false;
+    _discInName = false;
+    releaseDiscoveryBytes(_discTokenLen);
+    if (_discCallback != NULL)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        _discCallback(results, _discCount);
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, modeParam);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-    free(command_no_ble);
-
-    return err;
 }
 
 // AT+HIGH -- Data transmission speed mode
@@ -1457,68 +1797,14 @@ HM1X_error_t HM1X_BT::setBleMode(HM1X_ble_mode_t mode)
 // Enabled: SPP will go high speed
 HM1X_error_t HM1X_BT::enableHighSpeedSPP(boolean enabled)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char hsParam;
-
-    // Build command: e.g. AT+HIGH0
-    command = (char *) calloc(strlen(HM1X_COMMAND_HIGH_SPEED_SPP) + 2, sizeof(char));
-    hsParam = (enabled) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_HIGH_SPEED_SPP, hsParam);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, hsParam);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return commandSet(HM1X_CMD_HIGH_SPEED_SPP, enabled ? 1 : 0);
 }
 
-// This is only supported in HM12/13/14
+// AT+DUAL -- Dual work mode, 0 enables it
+// This is only supported in HM12/13
 HM1X_error_t HM1X_BT::enableDualMode(boolean enabled)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char hsParam;
-
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
-    {
-        // return error
-        return HM1X_ERROR_ER;
-    }
-
-    // Build command: e.g. AT+DUAL0
-    command = (char *) calloc(strlen(HM1X_COMMAND_DUAL_WORK_MODE) + 2, sizeof(char));
-    hsParam = (enabled) ? '0' : '1';
-    sprintf(command, "%s%c", HM1X_COMMAND_DUAL_WORK_MODE, hsParam);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, hsParam);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return commandSet(HM1X_CMD_DUAL_WORK_MODE, enabled ? 0 : 1);
 }
 
 // AT+MODE -- Module work mode
@@ -1526,1316 +1812,1438 @@ HM1X_error_t HM1X_BT::enableDualMode(boolean enabled)
 // Disabled: Data transmission only 
 HM1X_error_t HM1X_BT::enableRemoteControl(boolean enabled)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
-
-    // Build command: e.g. AT+MODE0
-    command = (char *) calloc(strlen(HM1X_COMMAND_MODULE_WORK_MODE) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    param = (enabled) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_MODULE_WORK_MODE, param);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return commandSet(HM1X_CMD_MODULE_WORK_MODE, enabled ? 1 : 0);
 }
 
 // AT+ATOB -- A to B mode
 // When two modules connected (BLE and SPP), this will route data from one to the other
 HM1X_error_t HM1X_BT::enableAtoB(boolean enable)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
+    return commandSet(HM1X_CMD_A_TO_B_MODE, enable ? 1 : 0);
+}
 
-    // Build command: e.g. AT+ATOB0
-    command = (char *) calloc(strlen(HM1X_COMMAND_A_TO_B_MODE) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    param = (enable) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_A_TO_B_MODE, param);
+// AT+AUTH -- Authentication mode
+HM1X_error_t HM1X_BT::enableAuthenticationMode(boolean enable)
+{
+    return commandSet(HM1X_CMD_AUTHENTICATION_MODE, enable ? 1 : 0);
+}
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+// AT+PINE, AT+PINB -- EDR/BLE PIN Code
+// does not support HM-15/16/17/18/19
+HM1X_error_t HM1X_BT::getEdrPin(char * code)
+{
+    return commandGetText(HM1X_CMD_EDR_PIN_CODE, code);
+}
 
-    return err;
+// AT+PASS for non-dual devices
+HM1X_error_t HM1X_BT::getBlePin(char * code)
+{
+    return commandGetText(HM1X_CMD_BLE_PIN_CODE, code);
 }
 
-    // AT+AUTH -- Authentication mode
-HM1X_error_t HM1X_BT::enableAuthenticationMode(boolean enable)
+// PIN codes are up to 6 decimal digits
+HM1X_error_t HM1X_BT::setEdrPin(char * code)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
+    return commandSetText(HM1X_CMD_EDR_PIN_CODE, code);
+}
 
-    // Build command: e.g. AT+ATOB0
-    command = (char *) calloc(strlen(HM1X_COMMAND_AUTHENTICATION_MODE) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    param = (enable) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_AUTHENTICATION_MODE, param);
+HM1X_error_t HM1X_BT::setBlePin(char * code)
+{
+    return commandSetText(HM1X_CMD_BLE_PIN_CODE, code);
+}
+
+// AT+COFD -- Class of device
+// Can set to any value between 0x000000 to 0xFFFFFE
+HM1X_error_t HM1X_BT::setCod(uint32_t cod)
+{
+    return commandSet(HM1X_CMD_COD, cod);
+}
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+// AT+COUP -- Update connection parameter
+// Only usable in  BLE slave mode. Updates min/max interval, slave latency, and connection supervised timeout
+HM1X_error_t HM1X_BT::enableUpdateConnectionParameter(boolean enable)
+{
+    return commandSet(HM1X_CMD_UPDATE_CON_PARAM, enable ? 1 : 0);
+}
+
+boolean HM1X_BT::iBeacon(boolean enable)
+{
+    if (enableiBeacon(enable) == HM1X_SUCCESS)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return true;
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+    return false;
+}
 
-    return err;
+// AT+IBEA -- Enable iBeacon
+HM1X_error_t HM1X_BT::enableiBeacon(boolean enabled)
+{
+    return commandSet(HM1X_CMD_IBEACON_SWITCH, enabled ? 1 : 0);
 }
 
-// AT+PINE, AT+PINB -- EDR/BLE PIN Code
-// does not support HM-15/16/17/18/19
-HM1X_error_t HM1X_BT::getEdrPin(char * code)
+String HM1X_BT::getiBeaconUUID(void)
 {
-    char * command;
-    char * response;
+    char uuid[HM1X_UUID_LEN + 1];
 
-    // Check if EDR is supported
-    if ( !_isEdrSupported )
+    if (getiBeaconUUID(uuid) == HM1X_SUCCESS)
     {
-        // return error
-        return HM1X_ERROR_ER;
+        return String(uuid);
     }
+    return "";
+}
 
-    // Set command string: "AT+PINE?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_PIN_CODE) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_EDR_PIN_CODE, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 8, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-    
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+// AT+IBE0, AT+IBE1, AT+IBE2, AT+IBE3 -- Get/Set iBeacon UUID
+// uuid must hold 32 characters plus the terminator
+HM1X_error_t HM1X_BT::getiBeaconUUID(char * uuid)
+{
+    HM1X_error_t err;
 
-    strcpy(code, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        err = getiBeaconUUID(uuid + (i * 8), i);
+        if (err != HM1X_SUCCESS)
+        {
+            return err;
+        }
+    }
+    return HM1X_SUCCESS;
+}
 
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;    
+HM1X_error_t HM1X_BT::getiBeaconUUID(char * uuid, uint8_t position)
+{
+    if (position > 3)
+    {
+        return HM1X_UNEXPECTED_RESPONSE;
+    }
+    return commandGetText(HM1X_CMD_IBEACON_UUID, uuid, position);
 }
 
-// AT+PINE, AT+PINB -- EDR/BLE PIN Code
-HM1X_error_t HM1X_BT::getBlePin(char * code)
+HM1X_error_t HM1X_BT::setiBeaconUUID(char * first, char * second, char * third, char * fourth)
 {
-    char * command;
-    char * response;
-    char *command_no_ble;
+    char * parts[4] = {first, second, third, fourth};
+    HM1X_error_t err;
 
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_PIN_CODE), sizeof(char));
-    if (command_no_ble == NULL)
+    for (uint8_t i = 0; i < 4; i++)
     {
-        return HM1X_OUT_OF_MEMORY;
+        err = setiBeaconUUID(parts[i], i);
+        if (err != HM1X_SUCCESS)
+        {
+            return err;
+        }
     }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for single
-        strcpy(command_no_ble, HM1X_COMMAND_PIN_CODE_SINGLE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_PIN_CODE);
+    return HM1X_SUCCESS;
+}
+
+// Each part must be exactly 8 hex characters
+HM1X_error_t HM1X_BT::setiBeaconUUID(char * uuid, uint8_t position)
+{
+    if (position > 3)
+    {
+        return HM1X_UNEXPECTED_RESPONSE;
     }
+    return commandSetText(HM1X_CMD_IBEACON_UUID, uuid, position);
+}
 
-    // Set command string: "AT+PINB?""
-    command = (char *) calloc(strlen(command_no_ble) + strlen(HM1X_QUERY_STRING) + 1, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", command_no_ble, HM1X_QUERY_STRING);
+// AT+MAJO, AT+MINO -- iBeacon Major/Minor version
+HM1X_error_t HM1X_BT::getiBeaconMajor(uint16_t * version)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 8, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-    
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    err = commandGet(HM1X_CMD_IBEACON_MAJOR, &value);
+    if (err == HM1X_SUCCESS) *version = value;
+    return err;
+}
 
-    strcpy(code, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+HM1X_error_t HM1X_BT::setiBeaconMajor(uint16_t version)
+{
+    return commandSet(HM1X_CMD_IBEACON_MAJOR, version);
+}
 
-    free(response);
-    free(command);
-    free(command_no_ble);
-    
-    return HM1X_SUCCESS;    
+HM1X_error_t HM1X_BT::getiBeaconMinor(uint16_t * version)
+{
+    HM1X_error_t err;
+    uint32_t value;
+
+    err = commandGet(HM1X_CMD_IBEACON_MINOR, &value);
+    if (err == HM1X_SUCCESS) *version = value;
+    return err;
 }
 
-HM1X_error_t HM1X_BT::setEdrPin(char * code)
+HM1X_error_t HM1X_BT::setiBeaconMinor(uint16_t version)
+{
+    return commandSet(HM1X_CMD_IBEACON_MINOR, version);
+}
+
+// AT+MEAS -- iBeacon Measured Power
+HM1X_error_t HM1X_BT::getiBeaconPower(uint8_t * power)
 {
     HM1X_error_t err;
-    char * command;
-    char * response;
+    uint32_t value;
 
-    if (strlen(code) > 6) return HM1X_UNEXPECTED_RESPONSE;
-    // TODO: Should check if the code is numeric here
+    err = commandGet(HM1X_CMD_IBEACON_POWER, &value);
+    if (err == HM1X_SUCCESS) *power = value;
+    return err;
+}
 
-    // Build command: e.g. AT+EDR1234
-    command = (char *) calloc(strlen(HM1X_COMMAND_EDR_PIN_CODE) + 8, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_EDR_PIN_CODE, code);
+HM1X_error_t HM1X_BT::setiBeaconPower(uint8_t power)
+{
+    return commandSet(HM1X_CMD_IBEACON_POWER, power);
+}
 
-    // Build expected response: e.g. OK+Set:1234
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 8, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%s", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, code);
+// Fire-and-forget iBeacon setters, see commandSetAsync()
+HM1X_error_t HM1X_BT::setiBeaconMajorAsync(uint16_t version)
+{
+    return commandSetAsync(HM1X_CMD_IBEACON_MAJOR, version);
+}
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+HM1X_error_t HM1X_BT::setiBeaconMinorAsync(uint16_t version)
+{
+    return commandSetAsync(HM1X_CMD_IBEACON_MINOR, version);
+}
 
-    return err;
+HM1X_error_t HM1X_BT::setiBeaconPowerAsync(uint8_t power)
+{
+    return commandSetAsync(HM1X_CMD_IBEACON_POWER, power);
 }
 
-HM1X_error_t HM1X_BT::setBlePin(char * code)
+// AT+MTUS -- MTU Size
+HM1X_error_t HM1X_BT::setMtuSize(HM1X_mtu_size_t mtuSize)
 {
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char *command_no_ble;
 
-    command_no_ble = (char*) calloc(strlen(HM1X_COMMAND_BLE_PIN_CODE), sizeof(char));
-    if (command_no_ble == NULL)
+    err = commandSet(HM1X_CMD_MTU_SIZE, mtuSize);
+    if (err == HM1X_SUCCESS)
     {
-        return HM1X_OUT_OF_MEMORY;
-    }
-    // check if EDR is disabled
-    if ( !_isEdrSupported ){
-        // use the code for single
-        strcpy(command_no_ble, HM1X_COMMAND_PIN_CODE_SINGLE);
-    }else{
-        // use as is
-        strcpy(command_no_ble, HM1X_COMMAND_BLE_PIN_CODE);
+        setTxPacketSize(((mtuSize == MTU_SIZE_120) ? 120 : 60) - HM1X_ATT_HEADER_LEN);
     }
-    
-
-    if (strlen(code) > 6) return HM1X_UNEXPECTED_RESPONSE;
-    // TODO: Should check if the code is numeric here
+    return err;
+}
 
-    // Build command: e.g. AT+EDR1234
-    command = (char *) calloc(strlen(command_no_ble) + 8, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", command_no_ble, code);
+// AT+SCAN -- EDR Advert type
+HM1X_error_t HM1X_BT::getEdrAdvertType(HM1X_edr_advert_t * type)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
-    // Build expected response: e.g. OK+Set:1234
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 8, sizeof(char));
-    if (response == NULL)
+    *type = EDR_ADVERT_UNDEFINED;
+    err = commandGet(HM1X_CMD_ADVERT_TYPE, &value);
+    if ((err == HM1X_SUCCESS) && (value < EDR_ADVERT_UNDEFINED))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        *type = (HM1X_edr_advert_t) value;
     }
-    sprintf(response, "%s%s%s", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, code);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-    free(command_no_ble);
-
     return err;
 }
 
-// AT+COFD -- Class of device
-// Can set to any value between 0x000000 to 0xFFFFFE
-HM1X_error_t HM1X_BT::setCod(uint32_t cod)
+HM1X_error_t HM1X_BT::setEdrAdvertType(HM1X_edr_advert_t type)
 {
-    HM1X_error_t err;
-    char * command;
-    char * response;
+    return commandSet(HM1X_CMD_ADVERT_TYPE, type);
+}
 
-    // Build command: e.g. AT+COFD001F00
-    command =(char *) calloc(strlen(HM1X_COMMAND_COD) + 7, sizeof(char));
-    sprintf(command, "%s%06X", HM1X_COMMAND_COD, cod);
+// AT+SAFE -- Module safe mode
+HM1X_error_t HM1X_BT::enableSafeMode(boolean enabled)
+{
+    return commandSet(HM1X_CMD_SAFE_MODE, enabled ? 1 : 0);
+}
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 7, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%06X", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, cod);
+// AT+ONEM -- Whether to use BLE MAC address
+// Note: If you want to use BLE in Android, don't use this command :S
+HM1X_error_t HM1X_BT::disableBleAddress(boolean disabled)
+{
+    return commandSet(HM1X_CMD_BLE_MAC, disabled ? 1 : 0);
+}
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+// AT+PIO0 -- Enable system key function on PIO0
+HM1X_error_t HM1X_BT::enableSystemKey(boolean enabled)
+{
+    return commandSet(HM1X_CMD_SYSTEM_KEY, enabled ? 1 : 0);
+}
 
-    return err;
+// AT+PIO1 -- System LED, PIO1 control
+HM1X_error_t HM1X_BT::setLedMode(HM1X_led_mode_t mode)
+{
+    return commandSet(HM1X_CMD_SYSTEM_LED, (mode == BLINK_DISCONNECTED) ? 0 : 1);
 }
 
-// AT+COUP -- Update connection parameter
-// Only usable in  BLE slave mode. Updates min/max interval, slave latency, and connection supervised timeout
-HM1X_error_t HM1X_BT::enableUpdateConnectionParameter(boolean enable)
+// AT+PIO -- Write/query PIO
+HM1X_error_t HM1X_BT::readPio(uint8_t pin, uint8_t * value)
 {
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
+    uint32_t state;
 
-    // Build command: e.g. AT+COUP1
-    command = (char *) calloc(strlen(HM1X_COMMAND_UPDATE_CON_PARAM) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    param = (enable) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_UPDATE_CON_PARAM, param);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    if ((pin > 15) || ((_pioPins & (1 << pin)) == 0))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_UNEXPECTED_RESPONSE;
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
 
+    err = commandGet(HM1X_CMD_PIO_STATUS, &state, pin);
+    if (err == HM1X_SUCCESS) *value = state;
     return err;
 }
 
-boolean HM1X_BT::iBeacon(boolean enable)
+HM1X_error_t HM1X_BT::writePio(uint8_t pin, uint8_t value)
 {
-    if (enableiBeacon(enable) == HM1X_SUCCESS)
+    if ((pin > 15) || ((_pioPins & (1 << pin)) == 0))
     {
-        return true;
+        return HM1X_UNEXPECTED_RESPONSE;
     }
-    return false;
+    return commandSet(HM1X_CMD_PIO_STATUS, (value >= 1) ? 1 : 0, pin);
 }
 
-// AT+IBEA -- Enable iBeacon
-HM1X_error_t HM1X_BT::enableiBeacon(boolean enabled)
+// AT+PIO?? -- All PIOs, read from poll()
+HM1X_error_t HM1X_BT::requestPios(void)
 {
+    hm1x_command_desc_t desc;
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
-
-    // Build command: e.g. AT+IBEA1
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_SWITCH) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    param = (enabled) ? '1' : '0';
-    sprintf(command, "%s%c", HM1X_COMMAND_IBEACON_SWITCH, param);
-
-    // Build expected response: e.g. OK+Set:1
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+    err = loadCommand(HM1X_CMD_PIO_ALL, &desc);
+    if (err != HM1X_SUCCESS) return err;
+    if (_discovering) return HM1X_ERROR_TRY_LATER;
 
-    return err;
+    _pioRequested = true;
+    pollPios();
+    return HM1X_SUCCESS;
 }
 
-String HM1X_BT::getiBeaconUUID(void)
+void HM1X_BT::watchPios(uint16_t mask, uint16_t interval, HM1X_pio_callback_t onChange)
 {
-    char * uuid;
-    uuid = (char *) calloc(33, sizeof(char));
-    if (getiBeaconUUID(uuid) == HM1X_SUCCESS)
-    {
-        return String(uuid);
-    }
-    return "";
+    _pioMask = mask;
+    _pioInterval = interval;
+    _pioCallback = onChange;
+    _pioKnown = false; // So the first read reports
+    _pioRequested = (interval > 0);
 }
 
-// AT+IBE0, AT+IBE1, AT+IBE2, AT+IBE3 -- Get/Set iBeacon UUID
-HM1X_error_t HM1X_BT::getiBeaconUUID(char * uuid)
+// AT+BAUD -- Baud rate
+// The character sent for each baud rate differs between models
+HM1X_error_t HM1X_BT::setBaud(HM1X_baud_t atob)
 {
-    HM1X_error_t err;
-    char * uuidPart;
-    uuidPart = (char *) calloc(8 * 4, sizeof(char));
-    
-    if (uuidPart == NULL) {
-        return HM1X_OUT_OF_MEMORY;
-    }
+    uint8_t baudCharNum;
 
-    for (int i = 0; i < 4; i++)
+    if (findBaudFromArray(atob, baudCharNum) != HM1X_SUCCESS)
     {
-        err = getiBeaconUUID(uuidPart + (i * 8), i);
-        if (err != HM1X_SUCCESS)
-        {
-            free(uuidPart);
-            return err;
-        }
+        return HM1X_UNEXPECTED_RESPONSE;
     }
-    strcpy(uuid, uuidPart);
-    return HM1X_SUCCESS;
+    return commandSet(HM1X_CMD_BAUD, baudCharNum);
 }
 
-HM1X_error_t HM1X_BT::getiBeaconUUID(char * uuid, uint8_t position)
+HM1X_error_t HM1X_BT::setBaud(uint32_t baud)
 {
-    char * command;
-    char * response;
+    HM1X_baud_t atob;
 
-    if (position > 3)
+    if (findBaudFromRate(baud, atob) != HM1X_SUCCESS)
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
+    return setBaud(atob);
+}
 
-    // Set command string: "AT+IBE<pos>?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_UUID) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%d%s", HM1X_COMMAND_IBEACON_UUID, position, HM1X_QUERY_STRING);
+// AT+FIOW -- Hardware flow control
+// Turns on the module's RTS/CTS handshake, and has the library drive rtsPin
+// (our RTS, to the module's CTS) and watch ctsPin (the module's RTS) from its
+// read/write paths. Pass HM1X_NO_PIN for a line that isn't wired.
+// The module applies the setting after a reset.
+HM1X_error_t HM1X_BT::enableFlowControl(uint8_t rtsPin, uint8_t ctsPin, boolean enabled)
+{
+    HM1X_error_t err;
 
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 10, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-    
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    if (_serial == NULL)
+    {
+        return HM1X_ERROR_ER; // Only UART transports have RTS/CTS lines
+    }
 
-    strcpy(uuid, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
+    err = commandSet(HM1X_CMD_FLOW_CONTROL, enabled ? 1 : 0);
+    if (err != HM1X_SUCCESS) return err;
 
-    free(response);
-    free(command);
-    
+    if (enabled)
+    {
+        _rtsPin = rtsPin;
+        _ctsPin = ctsPin;
+        if (_rtsPin != HM1X_NO_PIN)
+        {
+            pinMode(_rtsPin, OUTPUT);
+            updateRts();
+        }
+        if (_ctsPin != HM1X_NO_PIN)
+        {
+            pinMode(_ctsPin, INPUT);
+        }
+    }
+    else
+    {
+        if (_rtsPin != HM1X_NO_PIN)
+        {
+            digitalWrite(_rtsPin, LOW); // Leave the module free to send
+        }
+        _rtsPin = HM1X_NO_PIN;
+        _ctsPin = HM1X_NO_PIN;
+    }
     return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::setiBeaconUUID(char * first, char * second, char * third, char * fourth)
+// RTS is deasserted once this many bytes are waiting to be read
+// (library receive buffer plus the serial port's own buffer)
+void HM1X_BT::setFlowControlThreshold(uint8_t level)
 {
-    setiBeaconUUID(first, 0);
-    setiBeaconUUID(second, 1);
-    setiBeaconUUID(third, 2);
-    return setiBeaconUUID(fourth, 3);
+    _rtsThreshold = level;
+    updateRts();
 }
 
-HM1X_error_t HM1X_BT::setiBeaconUUID(char * uuid, uint8_t position)
+// Applies a named profile as one batch. Every step is checked against this
+// model, and the baud against what the transport can follow, before anything
+// is sent. Each setting's current value is read first, so a step or baud the
+// module refuses puts back the ones already made. The baud change goes last:
+// the module is reset, the MCU side switches to the new baud in lockstep, and
+// the link is verified before returning. A failure from there on leaves the
+// settings made and the MCU side at whichever baud still answers.
+HM1X_error_t HM1X_BT::applyProfile(HM1X_profile_t profile)
 {
+    hm1x_command_desc_t desc;
+    hm1x_profile_step_t step;
+    HM1X_baud_t baud;
+    uint8_t baudChar;
+    unsigned long maxBaud;
+    uint32_t value;
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char param;
 
-    if (position > 3)
+    static const hm1x_profile_step_t hm1xProfileSteps[] PROGMEM = {
+        // Max throughput: SPP high speed, 120 byte MTU, one link at a time
+        { PROFILE_MAX_THROUGHPUT, HM1X_MODELS_DUAL, HM1X_CMD_HIGH_SPEED_SPP, 1 },
+        { PROFILE_MAX_THROUGHPUT, HM1X_MODELS_DUAL, HM1X_CMD_MTU_SIZE,       MTU_SIZE_120 },
+        { PROFILE_MAX_THROUGHPUT, HM1X_MODELS_DUAL, HM1X_CMD_DUAL_WORK_MODE, 1 },
+        // Low latency: high speed, but small packets go out without waiting to fill
+        { PROFILE_LOW_LATENCY,    HM1X_MODELS_DUAL, HM1X_CMD_HIGH_SPEED_SPP, 1 },
+        { PROFILE_LOW_LATENCY,    HM1X_MODELS_DUAL, HM1X_CMD_MTU_SIZE,       MTU_SIZE_60 },
+        // Low power: balanced speed, one radio link, slow UART
+        { PROFILE_LOW_POWER,      HM1X_MODELS_DUAL, HM1X_CMD_HIGH_SPEED_SPP, 0 },
+        { PROFILE_LOW_POWER,      HM1X_MODELS_DUAL, HM1X_CMD_MTU_SIZE,       MTU_SIZE_60 },
+        { PROFILE_LOW_POWER,      HM1X_MODELS_DUAL, HM1X_CMD_DUAL_WORK_MODE, 1 },
+    };
+    const uint8_t numSteps = sizeof(hm1xProfileSteps) / sizeof(hm1xProfileSteps[0]);
+    uint8_t previous[numSteps];
+
+    if (profile >= NUM_HM1X_PROFILES)
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
 
-    if (strlen(uuid) < 8)
+    // Validate the whole batch before touching the module
+    for (uint8_t i = 0; i < numSteps; i++)
     {
-        // TODO: Should pre-pend 0's here
-        return HM1X_UNEXPECTED_RESPONSE;
+        memcpy_P(&step, &hm1xProfileSteps[i], sizeof(step));
+        if ((step.profile != profile) || ((step.models & (1 << _btModel)) == 0)) continue;
+
+        err = loadCommand((HM1X_command_t) step.command, &desc);
+        if (err != HM1X_SUCCESS) return err;
+        if ((step.value < desc.minValue) || (step.value > desc.maxValue)) return HM1X_UNEXPECTED_RESPONSE;
     }
-    else if (strlen(uuid) > 8 )
+
+    // The profile's baud, or the next lower one both ends can run
+    maxBaud = maxTransportBaud();
+    baud = (HM1X_baud_t) hm1xProfileBauds[profile];
+    while ((findBaudFromArray(baud, baudChar) != HM1X_SUCCESS) ||
+           ((maxBaud > 0) && ((unsigned long) btBauds[baud] > maxBaud)))
     {
-        return HM1X_UNEXPECTED_RESPONSE;
+        if (baud == HM1X_BAUD_1200) return HM1X_ERROR_ER;
+        baud = (HM1X_baud_t) (baud - 1);
     }
+    if (((unsigned long) btBauds[baud] != _baud) && (maxBaud == 0))
+    {
+        return HM1X_ERROR_ER; // Module would move to a baud we can't follow
+    }
+
+    // Note what each setting is now, so a failure part way can undo the rest
+    for (uint8_t i = 0; i < numSteps; i++)
+    {
+        memcpy_P(&step, &hm1xProfileSteps[i], sizeof(step));
+        if ((step.profile != profile) || ((step.models & (1 << _btModel)) == 0)) continue;
 
-    // Build command: e.g. AT+IBEA1
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_UUID) + 10, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%d%s", HM1X_COMMAND_IBEACON_UUID, position, uuid);
+        err = commandGet((HM1X_command_t) step.command, &value);
+        if (err != HM1X_SUCCESS) return err;
+        previous[i] = value;
+    }
 
-    // Build expected response: e.g. OK+Set:1
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 10, sizeof(char));
-    if (response == NULL)
+    // Apply settings, then the baud
+    for (uint8_t i = 0; i <= numSteps; i++)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        if (i == numSteps)
+        {
+            err = setBaud(baud);
+        }
+        else
+        {
+            memcpy_P(&step, &hm1xProfileSteps[i], sizeof(step));
+            if ((step.profile != profile) || ((step.models & (1 << _btModel)) == 0)) continue;
+            err = applyProfileStep(step.command, step.value);
+        }
+        if (err == HM1X_SUCCESS) continue;
+
+        while (i-- > 0)
+        {
+            memcpy_P(&step, &hm1xProfileSteps[i], sizeof(step));
+            if ((step.profile != profile) || ((step.models & (1 << _btModel)) == 0)) continue;
+            applyProfileStep(step.command, previous[i]);
+        }
+        return err;
     }
-    sprintf(response, "%s%s%s", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, uuid);
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
+    return resetAndFollowBaud(btBauds[baud]);
+}
 
-    
-    free(command);
-    free(response);
+// One setting from a profile. The MTU goes through setMtuSize() to keep
+// write pacing in step.
+HM1X_error_t HM1X_BT::applyProfileStep(uint8_t command, uint8_t value)
+{
+    if (command == HM1X_CMD_MTU_SIZE)
+    {
+        return setMtuSize((HM1X_mtu_size_t) value);
+    }
+    return commandSet((HM1X_command_t) command, value);
+}
+
+// AT+ADVI -- BLE advertising interval
+HM1X_error_t HM1X_BT::getAdvertisingInterval(HM1X_adv_interval_t * interval)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
+    *interval = NUM_ADV_INTERVALS;
+    err = commandGet(HM1X_CMD_ADVERT_INTERVAL, &value);
+    if ((err == HM1X_SUCCESS) && (value < NUM_ADV_INTERVALS))
+    {
+        *interval = (HM1X_adv_interval_t) value;
+    }
     return err;
 }
 
-// AT+MAJO, AT+MINO -- iBeacon Major version
-/*HM1X_error_t HM1X_BT::getiBeaconVersions(uint16_t * major, uint16_t * minor)
+HM1X_error_t HM1X_BT::setAdvertisingInterval(HM1X_adv_interval_t interval)
 {
-    getiBeaconMajor(major);
-    return getiBeaconMinor(minor);
+    return commandSet(HM1X_CMD_ADVERT_INTERVAL, interval);
 }
 
-HM1X_error_t HM1X_BT::setiBeaconVersions(uint16_t major, uint16_t minor)
+// AT+COMI, AT+COMA -- Min/max connection interval
+HM1X_error_t HM1X_BT::getConnectionInterval(HM1X_conn_interval_t * minInterval, HM1X_conn_interval_t * maxInterval)
 {
-    setiBeaconMajor(major);
-    return setiBeaconMinor(minor);
-}*/
-
-HM1X_error_t HM1X_BT::getiBeaconMajor(uint16_t * version)
-{
-    char * command;
-    char * response;
-    char * hexMajor;
-
-    // Set command string: "AT+MAJO?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_MAJOR) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_IBEACON_MAJOR, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 6, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
-
-    hexMajor = (char *) malloc(4 * sizeof(char) + 1);
-    if (hexMajor == NULL) return HM1X_OUT_OF_MEMORY;
-    
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    HM1X_error_t err;
+    uint32_t value;
 
-    strcpy(hexMajor, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    *version = strtol(hexMajor, NULL, 16);
+    *minInterval = NUM_CONN_INTERVALS;
+    *maxInterval = NUM_CONN_INTERVALS;
+    err = commandGet(HM1X_CMD_CONN_INTERVAL_MIN, &value);
+    if (err != HM1X_SUCCESS) return err;
+    if (value < NUM_CONN_INTERVALS) *minInterval = (HM1X_conn_interval_t) value;
 
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+    err = commandGet(HM1X_CMD_CONN_INTERVAL_MAX, &value);
+    if ((err == HM1X_SUCCESS) && (value < NUM_CONN_INTERVALS))
+    {
+        *maxInterval = (HM1X_conn_interval_t) value;
+    }
+    return err;
 }
 
-HM1X_error_t HM1X_BT::setiBeaconMajor(uint16_t version)
+HM1X_error_t HM1X_BT::setConnectionInterval(HM1X_conn_interval_t minInterval, HM1X_conn_interval_t maxInterval)
 {
     HM1X_error_t err;
-    char * command;
-    char * response;
 
-    if (version > 0xFFFE) 
+    if (minInterval > maxInterval)
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
+    err = commandSet(HM1X_CMD_CONN_INTERVAL_MIN, minInterval);
+    if (err != HM1X_SUCCESS) return err;
 
-    // Build command: e.g. AT+MAJOR0001
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_MAJOR) + 6, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%04X", HM1X_COMMAND_IBEACON_MAJOR, version);
-
-    // Build expected response: e.g. OK+Set:0001
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 6, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%04X", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, version);
+    return commandSet(HM1X_CMD_CONN_INTERVAL_MAX, maxInterval);
+}
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+// AT+COLA -- Slave latency
+HM1X_error_t HM1X_BT::getSlaveLatency(uint8_t * latency)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
+    err = commandGet(HM1X_CMD_SLAVE_LATENCY, &value);
+    *latency = (err == HM1X_SUCCESS) ? value : 0;
     return err;
 }
 
-HM1X_error_t HM1X_BT::getiBeaconMinor(uint16_t * version)
+HM1X_error_t HM1X_BT::setSlaveLatency(uint8_t latency)
 {
-    char * command;
-    char * response;
-    char * hexMinor;
-
-    // Set command string: "AT+MAJO?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_MINOR) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_IBEACON_MINOR, HM1X_QUERY_STRING);
-
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 6, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+    return commandSet(HM1X_CMD_SLAVE_LATENCY, latency);
+}
 
-    hexMinor = (char *) malloc(4 * sizeof(char) + 1);
-    if (hexMinor == NULL) return HM1X_OUT_OF_MEMORY;
-    
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+// AT+COSU -- Connection supervision timeout
+HM1X_error_t HM1X_BT::getSupervisionTimeout(HM1X_supervision_timeout_t * timeout)
+{
+    HM1X_error_t err;
+    uint32_t value;
 
-    strcpy(hexMinor, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    *version = strtol(hexMinor, NULL, 16);
+    *timeout = NUM_SUPERVISION_TIMEOUTS;
+    err = commandGet(HM1X_CMD_SUPERVISION_TIMEOUT, &value);
+    if ((err == HM1X_SUCCESS) && (value < NUM_SUPERVISION_TIMEOUTS))
+    {
+        *timeout = (HM1X_supervision_timeout_t) value;
+    }
+    return err;
+}
 
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+HM1X_error_t HM1X_BT::setSupervisionTimeout(HM1X_supervision_timeout_t timeout)
+{
+    return commandSet(HM1X_CMD_SUPERVISION_TIMEOUT, timeout);
 }
 
-HM1X_error_t HM1X_BT::setiBeaconMinor(uint16_t version)
+HM1X_error_t HM1X_BT::applyConnectionPreset(HM1X_conn_preset_t preset)
 {
+    hm1x_command_desc_t desc;
+    hm1x_profile_step_t step;
     HM1X_error_t err;
-    char * command;
-    char * response;
 
-    if (version > 0xFFFE) 
+    static const hm1x_profile_step_t hm1xPresetSteps[] PROGMEM = {
+        // Low latency: fast advertising, 7.5-15 ms interval, every event attended
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_ALL,     HM1X_CMD_ADVERT_INTERVAL,     ADV_INTERVAL_100MS },
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MIN,   CONN_INTERVAL_7_5MS },
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MAX,   CONN_INTERVAL_15MS },
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_HM10_11, HM1X_CMD_SLAVE_LATENCY,       0 },
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_HM10_11, HM1X_CMD_SUPERVISION_TIMEOUT, SUPERVISION_TIMEOUT_2S },
+        // Balanced: the HM-10's default connection parameters, advertising
+        // slowed from its 100 ms to 546 ms
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_ALL,     HM1X_CMD_ADVERT_INTERVAL,     ADV_INTERVAL_546MS },
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MIN,   CONN_INTERVAL_20MS },
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MAX,   CONN_INTERVAL_40MS },
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_HM10_11, HM1X_CMD_SLAVE_LATENCY,       0 },
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_HM10_11, HM1X_CMD_SUPERVISION_TIMEOUT, SUPERVISION_TIMEOUT_6S },
+        // Low power: slow advertising, 40-45 ms interval, up to 4 events skipped
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_ALL,     HM1X_CMD_ADVERT_INTERVAL,     ADV_INTERVAL_1285MS },
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MIN,   CONN_INTERVAL_40MS },
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_HM10_11, HM1X_CMD_CONN_INTERVAL_MAX,   CONN_INTERVAL_45MS },
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_HM10_11, HM1X_CMD_SLAVE_LATENCY,       4 },
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_HM10_11, HM1X_CMD_SUPERVISION_TIMEOUT, SUPERVISION_TIMEOUT_6S },
+        // Ask the central for the parameters above on each connection
+        { CONN_PRESET_LOW_LATENCY, HM1X_MODELS_HM10_11, HM1X_CMD_UPDATE_CON_PARAM,    1 },
+        { CONN_PRESET_BALANCED,    HM1X_MODELS_HM10_11, HM1X_CMD_UPDATE_CON_PARAM,    1 },
+        { CONN_PRESET_LOW_POWER,   HM1X_MODELS_HM10_11, HM1X_CMD_UPDATE_CON_PARAM,    1 },
+    };
+
+    if (preset >= NUM_CONN_PRESETS)
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
 
-    // Build command: e.g. AT+MAJOR0001
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_MINOR) + 6, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%04X", HM1X_COMMAND_IBEACON_MINOR, version);
-
-    // Build expected response: e.g. OK+Set:0001
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 6, sizeof(char));
-    if (response == NULL)
+    // Validate the whole batch before touching the module
+    for (uint8_t i = 0; i < sizeof(hm1xPresetSteps) / sizeof(hm1xPresetSteps[0]); i++)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        memcpy_P(&step, &hm1xPresetSteps[i], sizeof(step));
+        if ((step.profile != preset) || ((step.models & (1 << _btModel)) == 0)) continue;
+
+        err = loadCommand((HM1X_command_t) step.command, &desc);
+        if (err != HM1X_SUCCESS) return err;
+        if ((step.value < desc.minValue) || (step.value > desc.maxValue)) return HM1X_UNEXPECTED_RESPONSE;
     }
-    sprintf(response, "%s%s%04X", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, version);
 
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+    for (uint8_t i = 0; i < sizeof(hm1xPresetSteps) / sizeof(hm1xPresetSteps[0]); i++)
+    {
+        memcpy_P(&step, &hm1xPresetSteps[i], sizeof(step));
+        if ((step.profile != preset) || ((step.models & (1 << _btModel)) == 0)) continue;
 
-    return err;
+        err = commandSet((HM1X_command_t) step.command, step.value);
+        if (err != HM1X_SUCCESS) return err;
+    }
+    return HM1X_SUCCESS;
 }
 
-// AT+MEAS -- iBeacon Measured Power
-HM1X_error_t HM1X_BT::getiBeaconPower(uint8_t * power)
+// AT+SLEEP -- Module sleep
+HM1X_error_t HM1X_BT::sleepModule(void)
 {
-    char * command;
-    char * response;
-    char * hexPower;
-
-    // Set command string: "AT+MEAS?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_POWER) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_IBEACON_POWER, HM1X_QUERY_STRING);
+    HM1X_error_t err;
 
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 4, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+    err = commandExecute(HM1X_CMD_SLEEP);
+    if (err == HM1X_SUCCESS)
+    {
+        setModuleAsleep(true);
+    }
+    return err;
+}
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
-    
-    hexPower = (char *) malloc(2 * sizeof(char) + 1);
-    if (hexPower == NULL) return HM1X_OUT_OF_MEMORY;
+// Reads the reply straight off the port rather than through poll(), which
+// may itself want to send commands.
+HM1X_error_t HM1X_BT::wakeModule(void)
+{
+    unsigned long timeIn;
+    uint8_t c = HM1X_WAKE_CHAR;
 
-    strcpy(hexPower, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    *power = strtol(hexPower, NULL, 16);
+    flush();
+    for (uint8_t i = 0; i < HM1X_WAKE_LENGTH; i++)
+    {
+        hwWrite(&c, 1);
+    }
 
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+    timeIn = millis();
+    while (_moduleAsleep && (millis() - timeIn < (unsigned long) HM1X_WAKE_TIMEOUT))
+    {
+        if (hwAvailable() > 0)
+        {
+            parseByte(readChar());
+        }
+    }
+    return _moduleAsleep ? HM1X_ERROR_TIMEOUT : HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::setiBeaconPower(uint8_t power)
+// AT+PWRM -- Auto sleep (the module's value is inverted: 0 sleeps)
+HM1X_error_t HM1X_BT::enableAutoSleep(boolean enabled)
 {
-    char * command;
-    char * response;
     HM1X_error_t err;
 
-    if (power > 255) return HM1X_UNEXPECTED_RESPONSE;
-
-    // Build command: e.g. AT+MEASFF
-    command = (char *) calloc(strlen(HM1X_COMMAND_IBEACON_POWER) + 6, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%2X", HM1X_COMMAND_IBEACON_POWER, power);
-
-    // Build expected response: e.g. OK+Set:FF
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 6, sizeof(char));
-    if (response == NULL)
+    err = commandSet(HM1X_CMD_AUTO_SLEEP, enabled ? 0 : 1);
+    if (err == HM1X_SUCCESS)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        _autoSleep = enabled;
     }
-    sprintf(response, "%s%s%2X", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, power);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
     return err;
 }
 
-// AT+MTUS -- MTU Size
-HM1X_error_t HM1X_BT::setMtuSize(HM1X_mtu_size_t mtuSize)
+boolean HM1X_BT::idle(unsigned long timeout)
 {
-    char * command;
-    char * response;
-    char param;
-    HM1X_error_t err;
-    
-    if (mtuSize == MTU_SIZE_60)
+    unsigned long start = millis();
+
+    // Held notices, coalesced writes, queued or unanswered sets, PIO reads,
+    // reconnects and discovery all run on timers that poll() checks
+    if (((_noticeLen > 0) || (_txPending > 0) || (_setCount > 0) || _pioRequested || _pioSent ||
+         (_reconnectLeft > 0) || _discovering) &&
+        (timeout > (unsigned long) HM1X_RESPONSE_GAP))
     {
-        param = '0';
+        timeout = HM1X_RESPONSE_GAP;
     }
-    else if (mtuSize == MTU_SIZE_120)
+    // A watched PIO read is due at the end of its interval, unless
+    // something above holds it back
+    if ((_pioInterval > 0) && !_moduleAsleep && !_pioSent && (_setSent == 0) && !_discovering)
     {
-        param = '1';
+        unsigned long elapsed = start - _pioTime;
+        unsigned long due = (elapsed < _pioInterval) ? _pioInterval - elapsed : 0;
+        if (timeout > due) timeout = due;
     }
-    else return HM1X_UNEXPECTED_RESPONSE;
 
-    // Build command: e.g. AT+MTUS0
-    command = (char *) calloc(strlen(HM1X_COMMAND_MTU_SIZE) + 6, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_MTU_SIZE, param);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    while ((hwAvailable() <= 0) && (millis() - start < timeout))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+#ifdef ARDUINO_ARCH_AVR
+        // Idle mode leaves the UART, pin change interrupts (SoftwareSerial)
+        // and Timer 0 running: the next byte or millis() tick wakes the CPU
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sleep_cpu();
+        sleep_disable();
+#endif
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    _powerStats.mcuIdle += millis() - start;
+    return poll();
 }
 
-// AT+SCAN -- EDR Advert type
-HM1X_error_t HM1X_BT::getEdrAdvertType(HM1X_edr_advert_t * type)
+const HM1X_power_stats_t & HM1X_BT::powerStats(void)
 {
-    char * command;
-    char * response;
+    setModuleAsleep(_moduleAsleep); // Bring the module's time up to now
+    return _powerStats;
+}
 
-    // Set command string: "AT+SCAN?""
-    command = (char *) calloc(strlen(HM1X_COMMAND_ADVERT_TYPE) + strlen(HM1X_QUERY_STRING) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%s", HM1X_COMMAND_ADVERT_TYPE, HM1X_QUERY_STRING);
+/////////////
+// Private //
+/////////////
 
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 2, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+// Resets the module so new settings take effect, moves the MCU side to
+// newBaud and waits for the module to answer there.
+HM1X_error_t HM1X_BT::resetAndFollowBaud(unsigned long newBaud)
+{
+    unsigned long oldBaud = _baud;
+    HM1X_error_t err;
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    err = reset();
+    if (err != HM1X_SUCCESS) return err;
 
-    strcpy(response, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    if (strcmp(response, "0") == 0)
+    if (newBaud != _baud)
     {
-        *type = DISCOVERY_AND_CONNECTABLE;
+        setTransportBaud(newBaud);
     }
-    else if (strcmp(response, "1") == 0)
+    if (waitForModule() == HM1X_SUCCESS)
     {
-        *type = ONLY_CONNECTABLE;
+        return HM1X_SUCCESS;
     }
-    else
+
+    // Didn't come back at the new baud -- is it still at the old one?
+    if ((oldBaud != 0) && (oldBaud != newBaud) && setTransportBaud(oldBaud) &&
+        (waitForModule() == HM1X_SUCCESS))
     {
-        *type = EDR_ADVERT_UNDEFINED;
+        return HM1X_UNEXPECTED_RESPONSE;
     }
-
-    free(response);
-    free(command);
-    
-    return HM1X_SUCCESS;
+    return HM1X_ERROR_NO_CONNECTION;
 }
 
-HM1X_error_t HM1X_BT::setEdrAdvertType(HM1X_edr_advert_t type)
+// Keep testing until the module answers, e.g. while it reboots
+HM1X_error_t HM1X_BT::waitForModule(void)
 {
-    char * command;
-    char * response;
-    char param;
+    unsigned long timeIn = millis();
     HM1X_error_t err;
-    
-    if (type == DISCOVERY_AND_CONNECTABLE)
-    {
-        param = '0';
-    }
-    else if (type == ONLY_CONNECTABLE)
-    {
-        param = '1';
-    }
-    else return HM1X_UNEXPECTED_RESPONSE;
 
-    // Build command: e.g. AT+SCAN0
-    command = (char *) calloc(strlen(HM1X_COMMAND_ADVERT_TYPE) + 6, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_ADVERT_TYPE, param);
-
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    do
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
-    }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+        err = testOrDisconnect();
+    } while ((err != HM1X_SUCCESS) && (millis() - timeIn < HM1X_RESET_TIMEOUT));
 
     return err;
 }
 
-// AT+SAFE -- Module safe mode
-HM1X_error_t HM1X_BT::enableSafeMode(boolean enabled)
+// Every whole connection interval that passes, the module sends what it was
+// holding, so the budget is full again
+void HM1X_BT::refillTxCredits(void)
 {
-    char * command;
-    char * response;
-    char param;
-    HM1X_error_t err;
-    
-    if (enabled)
+    unsigned long elapsed = millis() - _txRefillTime;
+
+    if (elapsed >= _txInterval)
     {
-        param = '1';
+        _txRefillTime += elapsed - (elapsed % _txInterval);
+        _txCredits = (uint16_t) _txPacketSize * _txPacketsPerInterval;
     }
-    else
+}
+
+// RTS is active low: assert it while we have room, deassert when nearly full
+void HM1X_BT::updateRts(void)
+{
+    if (_rtsPin == HM1X_NO_PIN) return;
+
+    int level = _serial->available() + _rxCount;
+    digitalWrite(_rtsPin, (level >= _rtsThreshold) ? HIGH : LOW);
+}
+
+// Wait for the module's RTS (our CTS) to allow sending. Returns false on timeout.
+boolean HM1X_BT::waitForCts(void)
+{
+    unsigned long timeIn;
+
+    if (_ctsPin == HM1X_NO_PIN) return true;
+
+    timeIn = millis();
+    while (digitalRead(_ctsPin) == HIGH)
     {
-        param = '0';
+        updateRts(); // Keep our side flowing while we wait
+        if (millis() - timeIn >= HM1X_FLOW_CONTROL_TIMEOUT)
+        {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Build command: e.g. AT+SAFE0
-    command = (char *) calloc(strlen(HM1X_COMMAND_SAFE_MODE) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_SAFE_MODE, param);
+// returns the baudChar that selects the requested baud rate on this model
+HM1X_error_t HM1X_BT::findBaudFromArray(HM1X_baud_t atob, uint8_t &num){
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
-    {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+    // look for the baudChar that corresponds to atob
+    for( uint8_t i = _validBaudBounds_ptr[0]; i <= _validBaudBounds_ptr[1]; ++i ){
+        if (atob == *(_btBauds_ptr + i))
+        {
+            num = i;
+            return HM1X_SUCCESS;
+        }
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
 
-    return err;
+    // invalid atob for the particular model
+    return HM1X_UNEXPECTED_RESPONSE;
+    
 }
 
-// AT+ONEM -- Whether to use BLE MAC address
-// Note: If you want to use BLE in Android, don't use this command :S
-HM1X_error_t HM1X_BT::disableBleAddress(boolean disabled)
+// returns the HM1X_baud_t for a baud rate, e.g. 9600 -> HM1X_BAUD_9600
+HM1X_error_t HM1X_BT::findBaudFromRate(unsigned long baud, HM1X_baud_t &atob)
 {
-    char * command;
-    char * response;
-    char param;
-    HM1X_error_t err;
-    
-    if (disabled)
-    {
-        param = '1';
-    }
-    else
+    for (uint8_t i = 0; i < NUM_HM1X_BAUDS; i++)
     {
-        param = '0';
+        if (btBauds[i] == (long) baud)
+        {
+            atob = (HM1X_baud_t) i;
+            return HM1X_SUCCESS;
+        }
     }
+    return HM1X_ERROR_ER;
+}
 
-    // Build command: e.g. AT+ONEM0
-    command = (char *) calloc(strlen(HM1X_COMMAND_BLE_MAC) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_BLE_MAC, param);
+HM1X_error_t HM1X_BT::init(void)
+{
+    HM1X_error_t err;  
 
-    // Build expected response: e.g. OK+Set:0
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    err = testOrDisconnect();
+    if (err != HM1X_SUCCESS)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        delay(500); // AT may only disconnecte and not return "OK" response
+        err = testOrDisconnect();
+        if (err != HM1X_SUCCESS) 
+        {
+            return err;
+        }
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
+
+    err = notify(false, false);
 
     return err;
 }
 
-// AT+PIO0 -- Enable system key function on PIO0
-HM1X_error_t HM1X_BT::enableSystemKey(boolean enabled)
+// Copies a command's row out of the table and picks the mnemonic for this model.
+// Returns HM1X_ERROR_ER if the model doesn't support the command.
+HM1X_error_t HM1X_BT::loadCommand(HM1X_command_t command, struct hm1x_command_desc * desc)
 {
-    char * command;
-    char * response;
-    char param;
-    HM1X_error_t err;
-    
-    if (enabled)
+    if (command >= (sizeof(hm1xCommands) / sizeof(hm1xCommands[0])))
     {
-        param = '1';
+        return HM1X_ERROR_ER;
     }
-    else
+    memcpy_P(desc, &hm1xCommands[command], sizeof(hm1x_command_desc_t));
+
+    if ((desc->models & (1 << _btModel)) == 0)
     {
-        param = '0';
+        return HM1X_ERROR_ER;
     }
-
-    // Build command: e.g. AT+PIO01
-    command = (char *) calloc(strlen(HM1X_COMMAND_SYSTEM_KEY) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_SYSTEM_KEY, param);
-
-    // Build expected response: e.g. OK+Set:1
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    if ( !_isEdrSupported && (desc->singleMnemonic[0] != '\0') )
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        strcpy(desc->mnemonic, desc->singleMnemonic);
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return HM1X_SUCCESS;
 }
 
-// AT+POIO1 -- System LED, PIO1 control
-HM1X_error_t HM1X_BT::setLedMode(HM1X_led_mode_t mode)
+// Writes "AT+<mnemonic>[index]" to dest (index as one hex digit), returns a pointer to its terminator
+static char * buildCommand(char * dest, const hm1x_command_desc_t & desc, int8_t index)
 {
-    char * command;
-    char * response;
-    char param;
-    HM1X_error_t err;
-    
-    if (mode == BLINK_DISCONNECTED)
+    strcpy(dest, HM1X_COMMAND_PREFIX);
+    strcat(dest, desc.mnemonic);
+    dest += strlen(dest);
+    if (index >= 0)
     {
-        param = '0';
+        *dest++ = (index < 10) ? ('0' + index) : ('A' + index - 10); // PIOA, PIOB
+        *dest = '\0';
     }
-    else
+    return dest;
+}
+
+// Splits a reply into its value: "OK+Get:1234" or "OK+ADDR:1234" -> "1234".
+// Replies without a ':' (e.g. HM-10's "HMSoft V540") are the value themselves.
+static HM1X_error_t responseValue(const char * response, const char ** value)
+{
+    const char * colon;
+
+    if (strncmp(response, HM1X_RESPONSE_ER, strlen(HM1X_RESPONSE_ER)) == 0)
     {
-        param = '1';
+        return HM1X_ERROR_ER;
     }
+    colon = strchr(response, ':');
+    *value = (colon == NULL) ? response : colon + 1;
+    return HM1X_SUCCESS;
+}
+
+// AT+<mnemonic> -- expects "OK+<mnemonic>" back, e.g. AT+RESET -> OK+RESET
+HM1X_error_t HM1X_BT::commandExecute(HM1X_command_t command)
+{
+    hm1x_command_desc_t desc;
+    char cmd[HM1X_MAX_COMMAND_LEN];
+    char response[HM1X_MAX_COMMAND_LEN];
+    HM1X_error_t err;
+    uint8_t prefixLen = strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_PLUS);
+
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
 
-    // Build command: e.g. AT+PIO11
-    command = (char *) calloc(strlen(HM1X_COMMAND_SYSTEM_LED) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%c", HM1X_COMMAND_SYSTEM_LED, param);
+    buildCommand(cmd, desc, -1);
+    err = transact(cmd, response, sizeof(response), prefixLen + strlen(desc.mnemonic),
+                   false, HM1X_DEFAULT_TIMEOUT);
+    if (err != HM1X_SUCCESS) return err;
 
-    // Build expected response: e.g. OK+Set:1
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    if ((strncmp(response, HM1X_RESPONSE_OK, strlen(HM1X_RESPONSE_OK)) != 0) ||
+        (strcmp(response + prefixLen, desc.mnemonic) != 0))
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_UNEXPECTED_RESPONSE;
     }
-    sprintf(response, "%s%s%c", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, param);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    return HM1X_SUCCESS;
 }
 
-// AT+PIO -- Write/query PIO
-HM1X_error_t HM1X_BT::readPio(uint8_t pin, uint8_t * value)
+// AT+<mnemonic>[index]<value> -- value range-checked and formatted per the table
+HM1X_error_t HM1X_BT::commandSet(HM1X_command_t command, uint32_t value, int8_t index)
 {
-    char * command;
-    char * response;
+    hm1x_command_desc_t desc;
+    char arg[9];
+    HM1X_error_t err;
+
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
 
-    if ((pin != 2) && (pin != 3))
+    if ((desc.format != HM1X_FORMAT_HEX) || (desc.width > 8) ||
+        (value < desc.minValue) || (value > desc.maxValue))
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
+    appendHex(arg, value, desc.width);
 
-    // Set command string: "AT+PIO21""
-    command = (char *) calloc(strlen(HM1X_COMMAND_PIO_STATUS) + strlen(HM1X_QUERY_STRING) + 3, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%d%s", HM1X_COMMAND_PIO_STATUS, pin, HM1X_QUERY_STRING);
+    return sendSet(&desc, arg, index);
+}
 
-    response = (char *) calloc(sizeof(HM1X_RESPONSE_OK) + sizeof(HM1X_RESPONSE_GET) + 2, sizeof(char));
-    if (response == NULL) return HM1X_OUT_OF_MEMORY;
+// AT+<mnemonic>[index]<text> -- e.g. a name, PIN or UUID part
+HM1X_error_t HM1X_BT::commandSetText(HM1X_command_t command, const char * text, int8_t index)
+{
+    hm1x_command_desc_t desc;
+    HM1X_error_t err;
 
-    sendCommandWithTimeout(command, &response, HM1X_RESPONSE_TIMEOUT);
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
 
-    strcpy(response, response + (strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_GET)));
-    
-    if (strcmp(response, "0") == 0)
-    {
-        *value = 0;
-    }
-    if (strcmp(response, "1") == 0)
-    {
-        *value = 1;
-    }
-    else
+    if (!validText(text, desc))
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
+    return sendSet(&desc, text, index);
+}
 
-    free(response);
-    free(command);
-    
+// Sends a set command and checks the module echoes the argument: "OK+Set:<arg>"
+HM1X_error_t HM1X_BT::sendSet(const struct hm1x_command_desc * desc, const char * arg, int8_t index)
+{
+    char command[HM1X_MAX_COMMAND_LEN];
+    char response[HM1X_MAX_COMMAND_LEN];
+    const char * value;
+    HM1X_error_t err;
+    uint8_t argLen = strlen(arg);
+
+    strcpy(buildCommand(command, *desc, index), arg);
+
+    err = transact(command, response, sizeof(response), argLen, true, HM1X_DEFAULT_TIMEOUT);
+    if (err != HM1X_SUCCESS) return err;
+
+    err = responseValue(response, &value);
+    if (err != HM1X_SUCCESS) return err;
+
+    return (strcmp(value, arg) == 0) ? HM1X_SUCCESS : HM1X_UNEXPECTED_RESPONSE;
+}
+
+// AT+<mnemonic>[index]? -- copies the reply's value text (at most `width` characters)
+HM1X_error_t HM1X_BT::commandGetText(HM1X_command_t command, char * dest, int8_t index)
+{
+    hm1x_command_desc_t desc;
+    char cmd[HM1X_MAX_COMMAND_LEN];
+    char response[HM1X_MAX_COMMAND_LEN];
+    const char * value;
+    HM1X_error_t err;
+    uint8_t expectLen;
+
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
+
+    strcpy(buildCommand(cmd, desc, index), HM1X_QUERY_STRING);
+
+    // Fixed-width values let us stop reading as soon as the last digit arrives
+    expectLen = (desc.format == HM1X_FORMAT_HEX) ? desc.width : HM1X_LENGTH_UNKNOWN;
+    err = transact(cmd, response, sizeof(response), expectLen, true, HM1X_RESPONSE_TIMEOUT);
+    if (err != HM1X_SUCCESS) return err;
+
+    err = responseValue(response, &value);
+    if (err != HM1X_SUCCESS) return err;
+
+    strncpy(dest, value, desc.width);
+    dest[desc.width] = '\0';
     return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::writePio(uint8_t pin, uint8_t value)
+// Address getters: the 12 digit reply parsed to bytes
+HM1X_error_t HM1X_BT::commandGetAddress(HM1X_command_t command, HM1X_address_t & address)
 {
-    char * command;
-    char * response;
+    char text[HM1X_MAX_COMMAND_LEN];
     HM1X_error_t err;
-    uint8_t writeVal = value;
 
-    if ((pin != 2) && (pin != 3))
+    err = commandGetText(command, text);
+    if (err != HM1X_SUCCESS) return err;
+
+    if ((strlen(text) != HM1X_ADDRESS_LEN) || !address.parse(text))
     {
         return HM1X_UNEXPECTED_RESPONSE;
     }
-    if (writeVal >= 1) writeVal = 1;
+    return HM1X_SUCCESS;
+}
 
-    // Build command: e.g. AT+PIO21
-    command = (char *) calloc(strlen(HM1X_COMMAND_PIO_STATUS) + 4, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-    sprintf(command, "%s%d%d", HM1X_COMMAND_PIO_STATUS, pin, writeVal);
+// AT+<mnemonic><arg>, sent without waiting: the caller picks the reply up
+// from poll()
+HM1X_error_t HM1X_BT::commandSend(HM1X_command_t command, const char * arg)
+{
+    hm1x_command_desc_t desc;
+    char cmd[HM1X_MAX_COMMAND_LEN];
+    HM1X_error_t err;
 
-    // Build expected response: e.g. OK+Set:11
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
+
+    if (_discovering)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_ERROR_TRY_LATER; // A scanning module won't take it
     }
-    sprintf(response, "%s%s%d", HM1X_RESPONSE_OK, HM1X_RESPONSE_SET, value);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
-
-    return err;
+    strcpy(buildCommand(cmd, desc, -1), arg);
+    if (_moduleAsleep) wakeModule();
+    flush(); // Coalesced data goes first, not into the command
+    hwPrint(cmd);
+    return HM1X_SUCCESS;
 }
 
-HM1X_error_t HM1X_BT::setBaud(HM1X_baud_t atob)
+// AT+<mnemonic><value>, queued and sent without waiting for OK+Set:.
+// Only for hex settings, whose reply has a known length.
+HM1X_error_t HM1X_BT::commandSetAsync(HM1X_command_t command, uint32_t value)
 {
+    hm1x_command_desc_t desc;
+    hm1x_pending_set_t * set;
     HM1X_error_t err;
-    char * command;
-    char * response;
-    char * hsParam;
-    char * baudChar = (char*)"0";
-    uint8_t baudCharNum;
 
-    command = (char *) calloc(strlen(HM1X_COMMAND_BAUD) + 2, sizeof(char));
-    if (command == NULL) return HM1X_OUT_OF_MEMORY;
-
-    // Build command: e.g. AT+BAUD2
-    // Handle cases according to model
-    if (findBaudFromArray(atob, baudCharNum) != HM1X_SUCCESS){
+    err = loadCommand(command, &desc);
+    if (err != HM1X_SUCCESS) return err;
 
+    if ((desc.format != HM1X_FORMAT_HEX) || (desc.width > 8) ||
+        (value < desc.minValue) || (value > desc.maxValue))
+    {
         return HM1X_UNEXPECTED_RESPONSE;
-    
     }
-
-    baudChar[0] = (char)'0' + baudCharNum;
-
-    strcpy(command, HM1X_COMMAND_BAUD);
-    strcat(command, baudChar);
-
-    // Build expected response: e.g. OK+Set:2
-    response = (char *) calloc(strlen(HM1X_RESPONSE_OK) + strlen(HM1X_RESPONSE_SET) + 2, sizeof(char));
-    if (response == NULL)
+    if ((_setCount == HM1X_SET_QUEUE_DEPTH) || _discovering)
     {
-        free(command);
-        return HM1X_OUT_OF_MEMORY;
+        return HM1X_ERROR_TRY_LATER;
     }
-    strcat(response, HM1X_RESPONSE_OK);
-    strcat(response, HM1X_RESPONSE_SET);
-    strcat(response, baudChar);
-    
-    err = sendCommandWithResponseAndTimeout(command, response, HM1X_DEFAULT_TIMEOUT);
-    
-    free(command);
-    free(response);
 
-    return err;
+    set = &_sets[(_setHead + _setCount) % HM1X_SET_QUEUE_DEPTH];
+    set->command = command;
+    set->value = value;
+    _setCount++;
+    sendPendingSets();
+    return HM1X_SUCCESS;
 }
 
-/////////////
-// Private //
-/////////////
+// Value digits of the OK+Set: expected next, 0 if none is
+uint8_t HM1X_BT::pendingSetWidth(void)
+{
+    if (_setSent == 0) return 0;
+    return pgm_read_byte(&hm1xCommands[_sets[_setHead].command].width);
+}
 
-// returns the integer that corresponds to the correct baud rate depending on the model
-HM1X_error_t HM1X_BT::findBaudFromArray(HM1X_baud_t atob, uint8_t &num){
-    
-    // check bounds
-    if ((atob < _validBaudBounds_ptr[0]) || (atob > _validBaudBounds_ptr[1]))
+// Send queued sets: straight away if every earlier one has been answered,
+// else HM1X_COMMAND_GAP after the last. Never during a scan, whose parser
+// doesn't look for OK+Set:.
+void HM1X_BT::sendPendingSets(void)
+{
+    HM1X_error_t err;
+
+    if (_pioSent && (millis() - _pioTime < (unsigned long) HM1X_COMMAND_GAP)) return;
+    if (_discovering) return;
+
+    while (_setSent < _setCount)
     {
-        // out of bounds
-        return HM1X_UNEXPECTED_RESPONSE;
-    }
+        hm1x_command_desc_t desc;
+        char arg[9];
+        hm1x_pending_set_t * set = &_sets[(_setHead + _setSent) % HM1X_SET_QUEUE_DEPTH];
 
-    // look for the index that corresponds to atob
-    for( uint8_t i = _validBaudBounds_ptr[0]; i <= _validBaudBounds_ptr[1]; ++i ){
-        if (atob == *(_btBauds_ptr + i))
+        if (_setSent > 0)
         {
-            num = i;
-            return HM1X_SUCCESS;
+            hm1x_pending_set_t * last = &_sets[(_setHead + _setSent - 1) % HM1X_SET_QUEUE_DEPTH];
+            if (millis() - last->time < (unsigned long) HM1X_COMMAND_GAP) return;
+        }
+        memcpy_P(&desc, &hm1xCommands[set->command], sizeof(desc));
+        appendHex(arg, set->value, desc.width);
+        err = commandSend((HM1X_command_t) set->command, arg);
+        if (err != HM1X_SUCCESS)
+        {
+            setFailed(err, _setSent); // Never went out, so no reply is coming
+            continue;
         }
+        set->time = millis();
+        _setSent++;
     }
+}
 
-    // invalid atob for the particular model
-    return HM1X_UNEXPECTED_RESPONSE;
-    
+void HM1X_BT::pollPendingSets(void)
+{
+    if ((_setSent > 0) &&
+        (millis() - _sets[_setHead].time >= (unsigned long) HM1X_DEFAULT_TIMEOUT))
+    {
+        _setTimeouts++;
+        setFailed(HM1X_ERROR_TIMEOUT);
+    }
+    sendPendingSets();
 }
 
-HM1X_error_t HM1X_BT::init(void)
+// OK+Set:<value> came for the oldest set sent
+void HM1X_BT::setConfirmed(const char * value, uint8_t len)
 {
-    HM1X_error_t err;  
+    hm1x_pending_set_t * set = &_sets[_setHead];
+    uint8_t width = pendingSetWidth();
+    char expected[9];
 
-    err = testOrDisconnect();
-    if (err != HM1X_SUCCESS)
+    appendHex(expected, set->value, width);
+    if ((len != width) || (strncmp(value, expected, width) != 0))
     {
-        delay(500); // AT may only disconnecte and not return "OK" response
-        err = testOrDisconnect();
-        if (err != HM1X_SUCCESS) 
-        {
-            return err;
-        }
+        _setMismatches++;
+        setFailed(HM1X_UNEXPECTED_RESPONSE);
+        return;
     }
+    _setHead = (_setHead + 1) % HM1X_SET_QUEUE_DEPTH;
+    _setCount--;
+    _setSent--;
+}
 
-    err = notify(false, false);
+// Drop a queued set (index 0 is the oldest), telling the callback. The
+// ones before it move up a slot.
+void HM1X_BT::setFailed(HM1X_error_t result, uint8_t index)
+{
+    hm1x_pending_set_t set = _sets[(_setHead + index) % HM1X_SET_QUEUE_DEPTH];
+    hm1x_command_desc_t desc;
 
-    return err;
+    for (uint8_t i = index; i > 0; i--)
+    {
+        _sets[(_setHead + i) % HM1X_SET_QUEUE_DEPTH] = _sets[(_setHead + i - 1) % HM1X_SET_QUEUE_DEPTH];
+    }
+    _setHead = (_setHead + 1) % HM1X_SET_QUEUE_DEPTH;
+    _setCount--;
+    if (index < _setSent) _setSent--;
+    if (_setCallback != NULL)
+    {
+        memcpy_P(&desc, &hm1xCommands[set.command], sizeof(desc));
+        _setCallback(desc.mnemonic, set.value, result);
+    }
 }
 
-HM1X_error_t HM1X_BT::sendCommandWithResponseAndTimeout(const char * command, char * expectedResponse, uint16_t commandTimeout)
+// A blocking command would take a pending OK+Set: or OK+PIO?: as its own
+// reply. HM1X_ERROR_TRY_LATER if they don't all come in time, or if poll()
+// can't get at them because the receive buffer is full: read() it first.
+HM1X_error_t HM1X_BT::waitForReplies(void)
 {
     unsigned long timeIn = millis();
-    char * response;
+    HM1X_error_t err = HM1X_SUCCESS;
 
-    sendCommand(command);
-
-    // Wait until we've receved the requested number of characters
-    while (hwAvailable() < strlen(expectedResponse))
+    _waitingForReplies = true; // Callbacks from poll() mustn't transact()
+    while ((_setCount > 0) || _pioSent)
     {
-        if (millis() > timeIn + commandTimeout)
+        if ((millis() - timeIn >= (unsigned long) HM1X_REPLY_WAIT_TIMEOUT) ||
+            ((_rxCount + _noticeLen >= HM1X_RX_BUFFER_SIZE) && (hwAvailable() > 0)))
         {
-            return HM1X_ERROR_TIMEOUT;
+            err = HM1X_ERROR_TRY_LATER;
+            break;
         }
+        poll();
+        expirePioRead(); // A lost OK+PIO?: ends the wait, like a lost OK+Set:
     }
-    response = (char *) calloc(hwAvailable() + 1, sizeof(char));
-    if (response == NULL)
+    _waitingForReplies = false;
+    return err;
+}
+
+// Value digits of the OK+PIO?: expected next, 0 if none is
+uint8_t HM1X_BT::pendingPioWidth(void)
+{
+    if (!_pioSent) return 0;
+    return pgm_read_byte(&hm1xCommands[HM1X_CMD_PIO_ALL].width);
+}
+
+// Sends AT+PIO?? when one is asked for or the watch interval is up, once
+// no set is waiting on its reply
+void HM1X_BT::pollPios(void)
+{
+    if (_pioSent)
     {
-        return HM1X_OUT_OF_MEMORY;
+        expirePioRead();
+        return;
     }
-    readAvailable(response);
-    
-    // Check for expected response
-    if (strcmp(response, expectedResponse) == 0)
+    if ((_pioInterval > 0) && !_moduleAsleep && (millis() - _pioTime >= _pioInterval))
     {
-        return HM1X_SUCCESS;
+        _pioRequested = true;
     }
-    else
+    if (!_pioRequested || (_setSent > 0) || _discovering) return;
+
+    _pioRequested = false;
+    _pioTime = millis();
+    _pioSent = (commandSend(HM1X_CMD_PIO_ALL, HM1X_QUERY_STRING) == HM1X_SUCCESS);
+}
+
+// Give up on an OK+PIO?: that hasn't come in HM1X_DEFAULT_TIMEOUT
+void HM1X_BT::expirePioRead(void)
+{
+    if (_pioSent && (millis() - _pioTime >= (unsigned long) HM1X_DEFAULT_TIMEOUT))
     {
-        return HM1X_UNEXPECTED_RESPONSE;
+        _pioSent = false; // Lost: the watch retries at its next interval
     }
 }
 
-int HM1X_BT::sendCommandWithTimeout(const char * command, char ** responseDest, uint16_t commandTimeout)
+// OK+PIO?:<value> came: bit 0 of value is PIO2
+void HM1X_BT::piosRead(const char * value)
 {
-    unsigned long timeIn = millis();
-    char * response;
-    int retVal = 0;
-
-    sendCommand(command);
+    uint16_t states = 0;
+    uint16_t changed;
 
-    // Wait for timeout to occur
-    // TODO: Should this also check for an overflow of the serial buffer?
-    while (millis() < timeIn + commandTimeout)
-        ;
+    for (uint8_t i = 0; i < pendingPioWidth(); i++)
+    {
+        states = (states << 4) | HM1X_address_t::hexDigit(value[i]);
+    }
+    states = (states << 2) & _pioPins;
+    _pioSent = false;
 
-    // Read data into the response string
-    // TODO: Isn't it on the calling function to allocate memory for this read?
-    response = (char *) calloc(hwAvailable() + 1, sizeof(char));
-    if (response == NULL)
+    changed = (_pioKnown ? (states ^ _pioStates) : _pioPins) & _pioMask;
+    _pioStates = states;
+    _pioKnown = true;
+    if ((changed != 0) && (_pioCallback != NULL))
     {
-        return 0;
+        _pioCallback(states, changed);
     }
-    retVal = readAvailable(response);
-    strcpy(*responseDest, response);
-    return retVal;
 }
 
-boolean HM1X_BT::sendCommand(const char * command)
+// Adds the time since the last change to the state the module was in
+void HM1X_BT::setModuleAsleep(boolean asleep)
 {
-    if (strlen(command) == 0) // If string is not null it will include "+"
+    unsigned long now = millis();
+
+    if (_moduleAsleep)
     {
-        hwPrint(HM1X_COMMAND_AT);
-        return true;
+        _powerStats.moduleAsleep += now - _powerSince;
+        if (!asleep) _powerStats.moduleWakes++;
     }
     else
     {
-        char * commandToSend;
-        commandToSend = (char *) calloc(strlen(HM1X_COMMAND_AT) + strlen(command) + 2, sizeof(char));
-        if (commandToSend == NULL)
-        {
-            return false;
-        }
-        strcpy(commandToSend, HM1X_COMMAND_AT);
-        strcat(commandToSend, "+");
-        strcat(commandToSend, command);
-
-        hwPrint(commandToSend);
-        free(commandToSend);
+        _powerStats.moduleAwake += now - _powerSince;
     }
-
-    return true;
+    _powerSince = now;
+    _moduleAsleep = asleep;
 }
 
-/*void HM1X_BT::hwFlush(void)
+// AT+<mnemonic>[index]? -- parses a hex value of up to `width` digits
+HM1X_error_t HM1X_BT::commandGet(HM1X_command_t command, uint32_t * value, int8_t index)
 {
-    readAvailable();
-}*/
+    char text[HM1X_MAX_COMMAND_LEN];
+    HM1X_error_t err;
+    uint32_t result = 0;
+    uint8_t i;
 
-size_t HM1X_BT::hwPrint(const char * s)
-{
-    if (0)
-    {
+    err = commandGetText(command, text, index);
+    if (err != HM1X_SUCCESS) return err;
 
+    for (i = 0; (i < 8) && (text[i] != '\0'); i++)
+    {
+        int8_t digit = HM1X_address_t::hexDigit(text[i]);
+        if (digit < 0) return HM1X_UNEXPECTED_RESPONSE;
+        result = (result << 4) | digit;
     }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
+    if (i == 0) return HM1X_UNEXPECTED_RESPONSE;
+
+    *value = result;
+    return HM1X_SUCCESS;
+}
+
+// Send a complete command and collect the reply into response.
+// The reply is complete once expectLen characters have arrived (after the ':'
+// if afterColon is set), or once the line goes quiet after data has started.
+// CR/LF are dropped so trailing line endings can't corrupt the next reply.
+HM1X_error_t HM1X_BT::transact(const char * command, char * response, uint8_t responseSize,
+                               uint8_t expectLen, boolean afterColon, uint16_t commandTimeout)
+{
+    unsigned long timeIn;
+    unsigned long lastRx = 0;
+    uint8_t len = 0;
+    uint8_t valueStart = 0;
+    boolean overflow = false;
+    HM1X_error_t err;
+
+    response[0] = '\0';
+    if (_waitingForReplies)
     {
-        return _softSerial->print(s);
+        return HM1X_ERROR_TRY_LATER; // Called back from waitForReplies()
     }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
+    if (_discovering)
     {
-        return _serialPort->print(s);
+        return HM1X_ERROR_TRY_LATER; // The reply would be lost in the scan output
     }
-#endif
-#ifdef HM1X_I2C_ENABLED
-    else if (_wirePort != NULL)
+    if (_moduleAsleep) wakeModule(); // A sleeping module ignores commands
+    err = waitForReplies();
+    if (err != HM1X_SUCCESS) return err;
+    flush(); // Coalesced data goes first, not into the command
+    hwPrint(command);
+    timeIn = millis();
+
+    while (millis() - timeIn < commandTimeout)
     {
-        int charsToWrite = strlen(s);
-        int charsWritten = 0;
-        // ATtiny85 can only read/write 14 bytes at a time via I2C
-        // Need to split >14 writes into multiple transmissions
-        while (charsToWrite > 0)
+        if (hwAvailable() > 0)
         {
-            int toWrite;
-            if (charsToWrite > 14) toWrite = 14;
-            else toWrite = charsToWrite;
-            
-            _wirePort->beginTransmission(_wireAddress);
-            _wirePort->write(I2C_CMD_WRITE);
-            for (int i = 0; i < toWrite; i++)
+            char c = readChar();
+            lastRx = millis();
+            if ((c == '\r') || (c == '\n')) continue;
+
+            if (len < responseSize - 1)
             {
-                _wirePort->write(s[i + charsWritten]);
+                response[len++] = c;
+                response[len] = '\0';
+            }
+            else
+            {
+                overflow = true;
+            }
+            if ((c == ':') && (valueStart == 0)) valueStart = len;
+
+            if (expectLen != HM1X_LENGTH_UNKNOWN)
+            {
+                if (afterColon && (valueStart > 0) && (len - valueStart >= expectLen)) break;
+                if (!afterColon && (len >= expectLen)) break;
             }
-            _wirePort->endTransmission(true);
-            charsToWrite -= toWrite;
-            charsWritten += toWrite;
         }
-        return charsWritten;
+        else if ((len > 0) && (millis() - lastRx >= HM1X_RESPONSE_GAP))
+        {
+            break;
+        }
     }
-#endif
-    return 0;
+
+    if (len == 0) return HM1X_ERROR_TIMEOUT;
+    if (overflow) return HM1X_RX_OVERFLOW;
+    return HM1X_SUCCESS;
 }
 
-int HM1X_BT::readAvailable(char * inString)
+size_t HM1X_BT::hwPrint(const char * s)
 {
-    int len = 0;
-    if (0)
-    {
+    return hwWrite((const uint8_t *) s, strlen(s));
+}
 
-    }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
+size_t HM1X_BT::hwWrite(const uint8_t * buffer, size_t size)
+{
+    if (_serial != NULL)
     {
-        while (_softSerial->available())
+        if (_ctsPin == HM1X_NO_PIN)
         {
-            char c = (char)_softSerial->read();
-            inString[len++] = c;
+            return _serial->write(buffer, size);
         }
-        inString[len] = 0;
-    }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
-    {
-        while (_serialPort->available())
+
+        // Flow controlled: check CTS before every byte, stop if it never returns
+        size_t written = 0;
+        while ((written < size) && waitForCts())
         {
-            char c = (char)_serialPort->read();
-            inString[len++] = c;
+            written += _serial->write(buffer[written]);
         }
-        inString[len] = 0;
+        return written;
     }
-#endif
 #ifdef HM1X_I2C_ENABLED
     else if (_wirePort != NULL)
     {
-        int avail = hwAvailable();
-        int bytesToRead;
-        // I2C on the Tiny can only write out 14(?) bytes at a time.
-        // If there are more than 14 bytes to read, loop through
-        while (avail > 0)
+        size_t charsWritten = 0;
+        // ATtiny85 can only read/write 14 bytes at a time via I2C
+        // Need to split >14 writes into multiple transmissions
+        while (charsWritten < size)
         {
-            if (avail > 14) bytesToRead = 14;
-            else bytesToRead = avail;
+            size_t toWrite = size - charsWritten;
+            if (toWrite > 14) toWrite = 14;
 
             _wirePort->beginTransmission(_wireAddress);
-            _wirePort->write(I2C_CMD_READ);
-            _wirePort->write(bytesToRead);
-            _wirePort->endTransmission(false);
-            _wirePort->requestFrom(_wireAddress, (uint8_t)bytesToRead);
-            for (int i = 0; i < bytesToRead; i++)
+            _wirePort->write(I2C_CMD_WRITE);
+            for (size_t i = 0; i < toWrite; i++)
             {
-                char c = (char) _wirePort->read();
-                inString[len++] = c;
+                _wirePort->write(buffer[i + charsWritten]);
             }
-            avail -= bytesToRead;
+            _wirePort->endTransmission(true);
+            charsWritten += toWrite;
         }
-        inString[len] = 0;
+        return charsWritten;
     }
 #endif
-
-    return len;
+    return 0;
 }
 
 char HM1X_BT::readChar(void)
 {
-    char ret;
-
-    if (0)
-    {
+    char ret = 0;
 
-    }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
+    if (_serial != NULL)
     {
-        ret = (char)_softSerial->read();
+        ret = (char)_serial->read();
+        updateRts();
     }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL)
-    {
-        ret = (char)_serialPort->read();
-    }
-#endif
 #ifdef HM1X_I2C_ENABLED
     else if (_wirePort != NULL)
     {
@@ -2855,22 +3263,10 @@ char HM1X_BT::readChar(void)
 
 int HM1X_BT::hwAvailable(void)
 {
-    if (0)
-    {
-
-    }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-    else if (_softSerial != NULL)
-    {
-        return _softSerial->available();
-    }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-    else if (_serialPort != NULL) 
+    if (_serial != NULL)
     {
-        return _serialPort->available();
+        return _serial->available();
     }
-#endif
 #ifdef HM1X_I2C_ENABLED
     else if (_wirePort != NULL)
     {
@@ -2909,43 +3305,73 @@ void HM1X_BT::setI2cAddress(uint8_t address)
 }
 #endif
 
-HM1X_error_t HM1X_BT::forceBaud(unsigned long baud)
+// Re-open the MCU side of the link at baud. Returns false if the transport
+// can't change baud (a plain Stream without a baud callback).
+boolean HM1X_BT::setTransportBaud(unsigned long baud)
 {
-    HM1X_error_t err;
-    switch (baud) {
-    case 1200:
-        err = forceBaud(HM1X_BAUD_1200);
-        break;
-    case 2400:
-        err = forceBaud(HM1X_BAUD_2400);
-        break;
-    case 4800:
-        err = forceBaud(HM1X_BAUD_4800);
-        break;
-    case 9600:
-        err = forceBaud(HM1X_BAUD_9600);
-        break;
-    case 19200:
-        err = forceBaud(HM1X_BAUD_19200);
-        break;
-    case 38400:
-        err = forceBaud(HM1X_BAUD_38400);
-        break;
-    case 57600:
-        err = forceBaud(HM1X_BAUD_57600);
-        break;
-    case 115200:
-        err = forceBaud(HM1X_BAUD_115200);
-        break;
-    case 230400:
-        err = forceBaud(HM1X_BAUD_230400);
-        break;
-    default:
-        // Return error on unsupported baud
-        err = HM1X_ERROR_ER;
+    if (0)
+    {
+
+    }
+#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
+    else if (_softSerial != NULL)
+    {
+        _softSerial->begin(baud);
+    }
+#endif
+#ifdef HM1X_HARDWARE_SERIAL_ENABLED
+    else if (_serialPort != NULL)
+    {
+        _serialPort->begin(baud);
+    }
+#endif
+#ifdef HM1X_I2C_ENABLED
+    else if (_wirePort != NULL)
+    {
+        HM1X_baud_t atob;
+        if (findBaudFromRate(baud, atob) != HM1X_SUCCESS) return false;
+        writeI2cBaud(atob);
+    }
+#endif
+    else if (_baudCallback != NULL)
+    {
+        _baudCallback(baud);
+    }
+    else
+    {
+        return false;
     }
 
-    return err;
+    _baud = baud;
+    return true;
+}
+
+// Fastest baud setTransportBaud() can move this transport to, 0 if it can't
+// change baud at all. A baud callback's stream is taken to run any baud.
+unsigned long HM1X_BT::maxTransportBaud(void)
+{
+#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
+    if (_softSerial != NULL) return HM1X_SOFTWARE_SERIAL_MAX_BAUD;
+#endif
+#ifdef HM1X_HARDWARE_SERIAL_ENABLED
+    if (_serialPort != NULL) return btBauds[HM1X_BAUD_230400];
+#endif
+#ifdef HM1X_I2C_ENABLED
+    if (_wirePort != NULL) return btBauds[HM1X_BAUD_230400];
+#endif
+    return (_baudCallback != NULL) ? btBauds[HM1X_BAUD_230400] : 0;
+}
+
+HM1X_error_t HM1X_BT::forceBaud(unsigned long baud)
+{
+    HM1X_baud_t atob;
+
+    // Return error on unsupported baud
+    if (findBaudFromRate(baud, atob) != HM1X_SUCCESS)
+    {
+        return HM1X_ERROR_ER;
+    }
+    return forceBaud(atob);
 }
 
 // sweeps for all possible baud rates then force-set to the indicated baud rate
@@ -2953,32 +3379,25 @@ HM1X_error_t HM1X_BT::forceBaud(HM1X_baud_t baud)
 {    
     HM1X_error_t err;
     uint8_t idx;
-
-    for (uint8_t i = _validBaudBounds_ptr[0]; i < _validBaudBounds_ptr[1]; i++) 
-    {
-        idx = _btBauds_ptr[i];
-        if (0)
-        {
-            
-        }
-#ifdef HM1X_SOFTWARE_SERIAL_ENABLED
-        else if (_softSerial != NULL)
-        {
-            _softSerial->begin(btBauds[idx]);
-        }
-#endif
-#ifdef HM1X_I2C_ENABLED
-        else if (_wirePort != NULL)
+    // detectModel() can switch the model (and its tables) mid-sweep; keep
+    // sweeping the table we started with. setBaud() looks up the baud
+    // character in the current model's table.
+    uint8_t const * sweepBauds = _btBauds_ptr;
+    uint8_t first = _validBaudBounds_ptr[0];
+    uint8_t last = _validBaudBounds_ptr[1];
+
+    err = HM1X_ERROR_ER;
+    for (uint8_t i = first; i <= last; i++) 
+    {
+        idx = sweepBauds[i];
+        if (!setTransportBaud(btBauds[idx]))
         {
-            writeI2cBaud(i);
+            return HM1X_ERROR_ER; // Can't change the MCU-side baud to sweep
         }
-#endif
-#ifdef HM1X_HARDWARE_SERIAL_ENABLED
-        else if (_serialPort != NULL)
+        if (_modelUnknown && (detectModel() != HM1X_SUCCESS))
         {
-            _serialPort->begin(btBauds[idx]);
+            continue; // The baud character to send depends on the model
         }
-#endif
         err = setBaud(baud);
         if (err == HM1X_SUCCESS)
         {
@@ -2988,6 +3407,41 @@ HM1X_error_t HM1X_BT::forceBaud(HM1X_baud_t baud)
     return err;
 }
 
+void HM1X_BT::setModel(HM1X_model_t model)
+{
+    _btModel = model;
+    setModelSpecificVariables();
+}
+
+// The model a previous boot detected, if there is one
+boolean HM1X_BT::loadModel(void)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
+
+    readEeprom(_eepromAddress, saved);
+    if (saved.model < NUM_HM_MODELS)
+    {
+        _btModel = (HM1X_model_t) saved.model;
+        setModelSpecificVariables();
+        _modelUnknown = false;
+        return true;
+    }
+#endif
+    return false;
+}
+
+void HM1X_BT::saveModel(void)
+{
+#ifdef HM1X_EEPROM_ENABLED
+    hm1x_eeprom_t saved;
+
+    readEeprom(_eepromAddress, saved);
+    saved.model = _btModel;
+    EEPROM.put(_eepromAddress, saved);
+#endif
+}
+
 // set model-specific variables
 // _isEdrSupported, _btBauds_ptr, and _validBaudBounds_ptr
 void HM1X_BT::setModelSpecificVariables(void){
@@ -2998,6 +3452,7 @@ void HM1X_BT::setModelSpecificVariables(void){
         case HM11:
             // HM-10/11: only allow P0~8
             _isEdrSupported = false;
+            _pioPins = (_btModel == HM10) ? 0x0FFC : 0x000C; // PIO2-B, PIO2-3
             _validBaudBounds_ptr = &btBauds_validRange_HM10_11[0];
             _btBauds_ptr = &btBauds_HM10_11[0];
             break;
@@ -3005,6 +3460,7 @@ void HM1X_BT::setModelSpecificVariables(void){
         case HM13:
             // HM-12/13
             _isEdrSupported = true;
+            _pioPins = 0x000C;
             _validBaudBounds_ptr = &btBauds_validRange_HM12_13[0];
             _btBauds_ptr = &btBauds_HM12_13[0];
             break;
@@ -3016,6 +3472,7 @@ void HM1X_BT::setModelSpecificVariables(void){
         case HM19:
             // HM-14 to 19
             _isEdrSupported = false;
+            _pioPins = 0x000C;
             _validBaudBounds_ptr = &btBauds_validRange_HM16_17_18_19[0];
             _btBauds_ptr = &btBauds_HM16_17_18_19[0];
             break;
@@ -41,6 +41,7 @@
 #define HM1X_SOFTWARE_SERIAL_ENABLED // Enable software serial
 #define HM1X_HARDWARE_SERIAL_ENABLED // Enable hardware serial
 #define HM1X_I2C_ENABLED
+#define HM1X_EEPROM_ENABLED          // Detected model and boot snapshot
 #endif
 
 #ifdef ARDUINO_ARCH_SAMD              // Arduino SAMD boards (SAMD21, etc.)
@@ -49,6 +50,8 @@
 #define HM1X_I2C_ENABLED
 #endif
 
+#include "HM1X_Address.h"
+
 #ifdef HM1X_I2C_ENABLED
 #include <Wire.h>
 #endif
@@ -59,6 +62,74 @@
 #define QWIIC_BLUETOOTH_DEFAULT_ADDRESS 0x1B
 #define QWIIC_BLUETOOTH_JUMPED_ADDRESS 0x1C
 
+// Buffer sizes for string getters (add 1 for the terminator)
+#define HM1X_MAX_NAME_LEN 28 // getEdrName, getBleName
+#define HM1X_ADDRESS_LEN 12  // edrAddress, bleAddress, lastEdrAddress, lastBleAddress
+#define HM1X_UUID_LEN 32     // getiBeaconUUID
+#define HM1X_PIN_LEN 6       // getEdrPin, getBlePin
+#define HM1X_VERSION_LEN 20  // version
+// Longest unsolicited notice: "OK+CONB:" and an address
+#define HM1X_NOTICE_LEN (8 + HM1X_ADDRESS_LEN)
+
+// Where the library keeps what it remembers between boots (HM1X_EEPROM_ENABLED),
+// unless setEepromAddress() says otherwise
+#ifndef HM1X_EEPROM_ADDRESS
+#define HM1X_EEPROM_ADDRESS 0
+#endif
+
+// Fastest baud applyProfile() moves a SoftwareSerial link to: above it the
+// receive side drops bits on a 16 MHz AVR
+#ifndef HM1X_SOFTWARE_SERIAL_MAX_BAUD
+#define HM1X_SOFTWARE_SERIAL_MAX_BAUD 57600
+#endif
+
+// Receive buffer used once setupPoll() has been called
+#ifndef HM1X_RX_BUFFER_SIZE
+#define HM1X_RX_BUFFER_SIZE 64
+#endif
+#if HM1X_RX_BUFFER_SIZE > 255
+#error "HM1X_RX_BUFFER_SIZE must be 255 or less"
+#endif
+
+// Transmit pacing interval in ms at startup (see setTxPacing). 0 leaves
+// pacing off, so write() goes out at UART speed; 20 paces to a typical
+// 20 ms connection interval.
+#ifndef HM1X_TX_INTERVAL
+#define HM1X_TX_INTERVAL 0
+#endif
+
+// Transmit coalescing buffer (see setCoalescing). Writes are gathered into
+// packets of up to this many bytes; raise it to fill larger MTUs.
+#ifndef HM1X_TX_BUFFER_SIZE
+#define HM1X_TX_BUFFER_SIZE 20
+#endif
+#if HM1X_TX_BUFFER_SIZE > 255
+#error "HM1X_TX_BUFFER_SIZE must be 255 or less"
+#endif
+
+// Connection events poll() holds until getEvent() (see onEvent)
+#ifndef HM1X_EVENT_QUEUE_DEPTH
+#define HM1X_EVENT_QUEUE_DEPTH 8
+#endif
+
+// Characters of each device name kept by discovery (add 1 for the terminator)
+#ifndef HM1X_DISCOVERY_NAME_LEN
+#define HM1X_DISCOVERY_NAME_LEN 12
+#endif
+
+// Fire-and-forget sets that can wait for their reply at once
+#ifndef HM1X_SET_QUEUE_DEPTH
+#define HM1X_SET_QUEUE_DEPTH 4
+#endif
+
+// Connect attempts reconnect() makes by default
+#ifndef HM1X_RECONNECT_ATTEMPTS
+#define HM1X_RECONNECT_ATTEMPTS 5
+#endif
+
+// Pin argument for a flow control line that isn't connected
+#define HM1X_NO_PIN 0xFF
+
 typedef enum {
     HM1X_OUT_OF_MEMORY       = -8,
     HM1X_RX_OVERFLOW         = -7,
@@ -71,6 +142,79 @@ typedef enum {
     HM1X_SUCCESS             = 0
 } HM1X_error_t;
 
+// Called to re-open a generic Stream transport at a new baud rate
+typedef void (*HM1X_baud_callback_t)(unsigned long baud);
+
+typedef enum {
+    HM1X_EVENT_INIT,       // Module (re)started: OK+INIT
+    HM1X_EVENT_CONNECT,    // OK+CONE:/OK+CONB:
+    HM1X_EVENT_DISCONNECT, // OK+LSTE/OK+LSTB/OK+LOST
+    HM1X_EVENT_CONNECTING, // Connect command accepted: OK+CONNA/OK+CONNL
+    HM1X_EVENT_CONNECT_FAILED, // OK+CONNE/OK+CONNF/OK+CONNN
+    HM1X_EVENT_WAKE        // Module came out of sleep: OK+WAKE
+} HM1X_event_type_t;
+
+typedef enum {
+    HM1X_LINK_NONE,
+    HM1X_LINK_EDR,
+    HM1X_LINK_BLE
+} HM1X_link_t;
+
+// A connection notice picked out of the data stream by poll()
+typedef struct {
+    HM1X_event_type_t type;
+    HM1X_link_t link;
+    HM1X_address_t address;             // Peer address, null if the notice had none
+    unsigned long timestamp;            // millis() when the notice arrived
+} HM1X_event_t;
+
+// Reconnect timing (reconnect(), reconnectLast()), from the call to the link being up
+typedef struct {
+    uint16_t successes;
+    uint16_t failures;   // Gave up after the last attempt
+    uint16_t attempts;   // Connect commands sent
+    uint16_t lastTime;   // ms
+    uint16_t minTime;
+    uint16_t maxTime;
+    uint32_t totalTime;  // Over all successes, for the mean
+} HM1X_reconnect_stats_t;
+
+// Time spent in each power state (powerStats()), ms since start-up
+typedef struct {
+    uint32_t moduleAwake;
+    uint32_t moduleAsleep;
+    uint32_t mcuIdle;      // In idle(), whatever the module was doing
+    uint16_t moduleWakes;  // Times the module came out of sleep
+} HM1X_power_stats_t;
+
+// Called from poll() when a fire-and-forget set (e.g. setiBeaconMajorAsync)
+// wasn't confirmed: setting is the AT mnemonic ("MAJO"), value what was
+// asked for, result HM1X_UNEXPECTED_RESPONSE or HM1X_ERROR_TIMEOUT
+typedef void (*HM1X_set_callback_t)(const char * setting, uint32_t value, HM1X_error_t result);
+
+// Called from poll() when a watched PIO changes (watchPios). Bit n of
+// states is PIOn; changed has the watched pins that differ from the last read.
+typedef void (*HM1X_pio_callback_t)(uint16_t states, uint16_t changed);
+
+// Called from poll() for each event as it arrives
+typedef void (*HM1X_event_callback_t)(const HM1X_event_t & event);
+
+// One device found by startDiscovery()
+typedef struct {
+    HM1X_address_t address;
+    int8_t rssi;                             // dBm, 0 if the module didn't report it
+    char index;                              // The module's result number (the x in OK+DISx)
+    char name[HM1X_DISCOVERY_NAME_LEN + 1];  // "" if the module didn't report it
+} HM1X_discovery_result_t;
+
+// Called from poll() when a discovery finishes
+typedef void (*HM1X_discovery_callback_t)(HM1X_discovery_result_t * results, uint8_t count);
+
+// AT command descriptor, see the command table in the .cpp
+struct hm1x_command_desc;
+// Discovery can feed one of these, see HM1X_ScanCache.h
+class HM1X_ScanCache;
+struct HM1X_scan_entry_t;
 
 
 class HM1X_BT : public Print {
@@ -87,7 +231,8 @@ public:
         HM17,
         HM18,
         HM19,
-        NUM_HM_MODELS
+        NUM_HM_MODELS,
+        HM_AUTO = NUM_HM_MODELS // Work the model out in begin(), see detectModel()
     } HM1X_model_t;
 
     HM1X_BT(HM1X_model_t type = HM13);
@@ -102,19 +247,52 @@ public:
 #ifdef HM1X_I2C_ENABLED
     boolean begin(TwoWire &wirePort, uint8_t address);
 #endif
+    // Any other Stream, already opened at baud. Pass setBaudCallback to let
+    // the library change the port's baud (e.g. to recover the module's baud).
+    boolean begin(Stream &serial, unsigned long baud = 9600, HM1X_baud_callback_t setBaudCallback = NULL);
     
     boolean connected(void) { return (_connectedBle || _connectedEdr);};
     boolean connectedEdr(void) { return _connectedEdr;};
     boolean connectedBle(void) { return _connectedBle;};
+    // Peer of the current (or last) EDR/BLE connection, as reported while polling
+    const HM1X_address_t & edrPeer(void) { return _edrPeer;};
+    const HM1X_address_t & blePeer(void) { return _blePeer;};
+    // True once setupPoll() succeeded, i.e. connected() is being tracked
+    boolean polling(void) { return _polling;};
 
     boolean setupPoll(void);
+    // Reads what the module has sent, picking out connection notices.
+    // Returns true if any arrived.
     boolean poll(void);
+
+    // Connection events in arrival order. The queue keeps the newest
+    // HM1X_EVENT_QUEUE_DEPTH; older ones are dropped and counted. With a
+    // callback set, events go to it instead of the queue.
+    boolean getEvent(HM1X_event_t & event);
+    uint8_t eventsAvailable(void) { return _eventCount;};
+    uint16_t eventsDropped(void) { return _eventsDropped;};
+    void onEvent(HM1X_event_callback_t callback) { _eventCallback = callback;};
     int available(void);
     char read(void);
 
     virtual size_t write(uint8_t c);
     virtual size_t write(const char *str);
     virtual size_t write(const char * buffer, size_t size);
+    virtual size_t write(const uint8_t * buffer, size_t size);
+    virtual int availableForWrite(void);
+
+    // Transmit pacing. write() slices data into BLE packet-sized chunks and
+    // lets at most packetsPerInterval of them out per connection interval,
+    // blocking rather than overrunning the module. intervalMs = 0 turns
+    // pacing off (bytes go out at UART speed), which is the default
+    // unless HM1X_TX_INTERVAL says otherwise.
+    void setTxPacing(uint16_t intervalMs, uint8_t packetsPerInterval = 1);
+    void setTxPacketSize(uint8_t bytes);
+
+    // Opt-in coalescing of small writes into full packets, holding data at
+    // most delayMs. flush() sends whatever is held right away.
+    void setCoalescing(uint16_t delayMs);
+    virtual void flush(void);
 
     /* size_t send(String s); */
 
@@ -134,6 +312,43 @@ public:
     // AT+VERR -- Software version
     HM1X_error_t version(char * version);
 
+    // The model the library is driving, as constructed or as detected
+    HM1X_model_t model(void) { return _btModel;};
+    // Work out the model family from AT+VERR and, when the version doesn't
+    // name it, from whether AT+ADDE? answers (dual-mode) and which baud
+    // table AT+BAUD? fits. Switches baud tables and command dialect to it.
+    // At 230400, where both single-mode tables agree, it can't tell and
+    // returns HM1X_UNEXPECTED_RESPONSE. begin() runs this for
+    // HM1X_BT(HM_AUTO) and, when AT+VERR named the model, remembers it in
+    // EEPROM so later boots skip the probe; a family found by probing is
+    // probed again. forgetModel() clears what was remembered.
+    HM1X_error_t detectModel(void);
+    void forgetModel(void);
+
+    // Boot snapshot -- lets a sketch skip configuring the module when it's
+    // already set up. configVersion stands for the settings the sketch
+    // applies (a version number, or configHash() over them). Once they're
+    // applied, saveBootSnapshot() records it in EEPROM with the working baud
+    // and the module's BLE address. On later boots bootSnapshotValid() is
+    // true if configVersion and the baud match, the same module answers
+    // (AT+ADDR?) and, given bleName, it still has that name (AT+NAME? or
+    // AT+NAMB?), so a module reset with AT+RENEW or renamed from a phone fails
+    // the check. Then the sketch can skip straight to work.
+    // clearBootSnapshot() forces a reconfigure.
+    boolean bootSnapshotValid(uint32_t configVersion, const char * bleName = NULL);
+    HM1X_error_t saveBootSnapshot(uint32_t configVersion);
+    void clearBootSnapshot(void);
+    // Baud the module worked at when the snapshot was saved, else defaultBaud:
+    // begin() at it to avoid a baud sweep
+    unsigned long bootBaud(unsigned long defaultBaud);
+    // FNV-1a over text, chained through hash for several settings
+    static uint32_t configHash(const char * text, uint32_t hash = 2166136261UL);
+    // The model and boot snapshot are kept at HM1X_EEPROM_ADDRESS unless
+    // this moves them (call before begin()). They take eepromSize() bytes,
+    // the size of the library's EEPROM record: 16 on AVR.
+    void setEepromAddress(uint16_t address) { _eepromAddress = address;};
+    static uint16_t eepromSize(void);
+
     // AT+NOTI, AT+NOTP -- Notify information
     HM1X_error_t notifyInfo(boolean enabled = true);
     HM1X_error_t notifyMode(boolean enabled = true);
@@ -152,13 +367,17 @@ public:
     // AT+ADDE -- EDR address
     String edrAddress(void);
     HM1X_error_t edrAddress(char * retAddress);
+    HM1X_error_t edrAddress(HM1X_address_t & address);
     // AT+ADDB -- BLE address
     String bleAddress(void);
     HM1X_error_t bleAddress(char * retAddress);
+    HM1X_error_t bleAddress(HM1X_address_t & address);
 
     // AT+RADE, AT+RADB -- Last connected EDR/BLE address
     HM1X_error_t lastEdrAddress(char * address);
     HM1X_error_t lastBleAddress(char * address);
+    HM1X_error_t lastEdrAddress(HM1X_address_t & address);
+    HM1X_error_t lastBleAddress(HM1X_address_t & address);
 
     // AT+BONDE, AT+BONDB --- Clear EDR/BLE bond info
     HM1X_error_t clearEdrBond(void);
@@ -184,6 +403,60 @@ public:
     HM1X_error_t getBleMode(HM1X_ble_mode_t * mode);
     HM1X_error_t setBleMode(HM1X_ble_mode_t mode);
 
+    // AT+DISC? -- Scan for BLE devices (central mode) without blocking.
+    // poll() parses results into the caller's table as they arrive (a
+    // device seen twice keeps one entry) and calls onDone at the end of
+    // the scan. Returns HM1X_ERROR_TRY_LATER if a scan is in progress.
+    // results may be NULL (with size 0) when only the scan cache is wanted.
+    // Until the scan ends, notices and data between the scan lines still
+    // go through poll(), but commands that wait for a reply, async sets and
+    // requestPios() return HM1X_ERROR_TRY_LATER, watched PIO reads wait,
+    // and a scan can't start while a set or PIO read is waiting for its reply.
+    HM1X_error_t startDiscovery(HM1X_discovery_result_t * results, uint8_t size,
+                                HM1X_discovery_callback_t onDone = NULL);
+    void stopDiscovery(void);
+    boolean discovering(void) { return _discovering;};
+    uint8_t discoveryCount(void) { return _discCount;};
+    // Every scan also records its sightings here (NULL for none)
+    void setScanCache(HM1X_ScanCache * cache) { _scanCache = cache;};
+    // AT+DISI? -- Scan for iBeacons without blocking. The records come
+    // back as data (read()); HM1X_BeaconObserver parses them.
+    HM1X_error_t startIBeaconDiscovery(void);
+
+    // AT+CON<address>, AT+CONNL -- Connect straight to a known peer (central
+    // mode) without scanning. Driven from poll(): an attempt that fails or
+    // times out is retried after a back-off doubling from 100 ms, up to
+    // `attempts` tries. An attempt that can't be sent (e.g. during
+    // startDiscovery()) counts as failed and raises HM1X_EVENT_CONNECT_FAILED;
+    // its error is returned when it's the first. reconnecting() is true
+    // until the link is up or the last attempt failed.
+    HM1X_error_t reconnect(const HM1X_address_t & address, uint8_t attempts = HM1X_RECONNECT_ATTEMPTS);
+    HM1X_error_t reconnectLast(uint8_t attempts = HM1X_RECONNECT_ATTEMPTS);
+    void cancelReconnect(void) { _reconnectLeft = 0;};
+    boolean reconnecting(void) { return (_reconnectLeft > 0);};
+    // Reconnect to the peer by itself whenever a BLE link drops (0 = off)
+    void setAutoReconnect(uint8_t attempts) { _autoReconnect = attempts;};
+    const HM1X_reconnect_stats_t & reconnectStats(void) { return _reconnectStats;};
+
+    // AT+SLEEP -- Put the module to sleep (HM-10/11). It still advertises,
+    // and a central connecting wakes it (OK+CONB etc. arrive as usual), but
+    // it ignores commands until woken. Commands sent while it's asleep wake
+    // it first.
+    HM1X_error_t sleepModule(void);
+    // Wake the module: a string of over 80 characters, answered with OK+WAKE
+    HM1X_error_t wakeModule(void);
+    boolean moduleAsleep(void) { return _moduleAsleep;};
+    // AT+PWRM -- Let the module sleep by itself whenever it isn't connected
+    // (HM-10/11). Takes effect after a reset.
+    HM1X_error_t enableAutoSleep(boolean enabled = true);
+    // Sleep the MCU until the module sends something or timeout ms pass,
+    // then poll() and return what it returned. Call it in place of poll()
+    // when there's nothing else to do. On AVR this is idle mode, which keeps
+    // the UART receiving, so no notice is lost; elsewhere it just waits.
+    // Returns sooner when poll() has timed work due.
+    boolean idle(unsigned long timeout);
+    const HM1X_power_stats_t & powerStats(void);
+
     // AT+HIGH -- Data transmission speed mode
     // Disabled: SPP and BLE speeds balanced
     // Enabled: SPP will go high speed
@@ -242,6 +515,23 @@ public:
     HM1X_error_t getiBeaconPower(uint8_t * power);
     HM1X_error_t setiBeaconPower(uint8_t power);
 
+    // Fire-and-forget variants: the command goes out at once (or right
+    // after the one before it) and the call returns without waiting.
+    // poll() matches the OK+Set: replies later; one that doesn't match, or
+    // doesn't come, is counted and passed to onSetError's callback.
+    // HM1X_ERROR_TRY_LATER while HM1X_SET_QUEUE_DEPTH sets are unconfirmed,
+    // or during a scan (startDiscovery).
+    // Blocking commands wait for the replies first, and return
+    // HM1X_ERROR_TRY_LATER if they don't come, or if called from a
+    // callback during that wait.
+    HM1X_error_t setiBeaconMajorAsync(uint16_t version);
+    HM1X_error_t setiBeaconMinorAsync(uint16_t version);
+    HM1X_error_t setiBeaconPowerAsync(uint8_t power);
+    uint8_t pendingSets(void) { return _setCount;};
+    uint16_t setMismatches(void) { return _setMismatches;};
+    uint16_t setTimeouts(void) { return _setTimeouts;};
+    void onSetError(HM1X_set_callback_t callback) { _setCallback = callback;};
+
     // AT+MTUS -- MTU Size
     typedef enum {
         MTU_SIZE_60,
@@ -276,9 +566,21 @@ public:
     HM1X_error_t setLedMode(HM1X_led_mode_t mode);
 
     // AT+PIO -- Write/query PIO
+    // Pins 2-11 (PIO2-PIOB) on the HM-10, 2-3 on other models
     HM1X_error_t readPio(uint8_t pin, uint8_t * value);
     HM1X_error_t writePio(uint8_t pin, uint8_t value);
 
+    // AT+PIO?? -- Read every PIO in one exchange (HM-10/11), without
+    // blocking: poll() picks up the reply. pioStates() then has bit n set
+    // for PIOn high; pioReadPending() is true until then.
+    HM1X_error_t requestPios(void);
+    boolean pioReadPending(void) { return (_pioSent || _pioRequested);};
+    uint16_t pioStates(void) { return _pioStates;};
+    // Re-read the PIOs every interval ms from poll() (0 stops), calling
+    // onChange when a pin in mask changes. The first read goes out straight
+    // away and reports every pin in mask. Skipped while the module sleeps.
+    void watchPios(uint16_t mask, uint16_t interval, HM1X_pio_callback_t onChange);
+
     // AT+BAUD -- Baud rate
     typedef enum {
         HM1X_BAUD_1200,
@@ -295,9 +597,109 @@ public:
     HM1X_error_t setBaud(HM1X_baud_t atob);
     HM1X_error_t setBaud(uint32_t baud);
 
+    // AT+FIOW -- Hardware (RTS/CTS) flow control
+    // rtsPin is driven by the library, ctsPin is read before each byte sent.
+    // Takes effect on the module after a reset.
+    HM1X_error_t enableFlowControl(uint8_t rtsPin, uint8_t ctsPin, boolean enabled = true);
+    void setFlowControlThreshold(uint8_t level);
+
+    // Throughput profiles -- a model-appropriate batch of settings plus a UART
+    // baud, applied together. Resets the module; the MCU side follows the new
+    // baud and the link is checked before returning. The baud is capped at
+    // what the transport can run (HM1X_SOFTWARE_SERIAL_MAX_BAUD). If a
+    // setting or the baud is refused, the settings already made are put back.
+    typedef enum {
+        PROFILE_MAX_THROUGHPUT,
+        PROFILE_LOW_LATENCY,
+        PROFILE_LOW_POWER,
+        NUM_HM1X_PROFILES
+    } HM1X_profile_t;
+    HM1X_error_t applyProfile(HM1X_profile_t profile);
+
+    // AT+ADVI -- BLE advertising interval
+    // Longer intervals save power but make the module slower to discover.
+    // Takes effect after a reset.
+    typedef enum {
+        ADV_INTERVAL_100MS,
+        ADV_INTERVAL_152MS,
+        ADV_INTERVAL_211MS,
+        ADV_INTERVAL_318MS,
+        ADV_INTERVAL_417MS,
+        ADV_INTERVAL_546MS,
+        ADV_INTERVAL_760MS,
+        ADV_INTERVAL_852MS,
+        ADV_INTERVAL_1022MS,
+        ADV_INTERVAL_1285MS,
+        ADV_INTERVAL_2000MS,
+        ADV_INTERVAL_3000MS,
+        ADV_INTERVAL_4000MS,
+        ADV_INTERVAL_5000MS,
+        ADV_INTERVAL_6000MS,
+        ADV_INTERVAL_7000MS,
+        NUM_ADV_INTERVALS
+    } HM1X_adv_interval_t;
+    HM1X_error_t getAdvertisingInterval(HM1X_adv_interval_t * interval);
+    HM1X_error_t setAdvertisingInterval(HM1X_adv_interval_t interval);
+
+    // AT+COMI, AT+COMA -- Min/max connection interval requested as a BLE slave
+    // Single-mode (HM-10/11) modules only. Sent to the central on the next
+    // connection when enableUpdateConnectionParameter() is on.
+    typedef enum {
+        CONN_INTERVAL_7_5MS,
+        CONN_INTERVAL_10MS,
+        CONN_INTERVAL_15MS,
+        CONN_INTERVAL_20MS,
+        CONN_INTERVAL_25MS,
+        CONN_INTERVAL_30MS,
+        CONN_INTERVAL_35MS,
+        CONN_INTERVAL_40MS,
+        CONN_INTERVAL_45MS,
+        CONN_INTERVAL_4000MS,
+        NUM_CONN_INTERVALS
+    } HM1X_conn_interval_t;
+    HM1X_error_t getConnectionInterval(HM1X_conn_interval_t * minInterval, HM1X_conn_interval_t * maxInterval);
+    HM1X_error_t setConnectionInterval(HM1X_conn_interval_t minInterval, HM1X_conn_interval_t maxInterval);
+
+    // AT+COLA -- Slave latency: connection events the slave may skip (0-4)
+    HM1X_error_t getSlaveLatency(uint8_t * latency);
+    HM1X_error_t setSlaveLatency(uint8_t latency);
+
+    // AT+COSU -- Connection supervision timeout
+    typedef enum {
+        SUPERVISION_TIMEOUT_100MS,
+        SUPERVISION_TIMEOUT_1S,
+        SUPERVISION_TIMEOUT_2S,
+        SUPERVISION_TIMEOUT_3S,
+        SUPERVISION_TIMEOUT_4S,
+        SUPERVISION_TIMEOUT_5S,
+        SUPERVISION_TIMEOUT_6S,
+        NUM_SUPERVISION_TIMEOUTS
+    } HM1X_supervision_timeout_t;
+    HM1X_error_t getSupervisionTimeout(HM1X_supervision_timeout_t * timeout);
+    HM1X_error_t setSupervisionTimeout(HM1X_supervision_timeout_t timeout);
+
+    // Connection presets -- advertising interval and connection parameters
+    // trading latency for power. Commands the model doesn't have are skipped.
+    // Doesn't reset: call reset() (or reconnect) for them to take effect.
+    typedef enum {
+        CONN_PRESET_LOW_LATENCY,
+        CONN_PRESET_BALANCED,
+        CONN_PRESET_LOW_POWER,
+        NUM_CONN_PRESETS
+    } HM1X_conn_preset_t;
+    HM1X_error_t applyConnectionPreset(HM1X_conn_preset_t preset);
+
 private:
     
     HM1X_model_t _btModel;
+    boolean _modelUnknown; // HM_AUTO, not detected yet
+    uint16_t _eepromAddress;
+
+    // All serial I/O goes through _serial. The typed pointers below are
+    // only kept to change the port's baud rate.
+    Stream * _serial;
+    HM1X_baud_callback_t _baudCallback;
+    unsigned long _baud;
 
 #ifdef HM1X_HARDWARE_SERIAL_ENABLED
     HardwareSerial * _serialPort;
@@ -312,13 +714,107 @@ private:
 
     boolean _connectedEdr;
     boolean _connectedBle;
-    String _edrAddress;
-    String _bleAddress;
-
-    String _response;
+    HM1X_address_t _edrPeer;
+    HM1X_address_t _blePeer;
+
+    // Data received while polling, waiting for read()
+    char _rxBuffer[HM1X_RX_BUFFER_SIZE];
+    uint8_t _rxHead;
+    uint8_t _rxCount;
+
+    // Bytes that may be the start of a notice, held back from _rxBuffer
+    char _notice[HM1X_NOTICE_LEN];
+    uint8_t _noticeLen;
+    unsigned long _noticeTime;
+    uint8_t _noticesSeen;
+
+    HM1X_event_t _events[HM1X_EVENT_QUEUE_DEPTH];
+    uint8_t _eventHead;
+    uint8_t _eventCount;
+    uint16_t _eventsDropped;
+    HM1X_event_callback_t _eventCallback;
+
+    // Discovery in progress (startDiscovery). Bytes that may be the start
+    // of a scan line are held in _discToken; the rest go to parseByte().
+    boolean _discovering;
+    char _discToken[HM1X_NOTICE_LEN];
+    uint8_t _discTokenLen;
+    HM1X_discovery_result_t * _discResults;
+    uint8_t _discSize;
+    uint8_t _discCount;
+    uint8_t _discCurrent;   // Entry the module is reporting on, 0xFF if none
+    boolean _discInName;    // Inside an OK+NAME: value, which runs to the line end
+    HM1X_discovery_callback_t _discCallback;
+    HM1X_ScanCache * _scanCache;
+    HM1X_scan_entry_t * _scanEntry; // Cache entry of the device being reported
+
+    // Reconnect in progress: attempts left, and whether one is waiting on
+    // the module (else the back-off is running from _reconnectTime)
+    HM1X_address_t _reconnectAddress;
+    boolean _reconnectToLast;
+    uint8_t _reconnectLeft;
+    boolean _reconnectInFlight;
+    uint16_t _reconnectBackoff;
+    unsigned long _reconnectStart;
+    unsigned long _reconnectTime;
+    uint8_t _autoReconnect;
+    HM1X_reconnect_stats_t _reconnectStats;
+
+    // Fire-and-forget sets waiting for OK+Set:, oldest first. The first
+    // _setSent of them have gone to the module.
+    typedef struct {
+        uint8_t command;     // HM1X_command_t
+        uint32_t value;
+        unsigned long time;  // When it was sent
+    } hm1x_pending_set_t;
+    hm1x_pending_set_t _sets[HM1X_SET_QUEUE_DEPTH];
+    uint8_t _setHead;
+    uint8_t _setCount;
+    uint8_t _setSent;
+    uint16_t _setMismatches;
+    uint16_t _setTimeouts;
+    HM1X_set_callback_t _setCallback;
+    boolean _waitingForReplies; // A blocking command is waiting on them
+
+    // PIO reads (requestPios, watchPios): one AT+PIO?? at a time. _pioTime
+    // is when the last one went out.
+    uint16_t _pioPins;       // Pins this model has, by bit
+    uint16_t _pioStates;
+    boolean _pioKnown;       // _pioStates holds a read
+    boolean _pioRequested;   // Waiting to be sent
+    boolean _pioSent;        // Waiting for OK+PIO?:
+    unsigned long _pioTime;
+    uint16_t _pioMask;
+    uint16_t _pioInterval;
+    HM1X_pio_callback_t _pioCallback;
+
+    // Module sleep (sleepModule, enableAutoSleep). Time since _powerSince
+    // hasn't been added to _powerStats yet.
+    boolean _moduleAsleep;
+    boolean _autoSleep;
+    unsigned long _powerSince;
+    HM1X_power_stats_t _powerStats;
+
+    // Flow control pins, HM1X_NO_PIN when unused
+    uint8_t _rtsPin;
+    uint8_t _ctsPin;
+    uint8_t _rtsThreshold;
 
     boolean _polling;
 
+    // Transmit pacing: bytes the module can still take this connection interval
+    uint8_t _txPacketSize;
+    uint8_t _txPacketsPerInterval;
+    uint16_t _txInterval;
+    uint16_t _txCredits;
+    unsigned long _txRefillTime;
+
+    // Small writes held back by setCoalescing()
+    char _txBuffer[HM1X_TX_BUFFER_SIZE];
+    uint8_t _txPending;
+    uint16_t _txCoalesceDelay;
+    unsigned long _txPendingTime;
+
     // pointer to the proper baud mapping array per model
     // should be set during class construction
     uint8_t const * _btBauds_ptr;
@@ -331,31 +827,140 @@ private:
     boolean _isEdrSupported;
 
     void setModelSpecificVariables();
+    void setModel(HM1X_model_t model);
+    boolean loadModel(void);
+    HM1X_error_t resolveModel(void);
+    void saveModel(void);
 
     HM1X_error_t findBaudFromArray(HM1X_baud_t atob, uint8_t &num);
+    HM1X_error_t findBaudFromRate(unsigned long baud, HM1X_baud_t &atob);
 
+    boolean beginSerial(unsigned long baud);
     HM1X_error_t init(void);
 
-    // Send command with an expected response string/length -- e.g. "OK":
-    HM1X_error_t sendCommandWithResponseAndTimeout(const char * command, char * expectedResponse, uint16_t commandTimeout);
-    // Send a command wait for a timeout, check for response -- e.g. "OK" or "OK+LSTE:001122334455"
-    int sendCommandWithTimeout(const char * command, char ** responseDest, uint16_t commandTimeout);
-
-    // Send a command -- prepend AT
-    boolean sendCommand(const char * command);
+    // AT command engine. One entry per row of the command table in the .cpp,
+    // in the same order. Indexed commands (AT+IBE0, AT+PIO2) take the index.
+    typedef enum {
+        HM1X_CMD_RESET,
+        HM1X_CMD_FACTORY_DEFAULTS,
+        HM1X_CMD_VERSION,
+        HM1X_CMD_NOTIFY_INIT,
+        HM1X_CMD_NOTIFY_MODE,
+        HM1X_CMD_EDR_NAME,
+        HM1X_CMD_BLE_NAME,
+        HM1X_CMD_EDR_ADR,
+        HM1X_CMD_BLE_ADR,
+        HM1X_CMD_LAST_EDR,
+        HM1X_CMD_LAST_BLE,
+        HM1X_CMD_CLEAR_BOND_EDR,
+        HM1X_CMD_CLEAR_BOND_BLE,
+        HM1X_CMD_CLEAR_ADR_EDR,
+        HM1X_CMD_CLEAR_ADR_BLE,
+        HM1X_CMD_EDR_MODE,
+        HM1X_CMD_BLE_MODE,
+        HM1X_CMD_HIGH_SPEED_SPP,
+        HM1X_CMD_DUAL_WORK_MODE,
+        HM1X_CMD_MODULE_WORK_MODE,
+        HM1X_CMD_A_TO_B_MODE,
+        HM1X_CMD_AUTHENTICATION_MODE,
+        HM1X_CMD_EDR_PIN_CODE,
+        HM1X_CMD_BLE_PIN_CODE,
+        HM1X_CMD_COD,
+        HM1X_CMD_UPDATE_CON_PARAM,
+        HM1X_CMD_IBEACON_SWITCH,
+        HM1X_CMD_IBEACON_UUID,
+        HM1X_CMD_IBEACON_MAJOR,
+        HM1X_CMD_IBEACON_MINOR,
+        HM1X_CMD_IBEACON_POWER,
+        HM1X_CMD_MTU_SIZE,
+        HM1X_CMD_ADVERT_TYPE,
+        HM1X_CMD_SAFE_MODE,
+        HM1X_CMD_BLE_MAC,
+        HM1X_CMD_SYSTEM_KEY,
+        HM1X_CMD_SYSTEM_LED,
+        HM1X_CMD_PIO_STATUS,
+        HM1X_CMD_BAUD,
+        HM1X_CMD_FLOW_CONTROL,
+        HM1X_CMD_DISCOVER,
+        HM1X_CMD_DISCOVER_IBEACON,
+        HM1X_CMD_CONNECT_ADDRESS,
+        HM1X_CMD_CONNECT_LAST,
+        HM1X_CMD_ADVERT_INTERVAL,
+        HM1X_CMD_CONN_INTERVAL_MIN,
+        HM1X_CMD_CONN_INTERVAL_MAX,
+        HM1X_CMD_SLAVE_LATENCY,
+        HM1X_CMD_SUPERVISION_TIMEOUT,
+        HM1X_CMD_SLEEP,
+        HM1X_CMD_AUTO_SLEEP,
+        HM1X_CMD_PIO_ALL
+    } HM1X_command_t;
+
+    HM1X_error_t commandExecute(HM1X_command_t command);
+    HM1X_error_t commandSet(HM1X_command_t command, uint32_t value, int8_t index = -1);
+    HM1X_error_t commandSetText(HM1X_command_t command, const char * text, int8_t index = -1);
+    HM1X_error_t commandGet(HM1X_command_t command, uint32_t * value, int8_t index = -1);
+    HM1X_error_t commandGetText(HM1X_command_t command, char * dest, int8_t index = -1);
+    HM1X_error_t commandGetAddress(HM1X_command_t command, HM1X_address_t & address);
+    HM1X_error_t commandSend(HM1X_command_t command, const char * arg);
+    HM1X_error_t commandSetAsync(HM1X_command_t command, uint32_t value);
+
+    HM1X_error_t loadCommand(HM1X_command_t command, struct hm1x_command_desc * desc);
+    HM1X_error_t sendSet(const struct hm1x_command_desc * desc, const char * arg, int8_t index);
+
+    // Send a complete command line and read back the reply
+    HM1X_error_t transact(const char * command, char * response, uint8_t responseSize,
+                          uint8_t expectLen, boolean afterColon, uint16_t commandTimeout);
 
-    /*void hwFlush(void); // Read and trash all bytes from serial buffer*/
     size_t hwPrint(const char * s);
+    size_t hwWrite(const uint8_t * buffer, size_t size);
+
+    HM1X_error_t resetAndFollowBaud(unsigned long newBaud);
+    HM1X_error_t waitForModule(void);
+
+    size_t sendPaced(const uint8_t * buffer, size_t size);
+    void refillTxCredits(void);
+    void flushIfDue(void);
+
+    void updateRts(void);
+    boolean waitForCts(void);
 
-    int readAvailable(char * inString);
     char readChar(void);
     int hwAvailable(void);
+
+    void parseByte(char c);
+    void resolveNotice(boolean timedOut);
+    void handleNotice(uint8_t notice, uint8_t len);
+    void raiseEvent(const HM1X_event_t & event);
+    void storeByte(char c);
+    void parseDiscovery(char c);
+    void releaseDiscoveryBytes(uint8_t count);
+    void handleDiscoveryToken(uint8_t token);
+    void finishDiscovery(void);
+    HM1X_error_t startReconnect(uint8_t attempts);
+    HM1X_error_t reconnectAttempt(void);
+    void reconnectFailed(void);
+    void pollReconnect(void);
+    void reconnectEvent(const HM1X_event_t & event);
+    uint8_t pendingSetWidth(void);
+    void sendPendingSets(void);
+    void pollPendingSets(void);
+    void setModuleAsleep(boolean asleep);
+    void setConfirmed(const char * value, uint8_t len);
+    void setFailed(HM1X_error_t result, uint8_t index = 0);
+    uint8_t pendingPioWidth(void);
+    void pollPios(void);
+    void expirePioRead(void);
+    void piosRead(const char * value);
+    HM1X_error_t waitForReplies(void);
     
 #ifdef HM1X_I2C_ENABLED
     void writeI2cBaud(uint8_t baudIndex);
     void setI2cAddress(uint8_t address);
 #endif
 
+    unsigned long maxTransportBaud(void);
+    HM1X_error_t applyProfileStep(uint8_t command, uint8_t value);
+    boolean setTransportBaud(unsigned long baud);
     HM1X_error_t forceBaud(unsigned long baud);
     HM1X_error_t forceBaud(HM1X_baud_t baud);
 };
\ No newline at end of file
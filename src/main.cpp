@@ -16,6 +16,9 @@
   - getBleMode(), setBleMode()
   - getBlePin(), setBlePin()
   Also prints out BLE addresses (not configurable).
+  Once configured, the module's state is remembered in EEPROM
+  (saveBootSnapshot()) and later boots skip straight to loop()
+  after checking the module's address and BLE name (bootSnapshotValid()).
 
   Works well with a DSD-Tech HM-19 board -- 
   connecting via software serial (D3, D4)
@@ -42,6 +45,8 @@ SoftwareSerial btSerial(3, 4);
 String edrName = "MyEDR";
 String bleName = "MyBLE";
 String existingName;
+const char blePin[] = "784923";
+const HM1X_BT::HM1X_ble_mode_t bleMode = (HM1X_BT::HM1X_ble_mode_t)1;
 
 void setup() {
   Serial.begin(9600); // Serial debug port @ 9600 bps
@@ -50,13 +55,29 @@ void setup() {
   // in this case takes a SoftwareSerial connection and
   // a desired serial baud rate.
   // Returns true on success
-  if (bt.begin(btSerial, 9600) == false) {
+  // bootBaud: the baud the module was left at last time, else 9600
+  if (bt.begin(btSerial, bt.bootBaud(9600)) == false) {
     Serial.println(F("Failed to connect to the HM-19."));
     while (1) ;
   }
   Serial.println("Ready to Bluetooth!");
 
+  // The BLE settings this sketch makes below. Change any of them and the
+  // next boot configures the module again. The check reads the BLE name
+  // back, so a module reset to factory settings (AT+RENEW) or renamed
+  // from a phone is configured again too; other changes made outside
+  // the sketch aren't seen. Call bt.clearBootSnapshot() to force it.
+  const char modeText[2] = { (char) ('0' + bleMode), '\0' };
+  uint32_t config = HM1X_BT::configHash(bleName.c_str());
+  config = HM1X_BT::configHash(blePin, config);
+  config = HM1X_BT::configHash(modeText, config);
+  if (bt.bootSnapshotValid(config, bleName.c_str())) {
+    Serial.println(F("Module already configured"));
+    return;
+  }
+
   boolean resetRequired = false; // Reset is required on name change
+  boolean configured = true;     // Every BLE setting below took
 
   // 1: Device Name  
   // getEdrName returns a string containing EDR device name
@@ -88,6 +109,7 @@ void setup() {
       resetRequired = true;
     }else{
       Serial.println("Setting BLE name failed");
+      configured = false;
     }
   } else {
     Serial.println("BLE name is: " + bleName);
@@ -117,10 +139,12 @@ void setup() {
   }
 
   // set BLE mode
-  mode = (HM1X_BT::HM1X_ble_mode_t)1;
+  mode = bleMode;
   if (bt.setBleMode(mode) == HM1X_SUCCESS){
     Serial.print("changing... ");
     Serial.println(mode);  
+  }else{
+    configured = false;
   }
 
   // get BLE mode again
@@ -131,17 +155,19 @@ void setup() {
 
   // 4: Pin
   // get BLE pin
-  char* pin = (char *) calloc(6, sizeof(char));
+  char* pin = (char *) calloc(HM1X_PIN_LEN + 1, sizeof(char));
   if (bt.getBlePin(pin) == HM1X_SUCCESS){
     Serial.print("Current BLE Pin: ");
     Serial.println(pin);  
   }
 
   // set BLE pin to an arbitrary PIN
-  strcpy(pin, "784923");
+  strcpy(pin, blePin);
   if (bt.setBlePin(pin) == HM1X_SUCCESS){
     Serial.print("changing... ");
     Serial.println(mode);  
+  }else{
+    configured = false;
   }
 
   // get BLE pin again
@@ -152,7 +178,22 @@ void setup() {
   
   if (resetRequired) {
     Serial.println("Resetting BT module. Wait a few seconds.");
-    bt.reset();
+    if (bt.reset() == HM1X_SUCCESS) {
+      delay(5000); // Delay long enough for module to reset
+    } else {
+      Serial.println("Reset failed");
+      configured = false;
+    }
+  }
+
+  // Skip all of the above next boot, once it has all worked and the
+  // module has come back with the new name
+  if (configured && (bt.getBleName() != bleName)) {
+    Serial.println("Module didn't come back with the new settings");
+    configured = false;
+  }
+  if (configured && (bt.saveBootSnapshot(config) == HM1X_SUCCESS)) {
+    Serial.println(F("Configuration saved"));
   }
 }
 
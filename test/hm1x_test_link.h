@@ -0,0 +1,175 @@
+/*
+  In-memory stand-in for an HM-1X module, shared by the link layer tests.
+
+  While begin() talks to it, it answers "AT" with "OK" and any other
+  command with "OK+Set:" and the command's last character. A test can
+  queue its own replies with reply() and read back the last command in
+  command[]; setting transparent back to false lets it do so after
+  beginTestLink(). After
+  beginTestLink() it is a plain pipe: what the library writes collects
+  in sent[], and inject() queues bytes for the library to read, so a
+  test can check the exact bytes a layer puts on the wire and feed it
+  bytes encoded by the host side (extras/hm1x_host).
+
+  It also holds the fixture every test binary shares: one link, one
+  HM-10 on it, and beginTests() to open the run with test_begin.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <unity.h>
+#include <SparkFun_HM1X_Bluetooth_Arduino_Library.h>
+
+#ifndef HM1X_TEST_LINK_SIZE
+#define HM1X_TEST_LINK_SIZE 160
+#endif
+#ifndef HM1X_TEST_LINK_REPLIES
+#define HM1X_TEST_LINK_REPLIES 4
+#endif
+
+class HM1X_TestLink : public Stream
+{
+public:
+    uint8_t sent[HM1X_TEST_LINK_SIZE];
+    uint16_t sentLength;
+    boolean transparent;
+    char command[HM1X_TEST_LINK_SIZE + 1]; // Last command answered
+    uint16_t commands;                     // Commands answered so far
+
+    HM1X_TestLink(void)
+    {
+        sentLength = 0;
+        transparent = false;
+        command[0] = '\0';
+        commands = 0;
+        _head = 0;
+        _length = 0;
+        _replyCount = 0;
+    }
+
+    virtual size_t write(uint8_t c)
+    {
+        if (sentLength == HM1X_TEST_LINK_SIZE) return 0;
+        sent[sentLength++] = c;
+        return 1;
+    }
+    using Print::write;
+
+    virtual int availableForWrite(void) { return HM1X_TEST_LINK_SIZE - sentLength; }
+
+    virtual int available(void)
+    {
+        answer();
+        return _length - _head;
+    }
+
+    virtual int read(void)
+    {
+        answer();
+        if (_head == _length) return -1;
+        return _rx[_head++];
+    }
+
+    virtual int peek(void)
+    {
+        answer();
+        if (_head == _length) return -1;
+        return _rx[_head];
+    }
+
+    virtual void flush(void) {}
+
+    // Queue bytes for the library to read
+    void inject(const uint8_t * data, uint16_t length)
+    {
+        if (_head == _length)
+        {
+            _head = 0;
+            _length = 0;
+        }
+        while ((length > 0) && (_length < HM1X_TEST_LINK_SIZE))
+        {
+            _rx[_length++] = *data++;
+            length--;
+        }
+    }
+
+    void clearSent(void) { sentLength = 0; }
+
+    // Answer the next command with text; "" leaves it unanswered.
+    // Replies queue up for consecutive commands.
+    void reply(const char * text)
+    {
+        if (_replyCount < HM1X_TEST_LINK_REPLIES)
+        {
+            _replies[_replyCount++] = text;
+        }
+    }
+
+private:
+    uint8_t _rx[HM1X_TEST_LINK_SIZE];
+    uint16_t _head;
+    uint16_t _length;
+    const char * _replies[HM1X_TEST_LINK_REPLIES];
+    uint8_t _replyCount;
+
+    // Reply to the command the library has just sent, if any
+    void answer(void)
+    {
+        const char * text = "OK";
+        uint8_t set[8];
+
+        if (transparent || (sentLength == 0)) return;
+        memcpy(command, sent, sentLength);
+        command[sentLength] = '\0';
+        commands++;
+        if (_replyCount > 0)
+        {
+            text = _replies[0];
+            _replyCount--;
+            memmove(_replies, &_replies[1], _replyCount * sizeof(_replies[0]));
+        }
+        else if (sentLength > 2)
+        {
+            memcpy(set, "OK+Set:", 7);
+            set[7] = sent[sentLength - 1];
+            sentLength = 0;
+            inject(set, sizeof(set));
+            return;
+        }
+        sentLength = 0;
+        inject((const uint8_t *) text, strlen(text));
+    }
+};
+
+// Start bt on link, then switch the link to a plain pipe with nothing sent
+inline boolean beginTestLink(HM1X_BT & bt, HM1X_TestLink & link)
+{
+    if (!bt.begin(link, 9600))
+    {
+        return false;
+    }
+    link.transparent = true;
+    link.clearSent();
+    bt.setTxPacing(0);
+    return true;
+}
+
+// Each test directory builds to its own binary, so one definition each
+HM1X_TestLink link;
+HM1X_BT bt(HM1X_BT::HM10);
+
+void test_begin(void)
+{
+    TEST_ASSERT_TRUE(beginTestLink(bt, link));
+}
+
+// Call from setup(), then RUN_TEST the suite and UNITY_END()
+void beginTests(void)
+{
+    delay(2000); // Give the board time to open the test port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_begin);
+}
@@ -0,0 +1,105 @@
+/*
+  HM1X_address_t: parsing the module's 12 hex digit addresses and
+  printing them back.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+void test_parse(void)
+{
+    HM1X_address_t address;
+    const uint8_t expected[] = {0x00, 0x11, 0x22, 0xAA, 0xBB, 0xCC};
+
+    TEST_ASSERT_TRUE(address.parse("001122AABBCC"));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, address.bytes, HM1X_ADDRESS_BYTES);
+    TEST_ASSERT_FALSE(address.isNull());
+
+    // Either case; anything after the 12th digit is left alone
+    TEST_ASSERT_TRUE(address.parse("001122aabbccOK+LOST"));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, address.bytes, HM1X_ADDRESS_BYTES);
+}
+
+// A bad or short address leaves the null address, not half a parse
+void test_parse_failure(void)
+{
+    HM1X_address_t address;
+
+    TEST_ASSERT_TRUE(address.parse("001122AABBCC"));
+    TEST_ASSERT_FALSE(address.parse("001122AABBCG"));
+    TEST_ASSERT_TRUE(address.isNull());
+
+    TEST_ASSERT_TRUE(address.parse("001122AABBCC"));
+    TEST_ASSERT_FALSE(address.parse("001122"));
+    TEST_ASSERT_TRUE(address.isNull());
+}
+
+void test_to_string(void)
+{
+    HM1X_address_t address;
+    char text[HM1X_ADDRESS_BYTES * 2 + 1];
+
+    TEST_ASSERT_TRUE(address.parse("0a1b2c3d4e5f"));
+    address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("0A1B2C3D4E5F", text);
+
+    address.clear();
+    address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("000000000000", text);
+}
+
+void test_print_to(void)
+{
+    HM1X_address_t address;
+
+    TEST_ASSERT_TRUE(address.parse("001122AABBCC"));
+    link.clearSent();
+    TEST_ASSERT_EQUAL(12, address.printTo(link));
+    TEST_ASSERT_EQUAL_MEMORY("001122AABBCC", link.sent, 12);
+    link.clearSent();
+}
+
+void test_hex_digit(void)
+{
+    TEST_ASSERT_EQUAL(0, HM1X_address_t::hexDigit('0'));
+    TEST_ASSERT_EQUAL(9, HM1X_address_t::hexDigit('9'));
+    TEST_ASSERT_EQUAL(10, HM1X_address_t::hexDigit('A'));
+    TEST_ASSERT_EQUAL(15, HM1X_address_t::hexDigit('f'));
+    TEST_ASSERT_EQUAL(-1, HM1X_address_t::hexDigit('G'));
+    TEST_ASSERT_EQUAL(-1, HM1X_address_t::hexDigit(':'));
+    TEST_ASSERT_EQUAL(-1, HM1X_address_t::hexDigit('\0'));
+}
+
+void test_compare(void)
+{
+    HM1X_address_t a;
+    HM1X_address_t b;
+
+    a.parse("001122AABBCC");
+    b.parse("001122aabbcc");
+    TEST_ASSERT_TRUE(a == b);
+    TEST_ASSERT_FALSE(a != b);
+    TEST_ASSERT_EQUAL(a.hash(), b.hash());
+
+    b.parse("001122AABBCD");
+    TEST_ASSERT_FALSE(a == b);
+    TEST_ASSERT_TRUE(a != b);
+    TEST_ASSERT_NOT_EQUAL(a.hash(), b.hash());
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_parse);
+    RUN_TEST(test_parse_failure);
+    RUN_TEST(test_to_string);
+    RUN_TEST(test_print_to);
+    RUN_TEST(test_hex_digit);
+    RUN_TEST(test_compare);
+    UNITY_END();
+}
+
+void loop()
+{
+}
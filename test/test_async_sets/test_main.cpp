@@ -0,0 +1,168 @@
+/*
+  Fire-and-forget sets (setiBeaconMajorAsync() and friends): sent without
+  waiting, their OK+Set: replies matched later by poll().
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+uint8_t setErrors;
+char lastSetting[5];
+HM1X_error_t lastResult;
+
+void setError(const char * setting, uint32_t value, HM1X_error_t result)
+{
+    setErrors++;
+    strncpy(lastSetting, setting, sizeof(lastSetting) - 1);
+    lastResult = result;
+}
+
+HM1X_error_t innerResult;
+
+// Blocking commands can't run from a callback fired while one waits
+void setErrorTransact(const char * setting, uint32_t value, HM1X_error_t result)
+{
+    setErrors++;
+    innerResult = bt.setiBeaconMinor(3);
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+boolean sent(const char * text)
+{
+    boolean match = (link.sentLength == strlen(text)) &&
+                    (memcmp(link.sent, text, link.sentLength) == 0);
+    link.clearSent();
+    return match;
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    link.transparent = true;
+    link.clearSent();
+    bt.onSetError(setError);
+}
+
+// Each set waits for the one before it to be answered, or for the gap
+void test_queued(void)
+{
+    char text[4];
+    uint8_t len = 0;
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajorAsync(0x00FF));
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMinorAsync(0x1234));
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconPowerAsync(0xC5));
+    TEST_ASSERT_TRUE(sent("AT+MAJO00FF"));
+    TEST_ASSERT_EQUAL(3, bt.pendingSets());
+
+    // The reply, among data, releases the next at once
+    inject("xOK+Set:00FFy");
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+MINO1234"));
+    while (bt.available() > 0) text[len++] = bt.read();
+    text[len] = '\0';
+    TEST_ASSERT_EQUAL_STRING("xy", text);
+
+    delay(25);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+MEASC5"));
+    TEST_ASSERT_EQUAL(2, bt.pendingSets());
+}
+
+void test_mismatch(void)
+{
+    inject("OK+Set:1235");
+    bt.poll();
+    TEST_ASSERT_EQUAL(1, bt.setMismatches());
+    TEST_ASSERT_EQUAL(1, setErrors);
+    TEST_ASSERT_EQUAL_STRING("MINO", lastSetting);
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, lastResult);
+
+    inject("OK+Set:C5");
+    bt.poll();
+    TEST_ASSERT_EQUAL(0, bt.pendingSets());
+    TEST_ASSERT_EQUAL(1, setErrors);
+}
+
+void test_refused(void)
+{
+    uint8_t i;
+
+    // Checked against the table like any set, and never queued
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setiBeaconMajorAsync(0xFFFF));
+    for (i = 0; i < HM1X_SET_QUEUE_DEPTH; i++)
+    {
+        TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajorAsync(i + 1));
+    }
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.setiBeaconMajorAsync(i + 1));
+    TEST_ASSERT_EQUAL(HM1X_SET_QUEUE_DEPTH, bt.pendingSets());
+}
+
+void test_timeouts(void)
+{
+    for (uint8_t i = 0; (i < 250) && (bt.pendingSets() > 0); i++)
+    {
+        delay(25);
+        bt.poll();
+    }
+    TEST_ASSERT_EQUAL(0, bt.pendingSets());
+    TEST_ASSERT_EQUAL(HM1X_SET_QUEUE_DEPTH, bt.setTimeouts());
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TIMEOUT, lastResult);
+    link.clearSent();
+}
+
+// A blocking set waits for the replies still due first
+void test_blocking_waits(void)
+{
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajorAsync(7));
+    link.clearSent();
+    inject("OK+Set:0007");
+    link.transparent = false;
+    link.reply("OK+Set:0009");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMinor(9));
+    TEST_ASSERT_EQUAL_STRING("AT+MINO0009", link.command);
+    TEST_ASSERT_EQUAL(0, bt.pendingSets());
+    link.transparent = true;
+    link.clearSent();
+}
+
+void test_no_transact_from_callback(void)
+{
+    uint8_t errors = setErrors;
+
+    bt.onSetError(setErrorTransact);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajorAsync(1));
+    bt.poll();
+    link.clearSent(); // Its reply never comes
+    link.transparent = false;
+    link.reply("OK+Set:0009");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMinor(9));
+    TEST_ASSERT_EQUAL(errors + 1, setErrors);
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, innerResult);
+    link.transparent = true;
+    link.clearSent();
+    bt.onSetError(NULL);
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_queued);
+    RUN_TEST(test_mismatch);
+    RUN_TEST(test_refused);
+    RUN_TEST(test_timeouts);
+    RUN_TEST(test_blocking_waits);
+    RUN_TEST(test_no_transact_from_callback);
+    UNITY_END();
+}
+
+void loop()
+{
+}
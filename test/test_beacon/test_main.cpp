@@ -0,0 +1,153 @@
+/*
+  HM1X_BeaconObserver: AT+DISI? records parsed off the link and
+  summarised per beacon as one CBOR item per window.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Beacon.h>
+#include "../hm1x_test_link.h"
+
+#define UUID "74278BDAB64445208F0C720EAF059935"
+
+HM1X_beacon_stats_t stats[2];
+HM1X_BeaconObserver observer(bt, stats, 2);
+
+uint8_t seen;
+HM1X_ibeacon_t lastBeacon;
+
+void countBeacon(const HM1X_ibeacon_t & beacon)
+{
+    seen++;
+    lastBeacon = beacon;
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+void pollBoth(void)
+{
+    bt.poll();
+    observer.poll();
+}
+
+void test_begin_scan(void)
+{
+    observer.onBeacon(countBeacon);
+    observer.setWindow(1000);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, observer.begin());
+    TEST_ASSERT_EQUAL(8, link.sentLength);
+    TEST_ASSERT_EQUAL_MEMORY("AT+DISI?", link.sent, 8);
+    link.clearSent();
+}
+
+// Not polling, so nothing says a connection is up: the summary waits
+void test_waits_without_polling(void)
+{
+    inject("OK+DISIS"
+           "OK+DISC:4C000215:" UUID ":0001000AC5:A81B6AE2FB96:-052");
+    observer.poll();
+    TEST_ASSERT_EQUAL(1, seen);
+    delay(1100);
+    observer.poll();
+    TEST_ASSERT_EQUAL(1, observer.beacons());
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    link.transparent = true;
+    link.clearSent();
+}
+
+// Records split across reads, line ends between them, non-beacons
+// skipped and beacons past the table's size counted as dropped
+void test_records(void)
+{
+    const char * records =
+        "OK+DISC:4C000215:" UUID ":0001000AC5:A81B6AE2FB96:-060\r\n"
+        "OK+DISC:00000000:00000000000000000000000000000000:0000000000:112233445566:-071"
+        "OK+DISC:4C000215:" UUID ":0002000BC5:A81B6AE2FB97:-070"
+        "OK+DISC:4C000215:" UUID ":0003000CC5:A81B6AE2FB98:-080";
+    char piece[8];
+
+    for (uint16_t i = 0; i < strlen(records); i += 7)
+    {
+        strncpy(piece, &records[i], 7);
+        piece[7] = '\0';
+        inject(piece);
+        pollBoth();
+    }
+    TEST_ASSERT_EQUAL(4, seen);
+    TEST_ASSERT_EQUAL(2, observer.beacons());
+    TEST_ASSERT_EQUAL(1, observer.dropped());
+
+    TEST_ASSERT_EQUAL(3, lastBeacon.major);
+    TEST_ASSERT_EQUAL(12, lastBeacon.minor);
+    TEST_ASSERT_EQUAL(-59, lastBeacon.txPower);
+    TEST_ASSERT_EQUAL(-80, lastBeacon.rssi);
+    TEST_ASSERT_EQUAL_HEX8(0x74, lastBeacon.uuid[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x98, lastBeacon.address.bytes[5]);
+}
+
+// The module ends each scan; the observer starts the next
+void test_scan_restarted(void)
+{
+    inject("OK+DISCE");
+    pollBoth();
+    delay(20);
+    pollBoth();
+    TEST_ASSERT_EQUAL(8, link.sentLength);
+    TEST_ASSERT_EQUAL_MEMORY("AT+DISI?", link.sent, 8);
+    link.clearSent();
+}
+
+// Polling but not connected: still waiting. Connected: one summary,
+// [ms, [[major, minor, count, min, max, mean], ...]]
+void test_summary_once_connected(void)
+{
+    const uint8_t beacons[] = {
+        0x82,
+        0x86, 0x01, 0x0A, 0x02, 0x38, 0x3B, 0x38, 0x33, 0x38, 0x37, // -60, -52, -56
+        0x86, 0x02, 0x0B, 0x01, 0x38, 0x45, 0x38, 0x45, 0x38, 0x45  // -70
+    };
+
+    observer.poll();
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+
+    inject("OK+CONN");
+    bt.poll();
+    delay(20);
+    pollBoth();
+    TEST_ASSERT_TRUE(bt.connected());
+    TEST_ASSERT_EQUAL(0, observer.beacons());
+
+    // Array of 2, then the window length as a 16 bit unsigned
+    TEST_ASSERT_EQUAL_HEX8(0x82, link.sent[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x19, link.sent[1]);
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, ((uint16_t) link.sent[2] << 8) | link.sent[3]);
+    TEST_ASSERT_EQUAL(4 + sizeof(beacons), link.sentLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(beacons, &link.sent[4], sizeof(beacons));
+    link.clearSent();
+    observer.stop();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_begin_scan);
+    RUN_TEST(test_waits_without_polling);
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_records);
+    RUN_TEST(test_scan_restarted);
+    RUN_TEST(test_summary_once_connected);
+    UNITY_END();
+}
+
+void loop()
+{
+}
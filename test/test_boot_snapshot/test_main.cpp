@@ -0,0 +1,120 @@
+/*
+  Boot snapshot: saveBootSnapshot() records the configuration, baud and
+  module in EEPROM; bootSnapshotValid() checks them against the module.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+#define ADDRESS "OK+ADDR:001122334455"
+#define NAME "OK+NAME:MyBLE"
+
+uint32_t config;
+
+void test_config_hash(void)
+{
+    config = HM1X_BT::configHash("MyBLE");
+    config = HM1X_BT::configHash("784923", config);
+    TEST_ASSERT_NOT_EQUAL(config, HM1X_BT::configHash("MyBLE"));
+    TEST_ASSERT_NOT_EQUAL(config, HM1X_BT::configHash("MyBLF", HM1X_BT::configHash("784923")));
+    TEST_ASSERT_EQUAL_HEX32(0x811C9DC5, HM1X_BT::configHash(""));
+}
+
+void test_none_saved(void)
+{
+    bt.clearBootSnapshot();
+    link.transparent = false;
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config));
+    TEST_ASSERT_EQUAL(115200, bt.bootBaud(115200));
+}
+
+void test_saved(void)
+{
+    uint16_t commands = link.commands;
+
+    link.reply(ADDRESS);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.saveBootSnapshot(config));
+    TEST_ASSERT_EQUAL(9600, bt.bootBaud(115200));
+
+    // One exchange without a name, two with
+    link.reply(ADDRESS);
+    TEST_ASSERT_TRUE(bt.bootSnapshotValid(config));
+    link.reply(ADDRESS);
+    link.reply(NAME);
+    TEST_ASSERT_TRUE(bt.bootSnapshotValid(config, "MyBLE"));
+    TEST_ASSERT_EQUAL_STRING("AT+NAME?", link.command);
+    TEST_ASSERT_EQUAL(commands + 4, link.commands);
+}
+
+// Another configuration asks nothing of the module
+void test_config_changed(void)
+{
+    uint16_t commands = link.commands;
+
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config + 1));
+    TEST_ASSERT_EQUAL(commands, link.commands);
+}
+
+void test_other_module(void)
+{
+    link.reply("OK+ADDR:001122334456");
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config, "MyBLE"));
+    TEST_ASSERT_EQUAL_STRING("AT+ADDR?", link.command);
+}
+
+// Reset with AT+RENEW, or renamed from a phone
+void test_module_reconfigured(void)
+{
+    link.reply(ADDRESS);
+    link.reply("OK+NAME:HMSoft");
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config, "MyBLE"));
+
+    link.reply(ADDRESS);
+    link.reply("");
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config, "MyBLE"));
+}
+
+void test_cleared(void)
+{
+    bt.clearBootSnapshot();
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config));
+    TEST_ASSERT_EQUAL(9600, bt.bootBaud(9600));
+}
+
+// Kept where setEepromAddress() says, apart from the default record
+void test_eeprom_address(void)
+{
+    link.reply(ADDRESS);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.saveBootSnapshot(config));
+    bt.setEepromAddress(HM1X_EEPROM_ADDRESS + HM1X_BT::eepromSize());
+    TEST_ASSERT_FALSE(bt.bootSnapshotValid(config));
+
+    link.reply(ADDRESS);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.saveBootSnapshot(config));
+    bt.clearBootSnapshot();
+    bt.setEepromAddress(HM1X_EEPROM_ADDRESS);
+    link.reply(ADDRESS);
+    TEST_ASSERT_TRUE(bt.bootSnapshotValid(config));
+    bt.clearBootSnapshot();
+    link.transparent = true;
+    link.clearSent();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_config_hash);
+    RUN_TEST(test_none_saved);
+    RUN_TEST(test_saved);
+    RUN_TEST(test_config_changed);
+    RUN_TEST(test_other_module);
+    RUN_TEST(test_module_reconfigured);
+    RUN_TEST(test_cleared);
+    RUN_TEST(test_eeprom_address);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,151 @@
+/*
+  HM1X_CborWriter against RFC 8949 and the host decoder
+  (extras/hm1x_host/cbor.py).
+
+  There is no device-side decoder, so the check runs one way: the writer
+  must produce the reference bytes below, and
+  extras/hm1x_host/tests/test_cbor.py decodes the same bytes.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Cbor.h>
+#include "../hm1x_test_link.h"
+
+HM1X_CborWriter cbor(bt);
+
+// {"t": 21.5, "n": 100000, "neg": -500, "ok": true,
+//  "arr": [_ 0, 23, 24, 65536, null, h'010203'], "ts": 1(1700000000)}
+const uint8_t message[] = {
+    0xA6,
+    0x61, 't', 0xFA, 0x41, 0xAC, 0x00, 0x00,
+    0x61, 'n', 0x1A, 0x00, 0x01, 0x86, 0xA0,
+    0x63, 'n', 'e', 'g', 0x39, 0x01, 0xF3,
+    0x62, 'o', 'k', 0xF5,
+    0x63, 'a', 'r', 'r', 0x9F, 0x00, 0x17, 0x18, 0x18, 0x1A, 0x00, 0x01, 0x00, 0x00,
+    0xF6, 0x43, 0x01, 0x02, 0x03, 0xFF,
+    0x62, 't', 's', 0xC1, 0x1A, 0x65, 0x53, 0xF1, 0x00};
+
+void expectEncoded(const uint8_t * expected, uint16_t length)
+{
+    TEST_ASSERT_EQUAL(length, link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, link.sent, length);
+    link.clearSent();
+}
+
+// Examples from RFC 8949 Appendix A
+void test_integers(void)
+{
+    const uint8_t ui0[] = {0x00};
+    const uint8_t ui23[] = {0x17};
+    const uint8_t ui24[] = {0x18, 0x18};
+    const uint8_t ui1000[] = {0x19, 0x03, 0xE8};
+    const uint8_t ui1000000[] = {0x1A, 0x00, 0x0F, 0x42, 0x40};
+    const uint8_t neg1[] = {0x20};
+    const uint8_t neg100[] = {0x38, 0x63};
+    const uint8_t neg1000[] = {0x39, 0x03, 0xE7};
+    const uint8_t int10[] = {0x0A};
+
+    link.clearSent();
+    cbor.writeUInt(0);
+    expectEncoded(ui0, sizeof(ui0));
+    cbor.writeUInt(23);
+    expectEncoded(ui23, sizeof(ui23));
+    cbor.writeUInt(24);
+    expectEncoded(ui24, sizeof(ui24));
+    cbor.writeUInt(1000);
+    expectEncoded(ui1000, sizeof(ui1000));
+    cbor.writeUInt(1000000);
+    expectEncoded(ui1000000, sizeof(ui1000000));
+    cbor.writeInt(-1);
+    expectEncoded(neg1, sizeof(neg1));
+    cbor.writeInt(-100);
+    expectEncoded(neg100, sizeof(neg100));
+    cbor.writeInt(-1000);
+    expectEncoded(neg1000, sizeof(neg1000));
+    cbor.writeInt(10);
+    expectEncoded(int10, sizeof(int10));
+}
+
+void test_simple_values(void)
+{
+    const uint8_t falseValue[] = {0xF4};
+    const uint8_t nullValue[] = {0xF6};
+    const uint8_t float100000[] = {0xFA, 0x47, 0xC3, 0x50, 0x00};
+    const uint8_t floatMinus4[] = {0xFA, 0xC0, 0x80, 0x00, 0x00};
+
+    link.clearSent();
+    cbor.writeBool(false);
+    expectEncoded(falseValue, sizeof(falseValue));
+    cbor.writeNull();
+    expectEncoded(nullValue, sizeof(nullValue));
+    cbor.writeFloat(100000.0);
+    expectEncoded(float100000, sizeof(float100000));
+    cbor.writeFloat(-4.0);
+    expectEncoded(floatMinus4, sizeof(floatMinus4));
+}
+
+void test_strings(void)
+{
+    const uint8_t empty[] = {0x60};
+    const uint8_t ietf[] = {0x64, 'I', 'E', 'T', 'F'};
+    const uint8_t bytes[] = {0x44, 0x01, 0x02, 0x03, 0x04};
+
+    link.clearSent();
+    cbor.writeString("");
+    expectEncoded(empty, sizeof(empty));
+    cbor.writeString("IETF");
+    expectEncoded(ietf, sizeof(ietf));
+    cbor.writeString(F("IETF"));
+    expectEncoded(ietf, sizeof(ietf));
+    cbor.writeString("IETF!", 4);
+    expectEncoded(ietf, sizeof(ietf));
+    cbor.writeBytes(&bytes[1], 4);
+    expectEncoded(bytes, sizeof(bytes));
+}
+
+void test_message_matches_host(void)
+{
+    const uint8_t arrayBytes[] = {1, 2, 3};
+    size_t written = cbor.written();
+
+    link.clearSent();
+    cbor.beginMap(6);
+    cbor.writeString("t");
+    cbor.writeFloat(21.5);
+    cbor.writeString("n");
+    cbor.writeUInt(100000);
+    cbor.writeString("neg");
+    cbor.writeInt(-500);
+    cbor.writeString("ok");
+    cbor.writeBool(true);
+    cbor.writeString("arr");
+    cbor.beginArray();
+    cbor.writeUInt(0);
+    cbor.writeUInt(23);
+    cbor.writeUInt(24);
+    cbor.writeUInt(65536);
+    cbor.writeNull();
+    cbor.writeBytes(arrayBytes, sizeof(arrayBytes));
+    cbor.end();
+    cbor.writeString("ts");
+    cbor.writeTag(1);
+    cbor.writeUInt(1700000000);
+
+    TEST_ASSERT_EQUAL(sizeof(message), cbor.written() - written);
+    expectEncoded(message, sizeof(message));
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_integers);
+    RUN_TEST(test_simple_values);
+    RUN_TEST(test_strings);
+    RUN_TEST(test_message_matches_host);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,188 @@
+/*
+  The AT command engine: the hm1xCommands table, the commands built from
+  it and the replies parsed for it.
+
+  Runs through the public getters and setters with the test link
+  answering as the module, so each test sees both the exact command
+  sent and what the library made of the reply.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+void test_command_mode(void)
+{
+    link.transparent = false;
+    link.clearSent();
+}
+
+// Values are zero-padded hex to the table's width; the reply must echo them
+void test_set(void)
+{
+    link.reply("OK+Set:1");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setBleMode(HM1X_BT::BLE_CENTRAL));
+    TEST_ASSERT_EQUAL_STRING("AT+ROLE1", link.command);
+
+    link.reply("OK+Set:00ABCD");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setCod(0xABCD));
+    TEST_ASSERT_EQUAL_STRING("AT+COFD00ABCD", link.command);
+
+    link.reply("OK+Set:0");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setBleMode(HM1X_BT::BLE_CENTRAL));
+}
+
+// Out of range values and commands this model lacks never reach the module
+void test_set_refused(void)
+{
+    uint16_t commands = link.commands;
+    HM1X_BT::HM1X_edr_mode_t edrMode;
+
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setiBeaconMajor(0xFFFF));
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setAdvertisingInterval((HM1X_BT::HM1X_adv_interval_t) 16));
+    TEST_ASSERT_EQUAL(HM1X_ERROR_ER, bt.getEdrMode(&edrMode));
+    TEST_ASSERT_EQUAL(HM1X_ERROR_ER, bt.enableDualMode(true));
+    TEST_ASSERT_EQUAL(commands, link.commands);
+}
+
+void test_set_text(void)
+{
+    char pin[] = "123456";
+    char longPin[] = "1234567";
+    char letters[] = "12a456";
+
+    link.reply("OK+Set:123456");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setBlePin(pin));
+    TEST_ASSERT_EQUAL_STRING("AT+PASS123456", link.command);
+
+    link.reply("OK+Set:HM1X");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setBleName("HM1X"));
+    TEST_ASSERT_EQUAL_STRING("AT+NAMEHM1X", link.command);
+
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setBlePin(longPin));
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.setBlePin(letters));
+}
+
+void test_get(void)
+{
+    HM1X_BT::HM1X_ble_mode_t mode;
+    uint16_t major;
+
+    link.reply("OK+Get:1");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.getBleMode(&mode));
+    TEST_ASSERT_EQUAL_STRING("AT+ROLE?", link.command);
+    TEST_ASSERT_EQUAL(HM1X_BT::BLE_CENTRAL, mode);
+
+    link.reply("OK+Get:12AB");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.getiBeaconMajor(&major));
+    TEST_ASSERT_EQUAL_STRING("AT+MAJO?", link.command);
+    TEST_ASSERT_EQUAL_HEX16(0x12AB, major);
+
+    // Not hex, or out of the enum's range
+    link.reply("OK+Get:x");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.getBleMode(&mode));
+    link.reply("OK+Get:7");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.getBleMode(&mode));
+    TEST_ASSERT_EQUAL(HM1X_BT::BLE_MODE_INVALID, mode);
+}
+
+// A fixed-width value ends the read as soon as its last digit arrives
+void test_get_stops_at_width(void)
+{
+    HM1X_BT::HM1X_ble_mode_t mode;
+
+    link.reply("OK+Get:0OK+LOST");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.getBleMode(&mode));
+    TEST_ASSERT_EQUAL(HM1X_BT::BLE_PERIPHERAL, mode);
+    TEST_ASSERT_EQUAL(strlen("OK+LOST"), link.available());
+    while (link.available() > 0) link.read();
+}
+
+void test_get_text(void)
+{
+    char pin[7];
+    char name[29];
+    HM1X_address_t address;
+    char text[13];
+
+    link.reply("OK+Get:000000");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.getBlePin(pin));
+    TEST_ASSERT_EQUAL_STRING("AT+PASS?", link.command);
+    TEST_ASSERT_EQUAL_STRING("000000", pin);
+
+    link.reply("OK+NAME:HMSoft\r\n");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.getBleName(name));
+    TEST_ASSERT_EQUAL_STRING("AT+NAME?", link.command);
+    TEST_ASSERT_EQUAL_STRING("HMSoft", name);
+
+    link.reply("OK+ADDR:001122AABBCC");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.bleAddress(address));
+    TEST_ASSERT_EQUAL_STRING("AT+ADDR?", link.command);
+    address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("001122AABBCC", text);
+
+    link.reply("OK+ADDR:0011");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.bleAddress(address));
+}
+
+// Indexed commands take the index as one hex digit
+void test_indexed(void)
+{
+    link.reply("OK+Set:1");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.writePio(10, 1));
+    TEST_ASSERT_EQUAL_STRING("AT+PIOA1", link.command);
+
+    link.reply("OK+Set:0123ABCD");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconUUID((char *) "0123ABCD", 2));
+    TEST_ASSERT_EQUAL_STRING("AT+IBE20123ABCD", link.command);
+}
+
+void test_execute(void)
+{
+    link.reply("OK+BONDB");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.clearBleBond());
+    TEST_ASSERT_EQUAL_STRING("AT+BONDB", link.command);
+
+    // Single-mode models use the single mnemonic
+    link.reply("OK+CLEAR");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.clearBleConnected());
+    TEST_ASSERT_EQUAL_STRING("AT+CLEAR", link.command);
+
+    link.reply("OK+RESET");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.clearBleBond());
+}
+
+void test_transact_errors(void)
+{
+    HM1X_BT::HM1X_ble_mode_t mode;
+    char name[29];
+
+    link.reply("ER");
+    TEST_ASSERT_EQUAL(HM1X_ERROR_ER, bt.getBleMode(&mode));
+
+    link.reply("");
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TIMEOUT, bt.getBleMode(&mode));
+
+    link.reply("OK+NAME:0123456789012345678901234567890123456789");
+    TEST_ASSERT_EQUAL(HM1X_RX_OVERFLOW, bt.getBleName(name));
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_command_mode);
+    RUN_TEST(test_set);
+    RUN_TEST(test_set_refused);
+    RUN_TEST(test_set_text);
+    RUN_TEST(test_get);
+    RUN_TEST(test_get_stops_at_width);
+    RUN_TEST(test_get_text);
+    RUN_TEST(test_indexed);
+    RUN_TEST(test_execute);
+    RUN_TEST(test_transact_errors);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,134 @@
+/*
+  HM1X_Compressor/HM1X_Decompressor against the host codec
+  (extras/hm1x_host/compress.py).
+
+  For short messages the device coder and Compressor(max_match=32) emit
+  the same tokens; extras/hm1x_host/tests/test_compress.py checks the
+  vectors below from the host side.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Compress.h>
+#include "../hm1x_test_link.h"
+
+HM1X_Compressor compressor(bt);
+HM1X_Decompressor decompressor(bt);
+
+const char text1[] = "T=21.5,H=40;T=21.5,H=41;T=21.5,H=40;"
+                     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n";
+const uint8_t stream1[] = {
+    0x0B, 'T', '=', '2', '1', '.', '5', ',', 'H', '=', '4', '0', ';',
+    0x87, 0x0B, 0x00, '1', 0x88, 0x0B, 0x02, '0', ';', 'a',
+    0x9D, 0x00, 0x88, 0x00, 0x00, '\n'};
+// The same reading again, sent mostly as one match into the history
+const char text2[] = "T=21.5,H=40;\n";
+const uint8_t stream2[] = {0x89, 0x38, 0x00, '\n'};
+
+// Compare what the decompressor produces from the link with expected
+void expectDecoded(const uint8_t * expected, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        TEST_ASSERT_TRUE(decompressor.available() > 0);
+        TEST_ASSERT_EQUAL_HEX8(expected[i], decompressor.read());
+    }
+    TEST_ASSERT_EQUAL(0, decompressor.available());
+}
+
+// Input of the long host stream: 140 distinct bytes, then a run of 140
+uint8_t longInput(uint16_t i)
+{
+    return (i < 140) ? (uint8_t) (i * 7) : 0x55;
+}
+
+void test_encode_matches_host(void)
+{
+    link.clearSent();
+    compressor.print(text1);
+    compressor.flush();
+    TEST_ASSERT_EQUAL(sizeof(stream1), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(stream1, link.sent, sizeof(stream1));
+
+    link.clearSent();
+    compressor.print(text2);
+    compressor.flush();
+    TEST_ASSERT_EQUAL(sizeof(stream2), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(stream2, link.sent, sizeof(stream2));
+}
+
+void test_decode_host_stream(void)
+{
+    decompressor.reset();
+    link.inject(stream1, sizeof(stream1));
+    expectDecoded((const uint8_t *) text1, strlen(text1));
+    link.inject(stream2, sizeof(stream2));
+    expectDecoded((const uint8_t *) text2, strlen(text2));
+}
+
+void test_decode_long_tokens(void)
+{
+    // Compressor().compress() of longInput(): literal runs and matches
+    // longer than the device coder ever emits
+    const uint8_t tail[] = {0xFF, 0x00, 0x86, 0x00};
+    uint8_t c;
+    uint16_t i;
+
+    decompressor.reset();
+    c = 0x7F;
+    link.inject(&c, 1);
+    for (i = 0; i < 128; i++)
+    {
+        c = longInput(i);
+        link.inject(&c, 1);
+    }
+    for (i = 0; i < 128; i++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(longInput(i), decompressor.read());
+    }
+    c = 0x0C;
+    link.inject(&c, 1);
+    for (i = 128; i < 141; i++)
+    {
+        c = longInput(i);
+        link.inject(&c, 1);
+    }
+    link.inject(tail, sizeof(tail));
+    for (i = 128; i < 280; i++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(longInput(i), decompressor.read());
+    }
+    TEST_ASSERT_EQUAL(-1, decompressor.read());
+}
+
+void test_round_trip(void)
+{
+    char line[32];
+
+    compressor.reset();
+    decompressor.reset();
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        snprintf(line, sizeof(line), "T=%d.%d,H=%d,%s\n", 20 + i % 5, i % 10, 40 + i % 7, (i % 3) ? "run" : "idle");
+        link.clearSent();
+        compressor.print(line);
+        compressor.flush();
+        TEST_ASSERT_LESS_THAN(strlen(line) + 2, link.sentLength);
+        link.inject(link.sent, link.sentLength);
+        expectDecoded((const uint8_t *) line, strlen(line));
+    }
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_encode_matches_host);
+    RUN_TEST(test_decode_host_stream);
+    RUN_TEST(test_decode_long_tokens);
+    RUN_TEST(test_round_trip);
+    UNITY_END();
+}
+
+void loop()
+{
+}
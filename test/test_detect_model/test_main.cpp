@@ -0,0 +1,144 @@
+/*
+  HM1X_BT(HM_AUTO): the model worked out by detectModel() and, when the
+  module's version names it, remembered in EEPROM for later boots.
+*/
+
+#define HM1X_TEST_LINK_REPLIES 8
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+// Clear of the default address, so each test's record is its own
+#define OFFSET 64
+
+// begin()'s AT, AT+NOTP0 and AT+NOTI0, answered
+void replyInit(void)
+{
+    link.reply("OK");
+    link.reply("OK+Set:0");
+    link.reply("OK+Set:0");
+}
+
+boolean beginAuto(HM1X_BT & dev, unsigned long baud)
+{
+    boolean begun;
+
+    link.transparent = false;
+    begun = dev.begin(link, baud);
+    link.transparent = true;
+    link.clearSent();
+    return begun;
+}
+
+void test_record_size(void)
+{
+    TEST_ASSERT_GREATER_THAN(0, HM1X_BT::eepromSize());
+    TEST_ASSERT_LESS_OR_EQUAL(OFFSET, HM1X_BT::eepromSize());
+}
+
+// Named by AT+VERR: the next boot at the same address skips the probe
+void test_named_saved(void)
+{
+    HM1X_BT first(HM1X_BT::HM_AUTO);
+    HM1X_BT second(HM1X_BT::HM_AUTO);
+    uint16_t commands;
+
+    first.setEepromAddress(OFFSET);
+    first.forgetModel();
+    replyInit();
+    link.reply("HM-19 V605");
+    TEST_ASSERT_TRUE(beginAuto(first, 9600));
+    TEST_ASSERT_EQUAL(HM1X_BT::HM19, first.model());
+
+    second.setEepromAddress(OFFSET);
+    commands = link.commands;
+    TEST_ASSERT_TRUE(beginAuto(second, 9600));
+    TEST_ASSERT_EQUAL(HM1X_BT::HM19, second.model());
+    TEST_ASSERT_EQUAL(commands + 3, link.commands);
+    TEST_ASSERT_EQUAL_STRING("AT+NOTI0", link.command);
+}
+
+// Somewhere else in EEPROM nothing is remembered
+void test_address(void)
+{
+    HM1X_BT other(HM1X_BT::HM_AUTO);
+
+    other.setEepromAddress(OFFSET + HM1X_BT::eepromSize());
+    other.forgetModel();
+    replyInit();
+    link.reply("HM-10 V540");
+    TEST_ASSERT_TRUE(beginAuto(other, 9600));
+    TEST_ASSERT_EQUAL_STRING("AT+VERR?", link.command);
+    TEST_ASSERT_EQUAL(HM1X_BT::HM10, other.model());
+}
+
+// Told apart by the baud table: used, but probed again next boot
+void test_probed_not_saved(void)
+{
+    HM1X_BT first(HM1X_BT::HM_AUTO);
+    HM1X_BT second(HM1X_BT::HM_AUTO);
+
+    first.setEepromAddress(OFFSET);
+    first.forgetModel();
+    replyInit();
+    link.reply("HMSoft V540");
+    link.reply("ER");
+    link.reply("OK+Get:0"); // 9600 on an HM-10, 1200 on an HM-19
+    TEST_ASSERT_TRUE(beginAuto(first, 9600));
+    TEST_ASSERT_EQUAL(HM1X_BT::HM10, first.model());
+    TEST_ASSERT_EQUAL_STRING("AT+BAUD?", link.command);
+
+    second.setEepromAddress(OFFSET);
+    replyInit();
+    link.reply("HMSoft V540");
+    link.reply("ER");
+    link.reply("OK+Get:3"); // 9600 on an HM-19
+    TEST_ASSERT_TRUE(beginAuto(second, 9600));
+    TEST_ASSERT_EQUAL(HM1X_BT::HM19, second.model());
+    TEST_ASSERT_EQUAL_STRING("AT+BAUD?", link.command);
+}
+
+// '8' is 230400 in both single-mode tables: no guess
+void test_ambiguous_baud(void)
+{
+    HM1X_BT dev(HM1X_BT::HM_AUTO);
+    HM1X_BT next(HM1X_BT::HM_AUTO);
+
+    dev.setEepromAddress(OFFSET);
+    dev.forgetModel();
+    replyInit();
+    link.reply("HMSoft V540");
+    link.reply("ER");
+    link.reply("OK+Get:8");
+    TEST_ASSERT_FALSE(beginAuto(dev, 230400));
+
+    link.transparent = false;
+    link.reply("HMSoft V540");
+    link.reply("ER");
+    link.reply("OK+Get:8");
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, dev.detectModel());
+    link.transparent = true;
+    link.clearSent();
+
+    next.setEepromAddress(OFFSET);
+    replyInit();
+    link.reply("HM-10 V540");
+    TEST_ASSERT_TRUE(beginAuto(next, 230400));
+    TEST_ASSERT_EQUAL_STRING("AT+VERR?", link.command);
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_record_size);
+    RUN_TEST(test_named_saved);
+    RUN_TEST(test_address);
+    RUN_TEST(test_probed_not_saved);
+    RUN_TEST(test_ambiguous_baud);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,159 @@
+/*
+  startDiscovery(): scan output parsed by poll() into the caller's table,
+  with notices and data that arrive mid-scan still getting through.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+HM1X_discovery_result_t results[2];
+int8_t doneCount;
+
+void scanDone(HM1X_discovery_result_t * found, uint8_t count)
+{
+    TEST_ASSERT_TRUE(found == results);
+    doneCount = count;
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+void readData(char * text, uint8_t size)
+{
+    uint8_t len = 0;
+
+    while ((bt.available() > 0) && (len < size - 1))
+    {
+        text[len++] = bt.read();
+    }
+    text[len] = '\0';
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    link.transparent = true;
+    link.clearSent();
+}
+
+void test_scan(void)
+{
+    char text[13];
+
+    doneCount = -1;
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(results, 2, scanDone));
+    TEST_ASSERT_EQUAL_MEMORY("AT+DISC?", link.sent, 8);
+    TEST_ASSERT_TRUE(bt.discovering());
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.startDiscovery(results, 2, scanDone));
+
+    inject("OK+DISCSOK+DIS0:001122334455OK+RSSI:-060OK+NAME:Sensor\r\n");
+    bt.poll();
+    TEST_ASSERT_EQUAL(1, bt.discoveryCount());
+    inject("OK+DIS1:A1B2C3D4E5F6\r\nOK+DIS0:001122334455OK+RSSI:-042\r\n");
+    bt.poll();
+    TEST_ASSERT_EQUAL(0, bt.available());
+    TEST_ASSERT_EQUAL(-1, doneCount);
+
+    inject("OK+DISCE");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+    TEST_ASSERT_EQUAL(2, doneCount);
+
+    // A device seen twice keeps its entry, with the latest RSSI
+    results[0].address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("001122334455", text);
+    TEST_ASSERT_EQUAL('0', results[0].index);
+    TEST_ASSERT_EQUAL(-42, results[0].rssi);
+    TEST_ASSERT_EQUAL_STRING("Sensor", results[0].name);
+    TEST_ASSERT_EQUAL('1', results[1].index);
+    TEST_ASSERT_EQUAL(0, results[1].rssi);
+    TEST_ASSERT_EQUAL_STRING("", results[1].name);
+    link.clearSent();
+}
+
+// Notices and data between scan lines go where they would without a scan
+void test_notices_and_data_mid_scan(void)
+{
+    HM1X_event_t event;
+    char text[16];
+
+    while (bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(results, 2, scanDone));
+    inject("OK+DISCSOK+LOSTabOK+DIS0:001122334455");
+    bt.poll();
+    inject("cdOK+CONB:AABBCCDDEEFFOK+DISCE");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+    TEST_ASSERT_EQUAL(1, doneCount);
+
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_DISCONNECT, event.type);
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT, event.type);
+    TEST_ASSERT_TRUE(bt.connectedBle());
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("abcd", text);
+    link.clearSent();
+}
+
+// Blocking commands would have their reply swallowed by the scan parser
+void test_commands_wait(void)
+{
+    HM1X_BT::HM1X_ble_mode_t mode;
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(results, 2, scanDone));
+    link.clearSent();
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.getBleMode(&mode));
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.setBleMode(HM1X_BT::BLE_CENTRAL));
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.requestPios());
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+
+    inject("OK+DISCSOK+DISCE");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+}
+
+// A scan whose OK+DISCE is lost ends by itself; a half line held at the
+// time is passed on as data
+void test_timeout(void)
+{
+    char text[8];
+
+    doneCount = -1;
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(results, 2, scanDone));
+    inject("OK+DISCSOK+DI");
+    bt.poll();
+    delay(16000);
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+    TEST_ASSERT_EQUAL(0, doneCount);
+    delay(20);
+    bt.poll();
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("OK+DI", text);
+
+    inject("hello");
+    bt.poll();
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("hello", text);
+    link.clearSent();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_scan);
+    RUN_TEST(test_notices_and_data_mid_scan);
+    RUN_TEST(test_commands_wait);
+    RUN_TEST(test_timeout);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,139 @@
+/*
+  HM1X_Framer against the host codec (extras/hm1x_host/framing.py).
+
+  The byte vectors below are what framing.py's encode_frame() produces;
+  extras/hm1x_host/tests/test_framing.py checks the same vectors from the
+  host side, so a change to either codec breaks one of the two.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Framer.h>
+#include "../hm1x_test_link.h"
+
+uint8_t storage[48];
+HM1X_Framer framer(bt, storage, sizeof(storage));
+
+// Payload full of sync bytes: there is no escaping, the length carries it
+const uint8_t syncPayload[] = {0xA5, 0xA5, 0x00, 0xFF, 0x5A};
+// encode_frame(0x21, syncPayload)
+const uint8_t syncFrame[] = {0xA5, 0x21, 0x05, 0xFA, 0xA5, 0xA5, 0x00, 0xFF, 0x5A, 0xDC, 0xC4};
+// encode_frame(0x30)
+const uint8_t emptyFrame[] = {0xA5, 0x30, 0x00, 0xFF, 0xC9, 0x17};
+// encode_frame(0x07, b"hello")
+const uint8_t helloFrame[] = {0xA5, 0x07, 0x05, 0xFA, 'h', 'e', 'l', 'l', 'o', 0x5D, 0x5B};
+
+// Hand the frames the framer has queued back to it and count them
+uint8_t drain(void)
+{
+    uint8_t frames = 0;
+    while (framer.poll())
+    {
+        frames++;
+    }
+    return frames;
+}
+
+void test_crc_check_value(void)
+{
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, HM1X_Framer::crc16((const uint8_t *) "123456789", 9));
+}
+
+void test_encode_matches_host(void)
+{
+    link.clearSent();
+    TEST_ASSERT_EQUAL(sizeof(syncPayload), framer.writeFrame(0x21, syncPayload, sizeof(syncPayload)));
+    TEST_ASSERT_EQUAL(sizeof(syncFrame), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(syncFrame, link.sent, sizeof(syncFrame));
+
+    link.clearSent();
+    framer.writeFrame(0x30, syncPayload, 0);
+    TEST_ASSERT_EQUAL(sizeof(emptyFrame), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(emptyFrame, link.sent, sizeof(emptyFrame));
+
+    // A split payload encodes the same as a whole one
+    link.clearSent();
+    framer.writeFrame(0x21, syncPayload, 2, &syncPayload[2], sizeof(syncPayload) - 2);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(syncFrame, link.sent, sizeof(syncFrame));
+}
+
+void test_decode_host_frames(void)
+{
+    link.inject(syncFrame, sizeof(syncFrame));
+    link.inject(emptyFrame, sizeof(emptyFrame));
+
+    TEST_ASSERT_TRUE(framer.poll());
+    TEST_ASSERT_EQUAL_HEX8(0x21, framer.frameType());
+    TEST_ASSERT_EQUAL(sizeof(syncPayload), framer.frameLength());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(syncPayload, framer.frameData(), sizeof(syncPayload));
+
+    TEST_ASSERT_TRUE(framer.poll());
+    TEST_ASSERT_EQUAL_HEX8(0x30, framer.frameType());
+    TEST_ASSERT_EQUAL(0, framer.frameLength());
+
+    TEST_ASSERT_FALSE(framer.poll());
+}
+
+void test_resync(void)
+{
+    const uint8_t garbage[] = {0x00, 0xA5, 0xA5, 0x01, 'z', 'z'};
+    uint8_t corrupt[sizeof(helloFrame)];
+    uint16_t crcErrors = framer.crcErrors();
+    uint16_t dropped = framer.droppedBytes();
+
+    memcpy(corrupt, helloFrame, sizeof(corrupt));
+    corrupt[6] ^= 0x01;
+
+    // Garbage, stray sync bytes and a corrupted frame cost only themselves
+    link.inject(garbage, sizeof(garbage));
+    link.inject(corrupt, sizeof(corrupt));
+    link.inject(helloFrame, sizeof(helloFrame));
+    link.inject(syncFrame, sizeof(syncFrame));
+
+    TEST_ASSERT_TRUE(framer.poll());
+    TEST_ASSERT_EQUAL_HEX8(0x07, framer.frameType());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("hello", framer.frameData(), 5);
+    TEST_ASSERT_TRUE(framer.poll());
+    TEST_ASSERT_EQUAL_HEX8(0x21, framer.frameType());
+    TEST_ASSERT_FALSE(framer.poll());
+
+    TEST_ASSERT_EQUAL(crcErrors + 1, framer.crcErrors());
+    TEST_ASSERT_EQUAL(dropped + sizeof(garbage) + sizeof(corrupt), framer.droppedBytes());
+}
+
+void test_round_trip(void)
+{
+    uint8_t payload[sizeof(storage) - HM1X_FRAME_OVERHEAD];
+
+    for (uint8_t length = 0; length <= sizeof(payload); length++)
+    {
+        for (uint8_t i = 0; i < length; i++)
+        {
+            payload[i] = (i & 1) ? HM1X_FRAME_SYNC : (uint8_t) (length * 31 + i);
+        }
+        link.clearSent();
+        framer.writeFrame(length, payload, length);
+        link.inject(link.sent, link.sentLength);
+
+        TEST_ASSERT_TRUE(framer.poll());
+        TEST_ASSERT_EQUAL(length, framer.frameType());
+        TEST_ASSERT_EQUAL(length, framer.frameLength());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, framer.frameData(), length);
+    }
+    TEST_ASSERT_EQUAL(0, drain());
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_crc_check_value);
+    RUN_TEST(test_encode_matches_host);
+    RUN_TEST(test_decode_host_frames);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_round_trip);
+    UNITY_END();
+}
+
+void loop()
+{
+}
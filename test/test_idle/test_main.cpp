@@ -0,0 +1,105 @@
+/*
+  idle(): sleeps until the module sends something, the timeout is up,
+  or poll() has timed work due.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    link.transparent = true;
+    link.clearSent();
+}
+
+void test_nothing_to_do(void)
+{
+    unsigned long start = millis();
+    uint32_t idleTime = bt.powerStats().mcuIdle;
+
+    TEST_ASSERT_FALSE(bt.idle(50));
+    TEST_ASSERT_GREATER_OR_EQUAL(50, millis() - start);
+    TEST_ASSERT_GREATER_OR_EQUAL(idleTime + 50, bt.powerStats().mcuIdle);
+}
+
+void test_wakes_on_notice(void)
+{
+    HM1X_event_t event;
+    unsigned long start = millis();
+
+    inject("OK+CONB:A1B2C3D4E5F6");
+    TEST_ASSERT_TRUE(bt.idle(1000));
+    TEST_ASSERT_LESS_THAN(10, millis() - start);
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+}
+
+// A set queued behind a PIO read goes out once the command gap is up
+void test_queued_set(void)
+{
+    unsigned long start;
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajorAsync(1));
+    TEST_ASSERT_EQUAL_MEMORY("AT+PIO??", link.sent, link.sentLength);
+    link.clearSent();
+
+    start = millis();
+    for (uint8_t i = 0; (i < 10) && (link.sentLength == 0); i++)
+    {
+        bt.idle(1000);
+    }
+    TEST_ASSERT_LESS_THAN(100, millis() - start);
+    TEST_ASSERT_EQUAL_MEMORY("AT+MAJO0001", link.sent, link.sentLength);
+
+    inject("OK+PIO?:000OK+Set:0001");
+    bt.poll();
+    TEST_ASSERT_EQUAL(0, bt.pendingSets());
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+    link.clearSent();
+}
+
+// The watcher's next read is due at its interval, not the idle timeout
+void test_pio_watch(void)
+{
+    unsigned long start;
+
+    bt.watchPios(0x0010, 200, NULL);
+    bt.poll();
+    TEST_ASSERT_EQUAL_MEMORY("AT+PIO??", link.sent, link.sentLength);
+    link.clearSent();
+    inject("OK+PIO?:000");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+
+    start = millis();
+    bt.idle(5000);
+    TEST_ASSERT_UINT_WITHIN(20, 200, millis() - start);
+    TEST_ASSERT_EQUAL_MEMORY("AT+PIO??", link.sent, link.sentLength);
+    inject("OK+PIO?:000");
+    bt.poll();
+    bt.watchPios(0, 0, NULL);
+    link.clearSent();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_nothing_to_do);
+    RUN_TEST(test_wakes_on_notice);
+    RUN_TEST(test_queued_set);
+    RUN_TEST(test_pio_watch);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,131 @@
+/*
+  HM1X_Mux against the host end (extras/hm1x_host/mux.py).
+
+  extras/hm1x_host/tests/test_mux.py checks the same frame bytes and the
+  same schedule from the host side.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Mux.h>
+#include "../hm1x_test_link.h"
+
+#define MESSAGE_LEN 18
+#define MESSAGES 6
+
+uint8_t framerStorage[HM1X_FRAME_OVERHEAD + MESSAGE_LEN + 1];
+HM1X_Framer framer(bt, framerStorage, sizeof(framerStorage));
+HM1X_Mux mux(framer);
+uint8_t queue0[16];
+uint8_t queue1[MESSAGES * (MESSAGE_LEN + 2)];
+uint8_t queue2[MESSAGES * (MESSAGE_LEN + 2)];
+
+// "temp" on channel 1, and an empty message on channel 2
+const uint8_t tempFrame[] = {0xA5, 0xF2, 0x05, 0xFA, 0x01, 't', 'e', 'm', 'p', 0xA3, 0xCC};
+const uint8_t emptyFrame[] = {0xA5, 0xF2, 0x01, 0xFE, 0x02, 0x59, 0xD1};
+
+// Channel 0 urgent; channels 1 and 2 share the rest 3:1
+const char schedule[] = "0111211122222";
+
+char received[sizeof(schedule)];
+uint8_t receivedCount;
+uint8_t receivedLength;
+uint8_t receivedData[MESSAGE_LEN];
+
+void onReceive(uint8_t channel, const uint8_t * data, uint8_t length)
+{
+    if (receivedCount < sizeof(received) - 1)
+    {
+        received[receivedCount++] = '0' + channel;
+        received[receivedCount] = '\0';
+    }
+    receivedLength = length;
+    if (length <= sizeof(receivedData))
+    {
+        memcpy(receivedData, data, length);
+    }
+}
+
+void clearReceived(void)
+{
+    receivedCount = 0;
+    received[0] = '\0';
+}
+
+void test_begin_channels(void)
+{
+    TEST_ASSERT_TRUE(mux.beginChannel(0, queue0, sizeof(queue0), 2, 1, onReceive));
+    TEST_ASSERT_TRUE(mux.beginChannel(1, queue1, sizeof(queue1), 0, 3, onReceive));
+    TEST_ASSERT_TRUE(mux.beginChannel(2, queue2, sizeof(queue2), 0, 1, onReceive));
+}
+
+void test_send_matches_host(void)
+{
+    link.clearSent();
+    TEST_ASSERT_EQUAL(4, mux.write(1, (const uint8_t *) "temp", 4));
+    TEST_ASSERT_EQUAL(0, mux.write(2, NULL, 0));
+    mux.service();
+    TEST_ASSERT_EQUAL(sizeof(tempFrame) + sizeof(emptyFrame), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(tempFrame, link.sent, sizeof(tempFrame));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(emptyFrame, &link.sent[sizeof(tempFrame)], sizeof(emptyFrame));
+}
+
+void test_receive_from_host(void)
+{
+    clearReceived();
+    link.clearSent();
+    link.inject(tempFrame, sizeof(tempFrame));
+    link.inject(emptyFrame, sizeof(emptyFrame));
+    mux.service();
+    TEST_ASSERT_EQUAL_STRING("12", received);
+    TEST_ASSERT_EQUAL(0, receivedLength);
+
+    clearReceived();
+    link.inject(tempFrame, sizeof(tempFrame));
+    mux.service();
+    TEST_ASSERT_EQUAL(4, receivedLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("temp", receivedData, 4);
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+}
+
+void test_schedule_matches_host(void)
+{
+    uint8_t message[MESSAGE_LEN];
+
+    for (uint8_t i = 0; i < MESSAGES; i++)
+    {
+        memset(message, i, sizeof(message));
+        TEST_ASSERT_EQUAL(MESSAGE_LEN, mux.write(1, message, MESSAGE_LEN));
+        TEST_ASSERT_EQUAL(MESSAGE_LEN, mux.write(2, message, MESSAGE_LEN));
+    }
+    TEST_ASSERT_EQUAL(0, mux.write(1, message, MESSAGE_LEN)); // Queue full
+    mux.write(0, message, 5);
+
+    // Loop the wire back so each message comes in on its own channel
+    clearReceived();
+    for (uint8_t i = 0; (i < 10) && (receivedCount < sizeof(schedule) - 1); i++)
+    {
+        link.clearSent();
+        mux.service();
+        link.inject(link.sent, link.sentLength);
+    }
+    mux.service();
+    TEST_ASSERT_EQUAL_STRING(schedule, received);
+    TEST_ASSERT_EQUAL(MESSAGE_LEN, receivedLength);
+    TEST_ASSERT_EQUAL(MESSAGES - 1, receivedData[0]);
+    TEST_ASSERT_EQUAL(0, mux.queued(1) + mux.queued(2));
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_begin_channels);
+    RUN_TEST(test_send_matches_host);
+    RUN_TEST(test_receive_from_host);
+    RUN_TEST(test_schedule_matches_host);
+    UNITY_END();
+}
+
+void loop()
+{
+}
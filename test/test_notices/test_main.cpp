@@ -0,0 +1,215 @@
+/*
+  Connection notices picked out of the data stream by poll().
+
+  The test link plays the module: setupPoll() is answered as a command,
+  then notices and data are injected as the module would send them and
+  poll() has to separate the two.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+HM1X_event_t lastEvent;
+uint8_t callbackEvents;
+
+void countEvent(const HM1X_event_t & event)
+{
+    lastEvent = event;
+    callbackEvents++;
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+// Drain whatever poll() passed through as data into text
+void readData(char * text, uint8_t size)
+{
+    uint8_t len = 0;
+
+    while ((bt.available() > 0) && (len < size - 1))
+    {
+        text[len++] = bt.read();
+    }
+    text[len] = '\0';
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    TEST_ASSERT_TRUE(bt.polling());
+    TEST_ASSERT_FALSE(bt.connected());
+    link.transparent = true;
+    link.clearSent();
+}
+
+void test_connect_with_address(void)
+{
+    HM1X_event_t event;
+    char text[13];
+
+    inject("OK+CONB:001122AABBCC");
+    TEST_ASSERT_TRUE(bt.poll());
+    TEST_ASSERT_TRUE(bt.connectedBle());
+    TEST_ASSERT_FALSE(bt.connectedEdr());
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT, event.type);
+    TEST_ASSERT_EQUAL(HM1X_LINK_BLE, event.link);
+    event.address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("001122AABBCC", text);
+    TEST_ASSERT_TRUE(event.address == bt.blePeer());
+    TEST_ASSERT_FALSE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(0, bt.available());
+}
+
+// OK+LOST has no address; the peer is kept for reconnecting
+void test_lost(void)
+{
+    HM1X_event_t event;
+
+    inject("OK+LOST");
+    TEST_ASSERT_TRUE(bt.poll());
+    TEST_ASSERT_FALSE(bt.connected());
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_DISCONNECT, event.type);
+    TEST_ASSERT_TRUE(event.address.isNull());
+    TEST_ASSERT_FALSE(bt.blePeer().isNull());
+}
+
+// OK+CONN is complete on its own but is also the start of OK+CONNA, so
+// it's only settled by the next byte
+void test_short_notice_then_data(void)
+{
+    HM1X_event_t event;
+    char text[8];
+
+    inject("OK+CONNxy");
+    bt.poll();
+    TEST_ASSERT_TRUE(bt.connectedBle());
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT, event.type);
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("xy", text);
+}
+
+// Bytes that might start a notice are held, then released as data in
+// order once the module has gone quiet
+void test_partial_notice_is_data(void)
+{
+    char text[16];
+
+    inject("abOK+CO");
+    TEST_ASSERT_FALSE(bt.poll());
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("ab", text);
+
+    delay(20);
+    TEST_ASSERT_FALSE(bt.poll());
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("OK+CO", text);
+    TEST_ASSERT_EQUAL(0, bt.eventsAvailable());
+}
+
+// Data right up against a notice, on both sides
+void test_notice_between_data(void)
+{
+    HM1X_event_t event;
+    char text[16];
+
+    inject("12OK+LOSTOK34");
+    bt.poll();
+    delay(20);
+    bt.poll();
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_DISCONNECT, event.type);
+    readData(text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("12OK34", text);
+}
+
+// Notices split across polls are joined up
+void test_split_notice(void)
+{
+    HM1X_event_t event;
+
+    inject("OK+CO");
+    bt.poll();
+    inject("NB:0011");
+    bt.poll();
+    TEST_ASSERT_EQUAL(0, bt.eventsAvailable());
+    inject("22AABBCC");
+    TEST_ASSERT_TRUE(bt.poll());
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT, event.type);
+    TEST_ASSERT_EQUAL(0, bt.available());
+}
+
+// A full queue drops the oldest event and counts it
+void test_queue_overflow(void)
+{
+    HM1X_event_t event;
+    uint16_t dropped = bt.eventsDropped();
+
+    inject("OK+WAKE");
+    for (uint8_t i = 0; i < HM1X_EVENT_QUEUE_DEPTH; i++)
+    {
+        inject("OK+LOST");
+    }
+    bt.poll();
+    TEST_ASSERT_EQUAL(HM1X_EVENT_QUEUE_DEPTH, bt.eventsAvailable());
+    TEST_ASSERT_EQUAL(dropped + 1, bt.eventsDropped());
+    for (uint8_t i = 0; i < HM1X_EVENT_QUEUE_DEPTH; i++)
+    {
+        TEST_ASSERT_TRUE(bt.getEvent(event));
+        TEST_ASSERT_EQUAL(HM1X_EVENT_DISCONNECT, event.type);
+    }
+    TEST_ASSERT_FALSE(bt.getEvent(event));
+}
+
+// With a callback set, events go to it and not the queue
+void test_callback(void)
+{
+    char text[13];
+
+    bt.onEvent(countEvent);
+    inject("OK+CONE:AABBCCDDEEFF");
+    TEST_ASSERT_TRUE(bt.poll());
+    TEST_ASSERT_EQUAL(1, callbackEvents);
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT, lastEvent.type);
+    TEST_ASSERT_EQUAL(HM1X_LINK_EDR, lastEvent.link);
+    lastEvent.address.toString(text);
+    TEST_ASSERT_EQUAL_STRING("AABBCCDDEEFF", text);
+    TEST_ASSERT_TRUE(bt.connectedEdr());
+    TEST_ASSERT_EQUAL(0, bt.eventsAvailable());
+
+    // A restarted module has dropped its links
+    inject("OK+INIT");
+    bt.poll();
+    delay(20);
+    bt.poll();
+    TEST_ASSERT_EQUAL(2, callbackEvents);
+    TEST_ASSERT_EQUAL(HM1X_EVENT_INIT, lastEvent.type);
+    TEST_ASSERT_FALSE(bt.connected());
+    bt.onEvent(NULL);
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_connect_with_address);
+    RUN_TEST(test_lost);
+    RUN_TEST(test_short_notice_then_data);
+    RUN_TEST(test_partial_notice_is_data);
+    RUN_TEST(test_notice_between_data);
+    RUN_TEST(test_split_notice);
+    RUN_TEST(test_queue_overflow);
+    RUN_TEST(test_callback);
+    UNITY_END();
+}
+
+void loop()
+{
+}
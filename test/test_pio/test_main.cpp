@@ -0,0 +1,184 @@
+/*
+  PIO access: single pins through the command engine, and the bulk
+  AT+PIO?? read and watcher driven from poll().
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+uint8_t changes;
+uint16_t lastStates;
+uint16_t lastChanged;
+
+void pioChanged(uint16_t states, uint16_t changed)
+{
+    changes++;
+    lastStates = states;
+    lastChanged = changed;
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+boolean sent(const char * text)
+{
+    boolean match = (link.sentLength == strlen(text)) &&
+                    (memcmp(link.sent, text, link.sentLength) == 0);
+    link.clearSent();
+    return match;
+}
+
+// Poll for about ms, answering each bulk read with states
+void pollFor(unsigned long ms, const char * states)
+{
+    unsigned long start = millis();
+
+    while (millis() - start < ms)
+    {
+        bt.poll();
+        if ((states != NULL) && sent("AT+PIO??"))
+        {
+            inject("OK+PIO?:");
+            inject(states);
+        }
+    }
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+}
+
+// Pins up to PIOB, their index as one hex digit
+void test_single_pins(void)
+{
+    uint8_t value = 7;
+
+    link.reply("OK+Set:1");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.writePio(11, 1));
+    TEST_ASSERT_EQUAL_STRING("AT+PIOB1", link.command);
+
+    link.reply("OK+Get:0");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.readPio(9, &value));
+    TEST_ASSERT_EQUAL_STRING("AT+PIO9?", link.command);
+    TEST_ASSERT_EQUAL(0, value);
+
+    TEST_ASSERT_EQUAL(HM1X_UNEXPECTED_RESPONSE, bt.readPio(12, &value));
+    link.transparent = true;
+    link.clearSent();
+}
+
+// Sent at once, answered through poll(); bit 0 of the reply is PIO2
+void test_bulk_read(void)
+{
+    unsigned long start = millis();
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    TEST_ASSERT_LESS_THAN(5, millis() - start);
+    TEST_ASSERT_TRUE(sent("AT+PIO??"));
+    TEST_ASSERT_TRUE(bt.pioReadPending());
+
+    inject("OK+PIO?:201");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+    TEST_ASSERT_EQUAL_HEX16(0x201 << 2, bt.pioStates());
+}
+
+void test_reply_among_data(void)
+{
+    char text[5];
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    link.clearSent();
+    inject("abOK+PIO?:003cd");
+    bt.poll();
+    TEST_ASSERT_EQUAL_HEX16(0x000C, bt.pioStates());
+    TEST_ASSERT_EQUAL(4, bt.available());
+    for (uint8_t i = 0; i < 4; i++) text[i] = bt.read();
+    text[4] = '\0';
+    TEST_ASSERT_EQUAL_STRING("abcd", text);
+}
+
+// Only watched pins report, the first read reports them all
+void test_watch(void)
+{
+    bt.watchPios(0x0010, 100, pioChanged);
+    pollFor(20, "000");
+    TEST_ASSERT_EQUAL(1, changes);
+    TEST_ASSERT_EQUAL_HEX16(0x0010, lastChanged);
+    TEST_ASSERT_EQUAL_HEX16(0, lastStates & 0x0010);
+
+    pollFor(250, "008"); // PIO5, unwatched
+    TEST_ASSERT_EQUAL(1, changes);
+
+    pollFor(250, "004"); // PIO4
+    TEST_ASSERT_EQUAL(2, changes);
+    TEST_ASSERT_EQUAL_HEX16(0x0010, lastChanged);
+    TEST_ASSERT_EQUAL_HEX16(0x0010, lastStates & 0x0010);
+}
+
+// A lost reply doesn't hold up later reads for good
+void test_lost_reply(void)
+{
+    bt.watchPios(0, 0, NULL);
+    pollFor(20, "004");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    TEST_ASSERT_TRUE(sent("AT+PIO??"));
+    pollFor(500, NULL);
+    TEST_ASSERT_TRUE(bt.pioReadPending());
+    pollFor(600, NULL);
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    TEST_ASSERT_TRUE(sent("AT+PIO??"));
+    inject("OK+PIO?:004");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+}
+
+// A blocking command waits for the read's reply first
+void test_blocking_waits(void)
+{
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.requestPios());
+    link.clearSent();
+    inject("OK+PIO?:004");
+    link.transparent = false;
+    link.reply("OK+Set:0001");
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.setiBeaconMajor(1));
+    TEST_ASSERT_EQUAL_STRING("AT+MAJO0001", link.command);
+    TEST_ASSERT_FALSE(bt.pioReadPending());
+    link.transparent = true;
+    link.clearSent();
+}
+
+// Dual-mode modules have no bulk read
+void test_dual_mode(void)
+{
+    HM1X_BT dual(HM1X_BT::HM13);
+
+    link.transparent = false;
+    TEST_ASSERT_TRUE(beginTestLink(dual, link));
+    TEST_ASSERT_EQUAL(HM1X_ERROR_ER, dual.requestPios());
+    TEST_ASSERT_FALSE(dual.pioReadPending());
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_single_pins);
+    RUN_TEST(test_bulk_read);
+    RUN_TEST(test_reply_among_data);
+    RUN_TEST(test_watch);
+    RUN_TEST(test_lost_reply);
+    RUN_TEST(test_blocking_waits);
+    RUN_TEST(test_dual_mode);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,159 @@
+/*
+  HM1X_Probe against the host end (extras/hm1x_host/probe.py).
+
+  Probe times come from micros(), so the device's frames are checked
+  field by field; extras/hm1x_host/tests/test_probe.py decodes and
+  answers a probe laid out the same way, and this test answers the
+  host's probe below.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Probe.h>
+#include "../hm1x_test_link.h"
+
+// Remote clock ahead of ours in the reply the test sends back
+#define REMOTE_OFFSET 1000000L
+
+uint8_t framerStorage[32];
+HM1X_Framer framer(bt, framerStorage, sizeof(framerStorage));
+HM1X_Probe probe(framer);
+
+// Host probe: seq 7, t1 0x12345678
+const uint8_t hostProbe[] = {0xA5, 0xF5, 0x05, 0xFA, 0x07, 0x78, 0x56, 0x34, 0x12, 0x3A, 0xED};
+
+uint32_t sentT1;
+
+uint32_t getTime(const uint8_t * src)
+{
+    return (uint32_t) src[0] | ((uint32_t) src[1] << 8) |
+           ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+void putTime(uint8_t * dest, uint32_t t)
+{
+    dest[0] = t;
+    dest[1] = t >> 8;
+    dest[2] = t >> 16;
+    dest[3] = t >> 24;
+}
+
+// Check the frame at the start of link.sent: header and CRC
+void expectFrame(uint8_t type, uint8_t length)
+{
+    uint16_t crc;
+
+    TEST_ASSERT_EQUAL(HM1X_FRAME_OVERHEAD + length, link.sentLength);
+    TEST_ASSERT_EQUAL_HEX8(HM1X_FRAME_SYNC, link.sent[0]);
+    TEST_ASSERT_EQUAL_HEX8(type, link.sent[1]);
+    TEST_ASSERT_EQUAL(length, link.sent[2]);
+    TEST_ASSERT_EQUAL_HEX8((uint8_t) ~length, link.sent[3]);
+    crc = HM1X_Framer::crc16(&link.sent[1], HM1X_FRAME_HEADER_LEN - 1 + length);
+    TEST_ASSERT_EQUAL_HEX16(crc, link.sent[4 + length] | (link.sent[5 + length] << 8));
+}
+
+void test_probe_layout(void)
+{
+    uint32_t before;
+
+    link.clearSent();
+    before = micros();
+    TEST_ASSERT_TRUE(probe.probe());
+    expectFrame(HM1X_FRAME_TYPE_PROBE, 5);
+    TEST_ASSERT_EQUAL(1, link.sent[4]);
+    sentT1 = getTime(&link.sent[5]);
+    TEST_ASSERT_UINT_WITHIN(micros() - before, before, sentT1);
+
+    // Only one probe in flight
+    TEST_ASSERT_FALSE(probe.probe());
+}
+
+void test_answer_host_probe(void)
+{
+    uint32_t before;
+    uint32_t t2;
+    uint32_t t3;
+
+    link.clearSent();
+    link.inject(hostProbe, sizeof(hostProbe));
+    before = micros();
+    probe.poll();
+    expectFrame(HM1X_FRAME_TYPE_PROBE_REPLY, 13);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&hostProbe[4], &link.sent[4], 5); // seq, t1 echoed
+    t2 = getTime(&link.sent[9]);
+    t3 = getTime(&link.sent[13]);
+    TEST_ASSERT_UINT_WITHIN(micros() - before, before, t2);
+    TEST_ASSERT_UINT_WITHIN(micros() - before, before, t3);
+    TEST_ASSERT_TRUE(t3 - t2 <= micros() - before);
+}
+
+// Queue a reply to probe seq with the given times
+void injectReply(uint8_t seq, uint32_t t1, uint32_t t2, uint32_t t3)
+{
+    uint8_t reply[HM1X_FRAME_OVERHEAD + 13] = {HM1X_FRAME_SYNC, HM1X_FRAME_TYPE_PROBE_REPLY, 13, (uint8_t) ~13, seq};
+    uint16_t crc;
+
+    putTime(&reply[5], t1);
+    putTime(&reply[9], t2);
+    putTime(&reply[13], t3);
+    crc = HM1X_Framer::crc16(&reply[1], HM1X_FRAME_HEADER_LEN - 1 + 13);
+    reply[17] = crc & 0xFF;
+    reply[18] = crc >> 8;
+    link.inject(reply, sizeof(reply));
+}
+
+void test_sample_from_reply(void)
+{
+    uint32_t now = micros();
+    uint32_t span;
+
+    // Answer the probe from test_probe_layout as a peer REMOTE_OFFSET ahead
+    link.clearSent();
+    injectReply(1, sentT1, now + REMOTE_OFFSET, now + REMOTE_OFFSET + 50);
+    probe.poll();
+    span = micros() - sentT1;
+
+    TEST_ASSERT_EQUAL(1, probe.samples());
+    TEST_ASSERT_TRUE(probe.lastRtt() <= span);
+    TEST_ASSERT_EQUAL_UINT32(probe.lastRtt(), probe.minRtt());
+    TEST_ASSERT_INT32_WITHIN(span, REMOTE_OFFSET, probe.offset());
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+
+    // A second copy of the reply is late and ignored
+    injectReply(1, sentT1, now + REMOTE_OFFSET, now + REMOTE_OFFSET + 50);
+    probe.poll();
+    TEST_ASSERT_EQUAL(1, probe.samples());
+}
+
+// A turnaround longer than the round trip would make the RTT negative
+void test_negative_rtt_dropped(void)
+{
+    uint32_t lastRtt = probe.lastRtt();
+    uint16_t lost = probe.lost();
+    uint32_t t1;
+
+    link.clearSent();
+    TEST_ASSERT_TRUE(probe.probe());
+    t1 = getTime(&link.sent[5]);
+    injectReply(2, t1, t1, t1 + 10000000UL);
+    probe.poll();
+
+    TEST_ASSERT_EQUAL(1, probe.samples());
+    TEST_ASSERT_EQUAL(lost + 1, probe.lost());
+    TEST_ASSERT_EQUAL_UINT32(lastRtt, probe.lastRtt());
+    TEST_ASSERT_TRUE(probe.probe()); // Not left waiting for it
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_probe_layout);
+    RUN_TEST(test_answer_host_probe);
+    RUN_TEST(test_sample_from_reply);
+    RUN_TEST(test_negative_rtt_dropped);
+    UNITY_END();
+}
+
+void loop()
+{
+}
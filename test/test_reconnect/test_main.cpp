@@ -0,0 +1,172 @@
+/*
+  reconnect(), reconnectLast() and auto-reconnect: connect attempts
+  driven from poll(), retried after a doubling back-off.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "../hm1x_test_link.h"
+
+HM1X_address_t peer;
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+// True if exactly text was sent since the last check
+boolean sent(const char * text)
+{
+    boolean match = (link.sentLength == strlen(text)) &&
+                    (memcmp(link.sent, text, link.sentLength) == 0);
+    link.clearSent();
+    return match;
+}
+
+void drainEvents(void)
+{
+    HM1X_event_t event;
+
+    while (bt.getEvent(event));
+}
+
+void test_setup_poll(void)
+{
+    link.transparent = false;
+    TEST_ASSERT_TRUE(bt.setupPoll());
+    link.transparent = true;
+    link.clearSent();
+    peer.parse("001122334455");
+}
+
+// Turned down, then timed out, then up on the third attempt
+void test_retries(void)
+{
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.reconnect(peer, 4));
+    TEST_ASSERT_TRUE(bt.reconnecting());
+    TEST_ASSERT_TRUE(sent("AT+CON001122334455"));
+
+    inject("OK+CONNAOK+CONNF");
+    bt.poll();
+    TEST_ASSERT_TRUE(bt.reconnecting());
+    delay(50);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent(""));
+    delay(60);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+CON001122334455"));
+
+    delay(3100);
+    bt.poll(); // Timed out
+    delay(150);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent(""));
+    delay(60);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+CON001122334455"));
+
+    inject("OK+CONNAOK+CONN");
+    bt.poll();
+    delay(20);
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.reconnecting());
+    TEST_ASSERT_TRUE(bt.connectedBle());
+    TEST_ASSERT_EQUAL(1, bt.reconnectStats().successes);
+    TEST_ASSERT_EQUAL(3, bt.reconnectStats().attempts);
+    TEST_ASSERT_GREATER_THAN(3000, bt.reconnectStats().lastTime);
+    drainEvents();
+}
+
+void test_gives_up(void)
+{
+    inject("OK+LOST");
+    bt.poll();
+    delay(20);
+    bt.poll();
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.reconnectLast(2));
+    TEST_ASSERT_TRUE(sent("AT+CONNL"));
+    inject("OK+CONNN");
+    bt.poll();
+    delay(150);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+CONNL"));
+    inject("OK+CONNF");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.reconnecting());
+    TEST_ASSERT_EQUAL(1, bt.reconnectStats().failures);
+    drainEvents();
+}
+
+// An attempt that can't be sent fails like one turned down: counted,
+// reported, and retried after the back-off
+void test_send_error_retried(void)
+{
+    HM1X_discovery_result_t results[1];
+    HM1X_event_t event;
+    uint16_t attempts = bt.reconnectStats().attempts;
+    uint16_t failures = bt.reconnectStats().failures;
+
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(results, 1));
+    link.clearSent();
+    TEST_ASSERT_EQUAL(HM1X_ERROR_TRY_LATER, bt.reconnect(peer, 2));
+    TEST_ASSERT_TRUE(sent(""));
+    TEST_ASSERT_TRUE(bt.reconnecting());
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_CONNECT_FAILED, event.type);
+    TEST_ASSERT_TRUE(event.address == peer);
+
+    inject("OK+DISCSOK+DISCE");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+    delay(110);
+    bt.poll();
+    TEST_ASSERT_TRUE(sent("AT+CON001122334455"));
+    TEST_ASSERT_EQUAL(attempts + 1, bt.reconnectStats().attempts);
+
+    inject("OK+CONNF");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.reconnecting());
+    TEST_ASSERT_EQUAL(failures + 1, bt.reconnectStats().failures);
+    drainEvents();
+}
+
+// A dropped link is reported before the reconnect it starts
+void test_auto_reconnect(void)
+{
+    HM1X_event_t event;
+
+    bt.setAutoReconnect(3);
+    inject("OK+CONB:A1B2C3D4E5F6");
+    bt.poll();
+    drainEvents();
+
+    inject("OK+LSTB:A1B2C3D4E5F6");
+    bt.poll();
+    TEST_ASSERT_TRUE(bt.reconnecting());
+    TEST_ASSERT_TRUE(sent("AT+CONA1B2C3D4E5F6"));
+    TEST_ASSERT_TRUE(bt.getEvent(event));
+    TEST_ASSERT_EQUAL(HM1X_EVENT_DISCONNECT, event.type);
+
+    inject("OK+CONB:A1B2C3D4E5F6");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.reconnecting());
+    TEST_ASSERT_EQUAL(2, bt.reconnectStats().successes);
+    bt.setAutoReconnect(0);
+    drainEvents();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_setup_poll);
+    RUN_TEST(test_retries);
+    RUN_TEST(test_gives_up);
+    RUN_TEST(test_send_error_retried);
+    RUN_TEST(test_auto_reconnect);
+    UNITY_END();
+}
+
+void loop()
+{
+}
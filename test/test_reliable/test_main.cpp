@@ -0,0 +1,197 @@
+/*
+  HM1X_Reliable against the host end of the link
+  (extras/hm1x_host/reliable.py).
+
+  The frames below are what ReliableLink sends and expects;
+  extras/hm1x_host/tests/test_reliable.py checks the same bytes from the
+  host side.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Reliable.h>
+#include "../hm1x_test_link.h"
+
+#define WINDOW 4
+#define MAX_PAYLOAD 8
+
+uint8_t framerStorage[HM1X_FRAME_OVERHEAD + MAX_PAYLOAD + 1];
+HM1X_Framer framer(bt, framerStorage, sizeof(framerStorage));
+uint8_t txStorage[HM1X_ARQ_STORAGE_SIZE(WINDOW, MAX_PAYLOAD)];
+HM1X_Reliable arq(framer, txStorage, WINDOW, MAX_PAYLOAD);
+
+// Data seq 0 "ab", data seq 1 "c"
+const uint8_t data0[] = {0xA5, 0xF0, 0x03, 0xFC, 0x00, 'a', 'b', 0xFE, 0xD5};
+const uint8_t data1[] = {0xA5, 0xF0, 0x02, 0xFD, 0x01, 'c', 0xC5, 0x0D};
+// ACKs for seq 0 and seq 1
+const uint8_t ack1[] = {0xA5, 0xF1, 0x01, 0xFE, 0x01, 0xE6, 0x7A};
+const uint8_t ack2[] = {0xA5, 0xF1, 0x01, 0xFE, 0x02, 0x85, 0x4A};
+// Cumulative ACK up to seq 5
+const uint8_t ack6[] = {0xA5, 0xF1, 0x01, 0xFE, 0x06, 0x01, 0x0A};
+// Host data seq 0 "hi"
+const uint8_t hostData0[] = {0xA5, 0xF0, 0x03, 0xFC, 0x00, 'h', 'i', 0x0D, 0xDE};
+// A restarted end's SYNC (tx base 0, rx next 0), and SYNC_ACKs for it
+const uint8_t sync0[] = {0xA5, 0xF7, 0x02, 0xFD, 0x00, 0x00, 0xE5, 0x05};
+const uint8_t syncAck0[] = {0xA5, 0xF8, 0x02, 0xFD, 0x00, 0x00, 0x1C, 0x60};
+const uint8_t syncAck5[] = {0xA5, 0xF8, 0x02, 0xFD, 0x05, 0x00, 0xE9, 0x9F};
+// Data renumbered from seq 0 after a resync: "c", "z"; host data seq 5 "hi"
+const uint8_t data0c[] = {0xA5, 0xF0, 0x02, 0xFD, 0x00, 'c', 0xF4, 0x3E};
+const uint8_t data0z[] = {0xA5, 0xF0, 0x02, 0xFD, 0x00, 'z', 0xEC, 0xBD};
+const uint8_t hostData5[] = {0xA5, 0xF0, 0x03, 0xFC, 0x05, 'h', 'i', 0xFD, 0x35};
+
+void test_set_timeout(void)
+{
+    arq.setRetransmitTimeout(100);
+}
+
+void test_send_matches_host(void)
+{
+    link.clearSent();
+    TEST_ASSERT_EQUAL(2, arq.write((const uint8_t *) "ab", 2));
+    arq.poll();
+    TEST_ASSERT_EQUAL(sizeof(data0), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data0, link.sent, sizeof(data0));
+    TEST_ASSERT_EQUAL(1, arq.pending());
+
+    // The host's ACK releases it
+    link.clearSent();
+    link.inject(ack1, sizeof(ack1));
+    TEST_ASSERT_FALSE(arq.poll());
+    TEST_ASSERT_EQUAL(0, arq.pending());
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+}
+
+void test_receive_from_host(void)
+{
+    link.clearSent();
+    link.inject(hostData0, sizeof(hostData0));
+    TEST_ASSERT_TRUE(arq.poll());
+    TEST_ASSERT_EQUAL(2, arq.length());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("hi", arq.data(), 2);
+    TEST_ASSERT_EQUAL(sizeof(ack1), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(ack1, link.sent, sizeof(ack1));
+
+    // A resent copy is acknowledged again but not delivered twice
+    link.clearSent();
+    link.inject(hostData0, sizeof(hostData0));
+    TEST_ASSERT_FALSE(arq.poll());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(ack1, link.sent, sizeof(ack1));
+}
+
+void test_retransmit(void)
+{
+    uint16_t retransmits = arq.retransmits();
+
+    link.clearSent();
+    arq.write((const uint8_t *) "c", 1);
+    arq.poll();
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data1, link.sent, sizeof(data1));
+
+    // No ACK: the same bytes go out again after the timeout
+    link.clearSent();
+    delay(150);
+    arq.poll();
+    TEST_ASSERT_EQUAL(retransmits + 1, arq.retransmits());
+    TEST_ASSERT_EQUAL(sizeof(data1), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data1, link.sent, sizeof(data1));
+
+    link.inject(ack2, sizeof(ack2));
+    arq.poll();
+    TEST_ASSERT_EQUAL(0, arq.pending());
+}
+
+void test_window_full(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < WINDOW; i++)
+    {
+        TEST_ASSERT_EQUAL(1, arq.write(&i, 1));
+    }
+    TEST_ASSERT_FALSE(arq.canWrite());
+    TEST_ASSERT_EQUAL(0, arq.write(&i, 1));
+    TEST_ASSERT_EQUAL(0, arq.write(txStorage, MAX_PAYLOAD + 1));
+
+    // One cumulative ACK for sequence numbers 2-5 frees the whole window
+    arq.poll();
+    link.inject(ack6, sizeof(ack6));
+    arq.poll();
+    TEST_ASSERT_EQUAL(0, arq.pending());
+    TEST_ASSERT_TRUE(arq.canWrite());
+}
+
+// The host restarts with "c" (seq 6) unacknowledged: the device takes the
+// host's stream from 0 again and resends "c" as seq 0
+void test_host_restarts(void)
+{
+    link.clearSent();
+    arq.write((const uint8_t *) "c", 1);
+    arq.poll();
+    link.clearSent();
+
+    link.inject(sync0, sizeof(sync0));
+    TEST_ASSERT_FALSE(arq.poll());
+    TEST_ASSERT_EQUAL(sizeof(syncAck0) + sizeof(data0c), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(syncAck0, link.sent, sizeof(syncAck0));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data0c, &link.sent[sizeof(syncAck0)], sizeof(data0c));
+
+    link.clearSent();
+    link.inject(hostData0, sizeof(hostData0));
+    TEST_ASSERT_TRUE(arq.poll());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("hi", arq.data(), 2);
+    link.inject(ack1, sizeof(ack1));
+    arq.poll();
+    TEST_ASSERT_EQUAL(0, arq.pending());
+}
+
+// The device restarts while the host is at seq 5: data waits for the
+// host's SYNC_ACK, and host frames numbered from before it are dropped
+void test_device_restarts(void)
+{
+    link.clearSent();
+    arq.resync();
+    TEST_ASSERT_TRUE(arq.syncing());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(sync0, link.sent, sizeof(sync0));
+
+    link.clearSent();
+    arq.write((const uint8_t *) "z", 1);
+    link.inject(hostData5, sizeof(hostData5));
+    TEST_ASSERT_FALSE(arq.poll());
+    TEST_ASSERT_EQUAL(0, link.sentLength);
+
+    // Unanswered: the SYNC goes again
+    delay(150);
+    arq.poll();
+    TEST_ASSERT_EQUAL(sizeof(sync0), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(sync0, link.sent, sizeof(sync0));
+
+    link.clearSent();
+    link.inject(syncAck5, sizeof(syncAck5));
+    TEST_ASSERT_FALSE(arq.poll());
+    TEST_ASSERT_FALSE(arq.syncing());
+    TEST_ASSERT_EQUAL(sizeof(data0z), link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data0z, link.sent, sizeof(data0z));
+
+    link.clearSent();
+    link.inject(hostData5, sizeof(hostData5));
+    TEST_ASSERT_TRUE(arq.poll());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("hi", arq.data(), 2);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(ack6, link.sent, sizeof(ack6));
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_set_timeout);
+    RUN_TEST(test_send_matches_host);
+    RUN_TEST(test_receive_from_host);
+    RUN_TEST(test_retransmit);
+    RUN_TEST(test_window_full);
+    RUN_TEST(test_host_restarts);
+    RUN_TEST(test_device_restarts);
+    UNITY_END();
+}
+
+void loop()
+{
+}
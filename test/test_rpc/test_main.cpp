@@ -0,0 +1,121 @@
+/*
+  HM1X_Rpc against the host client (extras/hm1x_host/rpc.py).
+
+  The requests below are what RpcClient sends for four calls, the
+  responses what the device must answer; extras/hm1x_host/tests/test_rpc.py
+  checks the same bytes from the host side.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_Rpc.h>
+#include "../hm1x_test_link.h"
+
+#define METHOD_ADD 1
+#define METHOD_SLOW 2
+
+uint8_t framerStorage[32];
+HM1X_Framer framer(bt, framerStorage, sizeof(framerStorage));
+HM1X_Rpc rpc(framer);
+
+// id 0: add(2, 3); id 1: slow(); id 2: method 9; id 3: add(7)
+const uint8_t requestAdd[] = {0xA5, 0xF3, 0x04, 0xFB, 0x00, 0x01, 0x02, 0x03, 0xED, 0xB2};
+const uint8_t requestSlow[] = {0xA5, 0xF3, 0x02, 0xFD, 0x01, 0x02, 0x90, 0x9F};
+const uint8_t requestUnknown[] = {0xA5, 0xF3, 0x02, 0xFD, 0x02, 0x09, 0xA8, 0x7B};
+const uint8_t requestBadArgs[] = {0xA5, 0xF3, 0x03, 0xFC, 0x03, 0x01, 0x07, 0x67, 0x75};
+// id 0: OK 5; id 2: no method; id 3: bad args; id 1 (later): OK 42
+const uint8_t responseAdd[] = {0xA5, 0xF4, 0x03, 0xFC, 0x00, 0x00, 0x05, 0x05, 0xF7};
+const uint8_t responseUnknown[] = {0xA5, 0xF4, 0x02, 0xFD, 0x02, 0x01, 0x74, 0x9D};
+const uint8_t responseBadArgs[] = {0xA5, 0xF4, 0x02, 0xFD, 0x03, 0x02, 0x26, 0x9E};
+const uint8_t responseSlow[] = {0xA5, 0xF4, 0x03, 0xFC, 0x01, 0x00, 0x2A, 0xB8, 0x15};
+
+int16_t slowId = -1;
+
+void add(HM1X_Rpc & rpc, uint8_t id, const uint8_t * args, uint8_t length)
+{
+    uint8_t sum;
+
+    if (length != 2)
+    {
+        rpc.respond(id, HM1X_RPC_BAD_ARGS);
+        return;
+    }
+    sum = args[0] + args[1];
+    rpc.respond(id, HM1X_RPC_OK, &sum, 1);
+}
+
+// Answered later, from the test
+void slow(HM1X_Rpc &, uint8_t id, const uint8_t *, uint8_t)
+{
+    slowId = id;
+}
+
+void expectSent(const uint8_t * expected, uint16_t length)
+{
+    TEST_ASSERT_EQUAL(length, link.sentLength);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, link.sent, length);
+    link.clearSent();
+}
+
+void test_register_methods(void)
+{
+    TEST_ASSERT_TRUE(rpc.on(METHOD_ADD, add));
+    TEST_ASSERT_TRUE(rpc.on(METHOD_SLOW, slow));
+}
+
+void test_answers_match_host(void)
+{
+    link.clearSent();
+    link.inject(requestAdd, sizeof(requestAdd));
+    rpc.poll();
+    expectSent(responseAdd, sizeof(responseAdd));
+
+    link.inject(requestUnknown, sizeof(requestUnknown));
+    rpc.poll();
+    expectSent(responseUnknown, sizeof(responseUnknown));
+
+    link.inject(requestBadArgs, sizeof(requestBadArgs));
+    rpc.poll();
+    expectSent(responseBadArgs, sizeof(responseBadArgs));
+}
+
+void test_deferred_answer(void)
+{
+    // Requests pipelined behind the slow one are answered first
+    link.clearSent();
+    link.inject(requestSlow, sizeof(requestSlow));
+    link.inject(requestAdd, sizeof(requestAdd));
+    rpc.poll();
+    rpc.poll();
+    TEST_ASSERT_EQUAL(1, slowId);
+    expectSent(responseAdd, sizeof(responseAdd));
+
+    const uint8_t answer = 42;
+    rpc.respond(slowId, HM1X_RPC_OK, &answer, 1);
+    expectSent(responseSlow, sizeof(responseSlow));
+}
+
+void test_handler_removed(void)
+{
+    link.clearSent();
+    TEST_ASSERT_TRUE(rpc.on(METHOD_ADD, NULL));
+    link.inject(requestAdd, sizeof(requestAdd));
+    rpc.poll();
+    TEST_ASSERT_EQUAL(sizeof(responseUnknown), link.sentLength);
+    TEST_ASSERT_EQUAL(HM1X_RPC_NO_METHOD, link.sent[5]);
+    TEST_ASSERT_TRUE(rpc.on(METHOD_ADD, add));
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_register_methods);
+    RUN_TEST(test_answers_match_host);
+    RUN_TEST(test_deferred_answer);
+    RUN_TEST(test_handler_removed);
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,146 @@
+/*
+  HM1X_ScanCache: one entry per peer seen by discovery, with a sighting
+  count and smoothed RSSI, in a fixed-size hash table.
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <HM1X_ScanCache.h>
+#include "../hm1x_test_link.h"
+
+#define CACHE_SIZE 16
+
+HM1X_scan_entry_t entries[CACHE_SIZE];
+HM1X_ScanCache cache(entries, CACHE_SIZE);
+
+HM1X_address_t peer(uint8_t n)
+{
+    HM1X_address_t address;
+    char text[13];
+
+    snprintf(text, sizeof(text), "0011223344%02X", n);
+    address.parse(text);
+    return address;
+}
+
+void inject(const char * text)
+{
+    link.inject((const uint8_t *) text, strlen(text));
+}
+
+void test_sighting(void)
+{
+    HM1X_scan_entry_t * e;
+
+    cache.clear();
+    e = cache.sighting(peer(1), -50);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_TRUE(e == cache.find(peer(1)));
+    TEST_ASSERT_EQUAL(1, e->sightings);
+    TEST_ASSERT_EQUAL(-50, e->rssi());
+    TEST_ASSERT_NULL(cache.find(peer(2)));
+
+    TEST_ASSERT_TRUE(e == cache.sighting(peer(1)));
+    TEST_ASSERT_EQUAL(2, e->sightings);
+    TEST_ASSERT_EQUAL(-50, e->rssi()); // No sample, no change
+    TEST_ASSERT_EQUAL(1, cache.count());
+}
+
+// Each sample moves the average a quarter of the way
+void test_rssi_average(void)
+{
+    HM1X_scan_entry_t * e;
+
+    cache.clear();
+    e = cache.sighting(peer(1), -50);
+    cache.addRssi(e, -90);
+    TEST_ASSERT_EQUAL(-60, e->rssi());
+    for (uint8_t i = 0; i < 30; i++)
+    {
+        cache.addRssi(e, -90);
+    }
+    TEST_ASSERT_LESS_THAN(-88, e->rssi());
+    cache.addRssi(NULL, -90); // A full table has no entry to update
+}
+
+// A full table evicts the stalest peer in the probe range
+void test_eviction(void)
+{
+    uint16_t evictions = cache.evictions();
+
+    cache.clear();
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        cache.sighting(peer(i), -50);
+        delay(10);
+    }
+    TEST_ASSERT_EQUAL(CACHE_SIZE, cache.count());
+    TEST_ASSERT_EQUAL(evictions + 40 - CACHE_SIZE, cache.evictions());
+    for (uint8_t i = 32; i < 40; i++)
+    {
+        TEST_ASSERT_NOT_NULL(cache.find(peer(i)));
+    }
+}
+
+void test_expire(void)
+{
+    uint8_t found = 0;
+
+    cache.clear();
+    cache.sighting(peer(1));
+    cache.sighting(peer(2));
+    delay(1000);
+    cache.sighting(peer(3));
+
+    TEST_ASSERT_EQUAL(2, cache.expire(500));
+    TEST_ASSERT_EQUAL(1, cache.count());
+    TEST_ASSERT_NULL(cache.find(peer(1)));
+    TEST_ASSERT_NOT_NULL(cache.find(peer(3)));
+
+    for (uint8_t slot = 0; slot < cache.capacity(); slot++)
+    {
+        if (cache.entry(slot) != NULL) found++;
+    }
+    TEST_ASSERT_EQUAL(1, found);
+    TEST_ASSERT_NULL(cache.entry(CACHE_SIZE));
+}
+
+// Every scan records its sightings, even with no result table
+void test_fed_by_discovery(void)
+{
+    HM1X_scan_entry_t * e;
+    HM1X_address_t address;
+
+    cache.clear();
+    bt.setScanCache(&cache);
+    TEST_ASSERT_EQUAL(HM1X_SUCCESS, bt.startDiscovery(NULL, 0));
+    inject("OK+DISCSOK+DIS0:001122334455OK+RSSI:-060\r\n"
+           "OK+DIS1:001122334455OK+RSSI:-080\r\n"
+           "OK+DIS2:00112233445AOK+DISCE");
+    bt.poll();
+    TEST_ASSERT_FALSE(bt.discovering());
+    TEST_ASSERT_EQUAL(2, cache.count());
+
+    address.parse("001122334455");
+    e = cache.find(address);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_EQUAL(2, e->sightings);
+    TEST_ASSERT_EQUAL(-65, e->rssi());
+    bt.setScanCache(NULL);
+    link.clearSent();
+}
+
+void setup()
+{
+    beginTests();
+    RUN_TEST(test_sighting);
+    RUN_TEST(test_rssi_average);
+    RUN_TEST(test_eviction);
+    RUN_TEST(test_expire);
+    RUN_TEST(test_fed_by_discovery);
+    UNITY_END();
+}
+
+void loop()
+{
+}